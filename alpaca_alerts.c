@@ -0,0 +1,277 @@
+#include "alpaca_alerts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define MIN_ALERT_SYMBOLS 64
+#define MIN_ALERT_RULES 4
+
+void alert_engine_init(AlertEngine *engine) {
+    memset(engine, 0, sizeof(*engine));
+    symbol_table_init(&engine->symbols);
+    engine->fd = STDOUT_FILENO;
+}
+
+void alert_engine_free(AlertEngine *engine) {
+    for (size_t s = 0; s < engine->symbols.count; s++) {
+        free(engine->by_symbol[s].above);
+        free(engine->by_symbol[s].below);
+    }
+    free(engine->by_symbol);
+    symbol_table_free(&engine->symbols);
+    if (engine->fd > STDERR_FILENO) {
+        close(engine->fd);
+    }
+    memset(engine, 0, sizeof(*engine));
+    engine->fd = -1;
+}
+
+int64_t alert_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function to connect to a listening Unix socket, stream or datagram
+static int connect_unix(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path %s is too long.\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int types[2] = { SOCK_STREAM, SOCK_DGRAM };
+    for (int i = 0; i < 2; i++) {
+        int fd = socket(AF_UNIX, types[i] | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            break;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            return fd;
+        }
+        int err = errno;
+        close(fd);
+        if (err != EPROTOTYPE) {
+            errno = err;
+            break;
+        }
+    }
+    perror(path);
+    return -1;
+}
+
+// Function to send alerts to a file, a FIFO or a listening Unix socket instead of
+// stdout. Writes never block: a FIFO must already have a reader, and an alert the
+// output cannot take at once is counted in write_failures and dropped.
+int alert_engine_open_output(AlertEngine *engine, const char *path) {
+    struct stat st;
+    int fd;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        fd = connect_unix(path);
+    } else {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+        if (fd < 0 && errno == ENXIO) {
+            fprintf(stderr, "Error: nothing is reading the FIFO %s.\n", path);
+        } else if (fd < 0) {
+            perror(path);
+        }
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    if (engine->fd > STDERR_FILENO) {
+        close(engine->fd);
+    }
+    engine->fd = fd;
+    return 0;
+}
+
+static AlertSymbol *alert_symbol(AlertEngine *engine, const char *symbol) {
+    int index = symbol_table_add(&engine->symbols, symbol);
+    if (index < 0) {
+        return NULL;
+    }
+    if (engine->symbols.count > engine->symbol_capacity) {
+        size_t capacity = engine->symbol_capacity ? engine->symbol_capacity * 2 : MIN_ALERT_SYMBOLS;
+        AlertSymbol *by_symbol = (AlertSymbol *)realloc(engine->by_symbol, capacity * sizeof(AlertSymbol));
+        if (!by_symbol) {
+            return NULL;
+        }
+        memset(by_symbol + engine->symbol_capacity, 0, (capacity - engine->symbol_capacity) * sizeof(AlertSymbol));
+        engine->by_symbol = by_symbol;
+        engine->symbol_capacity = capacity;
+    }
+    return &engine->by_symbol[index];
+}
+
+// Whether a level is crossed by price, or lies beyond another level, for a side
+static int reaches(double level, double price, int below) {
+    return below ? level >= price : level <= price;
+}
+
+// First rule in rules[begin..n-1] whose level price does not reach. The pending
+// rules are sorted nearest first, so the crossed ones are exactly rules[begin..end-1].
+static size_t crossed_end(const AlertRule *rules, size_t begin, size_t n, double price, int below) {
+    size_t lo = begin;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (reaches(rules[mid].level, price, below)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Function to add a rule. It goes among the rules that have not fired, after any at
+// the same level, so the order of a file is kept for equal levels.
+int alert_engine_add(AlertEngine *engine, const char *symbol, AlertDirection direction, double level, const char *name) {
+    if (name) {
+        for (const char *c = name; *c; c++) {
+            if (*c == '"' || *c == '\\' || iscntrl((unsigned char)*c)) {
+                fprintf(stderr, "Error: alert name %s may not contain quotes, backslashes or control characters.\n", name);
+                return -1;
+            }
+        }
+        if (strlen(name) >= ALERT_NAME_MAX) {
+            fprintf(stderr, "Error: alert name %s is longer than %d characters.\n", name, ALERT_NAME_MAX - 1);
+            return -1;
+        }
+    }
+    AlertSymbol *as = alert_symbol(engine, symbol);
+    if (!as) {
+        fprintf(stderr, "Error: cannot add an alert for %s.\n", symbol);
+        return -1;
+    }
+    int below = direction == ALERT_BELOW;
+    AlertRule **rules = below ? &as->below : &as->above;
+    size_t *count = below ? &as->num_below : &as->num_above;
+    size_t *capacity = below ? &as->below_capacity : &as->above_capacity;
+    size_t fired = below ? as->below_fired : as->above_fired;
+
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : MIN_ALERT_RULES;
+        AlertRule *grown = (AlertRule *)realloc(*rules, new_capacity * sizeof(AlertRule));
+        if (!grown) {
+            fprintf(stderr, "Error: not enough memory for the alerts of %s.\n", symbol);
+            return -1;
+        }
+        *rules = grown;
+        *capacity = new_capacity;
+    }
+    size_t pos = crossed_end(*rules, fired, *count, level, below);
+    memmove(*rules + pos + 1, *rules + pos, (*count - pos) * sizeof(AlertRule));
+    (*rules)[pos].level = level;
+    snprintf((*rules)[pos].name, ALERT_NAME_MAX, "%s", name ? name : "");
+    (*count)++;
+    engine->rules++;
+    return 0;
+}
+
+// Function to read alert rules, one per line: SYMBOL above|below LEVEL [NAME].
+// '#' starts a comment. Returns the number of rules added, or -1 if the file cannot
+// be opened.
+int alert_engine_load(AlertEngine *engine, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    int line_number = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_number++;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        char *saveptr = NULL;
+        char *symbol = strtok_r(line, " \t\r\n", &saveptr);
+        if (!symbol) {
+            continue;
+        }
+        char *side = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *level = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *name = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *end = NULL;
+        double value = level ? strtod(level, &end) : 0;
+        if (!side || (strcmp(side, "above") != 0 && strcmp(side, "below") != 0) || !level || *end || value <= 0) {
+            fprintf(stderr, "%s:%d: expected SYMBOL above|below LEVEL [NAME]\n", path, line_number);
+            continue;
+        }
+        for (char *c = symbol; *c; c++) {
+            *c = (char)toupper((unsigned char)*c);
+        }
+        if (alert_engine_add(engine, symbol, strcmp(side, "below") == 0 ? ALERT_BELOW : ALERT_ABOVE, value, name) == 0) {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+// Function to write one alert as a line of JSON with a single write, so each alert
+// reaches a pipe in one piece and a datagram socket as one datagram
+static void emit_alert(AlertEngine *engine, const char *symbol, const AlertRule *rule, int below, double price, const char *timestamp, int64_t received_ns) {
+    char line[ALERT_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "{\"T\":\"alert\",\"S\":\"%s\",\"dir\":\"%s\",\"level\":%.6g,\"price\":%.6g",
+                       symbol, below ? "below" : "above", rule->level, price);
+    if (rule->name[0]) {
+        len += snprintf(line + len, sizeof(line) - len, ",\"name\":\"%s\"", rule->name);
+    }
+    if (timestamp) {
+        len += snprintf(line + len, sizeof(line) - len, ",\"t\":\"%.40s\"", timestamp);
+    }
+    if (received_ns > 0) {
+        len += snprintf(line + len, sizeof(line) - len, ",\"delay_us\":%.1f", (alert_clock_ns() - received_ns) / 1e3);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "}\n");
+
+    engine->fired++;
+    if (write(engine->fd, line, (size_t)len) != len) {
+        engine->write_failures++;
+    }
+}
+
+static size_t check_side(AlertEngine *engine, const char *symbol, const AlertRule *rules, size_t n, size_t *fired, int below, double price, const char *timestamp, int64_t received_ns) {
+    // The common case, nothing crossed, is one comparison
+    if (*fired == n || !reaches(rules[*fired].level, price, below)) {
+        return 0;
+    }
+    size_t end = crossed_end(rules, *fired + 1, n, price, below);
+    for (size_t i = *fired; i < end; i++) {
+        emit_alert(engine, symbol, &rules[i], below, price, timestamp, received_ns);
+    }
+    size_t hits = end - *fired;
+    *fired = end;
+    return hits;
+}
+
+// Function to fire every rule of a symbol that price reaches and has not fired yet.
+// Costs one lookup plus O(log N + hits). received_ns is alert_clock_ns() when the
+// message arrived, or 0; the delay since then is reported with each alert.
+size_t alert_engine_check(AlertEngine *engine, const char *symbol, double price, const char *timestamp, int64_t received_ns) {
+    int index = symbol_table_find(&engine->symbols, symbol);
+    if (index < 0 || price <= 0) {
+        return 0;
+    }
+    AlertSymbol *as = &engine->by_symbol[index];
+    size_t hits = check_side(engine, symbol, as->above, as->num_above, &as->above_fired, 0, price, timestamp, received_ns);
+    hits += check_side(engine, symbol, as->below, as->num_below, &as->below_fired, 1, price, timestamp, received_ns);
+    return hits;
+}
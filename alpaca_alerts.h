@@ -0,0 +1,53 @@
+#ifndef ALPACA_ALERTS_H
+#define ALPACA_ALERTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_symbol_table.h"
+
+#define ALERT_NAME_MAX 64
+#define ALERT_LINE_MAX 384     // longest alert written, including the newline
+
+typedef enum {
+    ALERT_ABOVE,        // fires when the price reaches the level or goes past it
+    ALERT_BELOW         // fires when the price falls to the level or under it
+} AlertDirection;
+
+typedef struct {
+    double level;
+    char name[ALERT_NAME_MAX];
+} AlertRule;
+
+// The alerts of one symbol. Levels not yet crossed are kept sorted from the nearest
+// to the farthest, so the ones a price crosses are always a prefix of them: above
+// ascending, below descending. Rules fire once; fired ones stay in front of that.
+typedef struct {
+    AlertRule *above;
+    size_t num_above;
+    size_t above_fired;
+    size_t above_capacity;
+    AlertRule *below;
+    size_t num_below;
+    size_t below_fired;
+    size_t below_capacity;
+} AlertSymbol;
+
+typedef struct {
+    SymbolTable symbols;
+    AlertSymbol *by_symbol;     // indexed like symbols
+    size_t symbol_capacity;
+    int fd;                     // where alerts are written, 1 (stdout) by default
+    size_t rules;
+    size_t fired;
+    size_t write_failures;      // alerts the output could not take at once
+} AlertEngine;
+
+void alert_engine_init(AlertEngine *engine);
+void alert_engine_free(AlertEngine *engine);
+int alert_engine_open_output(AlertEngine *engine, const char *path);
+int alert_engine_add(AlertEngine *engine, const char *symbol, AlertDirection direction, double level, const char *name);
+int alert_engine_load(AlertEngine *engine, const char *path);
+size_t alert_engine_check(AlertEngine *engine, const char *symbol, double price, const char *timestamp, int64_t received_ns);
+int64_t alert_clock_ns(void);
+
+#endif // ALPACA_ALERTS_H
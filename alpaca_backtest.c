@@ -0,0 +1,363 @@
+#include "alpaca_backtest.h"
+#include "alpaca_bar_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define BACKTEST_PATH_SIZE 1024
+#define BACKTEST_READ_CHUNK 4096    // bars per fread from a binary file
+#define SECONDS_PER_DAY 86400
+
+int bar_series_reserve(BarSeries *series, size_t count) {
+    if (count <= series->capacity) {
+        return 0;
+    }
+    size_t capacity = series->capacity ? series->capacity : 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int64_t *t = (int64_t *)realloc(series->t, capacity * sizeof(int64_t));
+    if (t) {
+        series->t = t;
+    }
+    double **columns[] = { &series->open, &series->high, &series->low, &series->close, &series->vw, &series->volume };
+    int ok = t != NULL;
+    for (size_t c = 0; ok && c < sizeof(columns) / sizeof(columns[0]); c++) {
+        double *ptr = (double *)realloc(*columns[c], capacity * sizeof(double));
+        if (ptr) {
+            *columns[c] = ptr;
+        }
+        ok = ptr != NULL;
+    }
+    if (!ok) {
+        // The columns that did grow keep working at the old capacity
+        fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+        return -1;
+    }
+    series->capacity = capacity;
+    return 0;
+}
+
+int bar_series_push(BarSeries *series, const AlpacaBar *bar) {
+    if (series->count == series->capacity && bar_series_reserve(series, series->count + 1) != 0) {
+        return -1;
+    }
+    size_t i = series->count++;
+    series->t[i] = bar->t;
+    series->open[i] = bar->open;
+    series->high[i] = bar->high;
+    series->low[i] = bar->low;
+    series->close[i] = bar->close;
+    series->vw[i] = bar->vw;
+    series->volume[i] = (double)bar->volume;
+    return 0;
+}
+
+// Function to append packed AlpacaBar records, the fetcher's -format binary output,
+// until the end of the file
+int bar_series_read_binary(BarSeries *series, FILE *fp) {
+    AlpacaBar chunk[BACKTEST_READ_CHUNK];
+    size_t n;
+    while ((n = fread(chunk, sizeof(AlpacaBar), BACKTEST_READ_CHUNK, fp)) > 0) {
+        if (bar_series_reserve(series, series->count + n) != 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            bar_series_push(series, &chunk[i]);
+        }
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+void bar_series_free(BarSeries *series) {
+    free(series->t);
+    free(series->open);
+    free(series->high);
+    free(series->low);
+    free(series->close);
+    free(series->vw);
+    free(series->volume);
+    memset(series, 0, sizeof(*series));
+}
+
+int backtest_load_binary(void *user, const char *symbol, BarSeries *series) {
+    char path[BACKTEST_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s.bin", (const char *)user, symbol);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    int result = bar_series_read_binary(series, fp);
+    if (result != 0) {
+        fprintf(stderr, "Error reading %s\n", path);
+    }
+    fclose(fp);
+    return result;
+}
+
+// Function to copy the cached days of the range column by column. Days missing
+// from the cache are skipped.
+int backtest_load_cache(void *user, const char *symbol, BarSeries *series) {
+    const BacktestCacheSource *source = (const BacktestCacheSource *)user;
+    int64_t first_day = source->from - source->from % SECONDS_PER_DAY;
+    for (int64_t day_start = first_day; day_start <= source->to; day_start += SECONDS_PER_DAY) {
+        BarCacheDay day;
+        if (bar_cache_open_day(source->dir, source->feed, symbol, source->timeframe, day_start, &day) != 0) {
+            continue;
+        }
+        size_t lo = 0;
+        size_t hi = (size_t)day.count;
+        while (lo < hi && day.t[lo] < source->from) {
+            lo++;
+        }
+        while (hi > lo && day.t[hi - 1] > source->to) {
+            hi--;
+        }
+        size_t n = hi - lo;
+        if (bar_series_reserve(series, series->count + n) != 0) {
+            bar_cache_close_day(&day);
+            return -1;
+        }
+        size_t at = series->count;
+        memcpy(series->t + at, day.t + lo, n * sizeof(int64_t));
+        memcpy(series->open + at, day.open + lo, n * sizeof(double));
+        memcpy(series->high + at, day.high + lo, n * sizeof(double));
+        memcpy(series->low + at, day.low + lo, n * sizeof(double));
+        memcpy(series->close + at, day.close + lo, n * sizeof(double));
+        memcpy(series->vw + at, day.vw + lo, n * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            series->volume[at + i] = (double)day.volume[lo + i];
+        }
+        series->count += n;
+        bar_cache_close_day(&day);
+    }
+    return 0;
+}
+
+int backtest_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+static int record_fill(BacktestResult *result, size_t index, int64_t t, double price, double quantity) {
+    if (index == result->fills_capacity) {
+        size_t capacity = result->fills_capacity ? result->fills_capacity * 2 : 16;
+        BacktestFill *ptr = (BacktestFill *)realloc(result->fills, capacity * sizeof(BacktestFill));
+        if (!ptr) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        result->fills = ptr;
+        result->fills_capacity = capacity;
+    }
+    BacktestFill *fill = &result->fills[index];
+    fill->t = t;
+    fill->price = price;
+    fill->quantity = quantity;
+    return 0;
+}
+
+// Function to run the strategy over one symbol's bars. Orders fill at the next
+// bar's open; an order from the last bar is dropped. state must hold
+// strategy.state_size zeroed bytes.
+int backtest_run_series(const BacktestOptions *options, const BarSeries *bars, void *state, BacktestResult *result) {
+    BacktestOnBar on_bar = options->strategy.on_bar;
+    void *user = options->strategy.user;
+    double fee = options->fee_per_share;
+    double position = 0;
+    double cash = 0;
+    double target = 0;
+    double peak = 0;
+    double drawdown = 0;
+    double traded = 0;
+    size_t num_fills = 0;
+
+    result->bars = bars->count;
+    for (size_t i = 0; i < bars->count; i++) {
+        if (target != position) {
+            double quantity = target - position;
+            double size = quantity < 0 ? -quantity : quantity;
+            double price = bars->open[i];
+            cash -= quantity * price + size * fee;
+            traded += size;
+            position = target;
+            if (options->record_fills && record_fill(result, num_fills, bars->t[i], price, quantity) != 0) {
+                return -1;
+            }
+            num_fills++;
+        }
+        double equity = cash + position * bars->close[i];
+        if (equity > peak) {
+            peak = equity;
+        } else if (peak - equity > drawdown) {
+            drawdown = peak - equity;
+        }
+        target = on_bar(state, bars, i, position, user);
+    }
+
+    result->num_fills = num_fills;
+    result->traded = traded;
+    result->position = position;
+    result->cash = cash;
+    result->pnl = bars->count ? cash + position * bars->close[bars->count - 1] : 0;
+    result->max_drawdown = drawdown;
+    return 0;
+}
+
+// Each worker owns a run of symbols and takes them from the front. A worker that
+// runs out steals the back half of another worker's run, so a few long histories
+// cannot leave the other threads idle at the end.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} BacktestQueue;
+
+typedef struct {
+    const BacktestOptions *options;
+    const char *const *symbols;
+    BacktestResult *results;
+    BacktestQueue *queues;
+    int num_workers;
+    int failed;
+} BacktestRun;
+
+typedef struct {
+    BacktestRun *run;
+    int id;
+} BacktestWorker;
+
+static int queue_pop(BacktestQueue *queue, size_t *index) {
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *index = queue->head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Function to move the back half of some other worker's run into this worker's queue
+static int queue_steal(BacktestRun *run, int id) {
+    for (int k = 1; k < run->num_workers; k++) {
+        BacktestQueue *victim = &run->queues[(id + k) % run->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->tail - victim->head;
+        size_t start = victim->tail - left / 2;
+        if (left == 1) {
+            start = victim->head;
+        }
+        size_t end = victim->tail;
+        victim->tail = start;
+        pthread_mutex_unlock(&victim->lock);
+        if (start < end) {
+            BacktestQueue *own = &run->queues[id];
+            pthread_mutex_lock(&own->lock);
+            own->head = start;
+            own->tail = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *backtest_worker(void *arg) {
+    BacktestWorker *worker = (BacktestWorker *)arg;
+    BacktestRun *run = worker->run;
+    const BacktestOptions *options = run->options;
+    size_t state_size = options->strategy.state_size;
+    BarSeries series;
+    memset(&series, 0, sizeof(series));
+    void *state = calloc(1, state_size ? state_size : 1);
+    if (!state) {
+        fprintf(stderr, "not enough memory (calloc returned NULL)\n");
+        run->failed = 1;
+        return NULL;
+    }
+
+    size_t index;
+    while (queue_pop(&run->queues[worker->id], &index) || (queue_steal(run, worker->id) && queue_pop(&run->queues[worker->id], &index))) {
+        BacktestResult *result = &run->results[index];
+        series.count = 0;
+        memset(state, 0, state_size);
+        if (options->load(options->load_user, run->symbols[index], &series) != 0 ||
+            backtest_run_series(options, &series, state, result) != 0) {
+            result->failed = 1;
+        }
+    }
+
+    bar_series_free(&series);
+    free(state);
+    return NULL;
+}
+
+// Function to load and run every symbol on a pool of threads. results must have
+// count zeroed entries; they are filled in symbol order. Returns 0, or -1 if the
+// pool could not be started; symbols that failed to load have failed set.
+int backtest_run(const BacktestOptions *options, const char *const *symbols, size_t count, BacktestResult *results) {
+    int num_workers = options->threads > 0 ? options->threads : backtest_default_threads();
+    if ((size_t)num_workers > count) {
+        num_workers = count > 0 ? (int)count : 1;
+    }
+
+    BacktestRun run;
+    memset(&run, 0, sizeof(run));
+    run.options = options;
+    run.symbols = symbols;
+    run.results = results;
+    run.num_workers = num_workers;
+    run.queues = (BacktestQueue *)calloc(num_workers, sizeof(BacktestQueue));
+    BacktestWorker *workers = (BacktestWorker *)calloc(num_workers, sizeof(BacktestWorker));
+    pthread_t *threads = (pthread_t *)calloc(num_workers, sizeof(pthread_t));
+    if (!run.queues || !workers || !threads) {
+        fprintf(stderr, "not enough memory (calloc returned NULL)\n");
+        free(run.queues);
+        free(workers);
+        free(threads);
+        return -1;
+    }
+
+    // Contiguous runs of symbols to start with; stealing evens out the rest
+    for (int w = 0; w < num_workers; w++) {
+        pthread_mutex_init(&run.queues[w].lock, NULL);
+        run.queues[w].head = count * w / num_workers;
+        run.queues[w].tail = count * (w + 1) / num_workers;
+        workers[w].run = &run;
+        workers[w].id = w;
+    }
+
+    int started = 0;
+    for (int w = 1; w < num_workers; w++) {
+        if (pthread_create(&threads[w], NULL, backtest_worker, &workers[w]) != 0) {
+            // The threads that did start steal the runs of the ones that did not
+            fprintf(stderr, "Error starting backtest thread %d\n", w);
+            break;
+        }
+        started = w;
+    }
+    backtest_worker(&workers[0]);
+    for (int w = 1; w <= started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+
+    for (int w = 0; w < num_workers; w++) {
+        pthread_mutex_destroy(&run.queues[w].lock);
+    }
+    free(run.queues);
+    free(workers);
+    free(threads);
+    return run.failed ? -1 : 0;
+}
+
+void backtest_results_free(BacktestResult *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(results[i].fills);
+        results[i].fills = NULL;
+        results[i].fills_capacity = 0;
+    }
+}
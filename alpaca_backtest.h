@@ -0,0 +1,92 @@
+#ifndef ALPACA_BACKTEST_H
+#define ALPACA_BACKTEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "alpaca_bars.h"
+
+// One symbol's bars in time order, one array per field, so a strategy can hand a
+// column straight to the indicator functions
+typedef struct {
+    int64_t *t;         // bar start, seconds since 1970 UTC
+    double *open;
+    double *high;
+    double *low;
+    double *close;
+    double *vw;
+    double *volume;
+    size_t count;
+    size_t capacity;
+} BarSeries;
+
+int bar_series_reserve(BarSeries *series, size_t count);
+int bar_series_push(BarSeries *series, const AlpacaBar *bar);
+int bar_series_read_binary(BarSeries *series, FILE *fp);
+void bar_series_free(BarSeries *series);
+
+// Appends the bars of one symbol to series. Returns 0, or -1 if nothing could be
+// read; a symbol without bars is not an error.
+typedef int (*BacktestLoader)(void *user, const char *symbol, BarSeries *series);
+
+// Loader for DIR/SYMBOL.bin as written by alpaca_memory_price_fetcher -format
+// binary -outdir DIR; user is the directory
+int backtest_load_binary(void *user, const char *symbol, BarSeries *series);
+
+// Loader for the bar cache; user is a BacktestCacheSource
+typedef struct {
+    const char *dir;
+    const char *feed;
+    const char *timeframe;
+    int64_t from;       // first and last bar times wanted, seconds since 1970 UTC
+    int64_t to;
+} BacktestCacheSource;
+
+int backtest_load_cache(void *user, const char *symbol, BarSeries *series);
+
+// Called once per bar, in order, after any order from the previous bar has been
+// filled. Returns the position (in shares, negative for short) wanted from the
+// next bar's open on. state is strategy_size zeroed bytes per symbol; user is
+// shared by every thread and must not be written to.
+typedef double (*BacktestOnBar)(void *state, const BarSeries *bars, size_t i, double position, void *user);
+
+typedef struct {
+    BacktestOnBar on_bar;
+    size_t state_size;
+    void *user;
+} BacktestStrategy;
+
+typedef struct {
+    int64_t t;          // time of the bar whose open filled the order
+    double price;
+    double quantity;    // positive for a buy, negative for a sell
+} BacktestFill;
+
+typedef struct {
+    size_t bars;
+    size_t num_fills;
+    double traded;      // shares bought and sold
+    double position;    // at the end
+    double cash;        // proceeds minus costs and fees
+    double pnl;         // cash plus the position at the last close
+    double max_drawdown; // largest fall of the marked-to-close equity from its high
+    BacktestFill *fills; // every fill with record_fills, else NULL
+    size_t fills_capacity;
+    int failed;         // the loader returned an error
+} BacktestResult;
+
+typedef struct {
+    BacktestLoader load;
+    void *load_user;
+    BacktestStrategy strategy;
+    int threads;        // 0 for one per online CPU
+    int record_fills;
+    double fee_per_share;
+} BacktestOptions;
+
+int backtest_default_threads(void);
+int backtest_run_series(const BacktestOptions *options, const BarSeries *bars, void *state, BacktestResult *result);
+int backtest_run(const BacktestOptions *options, const char *const *symbols, size_t count, BacktestResult *results);
+void backtest_results_free(BacktestResult *results, size_t count);
+
+#endif // ALPACA_BACKTEST_H
@@ -0,0 +1,258 @@
+/*
+This C-program backtests a simple trading rule over the bar history of one or many symbols. Bars are read
+from the files written by alpaca_memory_price_fetcher -format binary or from the local bar cache, one symbol
+at a time per thread, and the rule is run bar by bar with orders filled at the next bar's open. The
+profit and loss, fills and drawdown of every symbol are printed, followed by the totals.
+Example usage:
+  ./alpaca_memory_price_fetcher -symbols universe.txt -format binary -outdir bars -start 2024-01-01 -end 2024-12-31
+  ./alpaca_backtester -symbols universe.txt -dir bars -strategy ema-cross -fast 12 -slow 26
+  ./alpaca_backtester -symbols universe.txt -cache ~/.alpaca_cache -start 2024-01-01 -end 2024-12-31 -strategy rsi
+  ./alpaca_memory_price_fetcher -symbol AAPL -format binary | ./alpaca_backtester -symbol AAPL -input - -fills
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "alpaca_backtest.h"
+#include "alpaca_bar_cache.h"
+#include "alpaca_indicators.h"
+#include "alpaca_latest.h"
+
+#define SECONDS_PER_DAY 86400
+
+// Parameters shared by every symbol
+typedef struct {
+    size_t fast;
+    size_t slow;
+    size_t period;
+    double quantity;
+    double oversold;
+    double overbought;
+} StrategyParams;
+
+// Long while the fast EMA is above the slow one, flat otherwise
+typedef struct {
+    int started;
+    EmaStream fast;
+    EmaStream slow;
+} EmaCrossState;
+
+static double ema_cross_on_bar(void *state, const BarSeries *bars, size_t i, double position, void *user) {
+    EmaCrossState *s = (EmaCrossState *)state;
+    const StrategyParams *params = (const StrategyParams *)user;
+    if (!s->started) {
+        ema_stream_init(&s->fast, params->fast);
+        ema_stream_init(&s->slow, params->slow);
+        s->started = 1;
+    }
+    double fast = ema_stream_update(&s->fast, bars->close[i]);
+    double slow = ema_stream_update(&s->slow, bars->close[i]);
+    if (isnan(fast) || isnan(slow)) {
+        return 0;
+    }
+    return fast > slow ? params->quantity : 0;
+}
+
+// Buys when the RSI falls under oversold and sells when it rises over overbought
+typedef struct {
+    int started;
+    RsiStream rsi;
+} RsiState;
+
+static double rsi_on_bar(void *state, const BarSeries *bars, size_t i, double position, void *user) {
+    RsiState *s = (RsiState *)state;
+    const StrategyParams *params = (const StrategyParams *)user;
+    if (!s->started) {
+        rsi_stream_init(&s->rsi, params->period);
+        s->started = 1;
+    }
+    double rsi = rsi_stream_update(&s->rsi, bars->close[i]);
+    if (rsi < params->oversold) {
+        return params->quantity;
+    }
+    if (rsi > params->overbought) {
+        return 0;
+    }
+    return position;
+}
+
+// Loader for -input: the whole file is the one symbol's bars
+static int load_input(void *user, const char *symbol, BarSeries *series) {
+    const char *path = (const char *)user;
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    int result = bar_series_read_binary(series, fp);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return result;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    SymbolList symbols = { NULL, 0, 0 };
+    const char *dir = NULL;
+    const char *input = NULL;
+    const char *cache_dir = NULL;
+    const char *start_date = NULL;
+    const char *end_date = NULL;
+    const char *timeframe = "1Min";
+    const char *sip = "sip";
+    const char *strategy = "ema-cross";
+    StrategyParams params = { 12, 26, 14, 100, 30, 70 };
+    BacktestOptions options;
+    memset(&options, 0, sizeof(options));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-symbol") == 0 && i < argc - 1) {
+            symbol_list_add(&symbols, argv[++i]);
+        } else if (strcmp(argv[i], "-symbols") == 0 && i < argc - 1) {
+            if (symbol_list_read_file(&symbols, argv[++i]) != 0) {
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-dir") == 0 && i < argc - 1) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-input") == 0 && i < argc - 1) {
+            input = argv[++i];
+        } else if (strcmp(argv[i], "-cache") == 0 && i < argc - 1) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "-start") == 0 && i < argc - 1) {
+            start_date = argv[++i];
+        } else if (strcmp(argv[i], "-end") == 0 && i < argc - 1) {
+            end_date = argv[++i];
+        } else if (strcmp(argv[i], "-timeframe") == 0 && i < argc - 1) {
+            timeframe = argv[++i];
+        } else if (strcmp(argv[i], "-sip") == 0 && i < argc - 1) {
+            sip = argv[++i];
+        } else if (strcmp(argv[i], "-strategy") == 0 && i < argc - 1) {
+            strategy = argv[++i];
+        } else if (strcmp(argv[i], "-fast") == 0 && i < argc - 1) {
+            params.fast = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-slow") == 0 && i < argc - 1) {
+            params.slow = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-period") == 0 && i < argc - 1) {
+            params.period = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-quantity") == 0 && i < argc - 1) {
+            params.quantity = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-fee") == 0 && i < argc - 1) {
+            options.fee_per_share = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-threads") == 0 && i < argc - 1) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-fills") == 0) {
+            options.record_fills = 1;
+        } else {
+            fprintf(stderr, "Usage: %s -symbol SYMBOL | -symbols FILE  -dir DIR | -input FILE|- | -cache DIR -start YYYY-MM-DD -end YYYY-MM-DD [-timeframe 1Min] [-sip sip]\n"
+                            "       [-strategy ema-cross|rsi] [-fast N] [-slow N] [-period N] [-quantity N] [-fee F] [-threads N] [-fills]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (symbols.count == 0) {
+        fprintf(stderr, "Error: at least one symbol is required (-symbol SYMBOL or -symbols FILE).\n");
+        exit(1);
+    }
+    if ((dir != NULL) + (input != NULL) + (cache_dir != NULL) != 1) {
+        fprintf(stderr, "Error: exactly one of -dir, -input and -cache is required.\n");
+        exit(1);
+    }
+    if (input && symbols.count != 1) {
+        fprintf(stderr, "Error: -input holds the bars of a single symbol.\n");
+        exit(1);
+    }
+    if (params.fast == 0 || params.slow == 0 || params.period == 0) {
+        fprintf(stderr, "Error: -fast, -slow and -period must be positive.\n");
+        exit(1);
+    }
+
+    if (strcmp(strategy, "ema-cross") == 0) {
+        options.strategy.on_bar = ema_cross_on_bar;
+        options.strategy.state_size = sizeof(EmaCrossState);
+    } else if (strcmp(strategy, "rsi") == 0) {
+        options.strategy.on_bar = rsi_on_bar;
+        options.strategy.state_size = sizeof(RsiState);
+    } else {
+        fprintf(stderr, "Error: -strategy value must be 'ema-cross' or 'rsi'.\n");
+        exit(1);
+    }
+    options.strategy.user = &params;
+
+    BacktestCacheSource source;
+    if (cache_dir) {
+        if (!start_date || !end_date || parse_rfc3339(start_date) < 0 || parse_rfc3339(end_date) < 0) {
+            fprintf(stderr, "Error: -cache needs -start and -end dates (YYYY-MM-DD).\n");
+            exit(1);
+        }
+        source.dir = cache_dir;
+        source.feed = sip;
+        source.timeframe = timeframe;
+        source.from = parse_rfc3339(start_date);
+        source.to = parse_rfc3339(end_date);
+        // A date-only end covers the whole day
+        if (strlen(end_date) == 10) {
+            source.to += SECONDS_PER_DAY - 1;
+        }
+        options.load = backtest_load_cache;
+        options.load_user = &source;
+    } else if (dir) {
+        options.load = backtest_load_binary;
+        options.load_user = (void *)dir;
+    } else {
+        options.load = load_input;
+        options.load_user = (void *)input;
+    }
+
+    BacktestResult *results = (BacktestResult *)calloc(symbols.count, sizeof(BacktestResult));
+    if (!results) {
+        perror("Failed to allocate memory for results");
+        exit(1);
+    }
+
+    double started = now_seconds();
+    if (backtest_run(&options, (const char *const *)symbols.symbols, symbols.count, results) != 0) {
+        free(results);
+        symbol_list_free(&symbols);
+        exit(1);
+    }
+    double elapsed = now_seconds() - started;
+
+    size_t total_bars = 0;
+    size_t total_fills = 0;
+    size_t failures = 0;
+    double total_pnl = 0;
+    for (size_t i = 0; i < symbols.count; i++) {
+        const BacktestResult *result = &results[i];
+        if (result->failed) {
+            printf("Failed to load bars for %s.\n", symbols.symbols[i]);
+            failures++;
+            continue;
+        }
+        printf("%-8s bars %8zu  fills %6zu  position %8.0f  pnl %12.2f  max drawdown %10.2f\n", symbols.symbols[i],
+               result->bars, result->num_fills, result->position, result->pnl, result->max_drawdown);
+        for (size_t f = 0; f < result->num_fills && result->fills; f++) {
+            char time_buf[32];
+            format_rfc3339(result->fills[f].t, time_buf, sizeof(time_buf));
+            printf("  %s %+.0f @ %.4f\n", time_buf, result->fills[f].quantity, result->fills[f].price);
+        }
+        total_bars += result->bars;
+        total_fills += result->num_fills;
+        total_pnl += result->pnl;
+    }
+    printf("Total: %zu symbols, %zu bars, %zu fills, pnl %.2f\n", symbols.count - failures, total_bars, total_fills, total_pnl);
+    fprintf(stderr, "Backtested %zu bars in %.3f s (%.1f million bars/s)\n", total_bars, elapsed,
+            elapsed > 0 ? total_bars / elapsed / 1e6 : 0.0);
+
+    backtest_results_free(results, symbols.count);
+    free(results);
+    symbol_list_free(&symbols);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+#include "alpaca_bar_builder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_BUILDER_SYMBOLS 64
+
+// Function to set up a builder from a spec: time:SECONDS, volume:SHARES or
+// dollar:DOLLARS. Completed bars are passed to on_bar. Returns -1 for a bad spec.
+int bar_builder_init(BarBuilder *builder, const char *spec, void (*on_bar)(void *user, const BuiltBar *bar), void *user) {
+    memset(builder, 0, sizeof(*builder));
+    const char *colon = spec ? strchr(spec, ':') : NULL;
+    char *end = NULL;
+    double threshold = colon ? strtod(colon + 1, &end) : 0;
+    if (!colon || *end || threshold <= 0) {
+        fprintf(stderr, "Error: bar spec %s should be time:SECONDS, volume:SHARES or dollar:DOLLARS.\n", spec ? spec : "(null)");
+        return -1;
+    }
+    size_t kind_len = (size_t)(colon - spec);
+    if (kind_len == 4 && strncmp(spec, "time", 4) == 0) {
+        if (threshold != (double)(int64_t)threshold) {
+            fprintf(stderr, "Error: time bars must be a whole number of seconds.\n");
+            return -1;
+        }
+        builder->kind = BUILD_TIME;
+        builder->interval_ns = (int64_t)threshold * 1000000000LL;
+    } else if (kind_len == 6 && strncmp(spec, "volume", 6) == 0) {
+        builder->kind = BUILD_VOLUME;
+    } else if (kind_len == 6 && strncmp(spec, "dollar", 6) == 0) {
+        builder->kind = BUILD_DOLLAR;
+    } else {
+        fprintf(stderr, "Error: unknown bar kind in %s; use time, volume or dollar.\n", spec);
+        return -1;
+    }
+    builder->threshold = threshold;
+    builder->on_bar = on_bar;
+    builder->user = user;
+    symbol_table_init(&builder->symbols);
+    return 0;
+}
+
+void bar_builder_free(BarBuilder *builder) {
+    free(builder->bars);
+    symbol_table_free(&builder->symbols);
+    memset(builder, 0, sizeof(*builder));
+}
+
+// Function to skip trades carrying any of a comma-separated list of one-character
+// condition codes
+int bar_builder_exclude(BarBuilder *builder, const char *conditions) {
+    for (const char *c = conditions; *c;) {
+        const char *comma = strchr(c, ',');
+        size_t len = comma ? (size_t)(comma - c) : strlen(c);
+        if (len != 1) {
+            fprintf(stderr, "Error: trade conditions are single characters, got \"%.*s\".\n", (int)len, c);
+            return -1;
+        }
+        unsigned char code = (unsigned char)*c;
+        builder->excluded[code >> 6] |= 1ULL << (code & 63);
+        c += comma ? len + 1 : len;
+    }
+    return 0;
+}
+
+int64_t bar_builder_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static BuildingBar *building_bar(BarBuilder *builder, const char *symbol, int *index) {
+    *index = symbol_table_add(&builder->symbols, symbol);
+    if (*index < 0) {
+        return NULL;
+    }
+    if (builder->symbols.count > builder->capacity) {
+        size_t capacity = builder->capacity ? builder->capacity * 2 : MIN_BUILDER_SYMBOLS;
+        BuildingBar *bars = (BuildingBar *)realloc(builder->bars, capacity * sizeof(BuildingBar));
+        if (!bars) {
+            return NULL;
+        }
+        memset(bars + builder->capacity, 0, (capacity - builder->capacity) * sizeof(BuildingBar));
+        builder->bars = bars;
+        builder->capacity = capacity;
+    }
+    return &builder->bars[*index];
+}
+
+static void complete_bar(BarBuilder *builder, int index) {
+    BuildingBar *b = &builder->bars[index];
+    BuiltBar bar;
+    bar.symbol = symbol_table_name(&builder->symbols, index);
+    bar.t = b->start;
+    bar.open = b->open;
+    bar.high = b->high;
+    bar.low = b->low;
+    bar.close = b->close;
+    bar.vw = b->volume > 0 ? b->notional / b->volume : b->close;
+    bar.volume = b->volume;
+    bar.trades = b->trades;
+    b->active = 0;
+    builder->built++;
+    if (builder->on_bar) {
+        builder->on_bar(builder->user, &bar);
+    }
+}
+
+// Function to add a trade to its symbol's bar, first completing the bar it does not
+// belong in. Returns 1 if the trade was used and 0 if it was skipped for its
+// conditions or for being older than the time bar in progress.
+int bar_builder_trade(BarBuilder *builder, const char *symbol, int64_t t, double price, int64_t size, const char *const *conditions, size_t num_conditions) {
+    for (size_t i = 0; i < num_conditions; i++) {
+        const unsigned char *code = (const unsigned char *)conditions[i];
+        if (code && code[0] && !code[1] && (builder->excluded[code[0] >> 6] & (1ULL << (code[0] & 63)))) {
+            builder->filtered++;
+            return 0;
+        }
+    }
+    int index;
+    BuildingBar *b = symbol ? building_bar(builder, symbol, &index) : NULL;
+    if (!b || price <= 0 || t < 0) {
+        return 0;
+    }
+
+    if (builder->kind == BUILD_TIME) {
+        // b->end is kept after a bar completes, so a trade for a bucket already sent is late
+        if (t < (b->active ? b->start : b->end)) {
+            builder->late++;
+            return 0;
+        }
+        if (b->active && t >= b->end) {
+            complete_bar(builder, index);
+        }
+    }
+    if (!b->active) {
+        b->active = 1;
+        b->start = builder->kind == BUILD_TIME ? t - t % builder->interval_ns : t;
+        b->end = builder->kind == BUILD_TIME ? b->start + builder->interval_ns : 0;
+        b->open = b->high = b->low = price;
+        b->volume = 0;
+        b->notional = 0;
+        b->trades = 0;
+    }
+    if (price > b->high) {
+        b->high = price;
+    }
+    if (price < b->low) {
+        b->low = price;
+    }
+    b->close = price;
+    b->volume += size;
+    b->notional += price * size;
+    b->trades++;
+
+    if ((builder->kind == BUILD_VOLUME && b->volume >= builder->threshold) ||
+        (builder->kind == BUILD_DOLLAR && b->notional >= builder->threshold)) {
+        complete_bar(builder, index);
+    }
+    return 1;
+}
+
+// Function to complete the time bars that ended at least BAR_BUILDER_GRACE_NS before
+// now, for symbols whose next trade has not arrived to do it
+void bar_builder_flush(BarBuilder *builder, int64_t now) {
+    if (builder->kind != BUILD_TIME) {
+        return;
+    }
+    for (size_t i = 0; i < builder->symbols.count; i++) {
+        if (builder->bars[i].active && builder->bars[i].end <= now - BAR_BUILDER_GRACE_NS) {
+            complete_bar(builder, (int)i);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ALPACA_BAR_BUILDER_H
+#define ALPACA_BAR_BUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_symbol_table.h"
+
+#define BAR_BUILDER_GRACE_NS 1000000000LL   // how long a time bar waits for late trades after it ends
+#define BAR_BUILDER_MAX_CONDITIONS 8        // conditions of a trade checked against the filter
+
+typedef enum {
+    BUILD_TIME,         // a bar every threshold seconds, aligned to the epoch like the API's bars
+    BUILD_VOLUME,       // a bar once threshold shares have traded
+    BUILD_DOLLAR        // a bar once threshold dollars have traded
+} BarBuildKind;
+
+// A completed bar. t is the bucket start for time bars and the first trade's time
+// otherwise, in nanoseconds since 1970 UTC.
+typedef struct {
+    const char *symbol;
+    int64_t t;
+    double open;
+    double high;
+    double low;
+    double close;
+    double vw;
+    int64_t volume;
+    int64_t trades;
+} BuiltBar;
+
+// The bar a symbol is building
+typedef struct {
+    int active;
+    int64_t start;
+    int64_t end;            // time bars: first nanosecond after the bucket
+    double open;
+    double high;
+    double low;
+    double close;
+    int64_t volume;
+    double notional;
+    int64_t trades;
+} BuildingBar;
+
+// Builds bars of one kind for every symbol from its trades. A time bar is completed
+// by the first trade after it, or by bar_builder_flush once it has ended; volume and
+// dollar bars close with the trade that reaches the threshold.
+typedef struct {
+    BarBuildKind kind;
+    double threshold;
+    int64_t interval_ns;
+    uint64_t excluded[4];   // single-character trade conditions to skip, as a bitmap
+    void (*on_bar)(void *user, const BuiltBar *bar);
+    void *user;
+    SymbolTable symbols;
+    BuildingBar *bars;      // indexed like symbols
+    size_t capacity;
+    size_t built;
+    size_t filtered;        // trades skipped for their conditions
+    size_t late;            // trades older than the time bar being built
+} BarBuilder;
+
+int bar_builder_init(BarBuilder *builder, const char *spec, void (*on_bar)(void *user, const BuiltBar *bar), void *user);
+void bar_builder_free(BarBuilder *builder);
+int bar_builder_exclude(BarBuilder *builder, const char *conditions);
+int bar_builder_trade(BarBuilder *builder, const char *symbol, int64_t t, double price, int64_t size, const char *const *conditions, size_t num_conditions);
+void bar_builder_flush(BarBuilder *builder, int64_t now);
+int64_t bar_builder_clock_ns(void);
+
+#endif // ALPACA_BAR_BUILDER_H
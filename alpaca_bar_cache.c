@@ -0,0 +1,165 @@
+#include "alpaca_bar_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BAR_CACHE_PATH_SIZE 1024
+
+// Function to return the cache directory from APCA_BAR_CACHE, or NULL if caching is off
+const char *bar_cache_default_dir(void) {
+    const char *dir = getenv("APCA_BAR_CACHE");
+    return (dir && *dir) ? dir : NULL;
+}
+
+static void bar_cache_path(char *path, size_t size, const char *dir, const char *feed, const char *symbol, const char *timeframe, int64_t day_start) {
+    char date[16];
+    format_date(day_start, date, sizeof(date));
+    snprintf(path, size, "%s/%s/%s/%s/%s.bars", dir, feed, symbol, timeframe, date);
+}
+
+// Create every missing directory on the way to the file
+static int make_parent_dirs(const char *path) {
+    char tmp[BAR_CACHE_PATH_SIZE];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = 0;
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    return 0;
+}
+
+// Function to map a cached day read-only. Returns 0 if the file exists and is valid.
+int bar_cache_open_day(const char *dir, const char *feed, const char *symbol, const char *timeframe, int64_t day_start, BarCacheDay *day) {
+    char path[BAR_CACHE_PATH_SIZE];
+    bar_cache_path(path, sizeof(path), dir, feed, symbol, timeframe, day_start);
+    memset(day, 0, sizeof(*day));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BarCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    const BarCacheHeader *header = (const BarCacheHeader *)base;
+    size_t expected = sizeof(BarCacheHeader) + header->count * 8 * 8;
+    if (memcmp(header->magic, BAR_CACHE_MAGIC, sizeof(BAR_CACHE_MAGIC)) != 0 ||
+        header->version != BAR_CACHE_VERSION || (size_t)st.st_size != expected) {
+        munmap(base, (size_t)st.st_size);
+        return -1;
+    }
+
+    const char *columns = (const char *)base + sizeof(BarCacheHeader);
+    size_t column_size = header->count * 8;
+    day->base = base;
+    day->size = (size_t)st.st_size;
+    day->count = header->count;
+    day->flags = header->flags;
+    day->t = (const int64_t *)(columns);
+    day->open = (const double *)(columns + column_size);
+    day->high = (const double *)(columns + column_size * 2);
+    day->low = (const double *)(columns + column_size * 3);
+    day->close = (const double *)(columns + column_size * 4);
+    day->vw = (const double *)(columns + column_size * 5);
+    day->volume = (const int64_t *)(columns + column_size * 6);
+    day->trades = (const int64_t *)(columns + column_size * 7);
+    return 0;
+}
+
+void bar_cache_close_day(BarCacheDay *day) {
+    if (day->base) {
+        munmap(day->base, day->size);
+    }
+    memset(day, 0, sizeof(*day));
+}
+
+// Function to append the cached bars with from <= t <= to to a bar array
+int bar_cache_day_to_array(const BarCacheDay *day, int64_t from, int64_t to, BarArray *out) {
+    for (uint64_t i = 0; i < day->count; i++) {
+        if (day->t[i] < from || day->t[i] > to) {
+            continue;
+        }
+        AlpacaBar bar = { day->t[i], day->open[i], day->high[i], day->low[i], day->close[i], day->vw[i], day->volume[i], day->trades[i] };
+        if (bar_array_push(out, &bar) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_column(FILE *fp, const AlpacaBar *bars, size_t count, size_t offset) {
+    for (size_t i = 0; i < count; i++) {
+        if (fwrite((const char *)&bars[i] + offset, 8, 1, fp) != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to store one day of bars. The file is written under a temporary name
+// and renamed into place, so concurrent readers only ever map complete files.
+int bar_cache_write_day(const char *dir, const char *feed, const char *symbol, const char *timeframe, int64_t day_start,
+                        const AlpacaBar *bars, size_t count, int complete) {
+    char path[BAR_CACHE_PATH_SIZE];
+    char tmp_path[BAR_CACHE_PATH_SIZE + 32];
+    bar_cache_path(path, sizeof(path), dir, feed, symbol, timeframe, day_start);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    if (make_parent_dirs(path) != 0) {
+        perror("Error creating bar cache directory");
+        return -1;
+    }
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        perror("Error opening bar cache file");
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 16);
+
+    BarCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BAR_CACHE_MAGIC, sizeof(BAR_CACHE_MAGIC));
+    header.version = BAR_CACHE_VERSION;
+    header.flags = complete ? BAR_CACHE_COMPLETE : 0;
+    header.count = count;
+    header.day_start = day_start;
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, t)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, open)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, high)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, low)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, close)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, vw)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, volume)) == 0;
+    ok = ok && write_column(fp, bars, count, offsetof(AlpacaBar, trades)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Error writing bar cache file");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
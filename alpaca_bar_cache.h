@@ -0,0 +1,45 @@
+#ifndef ALPACA_BAR_CACHE_H
+#define ALPACA_BAR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_bars.h"
+
+#define BAR_CACHE_MAGIC "ALPBARS"
+#define BAR_CACHE_VERSION 1
+#define BAR_CACHE_COMPLETE 0x1
+
+// On-disk layout of one symbol/timeframe/day file: this header, then one
+// contiguous column per field, each `count` entries long and 8-byte aligned.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t count;
+    int64_t day_start;
+} BarCacheHeader;
+
+// Read-only view of a mapped cache file; the column pointers point into the mapping
+typedef struct {
+    void *base;
+    size_t size;
+    uint64_t count;
+    uint32_t flags;
+    const int64_t *t;
+    const double *open;
+    const double *high;
+    const double *low;
+    const double *close;
+    const double *vw;
+    const int64_t *volume;
+    const int64_t *trades;
+} BarCacheDay;
+
+const char *bar_cache_default_dir(void);
+int bar_cache_open_day(const char *dir, const char *feed, const char *symbol, const char *timeframe, int64_t day_start, BarCacheDay *day);
+void bar_cache_close_day(BarCacheDay *day);
+int bar_cache_day_to_array(const BarCacheDay *day, int64_t from, int64_t to, BarArray *out);
+int bar_cache_write_day(const char *dir, const char *feed, const char *symbol, const char *timeframe, int64_t day_start,
+                        const AlpacaBar *bars, size_t count, int complete);
+
+#endif // ALPACA_BAR_CACHE_H
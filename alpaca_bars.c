@@ -0,0 +1,254 @@
+#include "alpaca_bars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jansson.h>
+
+// Macro to get either the real or integer value of a json_t object
+#define GET_JSON_REAL_OR_INTEGER(json) \
+  (json_is_real(json) ? json_real_value(json) : json_integer_value(json))
+
+int bar_array_append(BarArray *array, const AlpacaBar *bars, size_t count) {
+    if (array->count + count > array->capacity) {
+        size_t capacity = array->capacity ? array->capacity : 1024;
+        while (array->count + count > capacity) {
+            capacity *= 2;
+        }
+        AlpacaBar *ptr = realloc(array->bars, capacity * sizeof(AlpacaBar));
+        if (ptr == NULL) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        array->bars = ptr;
+        array->capacity = capacity;
+    }
+    memcpy(array->bars + array->count, bars, count * sizeof(AlpacaBar));
+    array->count += count;
+    return 0;
+}
+
+int bar_array_push(BarArray *array, const AlpacaBar *bar) {
+    return bar_array_append(array, bar, 1);
+}
+
+void bar_array_free(BarArray *array) {
+    free(array->bars);
+    array->bars = NULL;
+    array->count = 0;
+    array->capacity = 0;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (Howard Hinnant's algorithm)
+int64_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Parse an RFC 3339 time into seconds since 1970 UTC and the fraction of a second
+// in nanoseconds. Returns -1 on error.
+static int64_t parse_rfc3339_parts(const char *str, int64_t *nanos) {
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    *nanos = 0;
+    if (!str || sscanf(str, "%4d-%2d-%2d", &year, &month, &day) != 3) {
+        return -1;
+    }
+
+    const char *p = str + 10;
+    if (*p == 'T' || *p == ' ') {
+        if (sscanf(p + 1, "%2d:%2d:%2d", &hour, &minute, &second) != 3) {
+            return -1;
+        }
+        p += 9;
+        if (*p == '.') {
+            int64_t scale = 100000000;
+            while (*++p >= '0' && *p <= '9') {
+                *nanos += (*p - '0') * scale;
+                scale /= 10;
+            }
+        }
+    }
+
+    int64_t t = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+
+    // Apply a numeric UTC offset if one is present
+    if (*p == '+' || *p == '-') {
+        int off_h = 0, off_m = 0;
+        if (sscanf(p + 1, "%2d:%2d", &off_h, &off_m) >= 1) {
+            int64_t offset = off_h * 3600 + off_m * 60;
+            t += (*p == '+') ? -offset : offset;
+        }
+    }
+    return t;
+}
+
+// Function to convert "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM:SS[.fff][Z|+hh:mm]" to
+// seconds since 1970 UTC without going through strptime/mktime. Returns -1 on error.
+int64_t parse_rfc3339(const char *str) {
+    int64_t nanos;
+    return parse_rfc3339_parts(str, &nanos);
+}
+
+// Function to convert an RFC 3339 time with up to nanosecond precision, as used by
+// trades and quotes, to nanoseconds since 1970 UTC. Returns -1 on error.
+int64_t parse_rfc3339_ns(const char *str) {
+    int64_t nanos;
+    int64_t t = parse_rfc3339_parts(str, &nanos);
+    return t < 0 ? -1 : t * 1000000000 + nanos;
+}
+
+void format_rfc3339(int64_t t, char *buf, size_t len) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+void format_date(int64_t t, char *buf, size_t len) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    strftime(buf, len, "%Y-%m-%d", &tm);
+}
+
+// Format a UTC timestamp in the local timezone, e.g. "2023-03-01 09:30:00 EST"
+void format_local_time(int64_t t, char *buf, size_t len) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    localtime_r(&tt, &tm);
+    strftime(buf, len, "%Y-%m-%d %H:%M:%S %Z", &tm);
+}
+
+// Function to return the length of a timeframe such as "1Min", "15T", "1Hour" or
+// "1Day" in seconds. Returns -1 for months and unknown units.
+int64_t timeframe_seconds(const char *timeframe) {
+    int count = 0;
+    char unit[16] = "";
+    if (!timeframe || sscanf(timeframe, "%d%15s", &count, unit) != 2 || count <= 0) {
+        return -1;
+    }
+    if (strcmp(unit, "Min") == 0 || strcmp(unit, "T") == 0) {
+        return (int64_t)count * 60;
+    }
+    if (strcmp(unit, "Hour") == 0 || strcmp(unit, "H") == 0) {
+        return (int64_t)count * 3600;
+    }
+    if (strcmp(unit, "Day") == 0 || strcmp(unit, "D") == 0) {
+        return (int64_t)count * 86400;
+    }
+    if (strcmp(unit, "Week") == 0 || strcmp(unit, "W") == 0) {
+        return (int64_t)count * 7 * 86400;
+    }
+    return -1;
+}
+
+// Function to decode one page of a /bars response into bar records.
+// Returns 0 on success and sets *next_page_token (caller frees) or NULL on the last page.
+int parse_bars_page(const char *json, size_t len, BarArray *out, char **next_page_token) {
+    json_error_t error;
+    json_t *root = json_loadb(json, len, 0, &error);
+    *next_page_token = NULL;
+
+    if (!root) {
+        fprintf(stderr, "error: on line %d: %s\n", error.line, error.text);
+        return -1;
+    }
+
+    json_t *bars = json_object_get(root, "bars");
+    if (!json_is_array(bars)) {
+        // A range with no bars is returned as "bars": null
+        if (json_is_null(bars)) {
+            json_decref(root);
+            return 0;
+        }
+        fprintf(stderr, "Error: 'bars' is not an array.\n");
+        json_decref(root);
+        return -1;
+    }
+
+    json_t *token = json_object_get(root, "next_page_token");
+    if (json_is_string(token)) {
+        *next_page_token = strdup(json_string_value(token));
+    }
+
+    size_t index;
+    json_t *bar;
+    json_array_foreach(bars, index, bar) {
+        AlpacaBar record;
+        record.t = parse_rfc3339(json_string_value(json_object_get(bar, "t")));
+        record.open = GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "o"));
+        record.high = GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "h"));
+        record.low = GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "l"));
+        record.close = GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "c"));
+        record.vw = GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "vw"));
+        record.volume = (int64_t)GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "v"));
+        record.trades = (int64_t)GET_JSON_REAL_OR_INTEGER(json_object_get(bar, "n"));
+        if (bar_array_push(out, &record) != 0) {
+            json_decref(root);
+            return -1;
+        }
+    }
+
+    json_decref(root);
+    return 0;
+}
+
+static void bar_stream_begin(void *user) {
+    BarStreamParser *parser = (BarStreamParser *)user;
+    memset(&parser->bar, 0, sizeof(parser->bar));
+    parser->bar.t = -1;
+}
+
+// Map one field of a bar object onto the bar being filled
+static void bar_stream_value(void *user, const char *key, const char *token, int is_string, int in_list) {
+    AlpacaBar *bar = &((BarStreamParser *)user)->bar;
+    if (in_list) {
+        return;
+    }
+    if (key[1] == 0) {
+        switch (key[0]) {
+        case 't': bar->t = is_string ? parse_rfc3339(token) : -1; break;
+        case 'o': bar->open = strtod(token, NULL); break;
+        case 'h': bar->high = strtod(token, NULL); break;
+        case 'l': bar->low = strtod(token, NULL); break;
+        case 'c': bar->close = strtod(token, NULL); break;
+        case 'v': bar->volume = (int64_t)strtod(token, NULL); break;
+        case 'n': bar->trades = (int64_t)strtod(token, NULL); break;
+        }
+    } else if (strcmp(key, "vw") == 0) {
+        bar->vw = strtod(token, NULL);
+    }
+}
+
+static void bar_stream_end(void *user, const char *symbol) {
+    BarStreamParser *parser = (BarStreamParser *)user;
+    parser->on_bar(parser->user, symbol, &parser->bar);
+}
+
+void bar_stream_init(BarStreamParser *parser, BarCallback on_bar, void *user) {
+    PageRecordHandler handler = { bar_stream_begin, bar_stream_value, bar_stream_end, parser };
+    memset(parser, 0, sizeof(*parser));
+    parser->on_bar = on_bar;
+    parser->user = user;
+    page_scanner_init(&parser->scanner, "bars", &handler);
+}
+
+// Forget any partial document, e.g. before a retried request starts over
+void bar_stream_reset(BarStreamParser *parser) {
+    page_scanner_reset(&parser->scanner);
+}
+
+// Function to feed the next chunk of the response body. Returns -1 on malformed input.
+int bar_stream_feed(BarStreamParser *parser, const char *data, size_t len) {
+    return page_scanner_feed(&parser->scanner, data, len);
+}
+
+// Function to check that a whole document was parsed. Returns 0 and sets
+// *next_page_token (caller frees) or NULL on the last page.
+int bar_stream_finish(BarStreamParser *parser, char **next_page_token) {
+    return page_scanner_finish(&parser->scanner, next_page_token);
+}
@@ -0,0 +1,61 @@
+#ifndef ALPACA_BARS_H
+#define ALPACA_BARS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_page_scanner.h"
+
+// One OHLCV bar as returned by /v2/stocks/{symbol}/bars
+typedef struct {
+    int64_t t;          // bar start, seconds since 1970 UTC
+    double open;
+    double high;
+    double low;
+    double close;
+    double vw;
+    int64_t volume;
+    int64_t trades;
+} AlpacaBar;
+
+// Growable, time-ordered array of bars
+typedef struct {
+    AlpacaBar *bars;
+    size_t count;
+    size_t capacity;
+} BarArray;
+
+int bar_array_push(BarArray *array, const AlpacaBar *bar);
+int bar_array_append(BarArray *array, const AlpacaBar *bars, size_t count);
+void bar_array_free(BarArray *array);
+
+int64_t parse_rfc3339(const char *str);
+int64_t parse_rfc3339_ns(const char *str);
+int64_t days_from_civil(int year, int month, int day);
+void format_rfc3339(int64_t t, char *buf, size_t len);
+void format_date(int64_t t, char *buf, size_t len);
+void format_local_time(int64_t t, char *buf, size_t len);
+int64_t timeframe_seconds(const char *timeframe);
+
+int parse_bars_page(const char *json, size_t len, BarArray *out, char **next_page_token);
+
+// Called for every complete bar; symbol is NULL for single-symbol responses
+typedef void (*BarCallback)(void *user, const char *symbol, const AlpacaBar *bar);
+
+// Incremental parser for /bars responses. The body can be fed in chunks of any size
+// and each bar is handed to on_bar as soon as its closing brace arrives, so memory
+// use does not depend on the page size. Both the single-symbol ("bars": [...]) and
+// the multi-symbol ("bars": {"SYM": [...]}) shapes are understood. The parser is
+// set up in place and must not be copied afterwards.
+typedef struct {
+    BarCallback on_bar;
+    void *user;
+    PageScanner scanner;
+    AlpacaBar bar;      // the bar being filled
+} BarStreamParser;
+
+void bar_stream_init(BarStreamParser *parser, BarCallback on_bar, void *user);
+void bar_stream_reset(BarStreamParser *parser);
+int bar_stream_feed(BarStreamParser *parser, const char *data, size_t len);
+int bar_stream_finish(BarStreamParser *parser, char **next_page_token);
+
+#endif // ALPACA_BARS_H
@@ -0,0 +1,318 @@
+#include "alpaca_correlation.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int correlation_init(CorrelationEngine *engine, size_t max_symbols, size_t window, int threads) {
+    memset(engine, 0, sizeof(*engine));
+    if (max_symbols == 0 || window < 2) {
+        fprintf(stderr, "Error: correlations need at least one symbol and a window of two periods.\n");
+        return -1;
+    }
+    engine->max_symbols = max_symbols;
+    engine->window = window;
+    engine->threads = threads;
+    engine->period_start = -1;
+    engine->returns = (double *)calloc(window * max_symbols, sizeof(double));
+    engine->sum = (double *)calloc(max_symbols, sizeof(double));
+    engine->cross = (double *)calloc(max_symbols * max_symbols, sizeof(double));
+    engine->last_close = (double *)calloc(max_symbols, sizeof(double));
+    engine->pending_close = (double *)calloc(max_symbols, sizeof(double));
+    engine->scratch = (double *)calloc(max_symbols, sizeof(double));
+    symbol_table_init(&engine->symbols);
+    if (!engine->returns || !engine->sum || !engine->cross || !engine->last_close || !engine->pending_close || !engine->scratch) {
+        fprintf(stderr, "Error: not enough memory for %zu x %zu correlations over %zu periods.\n", max_symbols, max_symbols, window);
+        correlation_free(engine);
+        return -1;
+    }
+    return 0;
+}
+
+void correlation_free(CorrelationEngine *engine) {
+    free(engine->returns);
+    free(engine->sum);
+    free(engine->cross);
+    free(engine->last_close);
+    free(engine->pending_close);
+    free(engine->scratch);
+    symbol_table_free(&engine->symbols);
+    memset(engine, 0, sizeof(*engine));
+}
+
+static size_t active_symbols(const CorrelationEngine *engine) {
+    return engine->symbols.count < engine->max_symbols ? engine->symbols.count : engine->max_symbols;
+}
+
+// Function to turn the closes collected for a period into a row of returns, put it in
+// place of the oldest row and update the sums with the difference: O(symbols^2).
+void correlation_finish_period(CorrelationEngine *engine) {
+    size_t n = active_symbols(engine);
+    size_t stride = engine->max_symbols;
+    size_t slot;
+    if (engine->count < engine->window) {
+        slot = (engine->head + engine->count) % engine->window;
+        engine->count++;
+    } else {
+        slot = engine->head;
+        engine->head = (engine->head + 1) % engine->window;
+    }
+    double *old = engine->returns + slot * stride;
+    double *x = engine->scratch;
+    for (size_t i = 0; i < n; i++) {
+        x[i] = 0;
+        if (engine->pending_close[i] > 0) {
+            if (engine->last_close[i] > 0) {
+                x[i] = log(engine->pending_close[i] / engine->last_close[i]);
+            }
+            engine->last_close[i] = engine->pending_close[i];
+            engine->pending_close[i] = 0;
+        }
+    }
+
+    // A symbol with no return now and none in the row leaving changes nothing in its row
+    for (size_t i = 0; i < n; i++) {
+        double xi = x[i];
+        double yi = old[i];
+        if (xi == 0 && yi == 0) {
+            continue;
+        }
+        engine->sum[i] += xi - yi;
+        double *c = engine->cross + i * stride;
+        for (size_t j = i; j < n; j++) {
+            c[j] += xi * x[j] - yi * old[j];
+        }
+    }
+    memcpy(old, x, n * sizeof(double));
+
+    engine->pending_count = 0;
+    engine->rows++;
+    if (++engine->since_recompute >= engine->window) {
+        correlation_recompute(engine);
+    }
+}
+
+// Function to add the close of a symbol's bar starting at t (ns since 1970 UTC). The
+// first bar of a later period completes the one being collected, as does the last
+// symbol to report once every symbol has been seen. A bar for a period already
+// completed counts toward the next one. Returns -1 if the symbol does not fit.
+int correlation_add_bar(CorrelationEngine *engine, const char *symbol, int64_t t, double close) {
+    int index = symbol ? symbol_table_add(&engine->symbols, symbol) : -1;
+    if (index < 0 || (size_t)index >= engine->max_symbols) {
+        if (index >= 0 && (size_t)index == engine->max_symbols) {
+            fprintf(stderr, "Error: correlations are limited to %zu symbols; ignoring %s and any after it.\n", engine->max_symbols, symbol);
+        }
+        return -1;
+    }
+    if (close <= 0) {
+        return 0;
+    }
+
+    if (engine->period_start < 0) {
+        engine->period_start = t;
+    } else if (t > engine->period_start) {
+        int64_t step = t - engine->period_start;
+        if (engine->period_ns == 0 || step < engine->period_ns) {
+            engine->period_ns = step;
+        }
+        if (!engine->period_done && engine->pending_count > 0) {
+            correlation_finish_period(engine);
+        }
+        engine->period_start = t;
+        engine->period_done = 0;
+    }
+
+    if (engine->pending_close[index] == 0) {
+        engine->pending_count++;
+    }
+    engine->pending_close[index] = close;
+
+    if (!engine->period_done && engine->rows > 0 && engine->pending_count == active_symbols(engine)) {
+        correlation_finish_period(engine);
+        engine->period_done = 1;
+    }
+    return 0;
+}
+
+// Function to complete the period being collected once CORRELATION_GRACE_NS have
+// passed since it ended, for the symbols that had no bar in it
+void correlation_flush(CorrelationEngine *engine, int64_t now) {
+    if (!engine->period_done && engine->pending_count > 0 && engine->period_ns > 0 &&
+        now >= engine->period_start + engine->period_ns + CORRELATION_GRACE_NS) {
+        correlation_finish_period(engine);
+        engine->period_done = 1;
+    }
+}
+
+typedef struct {
+    CorrelationEngine *engine;
+    size_t n;
+    size_t blocks;          // per side
+    size_t num_tiles;       // tiles on and above the diagonal
+    size_t next_tile;
+    pthread_mutex_t lock;
+} RecomputeJob;
+
+// Function to sum r_i * r_j over the window for one tile of the upper triangle. The
+// tile of the result stays in cache while every row streams past it once.
+static void recompute_tile(CorrelationEngine *engine, size_t n, size_t bi, size_t bj) {
+    size_t stride = engine->max_symbols;
+    size_t i0 = bi * CORRELATION_BLOCK;
+    size_t i1 = i0 + CORRELATION_BLOCK < n ? i0 + CORRELATION_BLOCK : n;
+    size_t j0 = bj * CORRELATION_BLOCK;
+    size_t j1 = j0 + CORRELATION_BLOCK < n ? j0 + CORRELATION_BLOCK : n;
+
+    for (size_t i = i0; i < i1; i++) {
+        size_t js = i > j0 ? i : j0;
+        if (js < j1) {
+            memset(engine->cross + i * stride + js, 0, (j1 - js) * sizeof(double));
+        }
+    }
+    for (size_t k = 0; k < engine->count; k++) {
+        const double *row = engine->returns + ((engine->head + k) % engine->window) * stride;
+        for (size_t i = i0; i < i1; i++) {
+            double xi = row[i];
+            if (xi == 0) {
+                continue;
+            }
+            double *c = engine->cross + i * stride;
+            for (size_t j = i > j0 ? i : j0; j < j1; j++) {
+                c[j] += xi * row[j];
+            }
+        }
+    }
+}
+
+static void *recompute_worker(void *arg) {
+    RecomputeJob *job = (RecomputeJob *)arg;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t tile = job->next_tile++;
+        pthread_mutex_unlock(&job->lock);
+        if (tile >= job->num_tiles) {
+            return NULL;
+        }
+        // Tiles are numbered row by row along the upper triangle
+        size_t bi = 0;
+        while (tile >= job->blocks - bi) {
+            tile -= job->blocks - bi;
+            bi++;
+        }
+        recompute_tile(job->engine, job->n, bi, bi + tile);
+    }
+}
+
+// Function to rebuild the sums from the rows in the window, one tile of
+// CORRELATION_BLOCK x CORRELATION_BLOCK symbols at a time, on engine->threads threads
+void correlation_recompute(CorrelationEngine *engine) {
+    size_t n = active_symbols(engine);
+    size_t stride = engine->max_symbols;
+    memset(engine->sum, 0, n * sizeof(double));
+    for (size_t k = 0; k < engine->count; k++) {
+        const double *row = engine->returns + ((engine->head + k) % engine->window) * stride;
+        for (size_t i = 0; i < n; i++) {
+            engine->sum[i] += row[i];
+        }
+    }
+    engine->since_recompute = 0;
+    if (n == 0) {
+        return;
+    }
+
+    RecomputeJob job;
+    job.engine = engine;
+    job.n = n;
+    job.blocks = (n + CORRELATION_BLOCK - 1) / CORRELATION_BLOCK;
+    job.num_tiles = job.blocks * (job.blocks + 1) / 2;
+    job.next_tile = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = engine->threads > 0 ? (size_t)engine->threads : cpus > 0 ? (size_t)cpus : 1;
+    if (num_threads > job.num_tiles) {
+        num_threads = job.num_tiles;
+    }
+    pthread_t *threads = num_threads > 1 ? (pthread_t *)calloc(num_threads, sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    for (size_t t = 1; threads && t < num_threads; t++) {
+        // Tiles left by threads that could not start are done by the others
+        if (pthread_create(&threads[t], NULL, recompute_worker, &job) != 0) {
+            break;
+        }
+        started = t;
+    }
+    recompute_worker(&job);
+    for (size_t t = 1; t <= started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+}
+
+// Function to get the sample covariance of the returns of symbols i and j over the
+// window, NAN with fewer than two periods
+double correlation_covariance(const CorrelationEngine *engine, int i, int j) {
+    size_t n = active_symbols(engine);
+    if (i < 0 || j < 0 || (size_t)i >= n || (size_t)j >= n || engine->count < 2) {
+        return NAN;
+    }
+    if (i > j) {
+        int tmp = i;
+        i = j;
+        j = tmp;
+    }
+    double count = (double)engine->count;
+    double cross = engine->cross[(size_t)i * engine->max_symbols + j];
+    return (cross - engine->sum[i] * engine->sum[j] / count) / (count - 1);
+}
+
+// Function to get the correlation of the returns of symbols i and j over the window,
+// NAN if either did not move
+double correlation_get(const CorrelationEngine *engine, int i, int j) {
+    double var_i = correlation_covariance(engine, i, i);
+    double var_j = correlation_covariance(engine, j, j);
+    if (!(var_i > 0) || !(var_j > 0)) {
+        return NAN;
+    }
+    double r = correlation_covariance(engine, i, j) / sqrt(var_i * var_j);
+    return r > 1 ? 1 : r < -1 ? -1 : r;
+}
+
+// Function to write the correlation matrix as CSV, with the symbols as the first row
+// and column and an empty cell where it is undefined. The file is replaced in one
+// step so a reader never sees half of it.
+int correlation_write_csv(const CorrelationEngine *engine, const char *path) {
+    size_t n = active_symbols(engine);
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        perror(tmp_path);
+        return -1;
+    }
+    fputs("symbol", fp);
+    for (size_t j = 0; j < n; j++) {
+        fprintf(fp, ",%s", symbol_table_name(&engine->symbols, (int)j));
+    }
+    fputc('\n', fp);
+    for (size_t i = 0; i < n; i++) {
+        fputs(symbol_table_name(&engine->symbols, (int)i), fp);
+        for (size_t j = 0; j < n; j++) {
+            double r = correlation_get(engine, (int)i, (int)j);
+            if (isnan(r)) {
+                fputc(',', fp);
+            } else {
+                fprintf(fp, ",%.6f", r);
+            }
+        }
+        fputc('\n', fp);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0) {
+        perror(path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
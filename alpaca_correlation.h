@@ -0,0 +1,49 @@
+#ifndef ALPACA_CORRELATION_H
+#define ALPACA_CORRELATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_symbol_table.h"
+
+#define CORRELATION_DEFAULT_MAX_SYMBOLS 512
+#define CORRELATION_GRACE_NS 10000000000LL  // how long a period waits for its last bars
+#define CORRELATION_BLOCK 64                // symbols per side of a tile in the full recompute
+
+// Rolling covariance and correlation of the log returns of many symbols over the last
+// `window` bar periods. Bars are lined up by their start time: each period gives a
+// row of returns, one per symbol, 0 for a symbol without a bar in it. The sums of the
+// window's returns and of their pairwise products are updated as each row is added
+// and the oldest leaves, and recomputed in full every `window` rows to shed the
+// rounding error that adding and removing leaves behind.
+typedef struct {
+    SymbolTable symbols;
+    size_t max_symbols;     // row stride and matrix dimension
+    size_t window;
+    int threads;            // for the full recompute; 0 for one per CPU
+    double *returns;        // window rows of max_symbols, a ring starting at head
+    size_t head;
+    size_t count;
+    double *sum;            // per symbol, sum of its returns in the window
+    double *cross;          // max_symbols x max_symbols, sum of r_i * r_j for j >= i
+    double *last_close;     // per symbol, close of the last period it had a bar in
+    double *pending_close;  // per symbol, close in the period being collected, 0 if none
+    size_t pending_count;
+    double *scratch;        // the row being added
+    int period_done;        // every symbol has reported for the period being collected
+    int64_t period_start;   // start of the period being collected, ns since 1970 UTC, -1 if none
+    int64_t period_ns;      // shortest step seen between periods, 0 until known
+    size_t rows;            // periods added since the start
+    size_t since_recompute;
+} CorrelationEngine;
+
+int correlation_init(CorrelationEngine *engine, size_t max_symbols, size_t window, int threads);
+void correlation_free(CorrelationEngine *engine);
+int correlation_add_bar(CorrelationEngine *engine, const char *symbol, int64_t t, double close);
+void correlation_flush(CorrelationEngine *engine, int64_t now);
+void correlation_finish_period(CorrelationEngine *engine);
+void correlation_recompute(CorrelationEngine *engine);
+double correlation_covariance(const CorrelationEngine *engine, int i, int j);
+double correlation_get(const CorrelationEngine *engine, int i, int j);
+int correlation_write_csv(const CorrelationEngine *engine, const char *path);
+
+#endif // ALPACA_CORRELATION_H
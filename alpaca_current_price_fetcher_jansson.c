@@ -1,10 +1,15 @@
 /*
-This C-program retrieves and displays the latest trade price for a given stock symbol using the Alpaca API.
-It makes an API request using libcurl, parses the JSON response with the Jansson library, and outputs the result.
+This C-program retrieves and displays the latest trade price (or quote, or snapshot) for one or many stock
+symbols using the Alpaca API. Symbols are looked up in batches through the multi-symbol latest trades, latest
+quotes and snapshots endpoints, all over one keep-alive connection, and the result is printed one line per symbol.
 To compile, link against libcurl and libjansson, and set the APCA_API_KEY_ID and APCA_API_SECRET_KEY environment
 variables to your Alpaca API credentials.
 Example usage:
-  ./alpaca-current-price-fetcher_jansson AAPL
+  ./alpaca_current_price_fetcher_jansson -s AAPL
+  ./alpaca_current_price_fetcher_jansson -s AAPL,MSFT GOOG -f watchlist.txt
+  cat watchlist.txt | ./alpaca_current_price_fetcher_jansson -mode snapshot
+  ./alpaca_current_price_fetcher_jansson -daemon /tmp/alpaca_prices.sock -ttl 0.5 &
+  ./alpaca_current_price_fetcher_jansson -connect /tmp/alpaca_prices.sock -s AAPL,MSFT
 Output: "Latest trade price for AAPL: 150.230"
 */
 
@@ -12,131 +17,160 @@ Output: "Latest trade price for AAPL: 150.230"
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include <jansson.h>
-#define ALPACA_API_KEY getenv("APCA_API_KEY_ID")
-#define ALPACA_SECRET_KEY getenv("APCA_API_SECRET_KEY")
-#define INITIAL_CHUNK_SIZE 1
-const char *ALPACA_ENDPOINT = "https://data.alpaca.markets/v2";
-typedef struct {
-    char *data;
-    size_t size;
-} MemoryStruct;
-MemoryStruct init_memory_struct() {
-    MemoryStruct chunk;
-    chunk.data = malloc(INITIAL_CHUNK_SIZE);
-    if (!chunk.data) {
-        perror("Failed to allocate memory for initial chunk");
-        exit(EXIT_FAILURE);
+#include "alpaca_rest.h"
+#include "alpaca_latest.h"
+#include "alpaca_price_client.h"
+#include "alpaca_price_daemon.h"
+
+// Print one line for a symbol in the format of the selected endpoint
+void print_latest(const LatestPrice *latest, LatestKind kind) {
+    switch (kind) {
+    case LATEST_QUOTE:
+        if (latest->has_quote) {
+            printf("Latest quote for %s: bid %.3f x %.0f, ask %.3f x %.0f\n", latest->symbol,
+                   latest->bid, latest->bid_size, latest->ask, latest->ask_size);
+        } else {
+            printf("Failed to retrieve latest quote for %s.\n", latest->symbol);
+        }
+        break;
+    case LATEST_SNAPSHOT:
+        if (latest->has_trade) {
+            printf("Snapshot for %s: last %.3f, bid %.3f, ask %.3f", latest->symbol, latest->price, latest->bid, latest->ask);
+            if (latest->has_prev_close && latest->prev_close > 0) {
+                printf(", prev close %.3f, change %+.2f%%", latest->prev_close,
+                       (latest->price - latest->prev_close) / latest->prev_close * 100.0);
+            }
+            printf("\n");
+        } else {
+            printf("Failed to retrieve snapshot for %s.\n", latest->symbol);
+        }
+        break;
+    default:
+        if (latest->has_trade) {
+            printf("Latest trade price for %s: %.3f\n", latest->symbol, latest->price);
+        } else {
+            printf("Failed to retrieve latest trade price for %s.\n", latest->symbol);
+        }
+        break;
     }
-    chunk.size = 0;
-    return chunk;
 }
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    MemoryStruct *mem = (MemoryStruct *)userp;
-    char *ptr = realloc(mem->data, mem->size + realsize + 1);
-    if (!ptr) {
-        perror("not enough memory (realloc returned NULL)");
-        return 0;
+
+int main(int argc, char **argv) {
+    SymbolList symbols = { NULL, 0, 0 };
+    const char *sip = "sip";
+    LatestKind kind = LATEST_TRADE;
+    int batch_size = LATEST_DEFAULT_BATCH;
+    int read_stdin = 0;
+    const char *daemon_socket = NULL;
+    const char *connect_socket = NULL;
+    double ttl = DAEMON_DEFAULT_TTL;
+
+    for (int i = 1; i < argc; i++) {
+        // -s takes one symbol or a comma-separated list and may be repeated
+        if (strcmp(argv[i], "-s") == 0 && i < argc - 1) {
+            symbol_list_add(&symbols, argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i < argc - 1) {
+            if (symbol_list_read_file(&symbols, argv[++i]) != 0) {
+                exit(1);
+            }
+            read_stdin = read_stdin || strcmp(argv[i], "-") == 0;
+        } else if (strcmp(argv[i], "-sip") == 0 && i < argc - 1) {
+            sip = argv[++i];
+        } else if (strcmp(argv[i], "-batch") == 0 && i < argc - 1) {
+            batch_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-daemon") == 0 && i < argc - 1) {
+            daemon_socket = argv[++i];
+        } else if (strcmp(argv[i], "-connect") == 0 && i < argc - 1) {
+            connect_socket = argv[++i];
+        } else if (strcmp(argv[i], "-ttl") == 0 && i < argc - 1) {
+            ttl = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-mode") == 0 && i < argc - 1) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "trade") == 0) {
+                kind = LATEST_TRADE;
+            } else if (strcmp(mode, "quote") == 0) {
+                kind = LATEST_QUOTE;
+            } else if (strcmp(mode, "snapshot") == 0) {
+                kind = LATEST_SNAPSHOT;
+            } else {
+                fprintf(stderr, "Error: -mode value must be 'trade', 'quote' or 'snapshot'.\n");
+                exit(1);
+            }
+        } else if (argv[i][0] != '-') {
+            symbol_list_add(&symbols, argv[i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-s SYMBOL[,SYMBOL...]] [SYMBOL...] [-f FILE|-] [-sip SIP] [-mode trade|quote|snapshot] [-batch N]\n"
+                            "       %s -daemon SOCKET [-ttl SECONDS] [-sip SIP] [-mode trade|quote|snapshot]\n"
+                            "       %s -connect SOCKET [-mode trade|quote|snapshot] SYMBOL...\n", argv[0], argv[0], argv[0]);
+            exit(1);
+        }
     }
-    mem->data = ptr;
-    memcpy(&(mem->data[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
-    return realsize;
-}
-int get_latest_trade(const char *symbol, const char *sip, double *price) {
-    int result;
-    if (!ALPACA_API_KEY || !ALPACA_SECRET_KEY) {
-        fprintf(stderr, "Error: APCA_API_KEY_ID and APCA_API_SECRET_KEY environment variables must be set.\n");
-        return -1.0;
+
+    if (strcmp(sip, "sip") != 0 && strcmp(sip, "iex") != 0) {
+        fprintf(stderr, "Error: -sip value must be either 'sip' or 'iex'.\n");
+        exit(1);
     }
-    CURL *curl;
-    CURLcode res;
-    MemoryStruct chunk = init_memory_struct();
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl = curl_easy_init();
-    if (!curl) {
-        free(chunk.data);
+
+    // Serve prices to local clients until interrupted
+    if (daemon_socket) {
+        PriceDaemonOptions options = { daemon_socket, sip, kind, ttl, batch_size > 0 ? (size_t)batch_size : 0 };
+        int status = price_daemon_run(&options);
         curl_global_cleanup();
-        return -1.0;
+        symbol_list_free(&symbols);
+        return status == 0 ? 0 : 1;
     }
-    char url[256];
-    snprintf(url, sizeof(url), "%s/stocks/%s/trades/latest?feed=%s", ALPACA_ENDPOINT, symbol, sip);
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    char auth_headers[2048];
-    snprintf(auth_headers, sizeof(auth_headers), "APCA-API-KEY-ID: %s\nAPCA-API-SECRET-KEY: %s", ALPACA_API_KEY, ALPACA_SECRET_KEY);
-    headers = curl_slist_append(headers, auth_headers);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &chunk);
-    res = curl_easy_perform(curl);
-    if (res == CURLE_OK) {
-        json_error_t error;
-        json_t *root = json_loads(chunk.data, 0, &error);
-        if (root) {
-            json_t *trade = json_object_get(root, "trade");
-            if (json_is_object(trade)) {
-                json_t *price_item = json_object_get(trade, "p");
-                if (json_is_number(price_item)) {
-                    *price = json_number_value(price_item);
-		    result = 0;
-                }
-            }
-            json_decref(root);
-        }
-    } else {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-	result = -1;
-    }
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    free(chunk.data);
-    return result;
-}
-void convert_to_upper(char *str) {
-    for (; *str; ++str) {
-        *str = toupper(*str);
+
+    // With no symbols on the command line, read them from a pipe
+    if (symbols.count == 0 && !read_stdin && !isatty(STDIN_FILENO)) {
+        symbol_list_read_file(&symbols, "-");
     }
-}
-int main(int argc, char **argv) {
-    if (argc < 3 || argc > 5) {
-        fprintf(stderr, "Usage: %s -s SYMBOL [-sip SIP]\n", argv[0]);
+
+    if (symbols.count == 0) {
+        fprintf(stderr, "Error: at least one symbol is required (-s SYMBOL, arguments, -f FILE or stdin).\n");
         exit(1);
     }
 
-    char *symbol = NULL;
-    char *sip = "sip";
+    LatestPrice *prices = (LatestPrice *)calloc(symbols.count, sizeof(LatestPrice));
+    if (!prices) {
+        perror("Failed to allocate memory for prices");
+        exit(1);
+    }
+    for (size_t i = 0; i < symbols.count; i++) {
+        snprintf(prices[i].symbol, sizeof(prices[i].symbol), "%s", symbols.symbols[i]);
+    }
 
-    for (int i = 1; i < argc; i += 2) {
-        if (strcmp(argv[i], "-s") == 0) {
-            symbol = argv[i + 1];
-        } else if (strcmp(argv[i], "-sip") == 0) {
-            sip = argv[i + 1];
+    // Ask a running daemon instead of the API
+    if (connect_socket) {
+        PriceClient *price_client = price_client_connect(connect_socket);
+        int status = price_client ? price_client_get(price_client, kind, (const char *const *)symbols.symbols, symbols.count, prices) : -1;
+        if (status == 0) {
+            for (size_t i = 0; i < symbols.count; i++) {
+                print_latest(&prices[i], kind);
+            }
         }
+        price_client_close(price_client);
+        free(prices);
+        symbol_list_free(&symbols);
+        return status == 0 ? 0 : 1;
     }
 
-    if (!symbol) {
-        fprintf(stderr, "Error: -s SYMBOL argument is required.\n");
+    // One client, and therefore one connection, serves every batch
+    RestClient *client = rest_client_create();
+    if (!client) {
         exit(1);
     }
+    int failures = fetch_latest_prices(client, sip, kind, prices, symbols.count, batch_size > 0 ? (size_t)batch_size : 0);
 
-    if (strcmp(sip, "sip") != 0 && strcmp(sip, "iex") != 0) {
-        fprintf(stderr, "Error: -sip value must be either 'sip' or 'iex'.\n");
-        exit(1);
+    for (size_t i = 0; i < symbols.count; i++) {
+        print_latest(&prices[i], kind);
     }
 
-    convert_to_upper(symbol);
-    double price;
-    int result = get_latest_trade(symbol, sip, &price); // Modify get_latest_trade to accept and use the sip parameter
-    if (result == 0) {
-        printf("Latest trade price for %s: %.3f\n", symbol, price);
-    } else {
-        printf("Failed to retrieve latest trade price for %s.\n", symbol);
-    }
-    return 0;
+    rest_client_destroy(client);
+    curl_global_cleanup();
+    free(prices);
+    symbol_list_free(&symbols);
+    return failures ? 1 : 0;
 }
@@ -0,0 +1,152 @@
+#include "alpaca_flow.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_FLOW_SYMBOLS 64
+
+void order_flow_init(OrderFlow *flow) {
+    memset(flow, 0, sizeof(*flow));
+    symbol_table_init(&flow->symbols);
+}
+
+void order_flow_free(OrderFlow *flow) {
+    free(flow->by_symbol);
+    symbol_table_free(&flow->symbols);
+    memset(flow, 0, sizeof(*flow));
+}
+
+static FlowSymbol *flow_symbol(OrderFlow *flow, const char *symbol) {
+    int index = symbol ? symbol_table_add(&flow->symbols, symbol) : -1;
+    if (index < 0) {
+        return NULL;
+    }
+    if (flow->symbols.count > flow->capacity) {
+        size_t capacity = flow->capacity ? flow->capacity * 2 : MIN_FLOW_SYMBOLS;
+        while (capacity < flow->symbols.count) {
+            capacity *= 2;
+        }
+        FlowSymbol *by_symbol = (FlowSymbol *)realloc(flow->by_symbol, capacity * sizeof(FlowSymbol));
+        if (!by_symbol) {
+            return NULL;
+        }
+        memset(by_symbol + flow->capacity, 0, (capacity - flow->capacity) * sizeof(FlowSymbol));
+        flow->by_symbol = by_symbol;
+        flow->capacity = capacity;
+    }
+    return &flow->by_symbol[index];
+}
+
+// Function to replace a symbol's quote and add its contribution to the order flow
+// imbalance (Cont, Kukanov and Stoikov): size added at or above the old bid counts as
+// buying pressure, size leaving it as selling, and the reverse on the ask side.
+void order_flow_quote(OrderFlow *flow, const char *symbol, double bid, double bid_size, double ask, double ask_size) {
+    FlowSymbol *fs = flow_symbol(flow, symbol);
+    if (!fs) {
+        return;
+    }
+    if (bid <= 0 || ask < bid) {
+        // One-sided or crossed: trades are classified by the tick test until a usable quote arrives
+        fs->has_quote = 0;
+        return;
+    }
+    if (fs->has_quote) {
+        double e = 0;
+        if (bid >= fs->bid) {
+            e += bid_size;
+        }
+        if (bid <= fs->bid) {
+            e -= fs->bid_size;
+        }
+        if (ask <= fs->ask) {
+            e -= ask_size;
+        }
+        if (ask >= fs->ask) {
+            e += fs->ask_size;
+        }
+        fs->ofi += e;
+    }
+    fs->bid = bid;
+    fs->ask = ask;
+    fs->bid_size = bid_size;
+    fs->ask_size = ask_size;
+    fs->has_quote = 1;
+}
+
+// Remember the trade price and the direction of the last price change for the tick test
+static void flow_tick(FlowSymbol *fs, double price) {
+    if (fs->last_price > 0 && price != fs->last_price) {
+        fs->last_tick = price > fs->last_price ? TRADE_BUY : TRADE_SELL;
+    }
+    fs->last_price = price;
+}
+
+static void flow_add_volume(FlowSymbol *fs, int side, double size) {
+    if (side == TRADE_BUY) {
+        fs->buy_volume += size;
+        fs->buys++;
+    } else if (side == TRADE_SELL) {
+        fs->sell_volume += size;
+        fs->sells++;
+    } else {
+        fs->unknown_volume += size;
+    }
+}
+
+// Function to classify a trade with the Lee-Ready rule against the symbol's latest
+// quote: above the midpoint is a buy, below it a sell. A trade at the midpoint, or
+// with no usable quote, takes the direction of the last price change (tick test).
+// Adds the trade to the symbol's signed volume and returns its side.
+int order_flow_trade(OrderFlow *flow, const char *symbol, double price, double size, SideMethod *method) {
+    FlowSymbol *fs = flow_symbol(flow, symbol);
+    if (method) {
+        *method = SIDE_BY_NONE;
+    }
+    if (!fs || price <= 0) {
+        return TRADE_UNKNOWN;
+    }
+
+    flow_tick(fs, price);
+
+    int side = TRADE_UNKNOWN;
+    SideMethod how = SIDE_BY_NONE;
+    double mid = fs->has_quote ? (fs->bid + fs->ask) / 2 : 0;
+    if (fs->has_quote && price != mid) {
+        side = price > mid ? TRADE_BUY : TRADE_SELL;
+        how = SIDE_BY_QUOTE;
+    } else if (fs->last_tick != 0) {
+        side = fs->last_tick;
+        how = SIDE_BY_TICK;
+    }
+
+    flow_add_volume(fs, side, size);
+    if (method) {
+        *method = how;
+    }
+    return side;
+}
+
+// Function to add a trade whose side was already decided, such as one restored from a
+// checkpoint, to the symbol's signed volume without classifying it again
+void order_flow_add_trade(OrderFlow *flow, const char *symbol, double price, double size, int side) {
+    FlowSymbol *fs = flow_symbol(flow, symbol);
+    if (!fs || price <= 0) {
+        return;
+    }
+    flow_tick(fs, price);
+    flow_add_volume(fs, side, size);
+}
+
+const FlowSymbol *order_flow_symbol(const OrderFlow *flow, const char *symbol) {
+    int index = symbol_table_find(&flow->symbols, symbol);
+    return index < 0 ? NULL : &flow->by_symbol[index];
+}
+
+// Function to compute (buy volume - sell volume) / classified volume, in [-1, 1]
+double order_flow_imbalance(const FlowSymbol *fs) {
+    double total = fs->buy_volume + fs->sell_volume;
+    return total > 0 ? (fs->buy_volume - fs->sell_volume) / total : 0;
+}
+
+const char *trade_side_name(int side) {
+    return side == TRADE_BUY ? "buy" : side == TRADE_SELL ? "sell" : "unknown";
+}
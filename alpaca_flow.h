@@ -0,0 +1,54 @@
+#ifndef ALPACA_FLOW_H
+#define ALPACA_FLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "alpaca_symbol_table.h"
+
+// Trade sides
+#define TRADE_SELL -1
+#define TRADE_UNKNOWN 0
+#define TRADE_BUY 1
+
+// How a trade's side was decided
+typedef enum {
+    SIDE_BY_NONE,       // no quote and no earlier price to compare with
+    SIDE_BY_QUOTE,      // above or below the prevailing quote midpoint
+    SIDE_BY_TICK        // at the midpoint or without a quote: the tick test
+} SideMethod;
+
+// One symbol's latest quote, which each trade is joined against, and its order flow
+// since the start of the session
+typedef struct {
+    double bid;
+    double ask;
+    double bid_size;
+    double ask_size;
+    int has_quote;
+    double last_price;      // price of the previous trade, for the tick test
+    int last_tick;          // direction of the last price change, carried over zero ticks
+    double buy_volume;
+    double sell_volume;
+    double unknown_volume;
+    int64_t buys;
+    int64_t sells;
+    double ofi;             // cumulative order flow imbalance of the quotes
+} FlowSymbol;
+
+typedef struct {
+    SymbolTable symbols;
+    FlowSymbol *by_symbol;  // indexed like symbols
+    size_t capacity;
+} OrderFlow;
+
+void order_flow_init(OrderFlow *flow);
+void order_flow_free(OrderFlow *flow);
+void order_flow_quote(OrderFlow *flow, const char *symbol, double bid, double bid_size, double ask, double ask_size);
+int order_flow_trade(OrderFlow *flow, const char *symbol, double price, double size, SideMethod *method);
+void order_flow_add_trade(OrderFlow *flow, const char *symbol, double price, double size, int side);
+const FlowSymbol *order_flow_symbol(const OrderFlow *flow, const char *symbol);
+double order_flow_imbalance(const FlowSymbol *fs);
+const char *trade_side_name(int side);
+
+#endif // ALPACA_FLOW_H
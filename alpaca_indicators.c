@@ -0,0 +1,840 @@
+#include "alpaca_indicators.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The AVX2 kernels are compiled with a target attribute, so the rest of the library
+// keeps the default flags and the choice is made at run time from the CPU.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define INDICATOR_HAVE_AVX2 1
+#include <immintrin.h>
+#define AVX2_FUNC __attribute__((target("avx2")))
+#else
+#define INDICATOR_HAVE_AVX2 0
+#endif
+
+static int simd_mode = -1;      // -1 until the CPU has been checked
+
+static int use_avx2(void) {
+    if (simd_mode < 0) {
+#if INDICATOR_HAVE_AVX2
+        __builtin_cpu_init();
+        simd_mode = __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+        simd_mode = 0;
+#endif
+    }
+    return simd_mode;
+}
+
+// Function to turn the AVX2 kernels off (0) or back on where the CPU has them (1)
+void indicator_set_simd(int enabled) {
+    simd_mode = -1;
+    if (!enabled) {
+        simd_mode = 0;
+    }
+}
+
+const char *indicator_simd_name(void) {
+    return use_avx2() ? "avx2" : "scalar";
+}
+
+static void fill_nan(double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = NAN;
+    }
+}
+
+// RSI from average gain and loss; 50 when nothing moved
+static double rsi_value(double avg_gain, double avg_loss) {
+    double total = avg_gain + avg_loss;
+    return total > 0 ? 100.0 * avg_gain / total : 50.0;
+}
+
+// Standard deviation from the shifted mean square and mean of a window. The sums
+// carry rounding of the order of the prices squared, so a flat window comes out
+// at a few 1e-9 of the price instead of 0; anything under FLAT_WINDOW of the
+// price is taken as flat.
+#define FLAT_WINDOW 1e-7
+
+static double window_std(double mean_square, double mu, double shift) {
+    double var = mean_square - mu * mu;
+    double level = (mu + shift) * FLAT_WINDOW;
+    return var > level * level ? sqrt(var) : 0;
+}
+
+static double true_range(double high, double low, double prev_close) {
+    double range = high - low;
+    double up = fabs(high - prev_close);
+    double down = fabs(low - prev_close);
+    if (up > range) {
+        range = up;
+    }
+    return down > range ? down : range;
+}
+
+// The window sums are rebuilt exactly, relative to the newest value, every
+// RESYNC_LENGTH outputs (or every period, if longer) so their rounding cannot
+// build up over a long series
+#define RESYNC_LENGTH 256
+
+static size_t resync_length(size_t period) {
+    return period > RESYNC_LENGTH ? period : RESYNC_LENGTH;
+}
+
+// Function to sum the window x[end - period..end - 1] relative to shift
+static void window_sums(const double *x, size_t end, size_t period, double shift, double *sum, double *sumsq) {
+    double s = 0;
+    double sq = 0;
+    for (size_t j = end - period; j < end; j++) {
+        double y = x[j] - shift;
+        s += y;
+        sq += y * y;
+    }
+    *sum = s;
+    *sumsq = sq;
+}
+
+// Rolling mean and standard deviation for outputs first..end-1, given the sums of
+// the window before first relative to shift
+static void moments_scalar(const double *x, size_t first, size_t end, size_t period, double shift,
+                           double sum, double sumsq, double *mean, double *std) {
+    double inv = 1.0 / (double)period;
+    for (size_t i = first; i < end; i++) {
+        double y = x[i] - shift;
+        double z = x[i - period] - shift;
+        sum += y - z;
+        sumsq += y * y - z * z;
+        double mu = sum * inv;
+        if (mean) {
+            mean[i] = mu + shift;
+        }
+        if (std) {
+            std[i] = window_std(sumsq * inv, mu, shift);
+        }
+    }
+}
+
+#if INDICATOR_HAVE_AVX2
+// Inclusive scan of four lanes: [a, a+b, a+b+c, a+b+c+d]
+AVX2_FUNC static inline __m256d scan4(__m256d v) {
+    __m256d zero = _mm256_setzero_pd();
+    v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, 0x90), zero, 0x1));
+    return _mm256_add_pd(v, _mm256_permute2f128_pd(v, v, 0x08));
+}
+
+// Running sums four values at a time: the scan of each block does not depend on
+// the carry, so the only serial step is one add per block
+AVX2_FUNC static inline __m256d running_sum4(__m256d d, __m256d *carry) {
+    __m256d t = scan4(d);
+    __m256d sum = _mm256_add_pd(t, *carry);
+    *carry = _mm256_add_pd(*carry, _mm256_permute4x64_pd(t, 0xFF));
+    return sum;
+}
+
+// Constants for four steps of y = a * x + b * y, b = 1 - a
+typedef struct {
+    __m256d a;
+    __m256d b;
+    __m256d b2;
+    __m256d b4;
+    __m256d powers;     // b, b^2, b^3, b^4
+} EmaConsts;
+
+AVX2_FUNC static void ema_consts(EmaConsts *k, double a) {
+    double b = 1.0 - a;
+    k->a = _mm256_set1_pd(a);
+    k->b = _mm256_set1_pd(b);
+    k->b2 = _mm256_set1_pd(b * b);
+    k->b4 = _mm256_set1_pd(b * b * b * b);
+    k->powers = _mm256_setr_pd(b, b * b, b * b * b, b * b * b * b);
+}
+
+// Four steps of the recurrence as a scan weighted by powers of b. *y holds the
+// previous value in every lane and is advanced with one multiply-add per block.
+AVX2_FUNC static inline __m256d ema4(__m256d x, __m256d *y, const EmaConsts *k) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d v = _mm256_mul_pd(k->a, x);
+    v = _mm256_add_pd(v, _mm256_mul_pd(k->b, _mm256_blend_pd(_mm256_permute4x64_pd(v, 0x90), zero, 0x1)));
+    v = _mm256_add_pd(v, _mm256_mul_pd(k->b2, _mm256_permute2f128_pd(v, v, 0x08)));
+    __m256d out = _mm256_add_pd(v, _mm256_mul_pd(k->powers, *y));
+    *y = _mm256_add_pd(_mm256_permute4x64_pd(v, 0xFF), _mm256_mul_pd(k->b4, *y));
+    return out;
+}
+
+// out[i] = a * x[i] + (1 - a) * out[i - 1], starting from y; returns the last value
+AVX2_FUNC static double ema_avx2(const double *x, size_t n, double a, double y, double *out) {
+    EmaConsts k;
+    ema_consts(&k, a);
+    __m256d c = _mm256_set1_pd(y);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, ema4(_mm256_loadu_pd(x + i), &c, &k));
+    }
+    y = _mm256_cvtsd_f64(c);
+    for (; i < n; i++) {
+        y = a * x[i] + (1.0 - a) * y;
+        out[i] = y;
+    }
+    return y;
+}
+
+// SMA from index period on, given the sum of the first window
+AVX2_FUNC static void sma_avx2(const double *x, size_t n, size_t period, double sum, double *out) {
+    double inv = 1.0 / (double)period;
+    __m256d vinv = _mm256_set1_pd(inv);
+    __m256d c = _mm256_set1_pd(sum);
+    size_t i = period;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(x + i - period));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(running_sum4(d, &c), vinv));
+    }
+    sum = _mm256_cvtsd_f64(c);
+    for (; i < n; i++) {
+        sum += x[i] - x[i - period];
+        out[i] = sum * inv;
+    }
+}
+
+// Rolling mean and standard deviation for outputs first..end-1, given the sums of
+// the window before first relative to shift
+AVX2_FUNC static void moments_avx2(const double *x, size_t first, size_t end, size_t period, double shift,
+                                   double sum, double sumsq, double *mean, double *std) {
+    double inv = 1.0 / (double)period;
+    __m256d vinv = _mm256_set1_pd(inv);
+    __m256d vs = _mm256_set1_pd(shift);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d c1 = _mm256_set1_pd(sum);
+    __m256d c2 = _mm256_set1_pd(sumsq);
+    __m256d flat = _mm256_set1_pd(FLAT_WINDOW);
+    size_t i = first;
+    for (; i + 4 <= end; i += 4) {
+        __m256d y = _mm256_sub_pd(_mm256_loadu_pd(x + i), vs);
+        __m256d z = _mm256_sub_pd(_mm256_loadu_pd(x + i - period), vs);
+        __m256d s1 = running_sum4(_mm256_sub_pd(y, z), &c1);
+        __m256d s2 = running_sum4(_mm256_sub_pd(_mm256_mul_pd(y, y), _mm256_mul_pd(z, z)), &c2);
+        __m256d mu = _mm256_mul_pd(s1, vinv);
+        __m256d var = _mm256_sub_pd(_mm256_mul_pd(s2, vinv), _mm256_mul_pd(mu, mu));
+        __m256d m = _mm256_add_pd(mu, vs);
+        if (mean) {
+            _mm256_storeu_pd(mean + i, m);
+        }
+        if (std) {
+            __m256d level = _mm256_mul_pd(m, flat);
+            __m256d moved = _mm256_cmp_pd(var, _mm256_mul_pd(level, level), _CMP_GT_OQ);
+            _mm256_storeu_pd(std + i, _mm256_and_pd(_mm256_sqrt_pd(_mm256_max_pd(var, zero)), moved));
+        }
+    }
+    moments_scalar(x, i, end, period, shift, _mm256_cvtsd_f64(c1), _mm256_cvtsd_f64(c2), mean, std);
+}
+
+// Wilder-smoothed gains and losses from index period + 1 on
+AVX2_FUNC static void rsi_avx2(const double *x, size_t n, size_t period, double avg_gain, double avg_loss, double *out) {
+    double a = 1.0 / (double)period;
+    EmaConsts k;
+    ema_consts(&k, a);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d hundred = _mm256_set1_pd(100.0);
+    __m256d fifty = _mm256_set1_pd(50.0);
+    __m256d cg = _mm256_set1_pd(avg_gain);
+    __m256d cl = _mm256_set1_pd(avg_loss);
+    size_t i = period + 1;
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(x + i - 1));
+        __m256d g = ema4(_mm256_max_pd(d, zero), &cg, &k);
+        __m256d l = ema4(_mm256_max_pd(_mm256_sub_pd(zero, d), zero), &cl, &k);
+        __m256d total = _mm256_add_pd(g, l);
+        __m256d rsi = _mm256_div_pd(_mm256_mul_pd(hundred, g), total);
+        _mm256_storeu_pd(out + i, _mm256_blendv_pd(fifty, rsi, _mm256_cmp_pd(total, zero, _CMP_GT_OQ)));
+    }
+    avg_gain = _mm256_cvtsd_f64(cg);
+    avg_loss = _mm256_cvtsd_f64(cl);
+    for (; i < n; i++) {
+        double d = x[i] - x[i - 1];
+        avg_gain = a * (d > 0 ? d : 0) + (1.0 - a) * avg_gain;
+        avg_loss = a * (d < 0 ? -d : 0) + (1.0 - a) * avg_loss;
+        out[i] = rsi_value(avg_gain, avg_loss);
+    }
+}
+
+// Wilder-smoothed true range from index period on
+AVX2_FUNC static void atr_avx2(const double *high, const double *low, const double *close, size_t n, size_t period,
+                               double atr, double *out) {
+    double a = 1.0 / (double)period;
+    EmaConsts k;
+    ema_consts(&k, a);
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d c = _mm256_set1_pd(atr);
+    size_t i = period;
+    for (; i + 4 <= n; i += 4) {
+        __m256d h = _mm256_loadu_pd(high + i);
+        __m256d l = _mm256_loadu_pd(low + i);
+        __m256d prev = _mm256_loadu_pd(close + i - 1);
+        __m256d range = _mm256_sub_pd(h, l);
+        __m256d up = _mm256_andnot_pd(sign, _mm256_sub_pd(h, prev));
+        __m256d down = _mm256_andnot_pd(sign, _mm256_sub_pd(l, prev));
+        __m256d tr = _mm256_max_pd(_mm256_max_pd(range, up), down);
+        _mm256_storeu_pd(out + i, ema4(tr, &c, &k));
+    }
+    atr = _mm256_cvtsd_f64(c);
+    for (; i < n; i++) {
+        atr = a * true_range(high[i], low[i], close[i - 1]) + (1.0 - a) * atr;
+        out[i] = atr;
+    }
+}
+
+AVX2_FUNC static void vwap_avx2(const double *price, const double *volume, size_t n, double *out) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d nan = _mm256_set1_pd(NAN);
+    __m256d c1 = zero;
+    __m256d c2 = zero;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(volume + i);
+        __m256d pv = running_sum4(_mm256_mul_pd(_mm256_loadu_pd(price + i), v), &c1);
+        __m256d total = running_sum4(v, &c2);
+        __m256d vwap = _mm256_div_pd(pv, total);
+        _mm256_storeu_pd(out + i, _mm256_blendv_pd(nan, vwap, _mm256_cmp_pd(total, zero, _CMP_GT_OQ)));
+    }
+    double sum_pv = _mm256_cvtsd_f64(c1);
+    double sum_v = _mm256_cvtsd_f64(c2);
+    for (; i < n; i++) {
+        sum_pv += price[i] * volume[i];
+        sum_v += volume[i];
+        out[i] = sum_v > 0 ? sum_pv / sum_v : NAN;
+    }
+}
+
+// out[i] = max(suffix[i - period + 1], prefix[i]) or the min of the two
+AVX2_FUNC static void combine_extreme_avx2(const double *suffix, const double *prefix, size_t n, size_t period, int is_max, double *out) {
+    size_t i = period - 1;
+    for (; i + 4 <= n; i += 4) {
+        __m256d s = _mm256_loadu_pd(suffix + i - period + 1);
+        __m256d p = _mm256_loadu_pd(prefix + i);
+        _mm256_storeu_pd(out + i, is_max ? _mm256_max_pd(s, p) : _mm256_min_pd(s, p));
+    }
+    for (; i < n; i++) {
+        double s = suffix[i - period + 1];
+        double p = prefix[i];
+        out[i] = is_max ? (s > p ? s : p) : (s < p ? s : p);
+    }
+}
+#endif
+
+// Function to compute the simple moving average of x over period values
+int indicator_sma(const double *x, size_t n, size_t period, double *out) {
+    if (period == 0) {
+        return -1;
+    }
+    if (n < period) {
+        fill_nan(out, n);
+        return 0;
+    }
+
+    double sum = 0;
+    for (size_t i = 0; i < period; i++) {
+        sum += x[i];
+        out[i] = NAN;
+    }
+    double inv = 1.0 / (double)period;
+    out[period - 1] = sum * inv;
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        sma_avx2(x, n, period, sum, out);
+        return 0;
+    }
+#endif
+    for (size_t i = period; i < n; i++) {
+        sum += x[i] - x[i - period];
+        out[i] = sum * inv;
+    }
+    return 0;
+}
+
+// Function to compute an exponential moving average seeded with the first SMA
+int indicator_ema(const double *x, size_t n, size_t period, double *out) {
+    if (period == 0) {
+        return -1;
+    }
+    if (n < period) {
+        fill_nan(out, n);
+        return 0;
+    }
+
+    double a = 2.0 / ((double)period + 1.0);
+    double y = 0;
+    for (size_t i = 0; i < period; i++) {
+        y += x[i];
+        out[i] = NAN;
+    }
+    y /= (double)period;
+    out[period - 1] = y;
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        ema_avx2(x + period, n - period, a, y, out + period);
+        return 0;
+    }
+#endif
+    for (size_t i = period; i < n; i++) {
+        y = a * x[i] + (1.0 - a) * y;
+        out[i] = y;
+    }
+    return 0;
+}
+
+// Function to compute the rolling mean and population standard deviation
+int indicator_rolling_std(const double *x, size_t n, size_t period, double *mean, double *std) {
+    if (period == 0) {
+        return -1;
+    }
+    if (mean) {
+        fill_nan(mean, n);
+    }
+    if (std) {
+        fill_nan(std, n);
+    }
+    if (n < period) {
+        return 0;
+    }
+    if (period == 1) {
+        // A one-value window: skip the running sums, whose rounding would show
+        for (size_t i = 0; i < n; i++) {
+            if (mean) {
+                mean[i] = x[i];
+            }
+            if (std) {
+                std[i] = 0;
+            }
+        }
+        return 0;
+    }
+
+    double inv = 1.0 / (double)period;
+    size_t chunk = resync_length(period);
+    for (size_t start = period - 1; start < n; start += chunk) {
+        size_t end = n - start > chunk ? start + chunk : n;
+        double shift = x[start];
+        double sum;
+        double sumsq;
+        window_sums(x, start + 1, period, shift, &sum, &sumsq);
+        double mu = sum * inv;
+        if (mean) {
+            mean[start] = mu + shift;
+        }
+        if (std) {
+            std[start] = window_std(sumsq * inv, mu, shift);
+        }
+#if INDICATOR_HAVE_AVX2
+        if (use_avx2()) {
+            moments_avx2(x, start + 1, end, period, shift, sum, sumsq, mean, std);
+            continue;
+        }
+#endif
+        moments_scalar(x, start + 1, end, period, shift, sum, sumsq, mean, std);
+    }
+    return 0;
+}
+
+int indicator_bollinger(const double *x, size_t n, size_t period, double k, double *middle, double *upper, double *lower) {
+    if (indicator_rolling_std(x, n, period, middle, upper) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        double width = k * upper[i];
+        upper[i] = middle[i] + width;
+        lower[i] = middle[i] - width;
+    }
+    return 0;
+}
+
+// Function to compute Wilder's RSI: average gain and loss over the first period
+// changes, then smoothed with alpha = 1 / period
+int indicator_rsi(const double *x, size_t n, size_t period, double *out) {
+    if (period == 0) {
+        return -1;
+    }
+    fill_nan(out, n < period ? n : period);
+    if (n <= period) {
+        return 0;
+    }
+
+    double avg_gain = 0;
+    double avg_loss = 0;
+    for (size_t i = 1; i <= period; i++) {
+        double d = x[i] - x[i - 1];
+        avg_gain += d > 0 ? d : 0;
+        avg_loss += d < 0 ? -d : 0;
+    }
+    avg_gain /= (double)period;
+    avg_loss /= (double)period;
+    out[period] = rsi_value(avg_gain, avg_loss);
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        rsi_avx2(x, n, period, avg_gain, avg_loss, out);
+        return 0;
+    }
+#endif
+    double a = 1.0 / (double)period;
+    for (size_t i = period + 1; i < n; i++) {
+        double d = x[i] - x[i - 1];
+        avg_gain = a * (d > 0 ? d : 0) + (1.0 - a) * avg_gain;
+        avg_loss = a * (d < 0 ? -d : 0) + (1.0 - a) * avg_loss;
+        out[i] = rsi_value(avg_gain, avg_loss);
+    }
+    return 0;
+}
+
+// Function to compute the running VWAP; NAN until some volume has traded
+int indicator_vwap(const double *price, const double *volume, size_t n, double *out) {
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        vwap_avx2(price, volume, n, out);
+        return 0;
+    }
+#endif
+    double sum_pv = 0;
+    double sum_v = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum_pv += price[i] * volume[i];
+        sum_v += volume[i];
+        out[i] = sum_v > 0 ? sum_pv / sum_v : NAN;
+    }
+    return 0;
+}
+
+// Function to compute Wilder's ATR: the mean true range of the first period bars,
+// then smoothed with alpha = 1 / period. The first bar's true range is high - low.
+int indicator_atr(const double *high, const double *low, const double *close, size_t n, size_t period, double *out) {
+    if (period == 0) {
+        return -1;
+    }
+    if (n < period) {
+        fill_nan(out, n);
+        return 0;
+    }
+
+    double atr = 0;
+    for (size_t i = 0; i < period; i++) {
+        atr += i == 0 ? high[0] - low[0] : true_range(high[i], low[i], close[i - 1]);
+        out[i] = NAN;
+    }
+    atr /= (double)period;
+    out[period - 1] = atr;
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        atr_avx2(high, low, close, n, period, atr, out);
+        return 0;
+    }
+#endif
+    double a = 1.0 / (double)period;
+    for (size_t i = period; i < n; i++) {
+        atr = a * true_range(high[i], low[i], close[i - 1]) + (1.0 - a) * atr;
+        out[i] = atr;
+    }
+    return 0;
+}
+
+// Sliding window extreme with a monotonic queue of positions (scalar path)
+static void rolling_extreme_scalar(const double *x, size_t n, size_t period, int is_max, size_t *queue, double *out) {
+    size_t head = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (count > 0 && queue[head] + period <= i) {
+            head = (head + 1) % period;
+            count--;
+        }
+        while (count > 0) {
+            double back = x[queue[(head + count - 1) % period]];
+            if (is_max ? back > x[i] : back < x[i]) {
+                break;
+            }
+            count--;
+        }
+        queue[(head + count) % period] = i;
+        count++;
+        out[i] = i + 1 >= period ? x[queue[head]] : NAN;
+    }
+}
+
+#if INDICATOR_HAVE_AVX2
+// van Herk/Gil-Werman: extremes from each block start (prefix) and to each block
+// end (suffix), then one vector min/max per output
+static void rolling_extreme_blocks(const double *x, size_t n, size_t period, int is_max, double *prefix, double *suffix, double *out) {
+    for (size_t i = 0; i < n; i++) {
+        double v = x[i];
+        if (i % period != 0 && (is_max ? prefix[i - 1] > v : prefix[i - 1] < v)) {
+            v = prefix[i - 1];
+        }
+        prefix[i] = v;
+    }
+    for (size_t i = n; i-- > 0;) {
+        double v = x[i];
+        if (i % period != period - 1 && i + 1 < n && (is_max ? suffix[i + 1] > v : suffix[i + 1] < v)) {
+            v = suffix[i + 1];
+        }
+        suffix[i] = v;
+    }
+    fill_nan(out, period - 1);
+    combine_extreme_avx2(suffix, prefix, n, period, is_max, out);
+}
+#endif
+
+// Function to compute the rolling minimum and maximum over period values
+int indicator_rolling_min_max(const double *x, size_t n, size_t period, double *min_out, double *max_out) {
+    if (period == 0) {
+        return -1;
+    }
+    if (n < period) {
+        if (min_out) {
+            fill_nan(min_out, n);
+        }
+        if (max_out) {
+            fill_nan(max_out, n);
+        }
+        return 0;
+    }
+#if INDICATOR_HAVE_AVX2
+    if (use_avx2()) {
+        double *scratch = (double *)malloc(2 * n * sizeof(double));
+        if (!scratch) {
+            return -1;
+        }
+        if (min_out) {
+            rolling_extreme_blocks(x, n, period, 0, scratch, scratch + n, min_out);
+        }
+        if (max_out) {
+            rolling_extreme_blocks(x, n, period, 1, scratch, scratch + n, max_out);
+        }
+        free(scratch);
+        return 0;
+    }
+#endif
+    size_t *queue = (size_t *)malloc(period * sizeof(size_t));
+    if (!queue) {
+        return -1;
+    }
+    if (min_out) {
+        rolling_extreme_scalar(x, n, period, 0, queue, min_out);
+    }
+    if (max_out) {
+        rolling_extreme_scalar(x, n, period, 1, queue, max_out);
+    }
+    free(queue);
+    return 0;
+}
+
+int rolling_stream_init(RollingStream *stream, size_t period) {
+    memset(stream, 0, sizeof(*stream));
+    if (period == 0) {
+        return -1;
+    }
+    stream->window = (double *)calloc(period, sizeof(double));
+    if (!stream->window) {
+        return -1;
+    }
+    stream->period = period;
+    return 0;
+}
+
+// Function to add one value. Returns 1 and sets *mean and *std (either may be NULL)
+// once the window is full, 0 and NAN before that.
+int rolling_stream_update(RollingStream *stream, double x, double *mean, double *std) {
+    if (stream->period == 1) {
+        if (mean) {
+            *mean = x;
+        }
+        if (std) {
+            *std = 0;
+        }
+        return 1;
+    }
+    size_t i = stream->count++;
+    double z = stream->window[stream->pos];
+    stream->window[stream->pos] = x;
+    stream->pos = (stream->pos + 1) % stream->period;
+
+    if (i + 1 < stream->period) {
+        if (mean) {
+            *mean = NAN;
+        }
+        if (std) {
+            *std = NAN;
+        }
+        return 0;
+    }
+    if ((i + 1 - stream->period) % resync_length(stream->period) == 0) {
+        // Same anchors as the batch function: shift to the newest value and
+        // sum the window from its oldest entry
+        stream->shift = x;
+        stream->sum = 0;
+        stream->sumsq = 0;
+        for (size_t j = 0; j < stream->period; j++) {
+            double y = stream->window[(stream->pos + j) % stream->period] - x;
+            stream->sum += y;
+            stream->sumsq += y * y;
+        }
+    } else {
+        double y = x - stream->shift;
+        z -= stream->shift;
+        stream->sum += y - z;
+        stream->sumsq += y * y - z * z;
+    }
+    double inv = 1.0 / (double)stream->period;
+    double mu = stream->sum * inv;
+    if (mean) {
+        *mean = mu + stream->shift;
+    }
+    if (std) {
+        *std = window_std(stream->sumsq * inv, mu, stream->shift);
+    }
+    return 1;
+}
+
+void rolling_stream_free(RollingStream *stream) {
+    free(stream->window);
+    stream->window = NULL;
+}
+
+void ema_stream_init(EmaStream *stream, size_t period) {
+    memset(stream, 0, sizeof(*stream));
+    stream->period = period ? period : 1;
+    stream->alpha = 2.0 / ((double)stream->period + 1.0);
+}
+
+double ema_stream_update(EmaStream *stream, double x) {
+    stream->count++;
+    if (stream->count < stream->period) {
+        stream->value += x;
+        return NAN;
+    }
+    if (stream->count == stream->period) {
+        stream->value = (stream->value + x) / (double)stream->period;
+    } else {
+        stream->value = stream->alpha * x + (1.0 - stream->alpha) * stream->value;
+    }
+    return stream->value;
+}
+
+void rsi_stream_init(RsiStream *stream, size_t period) {
+    memset(stream, 0, sizeof(*stream));
+    stream->period = period ? period : 1;
+}
+
+double rsi_stream_update(RsiStream *stream, double x) {
+    size_t i = stream->count++;
+    double d = i > 0 ? x - stream->prev : 0;
+    double gain = d > 0 ? d : 0;
+    double loss = d < 0 ? -d : 0;
+    stream->prev = x;
+    if (i == 0) {
+        return NAN;
+    }
+    if (i < stream->period) {
+        stream->avg_gain += gain;
+        stream->avg_loss += loss;
+        return NAN;
+    }
+    if (i == stream->period) {
+        stream->avg_gain = (stream->avg_gain + gain) / (double)stream->period;
+        stream->avg_loss = (stream->avg_loss + loss) / (double)stream->period;
+    } else {
+        double a = 1.0 / (double)stream->period;
+        stream->avg_gain = a * gain + (1.0 - a) * stream->avg_gain;
+        stream->avg_loss = a * loss + (1.0 - a) * stream->avg_loss;
+    }
+    return rsi_value(stream->avg_gain, stream->avg_loss);
+}
+
+void vwap_stream_init(VwapStream *stream) {
+    memset(stream, 0, sizeof(*stream));
+}
+
+double vwap_stream_update(VwapStream *stream, double price, double volume) {
+    stream->pv += price * volume;
+    stream->volume += volume;
+    return stream->volume > 0 ? stream->pv / stream->volume : NAN;
+}
+
+void atr_stream_init(AtrStream *stream, size_t period) {
+    memset(stream, 0, sizeof(*stream));
+    stream->period = period ? period : 1;
+}
+
+double atr_stream_update(AtrStream *stream, double high, double low, double close) {
+    size_t i = stream->count++;
+    double tr = i == 0 ? high - low : true_range(high, low, stream->prev_close);
+    stream->prev_close = close;
+    if (i + 1 < stream->period) {
+        stream->value += tr;
+        return NAN;
+    }
+    if (i + 1 == stream->period) {
+        stream->value = (stream->value + tr) / (double)stream->period;
+    } else {
+        double a = 1.0 / (double)stream->period;
+        stream->value = a * tr + (1.0 - a) * stream->value;
+    }
+    return stream->value;
+}
+
+int min_max_stream_init(MinMaxStream *stream, size_t period) {
+    memset(stream, 0, sizeof(*stream));
+    if (period == 0) {
+        return -1;
+    }
+    stream->window = (double *)calloc(period, sizeof(double));
+    stream->min_queue = (size_t *)calloc(period, sizeof(size_t));
+    stream->max_queue = (size_t *)calloc(period, sizeof(size_t));
+    if (!stream->window || !stream->min_queue || !stream->max_queue) {
+        min_max_stream_free(stream);
+        return -1;
+    }
+    stream->period = period;
+    return 0;
+}
+
+// Drop the position that left the window, then push position t onto a monotonic queue
+static void min_max_queue_push(const MinMaxStream *stream, size_t *queue, size_t *head, size_t *count, int is_max) {
+    size_t period = stream->period;
+    double x = stream->window[stream->t % period];
+    if (*count > 0 && queue[*head] + period <= stream->t) {
+        *head = (*head + 1) % period;
+        (*count)--;
+    }
+    while (*count > 0) {
+        double back = stream->window[queue[(*head + *count - 1) % period] % period];
+        if (is_max ? back > x : back < x) {
+            break;
+        }
+        (*count)--;
+    }
+    queue[(*head + *count) % period] = stream->t;
+    (*count)++;
+}
+
+// Function to add one value. Returns 1 and sets *min and *max (either may be NULL)
+// once the window is full, 0 and NAN before that.
+int min_max_stream_update(MinMaxStream *stream, double x, double *min, double *max) {
+    size_t period = stream->period;
+    stream->window[stream->t % period] = x;
+    min_max_queue_push(stream, stream->min_queue, &stream->min_head, &stream->min_count, 0);
+    min_max_queue_push(stream, stream->max_queue, &stream->max_head, &stream->max_count, 1);
+    int full = stream->t + 1 >= period;
+    if (min) {
+        *min = full ? stream->window[stream->min_queue[stream->min_head] % period] : NAN;
+    }
+    if (max) {
+        *max = full ? stream->window[stream->max_queue[stream->max_head] % period] : NAN;
+    }
+    stream->t++;
+    return full;
+}
+
+void min_max_stream_free(MinMaxStream *stream) {
+    free(stream->window);
+    free(stream->min_queue);
+    free(stream->max_queue);
+    stream->window = NULL;
+    stream->min_queue = NULL;
+    stream->max_queue = NULL;
+}
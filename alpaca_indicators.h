@@ -0,0 +1,112 @@
+#ifndef ALPACA_INDICATORS_H
+#define ALPACA_INDICATORS_H
+
+#include <stddef.h>
+
+// Technical indicators over contiguous double arrays, such as the ones returned by
+// the extract_*_prices_by_symbol functions or the columns of a BarArray.
+//
+// Batch functions fill out[0..n-1] and put NAN where the window is not full yet;
+// they return 0, or -1 if period is 0 (or memory ran out). On x86 CPUs with AVX2
+// the kernels run four values per instruction; elsewhere, or after
+// indicator_set_simd(0), the scalar code runs. Both give the same results up to
+// rounding.
+//
+// Streaming forms take one value at a time and return what the batch function
+// would have put at that position.
+
+void indicator_set_simd(int enabled);
+const char *indicator_simd_name(void);
+
+// Simple moving average
+int indicator_sma(const double *x, size_t n, size_t period, double *out);
+// Exponential moving average, alpha = 2 / (period + 1), seeded with the SMA of the
+// first period values
+int indicator_ema(const double *x, size_t n, size_t period, double *out);
+// Rolling mean and population standard deviation; either output may be NULL
+int indicator_rolling_std(const double *x, size_t n, size_t period, double *mean, double *std);
+// Bollinger bands: middle = SMA, upper/lower = middle +/- k standard deviations
+int indicator_bollinger(const double *x, size_t n, size_t period, double k, double *middle, double *upper, double *lower);
+// Wilder's RSI, 0 to 100; the first value is at index period
+int indicator_rsi(const double *x, size_t n, size_t period, double *out);
+// Cumulative volume-weighted average price from the start of the arrays
+int indicator_vwap(const double *price, const double *volume, size_t n, double *out);
+// Wilder's average true range
+int indicator_atr(const double *high, const double *low, const double *close, size_t n, size_t period, double *out);
+// Rolling minimum and maximum; either output may be NULL
+int indicator_rolling_min_max(const double *x, size_t n, size_t period, double *min_out, double *max_out);
+
+// Window sums for SMA, standard deviation and Bollinger bands. The sums are kept
+// relative to a recent value, which keeps the sum of squares accurate, and are
+// rebuilt from the window at the same points as indicator_rolling_std.
+typedef struct {
+    size_t period;
+    double *window;
+    size_t pos;
+    size_t count;
+    double shift;
+    double sum;
+    double sumsq;
+} RollingStream;
+
+int rolling_stream_init(RollingStream *stream, size_t period);
+int rolling_stream_update(RollingStream *stream, double x, double *mean, double *std);
+void rolling_stream_free(RollingStream *stream);
+
+typedef struct {
+    size_t period;
+    double alpha;
+    size_t count;
+    double value;
+} EmaStream;
+
+void ema_stream_init(EmaStream *stream, size_t period);
+double ema_stream_update(EmaStream *stream, double x);
+
+typedef struct {
+    size_t period;
+    size_t count;
+    double prev;
+    double avg_gain;
+    double avg_loss;
+} RsiStream;
+
+void rsi_stream_init(RsiStream *stream, size_t period);
+double rsi_stream_update(RsiStream *stream, double x);
+
+typedef struct {
+    double pv;
+    double volume;
+} VwapStream;
+
+void vwap_stream_init(VwapStream *stream);
+double vwap_stream_update(VwapStream *stream, double price, double volume);
+
+typedef struct {
+    size_t period;
+    size_t count;
+    double prev_close;
+    double value;
+} AtrStream;
+
+void atr_stream_init(AtrStream *stream, size_t period);
+double atr_stream_update(AtrStream *stream, double high, double low, double close);
+
+// Rolling minimum and maximum with monotonic queues of positions in window
+typedef struct {
+    size_t period;
+    size_t t;
+    double *window;
+    size_t *min_queue;
+    size_t *max_queue;
+    size_t min_head;
+    size_t min_count;
+    size_t max_head;
+    size_t max_count;
+} MinMaxStream;
+
+int min_max_stream_init(MinMaxStream *stream, size_t period);
+int min_max_stream_update(MinMaxStream *stream, double x, double *min, double *max);
+void min_max_stream_free(MinMaxStream *stream);
+
+#endif // ALPACA_INDICATORS_H
@@ -0,0 +1,216 @@
+#include "alpaca_latest.h"
+#include "alpaca_bars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <jansson.h>
+
+static int symbol_list_push(SymbolList *list, const char *symbol) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **ptr = (char **)realloc(list->symbols, capacity * sizeof(char *));
+        if (!ptr) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        list->symbols = ptr;
+        list->capacity = capacity;
+    }
+    char *copy = strdup(symbol);
+    if (!copy) {
+        return -1;
+    }
+    for (char *c = copy; *c; c++) {
+        *c = toupper((unsigned char)*c);
+    }
+    list->symbols[list->count++] = copy;
+    return 0;
+}
+
+// Symbols become parts of URLs and output file names, so only letters, digits and
+// dots (BRK.B) are accepted, starting with a letter or digit
+int symbol_is_valid(const char *symbol) {
+    if (!isalnum((unsigned char)symbol[0])) {
+        return 0;
+    }
+    for (const char *c = symbol; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '.') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to add the symbols in a comma or whitespace separated string
+int symbol_list_add(SymbolList *list, const char *text) {
+    char *copy = strdup(text);
+    if (!copy) {
+        return -1;
+    }
+
+    int result = 0;
+    char *saveptr;
+    for (char *token = strtok_r(copy, ", \t\r\n", &saveptr); token; token = strtok_r(NULL, ", \t\r\n", &saveptr)) {
+        if (strlen(token) >= SYMBOL_SIZE) {
+            fprintf(stderr, "Skipping symbol '%s': too long.\n", token);
+            continue;
+        }
+        if (!symbol_is_valid(token)) {
+            fprintf(stderr, "Skipping symbol '%s': only letters, digits and '.' are allowed.\n", token);
+            continue;
+        }
+        if (symbol_list_push(list, token) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(copy);
+    return result;
+}
+
+// Function to add the symbols listed in a file ("-" for stdin). Text after '#' is ignored.
+int symbol_list_read_file(SymbolList *list, const char *path) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        perror("Error opening symbol file");
+        return -1;
+    }
+
+    char line[1024];
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), fp)) {
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        result = symbol_list_add(list, line);
+    }
+
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return result;
+}
+
+void symbol_list_free(SymbolList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->symbols[i]);
+    }
+    free(list->symbols);
+    list->symbols = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static double json_number_or(json_t *value, double fallback) {
+    return json_is_number(value) ? json_number_value(value) : fallback;
+}
+
+static void parse_latest_trade(json_t *trade, LatestPrice *price) {
+    if (!json_is_object(trade) || !json_is_number(json_object_get(trade, "p"))) {
+        return;
+    }
+    price->has_trade = 1;
+    price->price = json_number_value(json_object_get(trade, "p"));
+    price->size = json_number_or(json_object_get(trade, "s"), 0);
+    price->trade_time = parse_rfc3339(json_string_value(json_object_get(trade, "t")));
+}
+
+static void parse_latest_quote(json_t *quote, LatestPrice *price) {
+    if (!json_is_object(quote)) {
+        return;
+    }
+    price->has_quote = 1;
+    price->bid = json_number_or(json_object_get(quote, "bp"), 0);
+    price->ask = json_number_or(json_object_get(quote, "ap"), 0);
+    price->bid_size = json_number_or(json_object_get(quote, "bs"), 0);
+    price->ask_size = json_number_or(json_object_get(quote, "as"), 0);
+    price->quote_time = parse_rfc3339(json_string_value(json_object_get(quote, "t")));
+}
+
+// Fill prices[0..count) from one multi-symbol response
+static int parse_latest_response(const char *data, size_t len, LatestKind kind, LatestPrice *prices, size_t count) {
+    json_error_t error;
+    json_t *root = json_loadb(data, len, 0, &error);
+    if (!root) {
+        fprintf(stderr, "error: on line %d: %s\n", error.line, error.text);
+        return -1;
+    }
+
+    // Latest trades and quotes are keyed by symbol under "trades"/"quotes";
+    // snapshots are keyed by symbol at the top level
+    json_t *by_symbol = root;
+    if (kind == LATEST_TRADE) {
+        by_symbol = json_object_get(root, "trades");
+    } else if (kind == LATEST_QUOTE) {
+        by_symbol = json_object_get(root, "quotes");
+    }
+    if (!json_is_object(by_symbol)) {
+        json_decref(root);
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        json_t *item = json_object_get(by_symbol, prices[i].symbol);
+        if (!json_is_object(item)) {
+            continue;
+        }
+        if (kind == LATEST_TRADE) {
+            parse_latest_trade(item, &prices[i]);
+        } else if (kind == LATEST_QUOTE) {
+            parse_latest_quote(item, &prices[i]);
+        } else {
+            parse_latest_trade(json_object_get(item, "latestTrade"), &prices[i]);
+            parse_latest_quote(json_object_get(item, "latestQuote"), &prices[i]);
+            json_t *prev = json_object_get(json_object_get(item, "prevDailyBar"), "c");
+            if (json_is_number(prev)) {
+                prices[i].has_prev_close = 1;
+                prices[i].prev_close = json_number_value(prev);
+            }
+        }
+    }
+
+    json_decref(root);
+    return 0;
+}
+
+// Function to look up the latest trade, quote or snapshot of every symbol in
+// prices[] (symbol filled in by the caller) with batch_size symbols per request,
+// all over the client's one connection. Returns the number of failed requests.
+int fetch_latest_prices(RestClient *client, const char *feed, LatestKind kind, LatestPrice *prices, size_t count, size_t batch_size) {
+    static const char *paths[] = { "trades/latest", "quotes/latest", "snapshots" };
+    if (batch_size == 0) {
+        batch_size = LATEST_DEFAULT_BATCH;
+    }
+
+    size_t url_size = 256 + batch_size * SYMBOL_SIZE;
+    char *url = (char *)malloc(url_size);
+    if (!url) {
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t first = 0; first < count; first += batch_size) {
+        size_t n = count - first < batch_size ? count - first : batch_size;
+
+        int len = snprintf(url, url_size, "%s/v2/stocks/%s?feed=%s&symbols=", rest_data_url(), paths[kind], feed);
+        for (size_t i = 0; i < n && len > 0 && (size_t)len < url_size; i++) {
+            len += snprintf(url + len, url_size - len, "%s%s", i ? "," : "", prices[first + i].symbol);
+        }
+
+        size_t body_len = 0;
+        const char *body = rest_client_get(client, url, &body_len);
+        if (body == NULL || !rest_client_ok(client)) {
+            fprintf(stderr, "Error fetching latest prices: %s\n", rest_client_error(client));
+            failures++;
+            continue;
+        }
+        if (parse_latest_response(body, body_len, kind, prices + first, n) != 0) {
+            failures++;
+        }
+    }
+
+    free(url);
+    return failures;
+}
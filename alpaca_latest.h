@@ -0,0 +1,49 @@
+#ifndef ALPACA_LATEST_H
+#define ALPACA_LATEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_rest.h"
+#include "alpaca_symbol_table.h"
+
+#define LATEST_DEFAULT_BATCH 200   // symbols per latest/snapshot request
+
+// Growable list of upper-case ticker symbols
+typedef struct {
+    char **symbols;
+    size_t count;
+    size_t capacity;
+} SymbolList;
+
+// Which multi-symbol endpoint to query
+typedef enum {
+    LATEST_TRADE,       // /v2/stocks/trades/latest
+    LATEST_QUOTE,       // /v2/stocks/quotes/latest
+    LATEST_SNAPSHOT     // /v2/stocks/snapshots: trade, quote and previous close together
+} LatestKind;
+
+// Most recent trade and quote known for one symbol
+typedef struct {
+    char symbol[SYMBOL_SIZE];
+    int has_trade;
+    int has_quote;
+    int has_prev_close;
+    double price;
+    double size;
+    int64_t trade_time;     // seconds since 1970 UTC
+    double bid;
+    double ask;
+    double bid_size;
+    double ask_size;
+    int64_t quote_time;
+    double prev_close;
+} LatestPrice;
+
+int symbol_is_valid(const char *symbol);
+int symbol_list_add(SymbolList *list, const char *text);
+int symbol_list_read_file(SymbolList *list, const char *path);
+void symbol_list_free(SymbolList *list);
+
+int fetch_latest_prices(RestClient *client, const char *feed, LatestKind kind, LatestPrice *prices, size_t count, size_t batch_size);
+
+#endif // ALPACA_LATEST_H
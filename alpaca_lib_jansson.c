@@ -1,4 +1,5 @@
 #include "alpaca_lib_jansson.h"
+#include "alpaca_bars.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,213 +10,263 @@
 #include <ctype.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define MAX_STORED_BARS 1000
 #define MAX_STORED_TRADES 1000
 #define MAX_STORED_QUOTE_PRICES 1000
 
-int interrupted = 0;
+// Checkpoint file layout: a header followed by typed sections of fixed-size records
+#define CHECKPOINT_MAGIC "ALPCKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_SECTION_BARS 1
+#define CHECKPOINT_SECTION_TRADES 2
+#define CHECKPOINT_SECTION_QUOTES 3
+#define CHECKPOINT_SYMBOL_LEN 16
+#define CHECKPOINT_EXCHANGE_LEN 8
+#define CHECKPOINT_TIME_LEN 40
+#define CHECKPOINT_MAX_CONDITIONS 8
+#define CHECKPOINT_CONDITION_LEN 4
+
+// Per-feed state. Everything a connection touches lives here, so several feeds
+// can run side by side in one process with one thread driving each context.
+struct AlpacaContext {
+    volatile sig_atomic_t interrupted;
+    json_t *params;
+    RecordStore bars;
+    RecordStore trades;
+    RecordStore quotes;
+    size_t bars_received;
+    size_t trades_received;
+    size_t quotes_received;
+    MarketRankings *rankings;   // not owned; NULL unless rankings are kept
+    AlertEngine *alerts;        // not owned; NULL unless alerts are checked
+    OrderFlow flow;             // latest quote per symbol, joined with each trade
+    BarBuilder *bar_builder;    // not owned; NULL unless bars are built from trades
+    CorrelationEngine *correlation; // not owned; NULL unless correlations are kept
+};
+
+// Signals are delivered to the whole process, so this is the one flag shared by every context
+static volatile sig_atomic_t signal_received = 0;
+
+static void free_bar(void *record);
+static void free_trade(void *record);
+static void free_quote(void *record);
+static void handle_bar(AlpacaContext *ctx, const char *msg_type, const char *symbol, double open, double high, double low, double close, double vw, int64_t volume, int64_t trades, const char *timestamp_str, int correlate);
+static void handle_built_bar(void *user, const BuiltBar *bar);
+
+// Function to create a context that owns the stores and subscription for one feed
+AlpacaContext *alpaca_context_create(json_t *params) {
+    AlpacaContext *ctx = (AlpacaContext *)calloc(1, sizeof(AlpacaContext));
+    if (!ctx) {
+        return NULL;
+    }
+    ctx->params = json_incref(params);
+    record_store_init(&ctx->bars, sizeof(Bar), free_bar, MAX_STORED_BARS);
+    record_store_init(&ctx->trades, sizeof(Trade), free_trade, MAX_STORED_TRADES);
+    record_store_init(&ctx->quotes, sizeof(Quote), free_quote, MAX_STORED_QUOTE_PRICES);
+    order_flow_init(&ctx->flow);
+    return ctx;
+}
 
-typedef struct Bar {
-    char *symbol;
-    double open;
-    double high;
-    double low;
-    double close;
-    double vw;
-    int volume;
-    int trades;
-    char *timestamp_str;
-    char *local_time_str;
-    double digital_seconds;
-    struct Bar *next;
-} Bar;
+void alpaca_context_destroy(AlpacaContext *ctx) {
+    if (!ctx) {
+        return;
+    }
+    record_store_free(&ctx->bars);
+    record_store_free(&ctx->trades);
+    record_store_free(&ctx->quotes);
+    order_flow_free(&ctx->flow);
+    json_decref(ctx->params);
+    free(ctx);
+}
 
-typedef struct Trade {
-    const char *symbol;
-    long long trade_id;
-    const char *exchange;
-    double price;
-    int size;
-    char **trade_conditions;
-    size_t num_conditions;
-    const char *tape;
-    const char *timestamp_str;
-    const char *local_time_str;
-    double digital_seconds;
-    struct Trade *next;
-} Trade;
+void alpaca_context_set_limits(AlpacaContext *ctx, size_t max_bars, size_t max_trades, size_t max_quotes) {
+    record_store_set_limit(&ctx->bars, max_bars);
+    record_store_set_limit(&ctx->trades, max_trades);
+    record_store_set_limit(&ctx->quotes, max_quotes);
+}
 
-typedef struct Quote {
-    char *symbol;
-    char *bid_exchange;
-    double bid_price;
-    int bid_size;
-    char *ask_exchange;
-    double ask_price;
-    int ask_size;
-    char *timestamp_str;
-    char *local_time_str;
-    double digital_seconds;
-    struct Quote *next;
-} Quote;
-
-Bar *bar_list_head = NULL;
-Trade *trade_list_head = NULL;
-Quote *quote_list_head = NULL;
-
-Bar *create_bar_node(const char *symbol, double open, double high, double low, double close, double vw, int volume, int trades, const char *timestamp_str, const char *local_time_str, double digital_seconds) {
-    Bar *new_node = (Bar *)malloc(sizeof(Bar));
-    new_node->symbol = strdup(symbol);
-    new_node->open = open;
-    new_node->high = high;
-    new_node->low = low;
-    new_node->close = close;
-    new_node->vw = vw;
-    new_node->volume = volume;
-    new_node->trades = trades;
-    new_node->timestamp_str = strdup(timestamp_str);
-    new_node->local_time_str = strdup(local_time_str);
-    new_node->digital_seconds = digital_seconds;
-    new_node->next = NULL;
-    return new_node;
-}
-
-Trade *create_trade_node(const char *symbol, long long trade_id, const char *exchange, double price, int size, json_t *trade_conditions, const char *timestamp_str, const char *local_time_str, double digital_seconds, const char *tape) {
-    Trade *new_node = (Trade *)malloc(sizeof(Trade));
-    new_node->symbol = strdup(symbol);
-    new_node->trade_id = trade_id;
-    new_node->exchange = strdup(exchange);
-    new_node->price = price;
-    new_node->size = size;
+void alpaca_context_get_counts(const AlpacaContext *ctx, size_t *bars, size_t *trades, size_t *quotes) {
+    *bars = ctx->bars_received;
+    *trades = ctx->trades_received;
+    *quotes = ctx->quotes_received;
+}
 
-    size_t num_conditions = json_array_size(trade_conditions);
-    new_node->trade_conditions = (char **)malloc(num_conditions * sizeof(char *));
-    for (size_t i = 0; i < num_conditions; ++i) {
-        new_node->trade_conditions[i] = strdup(json_string_value(json_array_get(trade_conditions, i)));
-    }
-    new_node->num_conditions = num_conditions;
+json_t *alpaca_context_params(const AlpacaContext *ctx) {
+    return ctx->params;
+}
+
+int alpaca_context_interrupted(const AlpacaContext *ctx) {
+    return ctx->interrupted || signal_received;
+}
 
-    new_node->tape = strdup(tape);
-    new_node->timestamp_str = strdup(timestamp_str);
-    new_node->local_time_str = strdup(local_time_str);
-    new_node->digital_seconds = digital_seconds;
-    new_node->next = NULL;
-    return new_node;
+void alpaca_context_interrupt(AlpacaContext *ctx) {
+    ctx->interrupted = 1;
 }
 
-Quote *create_quote_node(const char *symbol, const char *bid_exchange, double bid_price, int bid_size, const char *ask_exchange, double ask_price, int ask_size, const char *timestamp_str, const char *local_time_str, double digital_seconds) {
-    Quote *new_node = (Quote *)malloc(sizeof(Quote));
-    new_node->symbol = strdup(symbol);
-    new_node->bid_exchange = strdup(bid_exchange);
-    new_node->bid_price = bid_price;
-    new_node->bid_size = bid_size;
-    new_node->ask_exchange = strdup(ask_exchange);
-    new_node->ask_price = ask_price;
-    new_node->ask_size = ask_size;
-    new_node->timestamp_str = strdup(timestamp_str);
-    new_node->local_time_str = strdup(local_time_str);
-    new_node->digital_seconds = digital_seconds;
-    new_node->next = NULL;
-    return new_node;
+void alpaca_context_set_rankings(AlpacaContext *ctx, MarketRankings *rankings) {
+    ctx->rankings = rankings;
 }
 
-void insert_bar_node(Bar **head, Bar *new_node) {
-    new_node->next = *head;
-    *head = new_node;
+void alpaca_context_set_alerts(AlpacaContext *ctx, AlertEngine *alerts) {
+    ctx->alerts = alerts;
 }
 
-void insert_trade_node(Trade **head, Trade *new_node) {
-    new_node->next = *head;
-    *head = new_node;
+void alpaca_context_set_bar_builder(AlpacaContext *ctx, BarBuilder *builder) {
+    ctx->bar_builder = builder;
+    builder->on_bar = handle_built_bar;
+    builder->user = ctx;
 }
 
-void insert_quote_node(Quote **head, Quote *new_node) {
-    new_node->next = *head;
-    *head = new_node;
+void alpaca_context_set_correlation(AlpacaContext *ctx, CorrelationEngine *engine) {
+    ctx->correlation = engine;
 }
 
-void remove_oldest_bar(Bar **head) {
-    Bar *current = *head;
-    Bar *prev = NULL;
+const FlowSymbol *alpaca_order_flow(const AlpacaContext *ctx, const char *symbol) {
+    return order_flow_symbol(&ctx->flow, symbol);
+}
 
-    if (current == NULL) {
-        return;
-    }
+// Correlations take one kind of bar, so every return spans the same interval: the
+// bars built from trades when they are time bars, otherwise the bar messages
+static int correlate_built_bars(const AlpacaContext *ctx) {
+    return ctx->bar_builder && ctx->bar_builder->kind == BUILD_TIME;
+}
 
-    while (current->next != NULL) {
-        prev = current;
-        current = current->next;
-    }
+void init_bar(Bar *bar, const char *symbol, double open, double high, double low, double close, double vw, int64_t volume, int64_t trades, const char *timestamp_str, const char *local_time_str, double digital_seconds) {
+    bar->symbol = strdup(symbol);
+    bar->open = open;
+    bar->high = high;
+    bar->low = low;
+    bar->close = close;
+    bar->vw = vw;
+    bar->volume = volume;
+    bar->trades = trades;
+    bar->timestamp_str = strdup(timestamp_str);
+    bar->local_time_str = strdup(local_time_str);
+    bar->digital_seconds = digital_seconds;
+}
 
-    if (prev) {
-        prev->next = NULL;
-    } else {
-        *head = NULL;
+void init_trade(Trade *trade, const char *symbol, long long trade_id, const char *exchange, double price, int size, json_t *trade_conditions, const char *timestamp_str, const char *local_time_str, double digital_seconds, const char *tape) {
+    trade->symbol = strdup(symbol);
+    trade->trade_id = trade_id;
+    trade->exchange = strdup(exchange);
+    trade->price = price;
+    trade->size = size;
+
+    size_t num_conditions = json_array_size(trade_conditions);
+    trade->trade_conditions = (char **)malloc(num_conditions * sizeof(char *));
+    for (size_t i = 0; i < num_conditions; ++i) {
+        trade->trade_conditions[i] = strdup(json_string_value(json_array_get(trade_conditions, i)));
     }
+    trade->num_conditions = num_conditions;
 
-    free(current->symbol);
-    free(current->timestamp_str);
-    free(current->local_time_str);
-    free(current);
+    trade->tape = strdup(tape);
+    trade->timestamp_str = strdup(timestamp_str);
+    trade->local_time_str = strdup(local_time_str);
+    trade->digital_seconds = digital_seconds;
+    trade->side = TRADE_UNKNOWN;
 }
 
-void remove_oldest_trade(Trade **head) {
-    Trade *current = *head;
-    Trade *prev = NULL;
+void init_quote(Quote *quote, const char *symbol, const char *bid_exchange, double bid_price, int bid_size, const char *ask_exchange, double ask_price, int ask_size, const char *timestamp_str, const char *local_time_str, double digital_seconds) {
+    quote->symbol = strdup(symbol);
+    quote->bid_exchange = strdup(bid_exchange);
+    quote->bid_price = bid_price;
+    quote->bid_size = bid_size;
+    quote->ask_exchange = strdup(ask_exchange);
+    quote->ask_price = ask_price;
+    quote->ask_size = ask_size;
+    quote->timestamp_str = strdup(timestamp_str);
+    quote->local_time_str = strdup(local_time_str);
+    quote->digital_seconds = digital_seconds;
+}
 
-    if (current == NULL) {
-        return;
-    }
+static void free_bar(void *record) {
+    Bar *bar = (Bar *)record;
+    free(bar->symbol);
+    free(bar->timestamp_str);
+    free(bar->local_time_str);
+}
 
-    while (current->next != NULL) {
-        prev = current;
-        current = current->next;
+static void free_trade(void *record) {
+    Trade *trade = (Trade *)record;
+    for (size_t i = 0; i < trade->num_conditions; ++i) {
+        free(trade->trade_conditions[i]);
     }
+    free(trade->trade_conditions);
+    free(trade->symbol);
+    free(trade->exchange);
+    free(trade->tape);
+    free(trade->timestamp_str);
+    free(trade->local_time_str);
+}
 
-    if (prev) {
-        prev->next = NULL;
-    } else {
-        *head = NULL;
-    }
+static void free_quote(void *record) {
+    Quote *quote = (Quote *)record;
+    free(quote->symbol);
+    free(quote->bid_exchange);
+    free(quote->ask_exchange);
+    free(quote->timestamp_str);
+    free(quote->local_time_str);
+}
 
-    for (int i = 0; i < current->num_conditions; ++i) {
-        free(current->trade_conditions[i]);
+// Function to hand a filled-in record to a store, indexed by its exchange timestamp.
+// The record's strings are released if it cannot be stored.
+static int store_record(RecordStore *store, void *record, const char *symbol, const char *timestamp_str) {
+    int64_t t = timestamp_str ? parse_rfc3339_ns(timestamp_str) : -1;
+    if (t < 0) {
+        fprintf(stderr, "Error: cannot store a %s record without a valid timestamp.\n", symbol);
     }
-    free(current->trade_conditions);
-    free(current->symbol);
-    free(current->exchange);
-    free(current->tape);
-    free(current->timestamp_str);
-    free(current->local_time_str);
-    free(current);
+    if (t < 0 || record_store_add(store, symbol, t, record) != 0) {
+        store->free_record(record);
+        return -1;
+    }
+    return 0;
 }
 
-void remove_oldest_quote(Quote **head) {
-    Quote *current = *head;
-    Quote *prev = NULL;
+static BarView bar_view(RecordView view) {
+    BarView result = { (const Bar *)view.items, view.t, view.count };
+    return result;
+}
 
-    if (current == NULL) {
-        return;
-    }
+static TradeView trade_view(RecordView view) {
+    TradeView result = { (const Trade *)view.items, view.t, view.count };
+    return result;
+}
 
-    while (current->next != NULL) {
-        prev = current;
-        current = current->next;
-    }
+static QuoteView quote_view(RecordView view) {
+    QuoteView result = { (const Quote *)view.items, view.t, view.count };
+    return result;
+}
 
-    if (prev) {
-        prev->next = NULL;
-    } else {
-        *head = NULL;
-    }
+// Function to return the stored bars of a symbol with from_ns <= t <= to_ns
+BarView alpaca_bars_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns) {
+    return bar_view(record_store_between(&ctx->bars, symbol, from_ns, to_ns));
+}
 
-    free(current->symbol);
-    free(current->bid_exchange);
-    free(current->ask_exchange);
-    free(current->timestamp_str);
-    free(current->local_time_str);
-    free(current);
+// Function to return up to the last n stored bars of a symbol with t <= as_of_ns
+BarView alpaca_bars_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns) {
+    return bar_view(record_store_last(&ctx->bars, symbol, n, as_of_ns));
+}
+
+TradeView alpaca_trades_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns) {
+    return trade_view(record_store_between(&ctx->trades, symbol, from_ns, to_ns));
+}
+
+TradeView alpaca_trades_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns) {
+    return trade_view(record_store_last(&ctx->trades, symbol, n, as_of_ns));
+}
+
+QuoteView alpaca_quotes_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns) {
+    return quote_view(record_store_between(&ctx->quotes, symbol, from_ns, to_ns));
+}
+
+QuoteView alpaca_quotes_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns) {
+    return quote_view(record_store_last(&ctx->quotes, symbol, n, as_of_ns));
 }
 
 double time_string_to_seconds_since_1970(const char *time_string) {
@@ -253,7 +304,8 @@ char *print_local_time(const char *timestamp) {
     t = mktime(&tm);
     t -= timezone;
 
-    struct tm *local_tm = localtime(&t);
+    struct tm local_tm_buf;
+    struct tm *local_tm = localtime_r(&t, &local_tm_buf);
 
     char *buffer = (char *)malloc(64 * sizeof(char));
     strftime(buffer, 64, "%Y-%m-%d %H:%M:%S", local_tm);
@@ -270,109 +322,61 @@ char *print_local_time(const char *timestamp) {
     return buffer;
 }
 
-void extract_bar_close_prices_by_symbol(Bar *head, const char *symbol, double **prices, size_t *num_prices) {
-    size_t count = 0;
-
-    // Count the number of bars with the specified symbol
-    Bar *current = head;
-    while (current) {
-        if (strcmp(current->symbol, symbol) == 0 && current->close != 0) {
-            count++;
-        }
-        current = current->next;
-    }
+void extract_bar_close_prices_by_symbol(const AlpacaContext *ctx, const char *symbol, double **prices, size_t *num_prices) {
+    BarView bars = bar_view(record_store_symbol(&ctx->bars, symbol_table_find(&ctx->bars.symbols, symbol)));
 
-    // Allocate memory for the close prices array
-    *prices = (double *)malloc(count * sizeof(double));
-    *num_prices = count;
-
-    // Extract the close prices in reverse order
-    size_t index = count;
-    current = head;
-    while (current && index > 0) {
-        if (strcmp(current->symbol, symbol) == 0 && current->close != 0) {
-            (*prices)[--index] = current->close;
+    // Bars are stored oldest first; bars without a close are skipped
+    *prices = (double *)malloc((bars.count ? bars.count : 1) * sizeof(double));
+    *num_prices = 0;
+    for (size_t i = 0; i < bars.count; ++i) {
+        if (bars.items[i].close != 0) {
+            (*prices)[(*num_prices)++] = bars.items[i].close;
         }
-        current = current->next;
     }
 }
 
-double* extract_trade_prices_by_symbol(const Trade* trade_list_head, const char* symbol, size_t* num_prices) {
-    // Count the number of trades for the specified symbol
-    size_t trade_count = 0;
-    const Trade* current = trade_list_head;
-    while (current) {
-        if (strcmp(current->symbol, symbol) == 0) {
-            trade_count++;
-        }
-        current = current->next;
-    }
-
-    if (trade_count == 0) {
-        *num_prices = 0;
+double* extract_trade_prices_by_symbol(const AlpacaContext *ctx, const char* symbol, size_t* num_prices) {
+    TradeView trades = trade_view(record_store_symbol(&ctx->trades, symbol_table_find(&ctx->trades.symbols, symbol)));
+    *num_prices = 0;
+    if (trades.count == 0) {
         return NULL;
     }
 
-    double* prices = (double*)malloc(trade_count * sizeof(double));
+    double* prices = (double*)malloc(trades.count * sizeof(double));
     if (prices == NULL) {
-        *num_prices = 0;
         return NULL;
     }
 
-    // Extract the prices for the specified symbol in reverse order
-    size_t price_index = trade_count - 1;
-    current = trade_list_head;
-    while (current) {
-        if (strcmp(current->symbol, symbol) == 0 && current->price != 0) {
-            prices[price_index--] = current->price;
+    // Extract the non-zero prices for the specified symbol, oldest first
+    for (size_t i = 0; i < trades.count; ++i) {
+        if (trades.items[i].price != 0) {
+            prices[(*num_prices)++] = trades.items[i].price;
         }
-        current = current->next;
     }
-
-    *num_prices = trade_count - price_index - 2;
-    return prices + price_index + 1;
+    return prices;
 }
 
-void extract_bid_ask_prices_by_symbol(Quote *quote_list_head, const char *symbol, double **bid_prices, size_t *num_bid_prices, double **ask_prices, size_t *num_ask_prices) {
+void extract_bid_ask_prices_by_symbol(const AlpacaContext *ctx, const char *symbol, double **bid_prices, size_t *num_bid_prices, double **ask_prices, size_t *num_ask_prices) {
+    QuoteView quotes = quote_view(record_store_symbol(&ctx->quotes, symbol_table_find(&ctx->quotes.symbols, symbol)));
     *num_bid_prices = 0;
     *num_ask_prices = 0;
 
-    // Count the number of bid and ask prices for the given symbol
-    Quote *current = quote_list_head;
-    while (current) {
-        if (strcmp(current->symbol, symbol) == 0) {
-            if (current->bid_price != 0) {
-                (*num_bid_prices)++;
-            }
-            if (current->ask_price != 0) {
-                (*num_ask_prices)++;
-            }
-        }
-        current = current->next;
-    }
-
     // Allocate memory for the bid and ask price arrays
-    *bid_prices = (double *)malloc(*num_bid_prices * sizeof(double));
-    *ask_prices = (double *)malloc(*num_ask_prices * sizeof(double));
-
-    // Fill the bid and ask price arrays with the corresponding prices
-    size_t bid_index = 0;
-    size_t ask_index = 0;
-    current = quote_list_head;
-    while (current) {
-        if (strcmp(current->symbol, symbol) == 0) {
-            if (current->bid_price != 0) {
-                (*bid_prices)[(*num_bid_prices) - 1 - bid_index++] = current->bid_price;
-            }
-            if (current->ask_price != 0) {
-                (*ask_prices)[(*num_ask_prices) - 1 - ask_index++] = current->ask_price;
-            }
+    *bid_prices = (double *)malloc((quotes.count ? quotes.count : 1) * sizeof(double));
+    *ask_prices = (double *)malloc((quotes.count ? quotes.count : 1) * sizeof(double));
+
+    // Fill the bid and ask price arrays with the non-zero prices, oldest first
+    for (size_t i = 0; i < quotes.count; ++i) {
+        if (quotes.items[i].bid_price != 0) {
+            (*bid_prices)[(*num_bid_prices)++] = quotes.items[i].bid_price;
+        }
+        if (quotes.items[i].ask_price != 0) {
+            (*ask_prices)[(*num_ask_prices)++] = quotes.items[i].ask_price;
         }
-        current = current->next;
     }
 }
 
-void parse_bar_data(const char *json_data) {
+void parse_bar_data(AlpacaContext *ctx, const char *json_data) {
     json_error_t error;
     json_t *root;
 
@@ -395,7 +399,7 @@ void parse_bar_data(const char *json_data) {
     // Extract the bar data from the JSON object
     const char *msg_type, *symbol, *timestamp_str;
     double open, high, low, close, vw;
-    int volume, trades;
+    int64_t volume, trades;
 
     msg_type = json_string_value(json_object_get(root, "T"));
     symbol = json_string_value(json_object_get(root, "S"));
@@ -408,6 +412,15 @@ void parse_bar_data(const char *json_data) {
     trades = json_integer_value(json_object_get(root, "n"));
     vw = json_number_value(json_object_get(root, "vw"));
 
+    handle_bar(ctx, msg_type, symbol, open, high, low, close, vw, volume, trades, timestamp_str, !correlate_built_bars(ctx));
+
+    // Free the JSON object
+    json_decref(root);
+}
+
+// Function to print, store and report a bar, whether it came from the feed or was
+// built from trades. correlate says whether its close goes to the correlations.
+static void handle_bar(AlpacaContext *ctx, const char *msg_type, const char *symbol, double open, double high, double low, double close, double vw, int64_t volume, int64_t trades, const char *timestamp_str, int correlate) {
     // Print the bar data
     printf("Bar Data:\n");
     printf("  Message Type: %s\n", msg_type);
@@ -416,9 +429,9 @@ void parse_bar_data(const char *json_data) {
     printf("  High: %.3f\n", high);
     printf("  Low: %.3f\n", low);
     printf("  Close: %.3f\n", close);
-    printf("  Volume: %d\n", volume);
+    printf("  Volume: %lld\n", (long long)volume);
     printf("  Timestamp: %s\n", timestamp_str);
-    printf("  Number of Trades: %d\n", trades);
+    printf("  Number of Trades: %lld\n", (long long)trades);
     printf("  VWAP: %.5f\n", vw);
 
     // Print the local time using the provided function
@@ -427,25 +440,22 @@ void parse_bar_data(const char *json_data) {
 
     double digital_seconds = time_string_to_seconds_since_1970(local_time_str);
 
-    // Create and insert the new bar node with digital_seconds
-    Bar *new_node = create_bar_node(symbol, open, high, low, close, vw, volume, trades, timestamp_str, local_time_str, digital_seconds);
-    insert_bar_node(&bar_list_head, new_node);
-
-    // Limit the number of stored bars
-    int bar_count = 0;
-    Bar *current = bar_list_head;
-    while (current) {
-        bar_count++;
-        if (bar_count > MAX_STORED_BARS) {
-            remove_oldest_bar(&bar_list_head);
-        }
-        current = current->next;
+    // Add the close to the rolling correlations; a bar of a new period completes the last one
+    if (correlate && ctx->correlation && symbol && timestamp_str) {
+        correlation_add_bar(ctx->correlation, symbol, parse_rfc3339_ns(timestamp_str), close);
     }
 
+    // Store the new bar with digital_seconds; the oldest bar is dropped once the store is full
+    Bar bar;
+    init_bar(&bar, symbol, open, high, low, close, vw, volume, trades, timestamp_str, local_time_str, digital_seconds);
+    store_record(&ctx->bars, &bar, symbol, timestamp_str);
+    free(local_time_str);
+    ctx->bars_received++;
+
     // Extract and print close prices for the parsed symbol
     double *close_prices;
     size_t num_close_prices;
-    extract_bar_close_prices_by_symbol(bar_list_head, symbol, &close_prices, &num_close_prices);
+    extract_bar_close_prices_by_symbol(ctx, symbol, &close_prices, &num_close_prices);
 
     printf("Close prices for %s:\n", symbol);
     for (size_t i = 0; i < num_close_prices; ++i) {
@@ -457,7 +467,20 @@ void parse_bar_data(const char *json_data) {
     free(close_prices);
 }
 
-void parse_trade_data(const char *received_data) {
+// Function to pass a bar built from trades through the same handling as a bar message
+static void handle_built_bar(void *user, const BuiltBar *bar) {
+    char timestamp_str[48];
+    format_rfc3339(bar->t / 1000000000, timestamp_str, sizeof(timestamp_str));
+    int64_t fraction = bar->t % 1000000000;
+    size_t len = strlen(timestamp_str);
+    if (fraction != 0 && len > 0) {
+        snprintf(timestamp_str + len - 1, sizeof(timestamp_str) - len + 1, ".%09lldZ", (long long)fraction);
+    }
+    AlpacaContext *ctx = (AlpacaContext *)user;
+    handle_bar(ctx, "built", bar->symbol, bar->open, bar->high, bar->low, bar->close, bar->vw, bar->volume, bar->trades, timestamp_str, correlate_built_bars(ctx));
+}
+
+void parse_trade_data(AlpacaContext *ctx, const char *received_data) {
     json_error_t error;
     json_t *root = json_loads(received_data, 0, &error);
 
@@ -484,10 +507,10 @@ void parse_trade_data(const char *received_data) {
     symbol = json_string_value(json_object_get(root, "S"));
     trade_id = json_integer_value(json_object_get(root, "i"));
     exchange = json_string_value(json_object_get(root, "x"));
-    price = json_real_value(json_object_get(root, "p"));
+    price = json_number_value(json_object_get(root, "p"));
     size = json_integer_value(json_object_get(root, "s"));
     trade_conditions = json_object_get(root, "c");
-    tape = json_object_get(root, "z");
+    tape = json_string_value(json_object_get(root, "z"));
     timestamp_str = json_string_value(json_object_get(root, "t"));
 
     printf("Trade data:\n");
@@ -498,6 +521,11 @@ void parse_trade_data(const char *received_data) {
     printf("  Price: %.4f\n", price);
     printf("  Size: %d\n", size);
 
+    // Join the trade with the symbol's latest quote to tell buyer- from seller-initiated
+    SideMethod method;
+    int side = order_flow_trade(&ctx->flow, symbol, price, size, &method);
+    printf("  Side: %s%s\n", trade_side_name(side), method == SIDE_BY_TICK ? " (tick test)" : "");
+
     printf("  Trade Conditions: ");
     size_t index;
     json_t *condition;
@@ -508,29 +536,26 @@ void parse_trade_data(const char *received_data) {
 
     printf("  Tape: %s\n", tape);
     printf("  Timestamp: %s\n", timestamp_str);
+    const FlowSymbol *fs = order_flow_symbol(&ctx->flow, symbol);
+    if (fs) {
+        printf("  Signed Volume: %+.0f (imbalance %+.3f, quote OFI %+.0f)\n", fs->buy_volume - fs->sell_volume, order_flow_imbalance(fs), fs->ofi);
+    }
     char *local_time_str = print_local_time(timestamp_str);
     printf("\n");
 
     double digital_seconds = time_string_to_seconds_since_1970(local_time_str);
 
-    // Create and insert the new trade node with digital_seconds
-    Trade *new_node = create_trade_node(symbol, trade_id, exchange, price, size, trade_conditions, timestamp_str, local_time_str, digital_seconds, tape);
-    insert_trade_node(&trade_list_head, new_node);
-
-    // Limit the number of stored trades
-    int trade_count = 0;
-    Trade *current = trade_list_head;
-    while (current) {
-        trade_count++;
-        if (trade_count > MAX_STORED_TRADES) {
-            remove_oldest_trade(&trade_list_head);
-        }
-        current = current->next;
-    }
+    // Store the new trade with digital_seconds; the oldest trade is dropped once the store is full
+    Trade trade;
+    init_trade(&trade, symbol, trade_id, exchange, price, size, trade_conditions, timestamp_str, local_time_str, digital_seconds, tape);
+    trade.side = side;
+    store_record(&ctx->trades, &trade, symbol, timestamp_str);
+    free(local_time_str);
+    ctx->trades_received++;
 
     // Extract and print trade prices for the parsed symbol
     size_t num_prices;
-    double* prices = extract_trade_prices_by_symbol(trade_list_head, symbol, &num_prices);
+    double* prices = extract_trade_prices_by_symbol(ctx, symbol, &num_prices);
 
     if (prices != NULL) {
         printf("Trade prices for %s:\n", symbol);
@@ -546,11 +571,24 @@ void parse_trade_data(const char *received_data) {
         printf("No trade data found for %s.\n", symbol);
     }
 
+    // Add the trade to the bar being built for its symbol
+    if (ctx->bar_builder) {
+        const char *codes[BAR_BUILDER_MAX_CONDITIONS];
+        size_t num_codes = 0;
+        json_array_foreach(trade_conditions, index, condition) {
+            if (num_codes < BAR_BUILDER_MAX_CONDITIONS) {
+                codes[num_codes++] = json_string_value(condition);
+            }
+        }
+        int64_t t = timestamp_str ? parse_rfc3339_ns(timestamp_str) : -1;
+        bar_builder_trade(ctx->bar_builder, symbol, t, price, size, codes, num_codes);
+    }
+
     // Free the JSON object
     json_decref(root);
 }
 
-void parse_quote_data(const char *json_data) {
+void parse_quote_data(AlpacaContext *ctx, const char *json_data) {
     json_error_t error;
     json_t *root, *quote_object;
 
@@ -586,25 +624,20 @@ void parse_quote_data(const char *json_data) {
     char *local_time = print_local_time(timestamp);
     double digital_seconds = time_string_to_seconds_since_1970(local_time);
 
-    // Create a new quote node and insert it into the list
-    Quote *new_node = create_quote_node(symbol, bid_exchange, bid_price, bid_size, ask_exchange, ask_price, ask_size, timestamp, local_time, digital_seconds);
-    insert_quote_node(&quote_list_head, new_node);
+    // This becomes the prevailing quote that the symbol's next trades are classified against
+    order_flow_quote(&ctx->flow, symbol, bid_price, bid_size, ask_price, ask_size);
 
-    // Remove the oldest quote node if the list is too long
-    int quote_count = 0;
-    Quote *current = quote_list_head;
-    while (current != NULL) {
-        quote_count++;
-        current = current->next;
-    }
-    if (quote_count > MAX_STORED_QUOTE_PRICES) {
-        remove_oldest_quote(&quote_list_head);
-    }
+    // Store the new quote; the oldest quote is dropped once the store is full
+    Quote quote;
+    init_quote(&quote, symbol, bid_exchange, bid_price, bid_size, ask_exchange, ask_price, ask_size, timestamp, local_time, digital_seconds);
+    store_record(&ctx->quotes, &quote, symbol, timestamp);
+    free(local_time);
+    ctx->quotes_received++;
 
     // Extract and print bid and ask prices for the parsed symbol
     double *bid_prices, *ask_prices;
     size_t num_bid_prices, num_ask_prices;
-    extract_bid_ask_prices_by_symbol(quote_list_head, symbol, &bid_prices, &num_bid_prices, &ask_prices, &num_ask_prices);
+    extract_bid_ask_prices_by_symbol(ctx, symbol, &bid_prices, &num_bid_prices, &ask_prices, &num_ask_prices);
 
     printf("Bid and Ask prices for %s:\n", symbol);
     size_t max_length = num_bid_prices < num_ask_prices ? num_bid_prices : num_ask_prices;
@@ -626,14 +659,58 @@ void parse_quote_data(const char *json_data) {
     json_decref(root);
 }
 
-void process_received_data(const char *data) {
-    printf("Received data: %s\n", (char *)data);
+// Function to feed a trade or quote message into the rankings straight from the parsed element
+static void update_rankings(MarketRankings *rankings, const char *msg_type_str, json_t *element) {
+    const char *symbol = json_string_value(json_object_get(element, "S"));
+    if (!symbol) {
+        return;
+    }
+    if (strcmp(msg_type_str, "t") == 0) {
+        rankings_trade(rankings, symbol, json_number_value(json_object_get(element, "p")), json_number_value(json_object_get(element, "s")));
+    } else if (strcmp(msg_type_str, "q") == 0) {
+        rankings_quote(rankings, symbol, json_number_value(json_object_get(element, "bp")), json_number_value(json_object_get(element, "ap")));
+    }
+}
+
+// Function to check the trades and quotes of a message against the price alerts.
+// Trades are checked at their price and quotes at their midpoint.
+static void check_alerts(AlertEngine *alerts, json_t *root, int64_t received_ns) {
+    size_t count = json_is_array(root) ? json_array_size(root) : 1;
+    for (size_t i = 0; i < count; i++) {
+        json_t *element = json_is_array(root) ? json_array_get(root, i) : root;
+        const char *type = json_string_value(json_object_get(element, "T"));
+        const char *symbol = json_string_value(json_object_get(element, "S"));
+        if (!type || !symbol) {
+            continue;
+        }
+        const char *timestamp = json_string_value(json_object_get(element, "t"));
+        if (strcmp(type, "t") == 0) {
+            alert_engine_check(alerts, symbol, json_number_value(json_object_get(element, "p")), timestamp, received_ns);
+        } else if (strcmp(type, "q") == 0) {
+            double bid = json_number_value(json_object_get(element, "bp"));
+            double ask = json_number_value(json_object_get(element, "ap"));
+            if (bid > 0 && ask >= bid) {
+                alert_engine_check(alerts, symbol, (bid + ask) / 2, timestamp, received_ns);
+            }
+        }
+    }
+}
+
+void process_received_data(AlpacaContext *ctx, const char *data) {
+    int64_t received_ns = ctx->alerts ? alert_clock_ns() : 0;
 
     json_t *root, *element, *message_type;
     json_error_t error;
     size_t index;
 
     root = json_loads(data, 0, &error);
+
+    // Alerts go out before the message is printed or stored
+    if (ctx->alerts && root) {
+        check_alerts(ctx->alerts, root, received_ns);
+    }
+
+    printf("Received data: %s\n", (char *)data);
     if (!root) {
         fprintf(stderr, "Error parsing JSON data: %s\n", error.text);
         return;
@@ -657,14 +734,17 @@ void process_received_data(const char *data) {
         }
 
         const char *msg_type_str = json_string_value(message_type);
+        if (ctx->rankings) {
+            update_rankings(ctx->rankings, msg_type_str, element);
+        }
         char *element_str = json_dumps(element, 0);
 
         if (strcmp(msg_type_str, "t") == 0) {
-            parse_trade_data(element_str);
+            parse_trade_data(ctx, element_str);
         } else if (strcmp(msg_type_str, "q") == 0) {
-            parse_quote_data(element_str);
+            parse_quote_data(ctx, element_str);
         } else if (strcmp(msg_type_str, "b") == 0) {
-            parse_bar_data(element_str);
+            parse_bar_data(ctx, element_str);
         }
 
         free(element_str);
@@ -673,12 +753,12 @@ void process_received_data(const char *data) {
     json_decref(root);
 }
 
-void send_auth_message(struct lws *wsi) {
+void send_auth_message(AlpacaContext *ctx, struct lws *wsi) {
     char *apca_api_key_id = getenv("APCA_API_KEY_ID");
     char *apca_api_secret_key = getenv("APCA_API_SECRET_KEY");
     if (!apca_api_key_id || !apca_api_secret_key) {
         fprintf(stderr, "Error: APCA_API_KEY_ID and/or APCA_API_SECRET_KEY environment variables not set.\n");
-        interrupted = 1;
+        ctx->interrupted = 1;
         return;
     }
 
@@ -733,7 +813,9 @@ void send_subscription_message(struct lws *wsi, json_t *params) {
 }
 
 // WebSocket callback function for Alpaca's API
+// The connection's user pointer is the AlpacaContext that owns this feed.
 int callback_alpaca( struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+  AlpacaContext *ctx = (AlpacaContext *)user;
 
   switch (reason) {
     // Connection established
@@ -741,23 +823,23 @@ int callback_alpaca( struct lws *wsi, enum lws_callback_reasons reason, void *us
       puts("Connected to Alpaca WebSocket server.");
 
       // Send the authentication message
-      send_auth_message(wsi);
+      send_auth_message(ctx, wsi);
 
       // Send the subscription message
-      send_subscription_message(wsi, (json_t *)user);
+      send_subscription_message(wsi, ctx->params);
 
       break;
     }
     // Data received
     case LWS_CALLBACK_CLIENT_RECEIVE: {
       // Process the received data
-      process_received_data(in);
+      process_received_data(ctx, in);
       break;
     }
     // Connection closed
     case LWS_CALLBACK_CLIENT_CLOSED: {
       puts("Connection closed.");
-      interrupted = 1;
+      ctx->interrupted = 1;
       break;
     }
     default:
@@ -766,23 +848,401 @@ int callback_alpaca( struct lws *wsi, enum lws_callback_reasons reason, void *us
   return 0;
 }
 
-void free_bar_list(Bar *head) {
-    Bar *current = head;
-    Bar *next;
+// Function to release every stored bar, trade and quote
+void free_stored_data(AlpacaContext *ctx) {
+    record_store_clear(&ctx->bars);
+    record_store_clear(&ctx->trades);
+    record_store_clear(&ctx->quotes);
+}
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    int64_t created_at;
+} CheckpointHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t record_size;
+    uint64_t count;
+} CheckpointSection;
+
+typedef struct {
+    char symbol[CHECKPOINT_SYMBOL_LEN];
+    double open;
+    double high;
+    double low;
+    double close;
+    double vw;
+    int64_t volume;
+    int64_t trades;
+    char timestamp_str[CHECKPOINT_TIME_LEN];
+    char local_time_str[CHECKPOINT_TIME_LEN];
+    double digital_seconds;
+} CheckpointBar;
+
+// Bar record from before volumes and trade counts were 64-bit
+typedef struct {
+    char symbol[CHECKPOINT_SYMBOL_LEN];
+    double open;
+    double high;
+    double low;
+    double close;
+    double vw;
+    int32_t volume;
+    int32_t trades;
+    char timestamp_str[CHECKPOINT_TIME_LEN];
+    char local_time_str[CHECKPOINT_TIME_LEN];
+    double digital_seconds;
+} CheckpointBar32;
+
+typedef struct {
+    char symbol[CHECKPOINT_SYMBOL_LEN];
+    int64_t trade_id;
+    char exchange[CHECKPOINT_EXCHANGE_LEN];
+    double price;
+    int32_t size;
+    uint32_t num_conditions;
+    char trade_conditions[CHECKPOINT_MAX_CONDITIONS][CHECKPOINT_CONDITION_LEN];
+    char tape[CHECKPOINT_EXCHANGE_LEN];
+    char timestamp_str[CHECKPOINT_TIME_LEN];
+    char local_time_str[CHECKPOINT_TIME_LEN];
+    double digital_seconds;
+    int32_t side;           // appended; records written before it end at this field
+} CheckpointTrade;
+
+// Size of a trade record from before the side was kept
+#define CHECKPOINT_TRADE_SIZE_NO_SIDE offsetof(CheckpointTrade, side)
+
+typedef struct {
+    char symbol[CHECKPOINT_SYMBOL_LEN];
+    char bid_exchange[CHECKPOINT_EXCHANGE_LEN];
+    double bid_price;
+    int32_t bid_size;
+    char ask_exchange[CHECKPOINT_EXCHANGE_LEN];
+    double ask_price;
+    int32_t ask_size;
+    char timestamp_str[CHECKPOINT_TIME_LEN];
+    char local_time_str[CHECKPOINT_TIME_LEN];
+    double digital_seconds;
+} CheckpointQuote;
+
+// Copy a string into a fixed-size, always NUL-terminated field
+static void copy_fixed(char *dst, size_t dst_size, const char *src) {
+    memset(dst, 0, dst_size);
+    if (src) {
+        strncpy(dst, src, dst_size - 1);
+    }
+}
+
+// Fixed-size fields are not guaranteed to be terminated in a corrupt file
+static char *strdup_fixed(const char *src, size_t src_size) {
+    return strndup(src, src_size);
+}
+
+static int write_checkpoint_section(FILE *fp, uint32_t type, uint32_t record_size, uint64_t count) {
+    CheckpointSection section = { type, record_size, count };
+    return fwrite(&section, sizeof(section), 1, fp) == 1 ? 0 : -1;
+}
 
-    while (current) {
-        next = current->next;
-        free(current->symbol);
-        free(current);
-        current = next;
+static int write_checkpoint_bar(void *user, const void *record) {
+    const Bar *b = (const Bar *)record;
+    CheckpointBar rec;
+    memset(&rec, 0, sizeof(rec));
+    copy_fixed(rec.symbol, sizeof(rec.symbol), b->symbol);
+    rec.open = b->open;
+    rec.high = b->high;
+    rec.low = b->low;
+    rec.close = b->close;
+    rec.vw = b->vw;
+    rec.volume = b->volume;
+    rec.trades = b->trades;
+    copy_fixed(rec.timestamp_str, sizeof(rec.timestamp_str), b->timestamp_str);
+    copy_fixed(rec.local_time_str, sizeof(rec.local_time_str), b->local_time_str);
+    rec.digital_seconds = b->digital_seconds;
+    return fwrite(&rec, sizeof(rec), 1, (FILE *)user) == 1 ? 0 : -1;
+}
+
+static int write_checkpoint_trade(void *user, const void *record) {
+    const Trade *t = (const Trade *)record;
+    CheckpointTrade rec;
+    memset(&rec, 0, sizeof(rec));
+    copy_fixed(rec.symbol, sizeof(rec.symbol), t->symbol);
+    rec.trade_id = t->trade_id;
+    copy_fixed(rec.exchange, sizeof(rec.exchange), t->exchange);
+    rec.price = t->price;
+    rec.size = t->size;
+    rec.num_conditions = t->num_conditions < CHECKPOINT_MAX_CONDITIONS ? t->num_conditions : CHECKPOINT_MAX_CONDITIONS;
+    rec.side = t->side;
+    for (uint32_t i = 0; i < rec.num_conditions; ++i) {
+        copy_fixed(rec.trade_conditions[i], CHECKPOINT_CONDITION_LEN, t->trade_conditions[i]);
     }
+    copy_fixed(rec.tape, sizeof(rec.tape), t->tape);
+    copy_fixed(rec.timestamp_str, sizeof(rec.timestamp_str), t->timestamp_str);
+    copy_fixed(rec.local_time_str, sizeof(rec.local_time_str), t->local_time_str);
+    rec.digital_seconds = t->digital_seconds;
+    return fwrite(&rec, sizeof(rec), 1, (FILE *)user) == 1 ? 0 : -1;
+}
+
+static int write_checkpoint_quote(void *user, const void *record) {
+    const Quote *q = (const Quote *)record;
+    CheckpointQuote rec;
+    memset(&rec, 0, sizeof(rec));
+    copy_fixed(rec.symbol, sizeof(rec.symbol), q->symbol);
+    copy_fixed(rec.bid_exchange, sizeof(rec.bid_exchange), q->bid_exchange);
+    rec.bid_price = q->bid_price;
+    rec.bid_size = q->bid_size;
+    copy_fixed(rec.ask_exchange, sizeof(rec.ask_exchange), q->ask_exchange);
+    rec.ask_price = q->ask_price;
+    rec.ask_size = q->ask_size;
+    copy_fixed(rec.timestamp_str, sizeof(rec.timestamp_str), q->timestamp_str);
+    copy_fixed(rec.local_time_str, sizeof(rec.local_time_str), q->local_time_str);
+    rec.digital_seconds = q->digital_seconds;
+    return fwrite(&rec, sizeof(rec), 1, (FILE *)user) == 1 ? 0 : -1;
+}
+
+// Function to write all stored bars, trades and quotes to a versioned binary snapshot.
+// The snapshot is written to a temporary file and renamed over the target so a
+// crash mid-write never leaves a truncated checkpoint behind.
+int save_checkpoint(const AlpacaContext *ctx, const char *path) {
+    size_t path_len = strlen(path);
+    char *tmp_path = (char *)malloc(path_len + 5);
+    snprintf(tmp_path, path_len + 5, "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        perror("Error opening checkpoint file");
+        free(tmp_path);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    uint64_t num_bars = record_store_count(&ctx->bars);
+    uint64_t num_trades = record_store_count(&ctx->trades);
+    uint64_t num_quotes = record_store_count(&ctx->quotes);
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.num_sections = 3;
+    header.created_at = (int64_t)time(NULL);
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    // Records are written newest received first, as the stores were once linked lists
+    ok = ok && write_checkpoint_section(fp, CHECKPOINT_SECTION_BARS, sizeof(CheckpointBar), num_bars) == 0;
+    ok = ok && record_store_newest_first(&ctx->bars, write_checkpoint_bar, fp) == 0;
+
+    ok = ok && write_checkpoint_section(fp, CHECKPOINT_SECTION_TRADES, sizeof(CheckpointTrade), num_trades) == 0;
+    ok = ok && record_store_newest_first(&ctx->trades, write_checkpoint_trade, fp) == 0;
+
+    ok = ok && write_checkpoint_section(fp, CHECKPOINT_SECTION_QUOTES, sizeof(CheckpointQuote), num_quotes) == 0;
+    ok = ok && record_store_newest_first(&ctx->quotes, write_checkpoint_quote, fp) == 0;
+
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Error writing checkpoint file");
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    free(tmp_path);
+    return 0;
+}
+
+static void restore_checkpoint_bars(AlpacaContext *ctx, const unsigned char *recs, size_t record_size, uint64_t count) {
+    // Walk oldest to newest so that eviction order survives the restore
+    for (uint64_t i = count; i-- > 0;) {
+        CheckpointBar wide;
+        if (record_size == sizeof(CheckpointBar32)) {
+            CheckpointBar32 narrow;
+            memcpy(&narrow, recs + i * record_size, sizeof(narrow));
+            memcpy(wide.symbol, narrow.symbol, sizeof(wide.symbol));
+            wide.open = narrow.open;
+            wide.high = narrow.high;
+            wide.low = narrow.low;
+            wide.close = narrow.close;
+            wide.vw = narrow.vw;
+            wide.volume = narrow.volume;
+            wide.trades = narrow.trades;
+            memcpy(wide.timestamp_str, narrow.timestamp_str, sizeof(wide.timestamp_str));
+            memcpy(wide.local_time_str, narrow.local_time_str, sizeof(wide.local_time_str));
+            wide.digital_seconds = narrow.digital_seconds;
+        } else {
+            memcpy(&wide, recs + i * record_size, sizeof(wide));
+        }
+        const CheckpointBar *rec = &wide;
+        Bar bar;
+        Bar *node = &bar;
+        node->symbol = strdup_fixed(rec->symbol, sizeof(rec->symbol));
+        node->open = rec->open;
+        node->high = rec->high;
+        node->low = rec->low;
+        node->close = rec->close;
+        node->vw = rec->vw;
+        node->volume = rec->volume;
+        node->trades = rec->trades;
+        node->timestamp_str = strdup_fixed(rec->timestamp_str, sizeof(rec->timestamp_str));
+        node->local_time_str = strdup_fixed(rec->local_time_str, sizeof(rec->local_time_str));
+        node->digital_seconds = rec->digital_seconds;
+        store_record(&ctx->bars, node, node->symbol, node->timestamp_str);
+    }
+}
+
+// Records are record_size apart; fields beyond a shorter, older record read as zero
+static void restore_checkpoint_trades(AlpacaContext *ctx, const unsigned char *recs, size_t record_size, uint64_t count) {
+    for (uint64_t i = count; i-- > 0;) {
+        CheckpointTrade padded;
+        memset(&padded, 0, sizeof(padded));
+        memcpy(&padded, recs + i * record_size, record_size < sizeof(padded) ? record_size : sizeof(padded));
+        const CheckpointTrade *rec = &padded;
+        Trade trade;
+        Trade *node = &trade;
+        node->symbol = strdup_fixed(rec->symbol, sizeof(rec->symbol));
+        node->trade_id = rec->trade_id;
+        node->exchange = strdup_fixed(rec->exchange, sizeof(rec->exchange));
+        node->price = rec->price;
+        node->size = rec->size;
+        node->num_conditions = rec->num_conditions < CHECKPOINT_MAX_CONDITIONS ? rec->num_conditions : CHECKPOINT_MAX_CONDITIONS;
+        node->trade_conditions = (char **)malloc(node->num_conditions * sizeof(char *));
+        for (size_t j = 0; j < node->num_conditions; ++j) {
+            node->trade_conditions[j] = strdup_fixed(rec->trade_conditions[j], CHECKPOINT_CONDITION_LEN);
+        }
+        node->tape = strdup_fixed(rec->tape, sizeof(rec->tape));
+        node->timestamp_str = strdup_fixed(rec->timestamp_str, sizeof(rec->timestamp_str));
+        node->local_time_str = strdup_fixed(rec->local_time_str, sizeof(rec->local_time_str));
+        node->digital_seconds = rec->digital_seconds;
+        node->side = rec->side > 0 ? TRADE_BUY : rec->side < 0 ? TRADE_SELL : TRADE_UNKNOWN;
+        order_flow_add_trade(&ctx->flow, node->symbol, node->price, node->size, node->side);
+        if (ctx->rankings) {
+            rankings_trade(ctx->rankings, node->symbol, node->price, node->size);
+        }
+        store_record(&ctx->trades, node, node->symbol, node->timestamp_str);
+    }
+}
+
+static void restore_checkpoint_quotes(AlpacaContext *ctx, const CheckpointQuote *recs, uint64_t count) {
+    for (uint64_t i = count; i-- > 0;) {
+        const CheckpointQuote *rec = &recs[i];
+        Quote quote;
+        Quote *node = &quote;
+        node->symbol = strdup_fixed(rec->symbol, sizeof(rec->symbol));
+        node->bid_exchange = strdup_fixed(rec->bid_exchange, sizeof(rec->bid_exchange));
+        node->bid_price = rec->bid_price;
+        node->bid_size = rec->bid_size;
+        node->ask_exchange = strdup_fixed(rec->ask_exchange, sizeof(rec->ask_exchange));
+        node->ask_price = rec->ask_price;
+        node->ask_size = rec->ask_size;
+        node->timestamp_str = strdup_fixed(rec->timestamp_str, sizeof(rec->timestamp_str));
+        node->local_time_str = strdup_fixed(rec->local_time_str, sizeof(rec->local_time_str));
+        node->digital_seconds = rec->digital_seconds;
+        order_flow_quote(&ctx->flow, node->symbol, node->bid_price, node->bid_size, node->ask_price, node->ask_size);
+        if (ctx->rankings) {
+            rankings_quote(ctx->rankings, node->symbol, node->bid_price, node->ask_price);
+        }
+        store_record(&ctx->quotes, node, node->symbol, node->timestamp_str);
+    }
+}
+
+// Function to check that each section header and its records lie within the file
+static int checkpoint_sections_valid(const unsigned char *base, size_t file_size, uint32_t num_sections, const char *path) {
+    size_t offset = sizeof(CheckpointHeader);
+    for (uint32_t s = 0; s < num_sections; ++s) {
+        if (file_size - offset < sizeof(CheckpointSection)) {
+            fprintf(stderr, "Error: checkpoint file %s ends before section %u.\n", path, s + 1);
+            return -1;
+        }
+        const CheckpointSection *section = (const CheckpointSection *)(base + offset);
+        offset += sizeof(CheckpointSection);
+
+        if (section->record_size == 0 || section->count > (file_size - offset) / section->record_size) {
+            fprintf(stderr, "Error: checkpoint section %u in %s is truncated.\n", section->type, path);
+            return -1;
+        }
+        offset += section->record_size * section->count;
+    }
+    return 0;
+}
+
+// Function to restore stored bars, trades and quotes from a checkpoint written by save_checkpoint().
+// Returns 0 on success, 1 if no checkpoint exists and -1 if the file is unusable. A
+// file cut short also returns -1, with nothing restored rather than part of it.
+// The order flow, and the rankings if set, are rebuilt from the restored trades and
+// quotes, so they cover only what the stores kept. Half-built bars and the
+// correlation window are not saved and start empty.
+int load_checkpoint(AlpacaContext *ctx, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "Error: checkpoint file %s is truncated.\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    const unsigned char *base = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("Error mapping checkpoint file");
+        return -1;
+    }
+
+    const CheckpointHeader *header = (const CheckpointHeader *)base;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || header->version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "Error: %s is not a version %d checkpoint file.\n", path, CHECKPOINT_VERSION);
+        munmap((void *)base, file_size);
+        return -1;
+    }
+
+    // Check every section's bounds first: the order flow and rankings fed while restoring
+    // could not be taken back if the file turned out to be cut short
+    if (checkpoint_sections_valid(base, file_size, header->num_sections, path) != 0) {
+        munmap((void *)base, file_size);
+        return -1;
+    }
+
+    // Drop whatever is in memory so the snapshot fully defines the restored state
+    free_stored_data(ctx);
+    order_flow_free(&ctx->flow);
+    order_flow_init(&ctx->flow);
+
+    size_t offset = sizeof(CheckpointHeader);
+    for (uint32_t s = 0; s < header->num_sections; ++s) {
+        const CheckpointSection *section = (const CheckpointSection *)(base + offset);
+        offset += sizeof(CheckpointSection);
+        const void *records = base + offset;
+        offset += section->record_size * section->count;
+
+        // Unknown sections, or sections whose layout changed, are skipped rather than misread
+        if (section->type == CHECKPOINT_SECTION_BARS &&
+            (section->record_size == sizeof(CheckpointBar) || section->record_size == sizeof(CheckpointBar32))) {
+            restore_checkpoint_bars(ctx, records, section->record_size, section->count < ctx->bars.max_records ? section->count : ctx->bars.max_records);
+        } else if (section->type == CHECKPOINT_SECTION_TRADES &&
+                   (section->record_size == sizeof(CheckpointTrade) || section->record_size == CHECKPOINT_TRADE_SIZE_NO_SIDE)) {
+            restore_checkpoint_trades(ctx, records, section->record_size, section->count < ctx->trades.max_records ? section->count : ctx->trades.max_records);
+        } else if (section->type == CHECKPOINT_SECTION_QUOTES && section->record_size == sizeof(CheckpointQuote)) {
+            restore_checkpoint_quotes(ctx, records, section->count < ctx->quotes.max_records ? section->count : ctx->quotes.max_records);
+        }
+    }
+
+    munmap((void *)base, file_size);
+    return 0;
 }
 
-// Signal handler for SIGINT (e.g., Ctrl+C)
+// Signal handler for SIGINT (e.g., Ctrl+C). Cleanup and checkpointing happen in
+// the main loop once it observes the flag, since neither is async-signal-safe.
 void sigint_handler(int sig) {
   fprintf(stderr, "Received signal %d, terminating...\n", sig);
-  free_bar_list(bar_list_head);
-  interrupted = 1;
+  signal_received = 1;
 }
 
 // Function to convert a string to uppercase
@@ -800,12 +1260,13 @@ json_t *parse_symbols(const char *symbols_str) {
     json_array_append_new(symbols, json_string("*"));
   } else {
     char *str = strdup(symbols_str);
-    char *token = strtok(str, ",");
+    char *saveptr = NULL;
+    char *token = strtok_r(str, ",", &saveptr);
 
     while (token) {
       to_upper(token);  // Convert the token to upper-case
       json_array_append_new(symbols, json_string(token));
-      token = strtok(NULL, ",");
+      token = strtok_r(NULL, ",", &saveptr);
     }
 
     free(str);
@@ -816,12 +1277,29 @@ json_t *parse_symbols(const char *symbols_str) {
 
 // Function to print the help message with usage instructions
 void print_help(const char *program_name) {
-  fprintf(stderr, "Usage: %s [-t trades] [-q quotes] [-b bars]\n", program_name);
+  fprintf(stderr, "Usage: %s [-t trades] [-q quotes] [-b bars] [-s sip] [-c file] [-i secs] [-r port] [-u path] [-n frames] [-m secs] [-P file] [-N count] [-A file] [-O path] [-B spec] [-X codes] [-R window] [-W file]\n", program_name);
   fprintf(stderr, "\n");
   fprintf(stderr, "Options:\n");
   fprintf(stderr, "  -t trades : Comma-separated list of trade symbols, or \"*\" for all trades (with quotes).\n");
   fprintf(stderr, "  -q quotes : Comma-separated list of quote symbols, or \"*\" for all quotes (with quotes).\n");
   fprintf(stderr, "  -b bars   : Comma-separated list of bar symbols, or \"*\" for all bars (with quotes).\n");
   fprintf(stderr, "  -s sip    : Choose the data source. Allowed values are 'sip' (default) or 'iex'.\n");
+  fprintf(stderr, "  -c file   : Checkpoint file. Restored on startup and written on shutdown and periodically.\n");
+  fprintf(stderr, "              Order flow and rankings are rebuilt from the stored trades and quotes;\n");
+  fprintf(stderr, "              half-built bars and correlations start empty.\n");
+  fprintf(stderr, "  -i secs   : Seconds between periodic checkpoints (default 60, 0 disables).\n");
+  fprintf(stderr, "  -r port   : Relay mode: re-serve the feed to local WebSocket clients on 127.0.0.1:port.\n");
+  fprintf(stderr, "  -u path   : Relay mode: re-serve the feed to local WebSocket clients on a Unix socket.\n");
+  fprintf(stderr, "  -n frames : Frames queued per relay client before the oldest are dropped (default 1024).\n");
+  fprintf(stderr, "  -m secs   : Print the top movers, volume leaders and widest spreads every secs seconds\n");
+  fprintf(stderr, "              (0 prints only on SIGUSR1 and at exit).\n");
+  fprintf(stderr, "  -P file   : Prior closes for the rankings, one \"SYMBOL PRICE\" per line. Enables the rankings.\n");
+  fprintf(stderr, "  -N count  : Entries per ranking (default 10).\n");
+  fprintf(stderr, "  -A file   : Price alert rules, one \"SYMBOL above|below LEVEL [NAME]\" per line.\n");
+  fprintf(stderr, "  -O path   : Write triggered alerts to a file, FIFO or Unix socket instead of stdout.\n");
+  fprintf(stderr, "  -B spec   : Build bars from trades: time:SECONDS, volume:SHARES or dollar:DOLLARS.\n");
+  fprintf(stderr, "  -X codes  : Comma-separated trade conditions left out of built bars.\n");
+  fprintf(stderr, "  -R window : Keep correlations of bar returns over the last window periods (window[:max_symbols]).\n");
+  fprintf(stderr, "  -W file   : Rewrite the correlation matrix as CSV in file after each period.\n");
   fprintf(stderr, "\n");
 }
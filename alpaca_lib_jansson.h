@@ -4,17 +4,61 @@
 #include <jansson.h>
 #include <libwebsockets.h>
 #include <time.h>
+#include "alpaca_store.h"
+#include "alpaca_rankings.h"
+#include "alpaca_alerts.h"
+#include "alpaca_flow.h"
+#include "alpaca_bar_builder.h"
+#include "alpaca_correlation.h"
 
-void parse_bar_data(const char *json_data);
-void parse_quote_data(const char *json_data);
-void parse_trade_data(const char *received_data);
-void process_received_data(const char *data);
-void send_auth_message(struct lws *wsi);
+// Opaque per-feed state: stores, subscription, limits and counters
+typedef struct AlpacaContext AlpacaContext;
+
+AlpacaContext *alpaca_context_create(json_t *params);
+void alpaca_context_destroy(AlpacaContext *ctx);
+void alpaca_context_set_limits(AlpacaContext *ctx, size_t max_bars, size_t max_trades, size_t max_quotes);
+void alpaca_context_get_counts(const AlpacaContext *ctx, size_t *bars, size_t *trades, size_t *quotes);
+json_t *alpaca_context_params(const AlpacaContext *ctx);
+int alpaca_context_interrupted(const AlpacaContext *ctx);
+void alpaca_context_interrupt(AlpacaContext *ctx);
+// Trades and quotes received are also fed into rankings, which the caller keeps alive
+void alpaca_context_set_rankings(AlpacaContext *ctx, MarketRankings *rankings);
+// Trades and quotes received are checked against alerts, also kept alive by the caller
+void alpaca_context_set_alerts(AlpacaContext *ctx, AlertEngine *alerts);
+// Trades received are built into bars, which are printed and stored like bar messages
+void alpaca_context_set_bar_builder(AlpacaContext *ctx, BarBuilder *builder);
+// The closes of bar messages are added to the rolling correlations, or those of the
+// built bars instead when the builder makes time bars
+void alpaca_context_set_correlation(AlpacaContext *ctx, CorrelationEngine *engine);
+// A symbol's latest quote and its signed trade volume since the context was created,
+// or NULL before its first trade or quote
+const FlowSymbol *alpaca_order_flow(const AlpacaContext *ctx, const char *symbol);
+
+// Stored records of one symbol by exchange time, in nanoseconds since 1970 UTC:
+// everything with from_ns <= t <= to_ns, or the last n with t <= as_of_ns. The views
+// point into the context's stores, oldest first, and stay valid until the context
+// next stores or drops a record.
+BarView alpaca_bars_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns);
+BarView alpaca_bars_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns);
+TradeView alpaca_trades_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns);
+TradeView alpaca_trades_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns);
+QuoteView alpaca_quotes_between(const AlpacaContext *ctx, const char *symbol, int64_t from_ns, int64_t to_ns);
+QuoteView alpaca_quotes_last(const AlpacaContext *ctx, const char *symbol, size_t n, int64_t as_of_ns);
+
+char *print_local_time(const char *timestamp);
+void parse_bar_data(AlpacaContext *ctx, const char *json_data);
+void parse_quote_data(AlpacaContext *ctx, const char *json_data);
+void parse_trade_data(AlpacaContext *ctx, const char *received_data);
+void process_received_data(AlpacaContext *ctx, const char *data);
+void send_auth_message(AlpacaContext *ctx, struct lws *wsi);
 void send_subscription_message(struct lws *wsi, json_t *params);
 int callback_alpaca(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 void sigint_handler(int sig);
 void to_upper(char *str);
 json_t *parse_symbols(const char *symbols_str);
 void print_help(const char *program_name);
+int save_checkpoint(const AlpacaContext *ctx, const char *path);
+int load_checkpoint(AlpacaContext *ctx, const char *path);
+void free_stored_data(AlpacaContext *ctx);
 
 #endif // ALPACA_LIB_JANSSON_H
@@ -3,278 +3,1171 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <jansson.h>
-#include <curl/curl.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "alpaca_rest.h"
+#include "alpaca_bars.h"
+#include "alpaca_bar_cache.h"
+#include "alpaca_latest.h"
+#include "alpaca_resample.h"
+#include "alpaca_ticks.h"
 
-#define URL_SIZE 500
-#define ALPACA_API_KEY getenv("APCA_API_KEY_ID")
-#define ALPACA_SECRET_KEY getenv("APCA_API_SECRET_KEY")
-#define ALPACA_ENDPOINT "https://data.alpaca.markets/v2"
+#define URL_SIZE 1024
 
-// Macro to get either the real or integer value of a json_t object
-#define GET_JSON_REAL_OR_INTEGER(json) \
-  (json_is_real(json) ? json_real_value(json) : json_integer_value(json))
+#define SECONDS_PER_DAY 86400
+#define CACHE_SETTLE_SECONDS 3600   // a UTC day is cached as complete this long after it ends
 
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define FOLLOW_DEFAULT_SETTLE 5.0   // seconds after a bar closes before it is requested
+
+// How bars are written to stdout
+typedef enum {
+  OUTPUT_TEXT,      // "Bar N: Time=..., Open=..." lines in local time
+  OUTPUT_CSV,       // headerless t,open,high,low,close,volume,trades,vw
+  OUTPUT_NDJSON,    // one JSON object per line with the API's field names
+  OUTPUT_BINARY     // packed 64-byte AlpacaBar records in host byte order
+} OutputFormat;
+
+// Per-fetch state: the request being paged through and its running counters.
+// Nothing is kept in globals, so independent fetches can run side by side.
 typedef struct {
-  char* data;
-  size_t size;
-} MemoryStruct;
-
-// This function is called by libcurl when it receives data.
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-  size_t realsize = size * nmemb;
-  MemoryStruct *mem = (MemoryStruct *)userp;
-
-  char* ptr = realloc(mem->data, mem->size + realsize + 1);
-  if(ptr == NULL) {
-    printf("not enough memory (realloc returned NULL)\n");
+  const char *symbol;
+  const char *timeframe;
+  const char *start_date;
+  const char *end_date;
+  int limit;
+  const char *sip;
+  size_t total_bars_count;
+  RestClient *client;   // long-lived connection shared by every page
+  bool report_latency;  // print per-page timing to stderr
+  size_t pages;
+  double total_latency_ms;
+  int shard_days;       // 0 fetches the whole range as one request chain
+  int concurrency;      // shards downloaded at the same time
+  const char *cache_dir; // local bar cache, or NULL to always download
+  size_t cached_days;
+  OutputFormat format;
+  struct BarShard *shards;
+  size_t num_shards;
+  size_t next_emit;     // first shard not yet completely printed
+  int64_t last_bar_t;   // start of the newest bar printed, 0 if none
+  BarResampler *resampler; // aggregates the downloaded bars before printing, or NULL
+  BarArray resampled;
+} FetcherContext;
+
+// One slice of the requested time range, paged through independently of the others
+typedef struct BarShard {
+  FetcherContext *ctx;
+  char start[32];
+  char end[32];
+  int64_t from;         // bounds in seconds since 1970, or -1 if the range was not parsed
+  int64_t to;
+  char *next_page_token;
+  BarArray bars;
+  size_t printed;       // bars already written to stdout
+  int64_t last_t;       // newest bar received, to skip repeats when a page is retried
+  BarStreamParser parser;
+  RestSink sink;
+  bool done;
+  bool failed;
+} BarShard;
+
+// Print how long a page took and whether it needed a new connection
+static void report_page_latency(FetcherContext *ctx, const RestClient *client) {
+  const RestTiming *timing = &client->timing;
+  ctx->pages++;
+  ctx->total_latency_ms += timing->total_ms;
+  if (ctx->report_latency) {
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(client->curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    fprintf(stderr, "Page %zu: total=%.1f ms, first_byte=%.1f ms, connect=%.1f ms, tls=%.1f ms, new_connections=%ld, bytes=%lld\n",
+      ctx->pages, timing->total_ms, timing->first_byte_ms, timing->connect_ms, timing->tls_ms,
+      timing->new_connections, (long long)bytes);
+  }
+}
+
+// Build the URL for one page of a shard, appending the page token if there is one
+static void build_bars_url(const FetcherContext *ctx, const BarShard *shard, char *url, size_t url_size) {
+  int n = snprintf(url, url_size, "%s/v2/stocks/%s/bars?timeframe=%s&start=%s&end=%s&limit=%d&feed=%s",
+    rest_data_url(), ctx->symbol, ctx->timeframe, shard->start, shard->end, ctx->limit, ctx->sip);
+  if (shard->next_page_token != NULL && n > 0 && (size_t)n < url_size) {
+    snprintf(url + n, url_size - n, "&page_token=%s", shard->next_page_token);
+  }
+}
+
+// Function to write bars in the selected output format. first_index numbers the
+// text format's "Bar N" lines.
+static void write_bars(FILE *out, OutputFormat format, const char *symbol, const AlpacaBar *bars, size_t count, size_t first_index) {
+  char time_str[32];
+
+  // Binary records are the in-memory layout, so a whole block is one write
+  if (format == OUTPUT_BINARY) {
+    if (count > 0 && fwrite(bars, sizeof(AlpacaBar), count, out) != count) {
+      perror("Error writing bars");
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const AlpacaBar *bar = &bars[i];
+
+    switch (format) {
+    case OUTPUT_CSV:
+      format_rfc3339(bar->t, time_str, sizeof(time_str));
+      fprintf(out, "%s,%.15g,%.15g,%.15g,%.15g,%lld,%lld,%.15g\n", time_str, bar->open, bar->high, bar->low, bar->close,
+        (long long)bar->volume, (long long)bar->trades, bar->vw);
+      break;
+    case OUTPUT_NDJSON:
+      format_rfc3339(bar->t, time_str, sizeof(time_str));
+      fprintf(out, "{\"S\":\"%s\",\"t\":\"%s\",\"o\":%.15g,\"h\":%.15g,\"l\":%.15g,\"c\":%.15g,\"v\":%lld,\"n\":%lld,\"vw\":%.15g}\n",
+        symbol, time_str, bar->open, bar->high, bar->low, bar->close,
+        (long long)bar->volume, (long long)bar->trades, bar->vw);
+      break;
+    default:
+      format_local_time(bar->t, time_str, sizeof(time_str));
+
+      // Print the bar information
+      fprintf(out, "Bar %6zu: Time=%s, Open=%.3f, High=%.3f, Low=%.3f, Close=%.3f, Volume=%8lld, Trade_Count=%5lld, Weighted_Volume=%.3f\n",
+        first_index+i+1, time_str, bar->open, bar->high, bar->low, bar->close,
+        (long long)bar->volume, (long long)bar->trades, bar->vw);
+      break;
+    }
+  }
+}
+
+// Function to print the bars of one shard to stdout. When resampling, the bars are
+// fed to the resampler instead and only the buckets they complete are printed.
+void print_bars(FetcherContext *ctx, const BarArray *bars) {
+  const BarArray *out = bars;
+  if (ctx->resampler) {
+    ctx->resampled.count = 0;
+    for (size_t i = 0; i < bars->count; i++) {
+      bar_resampler_push(ctx->resampler, &bars->bars[i], &ctx->resampled);
+    }
+    out = &ctx->resampled;
+  }
+  write_bars(stdout, ctx->format, ctx->symbol, out->bars, out->count, ctx->total_bars_count);
+  ctx->total_bars_count += out->count;
+  if (bars->count > 0) {
+    ctx->last_bar_t = bars->bars[bars->count - 1].t;
+  }
+}
+
+// Print the resampled bucket in progress if it has ended by now
+static void flush_resampled(FetcherContext *ctx, int64_t now) {
+  if (!ctx->resampler) {
+    return;
+  }
+  ctx->resampled.count = 0;
+  bar_resampler_flush(ctx->resampler, now, &ctx->resampled);
+  write_bars(stdout, ctx->format, ctx->symbol, ctx->resampled.bars, ctx->resampled.count, ctx->total_bars_count);
+  ctx->total_bars_count += ctx->resampled.count;
+}
+
+static void init_shard(BarShard *shard, int64_t from, int64_t to) {
+  shard->from = from;
+  shard->to = to;
+  format_rfc3339(from, shard->start, sizeof(shard->start));
+  format_rfc3339(to, shard->end, sizeof(shard->end));
+}
+
+// Serve one UTC day from the cache if a complete file for it exists
+static bool load_cached_day(FetcherContext *ctx, int64_t day, int64_t t0, int64_t t1, BarShard *shard) {
+  BarCacheDay cached;
+  if (bar_cache_open_day(ctx->cache_dir, ctx->sip, ctx->symbol, ctx->timeframe, day, &cached) != 0) {
+    return false;
+  }
+  bool hit = (cached.flags & BAR_CACHE_COMPLETE) != 0;
+  if (hit) {
+    init_shard(shard, day < t0 ? t0 : day, day + SECONDS_PER_DAY - 1 > t1 ? t1 : day + SECONDS_PER_DAY - 1);
+    hit = bar_cache_day_to_array(&cached, shard->from, shard->to, &shard->bars) == 0;
+    shard->done = hit;
+  }
+  bar_cache_close_day(&cached);
+  return hit;
+}
+
+// Function to size shards so one page of limit bars covers each of them, counting
+// every hour of the day: six days of 1Min bars, and the whole range as one request
+// chain for 1Day and coarser. An unknown timeframe gets day shards.
+static int shard_days_for_timeframe(const char *timeframe, int limit) {
+  int64_t tf = timeframe_seconds(timeframe);
+  if (tf <= 0) {
+    return 1;
+  }
+  if (tf >= SECONDS_PER_DAY) {
     return 0;
   }
+  int64_t days = (int64_t)limit * tf / SECONDS_PER_DAY;
+  return days < 1 ? 1 : days > 366 ? 0 : (int)days;
+}
 
-  mem->data = ptr;
-  memcpy(&(mem->data[mem->size]), contents, realsize);
-  mem->size += realsize;
-  mem->data[mem->size] = 0;
-
-  return realsize;
-}
-
-// Function to fetch JSON data from the Alpaca API
-char *fetch_json_data(char *symbol, char *timeframe, char *start_date, char *end_date, int limit, char *sip, char *next_page_token) {
-    CURL *curl;
-    CURLcode res;
-    char url[URL_SIZE];
-    char* url_format = "%s&page_token=%s";
-    char* base_url = "https://data.alpaca.markets/v2/stocks/%s/bars?timeframe=%s&start=%s&end=%s&limit=%d&feed=%s";
-    MemoryStruct chunk;
-
-    chunk.data = malloc(1);
-    chunk.size = 0;
-
-    /*
-    // Get the API key ID and secret key from environment variables
-    const char *api_key_id = getenv("APCA_API_KEY_ID");
-    const char *api_secret_key = getenv("APCA_API_SECRET_KEY");
-    */
-
-    // Check that the keys were found
-    if (!ALPACA_API_KEY || !ALPACA_SECRET_KEY) {
-      fprintf(stderr, "API key ID and/or secret key not found in environment variables\n");
-      return 1;
-    }
-
-    // Construct the URL for the API request
-    // Check if next_page_token is NULL
-    if (next_page_token == NULL) {
-      snprintf(url, URL_SIZE, base_url, symbol, timeframe, start_date, end_date, limit, sip);
-    }
-    else {
-      // Append next_page_token to the URL
-      char* url_with_token = malloc(strlen(base_url) + strlen(next_page_token) + strlen(url_format) + 1);
-      sprintf(url_with_token, url_format, base_url, next_page_token);
-      snprintf(url, URL_SIZE, url_with_token, symbol, timeframe, start_date, end_date, limit, sip);
-      free(url_with_token);
-    }
-
-    // Initialize a curl handle
-    curl = curl_easy_init();
-    if(curl) {
-        // Set the headers for the API request
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        char auth_header[128];
-        snprintf(auth_header, 128, "APCA-API-KEY-ID: %s", ALPACA_API_KEY);
-        headers = curl_slist_append(headers, auth_header);
-        char secret_header[128];
-        snprintf(secret_header, 128, "APCA-API-SECRET-KEY: %s", ALPACA_SECRET_KEY);
-        headers = curl_slist_append(headers, secret_header);
-
-        // Set options for the curl handle
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-        res = curl_easy_perform(curl);
-
-	// Check for errors in the curl request
-        if(res != CURLE_OK) {
-            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            free(chunk.data);
-	    exit(0);
-        }
+// Split [start, end] at UTC day boundaries into shards of shard_days days each.
+// Date-only bounds cover whole days: the start at 00:00:00Z and the end through 23:59:59Z.
+// With a cache, days already on disk become finished shards and only the runs of
+// missing days between them are requested.
+static BarShard *make_shards(FetcherContext *ctx, size_t *num_shards) {
+  BarShard *shards;
+
+  int64_t t0 = parse_rfc3339(ctx->start_date);
+  int64_t t1 = parse_rfc3339(ctx->end_date);
+  if (t1 >= 0 && strlen(ctx->end_date) == 10) {
+    t1 += SECONDS_PER_DAY - 1;
+  }
+
+  // Fall back to a single request chain when the range is not understood, or when
+  // sharding is off and there is no cache to consult
+  if (t0 < 0 || t1 < t0 || (ctx->shard_days <= 0 && !ctx->cache_dir)) {
+    shards = (BarShard *)calloc(1, sizeof(BarShard));
+    snprintf(shards[0].start, sizeof(shards[0].start), "%s", ctx->start_date);
+    snprintf(shards[0].end, sizeof(shards[0].end), "%s", ctx->end_date);
+    shards[0].from = -1;
+    shards[0].to = -1;
+    *num_shards = 1;
+    return shards;
+  }
+
+  int64_t first = t0 - t0 % SECONDS_PER_DAY;
+  size_t num_days = (size_t)((t1 - first) / SECONDS_PER_DAY + 1);
+  size_t max_run = ctx->shard_days > 0 ? (size_t)ctx->shard_days : num_days;
+  shards = (BarShard *)calloc(num_days, sizeof(BarShard));
+
+  size_t count = 0;
+  size_t run = 0;   // days in the shard currently being extended
+  for (size_t d = 0; d < num_days; d++) {
+    int64_t day = first + (int64_t)d * SECONDS_PER_DAY;
+    int64_t day_end = day + SECONDS_PER_DAY - 1;
+
+    if (ctx->cache_dir && load_cached_day(ctx, day, t0, t1, &shards[count])) {
+      ctx->cached_days++;
+      count++;
+      run = 0;
+      continue;
+    }
+
+    if (run > 0 && run < max_run) {
+      // Extend the current run of missing days
+      init_shard(&shards[count - 1], shards[count - 1].from, day_end > t1 ? t1 : day_end);
+      run++;
+    } else {
+      init_shard(&shards[count], day < t0 ? t0 : day, day_end > t1 ? t1 : day_end);
+      count++;
+      run = 1;
+    }
+  }
+  *num_shards = count;
+  return shards;
+}
 
-	// Cleanup curl handle and headers
-        curl_easy_cleanup(curl);
-    	curl_slist_free_all(headers);
+// Write each whole, settled UTC day of a downloaded shard to the cache. Days with no
+// bars (weekends, holidays) are stored too, so they are never requested again.
+static void store_shard_in_cache(FetcherContext *ctx, const BarShard *shard) {
+  if (!ctx->cache_dir || shard->from < 0 || shard->failed) {
+    return;
+  }
+
+  int64_t now = (int64_t)time(NULL);
+  size_t i = 0;
+  for (int64_t day = shard->from - shard->from % SECONDS_PER_DAY; day <= shard->to; day += SECONDS_PER_DAY) {
+    int64_t day_end = day + SECONDS_PER_DAY - 1;
+    size_t first = i;
+    while (i < shard->bars.count && shard->bars.bars[i].t <= day_end) {
+      i++;
+    }
+    bool whole_day = day >= shard->from && day_end <= shard->to;
+    if (whole_day && day_end + CACHE_SETTLE_SECONDS < now) {
+      bar_cache_write_day(ctx->cache_dir, ctx->sip, ctx->symbol, ctx->timeframe, day, shard->bars.bars + first, i - first, 1);
     }
-    return chunk.data; // return the received data
+  }
+}
+
+// Print the bars of a shard that have not been printed yet. Without a cache they
+// are dropped once printed, so the shard being printed never holds more than a chunk.
+static void flush_shard(FetcherContext *ctx, BarShard *shard) {
+  BarArray pending = { shard->bars.bars + shard->printed, shard->bars.count - shard->printed, 0 };
+  print_bars(ctx, &pending);
+  if (ctx->cache_dir) {
+    shard->printed = shard->bars.count;
+  } else {
+    shard->bars.count = 0;
+    shard->printed = 0;
+  }
 }
 
-// Define global variable
-size_t total_bars_count = 0;
+// Emit every shard that is now contiguous with what has already been printed,
+// and whatever has arrived so far of the first unfinished one
+static void emit_done_shards(FetcherContext *ctx) {
+  while (ctx->next_emit < ctx->num_shards && ctx->shards[ctx->next_emit].done) {
+    flush_shard(ctx, &ctx->shards[ctx->next_emit]);
+    bar_array_free(&ctx->shards[ctx->next_emit].bars);
+    ctx->next_emit++;
+  }
+  if (ctx->next_emit < ctx->num_shards) {
+    flush_shard(ctx, &ctx->shards[ctx->next_emit]);
+  }
+}
 
-// Convert from UTC timestring to local time format
-char* utc_to_local(char* utc_time_str) {
-    // Parse UTC time string
-    struct tm utc_tm = {0};
-    strptime(utc_time_str, "%Y-%m-%dT%H:%M:%SZ", &utc_tm);
-    time_t utc_time = timegm(&utc_tm);
+static void shard_on_bar(void *user, const char *symbol, const AlpacaBar *bar) {
+  BarShard *shard = (BarShard *)user;
+  // A retried page is parsed again from the start; skip the bars already kept
+  if (bar->t <= shard->last_t) {
+    return;
+  }
+  shard->last_t = bar->t;
+  if (bar_array_push(&shard->bars, bar) != 0) {
+    shard->failed = true;
+  }
+}
 
-    // Convert to local time using pre-loaded timezone information
-    struct tm local_tm = {0};
-    localtime_r(&utc_time, &local_tm);
+static int shard_sink_begin(void *user) {
+  bar_stream_reset(&((BarShard *)user)->parser);
+  return 0;
+}
 
-    // Format local time string
-    char* local_time_str = (char*) malloc(20);
-    strftime(local_time_str, 25, "%Y-%m-%d %H:%M:%S %Z", &local_tm);
+// Parse each chunk of a page as it arrives and print it at once if this is the
+// shard currently at the head of the output
+static int shard_sink_write(void *user, const char *data, size_t len) {
+  BarShard *shard = (BarShard *)user;
+  FetcherContext *ctx = shard->ctx;
+  if (bar_stream_feed(&shard->parser, data, len) != 0 || shard->failed) {
+    return -1;
+  }
+  if (shard == &ctx->shards[ctx->next_emit]) {
+    flush_shard(ctx, shard);
+  }
+  return 0;
+}
 
-    return local_time_str;
+static void start_shard(FetcherContext *ctx, RestMulti *multi, RestClient *client, BarShard *shard) {
+  char url[URL_SIZE];
+  client->user = shard;
+  rest_client_set_sink(client, &shard->sink);
+  build_bars_url(ctx, shard, url, sizeof(url));
+  rest_multi_add(multi, client, url);
 }
 
-char* parse_json_data(char* json_data) {
-  char* next_page_token = NULL;
-  const char* time_format = "%Y-%m-%d %H:%M:%S CST"; // Format string for the timestamp
-  // Get the JSON objects for the bar fields
-  json_t *alpaca_time, *open, *high, *low, *close, *volume, *trade_count, *weighted_volume;
+// Function to download the requested range. Shards are fetched concurrently over a
+// curl multi handle, each following its own next_page_token chain, and are printed
+// in timestamp order as soon as every earlier shard has completed. Pages are parsed
+// while they download, and the bars of the first unfinished shard are printed as
+// they arrive.
+int download_bars(FetcherContext *ctx) {
+  size_t num_shards;
+  BarShard *shards = make_shards(ctx, &num_shards);
+  ctx->shards = shards;
+  ctx->num_shards = num_shards;
+  ctx->next_emit = 0;
 
-  // Parse the received JSON using jansson
-  json_error_t error;
-  json_t *root = json_loads(json_data, 0, &error);
-  free(json_data);
+  // Shards served from the cache are already done
+  size_t num_missing = 0;
+  for (size_t i = 0; i < num_shards; i++) {
+    BarShard *shard = &shards[i];
+    num_missing += !shard->done;
+    shard->ctx = ctx;
+    shard->last_t = INT64_MIN;
+    bar_stream_init(&shard->parser, shard_on_bar, shard);
+    shard->sink.begin = shard_sink_begin;
+    shard->sink.write = shard_sink_write;
+    shard->sink.user = shard;
+  }
 
-  if (!root) {
-    fprintf(stderr, "error: on line %d: %s\n", error.line, error.text);
-    return NULL;
+  int concurrency = ctx->concurrency < 1 ? 1 : ctx->concurrency;
+  if ((size_t)concurrency > num_missing) {
+    concurrency = (int)num_missing;
   }
 
-  // Extract and print the desired data
-  json_t *bars = json_object_get(root, "bars");
-  if (!json_is_array(bars)) {
-    fprintf(stderr, "Error: 'bars' is not an array.\n");
-    fprintf(stderr, "\n");
-    json_decref(root);
-    return NULL;
+  RestMulti *multi = rest_multi_create(concurrency);
+  RestClient **clients = (RestClient **)calloc(concurrency, sizeof(RestClient *));
+  if (!multi || (concurrency > 0 && !clients)) {
+    free(shards);
+    free(clients);
+    rest_multi_destroy(multi);
+    return -1;
+  }
+
+  // Start one shard on every client
+  size_t next_shard = 0;
+  for (int i = 0; i < concurrency; i++) {
+    while (shards[next_shard].done) {
+      next_shard++;
+    }
+    clients[i] = rest_client_create();
+    if (!clients[i]) {
+      break;
+    }
+    rest_client_set_fresh_connections(clients[i], ctx->client->fresh_connections);
+    rest_client_set_priority(clients[i], REST_PRIORITY_BULK);
+    start_shard(ctx, multi, clients[i], &shards[next_shard]);
+    next_shard++;
   }
 
-  // Extract the next page token (if any) and print it out
-  json_t* next_page_token_json = json_object_get(root, "next_page_token");
-  if (json_is_string(next_page_token_json)) {
-    next_page_token = strdup(json_string_value(next_page_token_json));
-    // printf("Next page token: %s\n", next_page_token);
+  // Print any cached shards at the head of the range straight away
+  emit_done_shards(ctx);
+
+  int failures = 0;
+  RestClient *client;
+  while ((client = rest_multi_next(multi)) != NULL) {
+    BarShard *shard = (BarShard *)client->user;
+
+    // Retries have already been spent by the scheduler; give up on this shard only
+    free(shard->next_page_token);
+    shard->next_page_token = NULL;
+    if (!rest_client_ok(client)) {
+      fprintf(stderr, "Error fetching bars for %s from %s to %s: %s\n", ctx->symbol, shard->start, shard->end, rest_client_error(client));
+      shard->failed = true;
+    } else {
+      report_page_latency(ctx, client);
+      if (bar_stream_finish(&shard->parser, &shard->next_page_token) != 0) {
+        shard->failed = true;
+      }
+    }
+    if (shard->failed) {
+      free(shard->next_page_token);
+      shard->next_page_token = NULL;
+      failures++;
+    }
+
+    if (shard->next_page_token != NULL) {
+      // Keep paging this shard on the same client
+      start_shard(ctx, multi, client, shard);
+      continue;
+    }
+
+    shard->done = true;
+    store_shard_in_cache(ctx, shard);
+    emit_done_shards(ctx);
+
+    // Move this client on to the next pending shard
+    while (next_shard < num_shards && shards[next_shard].done) {
+      next_shard++;
+    }
+    if (next_shard < num_shards) {
+      start_shard(ctx, multi, client, &shards[next_shard]);
+      next_shard++;
+    }
+  }
+
+  for (int i = 0; i < concurrency; i++) {
+    rest_client_destroy(clients[i]);
+  }
+  free(clients);
+  rest_multi_destroy(multi);
+  for (size_t i = 0; i < num_shards; i++) {
+    bar_array_free(&shards[i].bars);
+    free(shards[i].next_page_token);
+  }
+  free(shards);
+  ctx->shards = NULL;
+  ctx->num_shards = 0;
+  return failures ? -1 : 0;
+}
+
+// State of one symbol in universe mode
+typedef struct {
+  char symbol[SYMBOL_SIZE];
+  int64_t last_t;       // newest bar written, to skip repeats when a page is retried
+  size_t count;
+} UniverseSymbol;
+
+// A group of symbols fetched together through /v2/stocks/bars?symbols=. Responses
+// are ordered by symbol, so only one output file per batch is open at a time.
+typedef struct {
+  FetcherContext *ctx;
+  const char *outdir;
+  char *symbols_param;  // comma-separated list for the URL
+  UniverseSymbol *symbols;
+  size_t num_symbols;
+  size_t current;       // symbol whose file is open, or num_symbols if none
+  FILE *out;
+  char *next_page_token;
+  BarStreamParser parser;
+  RestSink sink;
+  bool failed;
+} UniverseBatch;
+
+static const char *format_extension(OutputFormat format) {
+  switch (format) {
+  case OUTPUT_CSV: return "csv";
+  case OUTPUT_NDJSON: return "ndjson";
+  case OUTPUT_BINARY: return "bin";
+  default: return "txt";
+  }
+}
+
+static void universe_close_output(UniverseBatch *batch) {
+  if (batch->out) {
+    if (fclose(batch->out) != 0) {
+      perror("Error writing bar file");
+      batch->failed = true;
+    }
+    batch->out = NULL;
+  }
+  batch->current = batch->num_symbols;
+}
+
+// Switch the open output file to symbol; files are created on the symbol's first bar
+static bool universe_select_symbol(UniverseBatch *batch, const char *symbol) {
+  if (batch->current < batch->num_symbols && strcmp(batch->symbols[batch->current].symbol, symbol) == 0) {
+    return true;
+  }
+  universe_close_output(batch);
+
+  size_t i;
+  for (i = 0; i < batch->num_symbols; i++) {
+    if (strcmp(batch->symbols[i].symbol, symbol) == 0) {
+      break;
+    }
+  }
+  if (i == batch->num_symbols) {
+    return false;
+  }
+
+  char path[URL_SIZE];
+  snprintf(path, sizeof(path), "%s/%s.%s", batch->outdir, symbol, format_extension(batch->ctx->format));
+  batch->out = fopen(path, batch->symbols[i].count > 0 ? "ab" : "wb");
+  if (!batch->out) {
+    perror("Error opening bar file");
+    batch->failed = true;
+    return false;
+  }
+  setvbuf(batch->out, NULL, _IOFBF, 1 << 16);
+  batch->current = i;
+  return true;
+}
+
+static void universe_on_bar(void *user, const char *symbol, const AlpacaBar *bar) {
+  UniverseBatch *batch = (UniverseBatch *)user;
+  if (!symbol || !universe_select_symbol(batch, symbol)) {
+    return;
+  }
+  UniverseSymbol *entry = &batch->symbols[batch->current];
+  // A retried page is parsed again from the start; skip the bars already written
+  if (bar->t <= entry->last_t) {
+    return;
+  }
+  entry->last_t = bar->t;
+  write_bars(batch->out, batch->ctx->format, entry->symbol, bar, 1, entry->count);
+  entry->count++;
+}
+
+static int universe_sink_begin(void *user) {
+  bar_stream_reset(&((UniverseBatch *)user)->parser);
+  return 0;
+}
+
+static int universe_sink_write(void *user, const char *data, size_t len) {
+  UniverseBatch *batch = (UniverseBatch *)user;
+  if (bar_stream_feed(&batch->parser, data, len) != 0 || batch->failed) {
+    return -1;
+  }
+  return 0;
+}
+
+static void start_batch(FetcherContext *ctx, RestMulti *multi, RestClient *client, UniverseBatch *batch) {
+  size_t size = strlen(batch->symbols_param) + URL_SIZE;
+  char *url = (char *)malloc(size);
+  if (!url) {
+    batch->failed = true;
+    return;
+  }
+  int n = snprintf(url, size, "%s/v2/stocks/bars?symbols=%s&timeframe=%s&start=%s&end=%s&limit=%d&feed=%s",
+    rest_data_url(), batch->symbols_param, ctx->timeframe, ctx->start_date, ctx->end_date, ctx->limit, ctx->sip);
+  if (batch->next_page_token != NULL && n > 0 && (size_t)n < size) {
+    snprintf(url + n, size - n, "&page_token=%s", batch->next_page_token);
+  }
+
+  client->user = batch;
+  rest_client_set_sink(client, &batch->sink);
+  rest_multi_add(multi, client, url);
+  free(url);
+}
+
+// Function to fetch bars for a list of symbols, batch_size symbols per request chain,
+// with up to ctx->concurrency batches in flight. Each symbol's bars are written to
+// outdir/SYMBOL.<format> as they stream in.
+int download_universe(FetcherContext *ctx, char **symbols, size_t num_symbols, int batch_size, const char *outdir) {
+  if (batch_size < 1) {
+    batch_size = 1;
+  }
+  if (mkdir(outdir, 0755) != 0 && errno != EEXIST) {
+    perror("Error creating output directory");
+    return -1;
+  }
+
+  size_t num_batches = (num_symbols + batch_size - 1) / batch_size;
+  UniverseBatch *batches = (UniverseBatch *)calloc(num_batches ? num_batches : 1, sizeof(UniverseBatch));
+  if (!batches) {
+    return -1;
+  }
+
+  for (size_t b = 0; b < num_batches; b++) {
+    UniverseBatch *batch = &batches[b];
+    size_t first = b * batch_size;
+    size_t count = num_symbols - first < (size_t)batch_size ? num_symbols - first : (size_t)batch_size;
+
+    size_t param_size = 1;
+    for (size_t i = 0; i < count; i++) {
+      param_size += strlen(symbols[first + i]) + 1;
+    }
+    batch->ctx = ctx;
+    batch->outdir = outdir;
+    batch->symbols_param = (char *)calloc(1, param_size);
+    batch->symbols = (UniverseSymbol *)calloc(count, sizeof(UniverseSymbol));
+    if (!batch->symbols_param || !batch->symbols) {
+      batch->failed = true;
+      continue;
+    }
+    batch->num_symbols = count;
+    batch->current = count;
+    for (size_t i = 0; i < count; i++) {
+      snprintf(batch->symbols[i].symbol, sizeof(batch->symbols[i].symbol), "%s", symbols[first + i]);
+      batch->symbols[i].last_t = INT64_MIN;
+      if (i > 0) {
+        strcat(batch->symbols_param, ",");
+      }
+      strcat(batch->symbols_param, symbols[first + i]);
+    }
+    bar_stream_init(&batch->parser, universe_on_bar, batch);
+    batch->sink.begin = universe_sink_begin;
+    batch->sink.write = universe_sink_write;
+    batch->sink.user = batch;
+  }
+
+  int concurrency = ctx->concurrency < 1 ? 1 : ctx->concurrency;
+  if ((size_t)concurrency > num_batches) {
+    concurrency = (int)num_batches;
+  }
+  RestMulti *multi = rest_multi_create(concurrency);
+  RestClient **clients = (RestClient **)calloc(concurrency ? concurrency : 1, sizeof(RestClient *));
+  int failures = 0;
+  size_t next_batch = 0;
+
+  if (multi && clients) {
+    for (int i = 0; i < concurrency; i++) {
+      clients[i] = rest_client_create();
+      if (!clients[i]) {
+        break;
+      }
+      rest_client_set_fresh_connections(clients[i], ctx->client->fresh_connections);
+      rest_client_set_priority(clients[i], REST_PRIORITY_BULK);
+      start_batch(ctx, multi, clients[i], &batches[next_batch++]);
+    }
+
+    RestClient *client;
+    while ((client = rest_multi_next(multi)) != NULL) {
+      UniverseBatch *batch = (UniverseBatch *)client->user;
+
+      free(batch->next_page_token);
+      batch->next_page_token = NULL;
+      if (!rest_client_ok(client)) {
+        fprintf(stderr, "Error fetching bars for %s: %s\n", batch->symbols_param, rest_client_error(client));
+        batch->failed = true;
+      } else {
+        report_page_latency(ctx, client);
+        if (bar_stream_finish(&batch->parser, &batch->next_page_token) != 0) {
+          batch->failed = true;
+        }
+      }
+
+      if (!batch->failed && batch->next_page_token != NULL) {
+        // The next page continues the batch where this one stopped
+        start_batch(ctx, multi, client, batch);
+        continue;
+      }
+      universe_close_output(batch);
+      if (batch->failed) {
+        failures++;
+      }
+
+      if (next_batch < num_batches) {
+        start_batch(ctx, multi, client, &batches[next_batch++]);
+      }
+    }
+
+    for (int i = 0; i < concurrency; i++) {
+      rest_client_destroy(clients[i]);
+    }
   } else {
-    next_page_token = NULL;
-    // printf("Next page token not found\n");
+    failures++;
   }
+  free(clients);
+  rest_multi_destroy(multi);
+
+  size_t with_bars = 0;
+  for (size_t b = 0; b < num_batches; b++) {
+    for (size_t i = 0; i < batches[b].num_symbols; i++) {
+      ctx->total_bars_count += batches[b].symbols[i].count;
+      with_bars += batches[b].symbols[i].count > 0;
+    }
+    universe_close_output(&batches[b]);
+    free(batches[b].symbols_param);
+    free(batches[b].symbols);
+    free(batches[b].next_page_token);
+  }
+  free(batches);
+
+  fprintf(stderr, "Fetched %zu bars for %zu of %zu symbols in %zu requests.\n", ctx->total_bars_count, with_bars, num_symbols, ctx->pages);
+  return failures ? -1 : 0;
+}
 
-  size_t bars_count = json_array_size(bars);
+struct TickSymbol;
 
-  for (size_t i = 0; i < bars_count; i++) {
-    json_t *bar = json_array_get(bars, i);
+// One trading day of one symbol in -ticks mode. The day is encoded into a scratch
+// file as its pages stream in, so memory does not grow with the number of records.
+typedef struct {
+  FetcherContext *ctx;
+  struct TickSymbol *owner;
+  int64_t day_start;    // New York midnight, in seconds since 1970 UTC
+  char start[32];
+  char end[48];
+  char *next_page_token;
+  TickStreamParser parser;
+  TickEncoder encoder;
+  TickEncoderMark page_mark; // encoder position when the current page started, for retries
+  FILE *run;
+  RestSink sink;
+  bool done;
+  bool failed;
+} TickTask;
 
-    // Parse the UTC time
-    alpaca_time = json_object_get(bar, "t");
-    const char *utc_time_str = json_string_value(alpaca_time);
-    // strptime(utc_time_str, "%Y-%m-%dT%H:%M:%SZ", &utc_tm);
+// A symbol's data file, assembled from its days in order as they complete
+typedef struct TickSymbol {
+  const char *symbol;
+  TickKind kind;
+  const char *outdir;
+  TickTask *tasks;
+  size_t num_tasks;
+  size_t next_append;   // first day not yet copied into the data file
+  TickFileWriter writer;
+  bool open;
+  bool failed;
+  uint64_t json_bytes;
+} TickSymbol;
 
-    char* local_time_str = utc_to_local(utc_time_str);
+static void tick_task_on_tick(void *user, const char *symbol, const void *tick) {
+  TickTask *task = (TickTask *)user;
+  if (!task->failed && tick_encoder_put(&task->encoder, tick) != 0) {
+    perror("Error writing tick data");
+    task->failed = true;
+  }
+}
 
-    // Get the values for the bar fields
-    open = json_object_get(bar, "o");
-    high = json_object_get(bar, "h");
-    low = json_object_get(bar, "l");
-    close = json_object_get(bar, "c");
-    volume = json_object_get(bar, "v");
-    trade_count = json_object_get(bar, "n");
-    weighted_volume = json_object_get(bar, "vw");
-    double open_value = GET_JSON_REAL_OR_INTEGER(open);
-    double high_value = GET_JSON_REAL_OR_INTEGER(high);
-    double low_value = GET_JSON_REAL_OR_INTEGER(low);
-    double close_value = GET_JSON_REAL_OR_INTEGER(close);
+// A retried page starts over, so drop whatever the failed attempt encoded
+static int tick_task_sink_begin(void *user) {
+  TickTask *task = (TickTask *)user;
+  if (tick_encoder_rewind(&task->encoder, &task->page_mark) != 0) {
+    return -1;
+  }
+  tick_stream_reset(&task->parser);
+  return 0;
+}
 
-    // Print the bar information
-    printf("Bar %6zu: Time=%s, Open=%.3f, High=%.3f, Low=%.3f, Close=%.3f, Volume=%8lld, Trade_Count=%5lld, Weighted_Volume=%.3f\n",
-      total_bars_count+i+1, local_time_str, open_value, high_value, low_value, close_value, json_integer_value(volume), json_integer_value(trade_count),
-      json_real_value(weighted_volume));
+static int tick_task_sink_write(void *user, const char *data, size_t len) {
+  TickTask *task = (TickTask *)user;
+  task->owner->json_bytes += len;
+  if (tick_stream_feed(&task->parser, data, len) != 0 || task->failed) {
+    return -1;
   }
-  total_bars_count += bars_count;
-  json_decref(root);
-  return next_page_token;
+  return 0;
 }
 
-double get_latest_trade(char* symbol, char* sip) {
-  CURL *curl;
-  CURLcode res;
-  MemoryStruct chunk;
+static void start_tick_task(FetcherContext *ctx, RestMulti *multi, RestClient *client, TickTask *task) {
+  char url[URL_SIZE];
+  if (!task->run) {
+    task->run = tmpfile();
+    if (!task->run) {
+      perror("Error creating scratch file");
+      task->failed = true;
+      return;
+    }
+    if (tick_encoder_init(&task->encoder, task->owner->kind, task->run) != 0) {
+      fprintf(stderr, "not enough memory for the tick encoder\n");
+      task->failed = true;
+      return;
+    }
+  }
+  // Pages start on a block boundary so a retry only has to cut the scratch file
+  if (tick_encoder_flush(&task->encoder) != 0) {
+    perror("Error writing tick data");
+    task->failed = true;
+    return;
+  }
+  tick_encoder_mark(&task->encoder, &task->page_mark);
+
+  int n = snprintf(url, sizeof(url), "%s/v2/stocks/%s/%s?start=%s&end=%s&limit=%d&feed=%s",
+    rest_data_url(), task->owner->symbol, tick_kind_name(task->owner->kind), task->start, task->end, ctx->limit, ctx->sip);
+  if (task->next_page_token != NULL && n > 0 && (size_t)n < sizeof(url)) {
+    snprintf(url + n, sizeof(url) - n, "&page_token=%s", task->next_page_token);
+  }
+  client->user = task;
+  rest_client_set_sink(client, &task->sink);
+  rest_multi_add(multi, client, url);
+}
 
-  chunk.data = malloc(1);
-  chunk.size = 0;
+// Copy every finished day that follows the last one copied into the symbol's data
+// file, and commit the file once its last day is in. A failed day is left out of
+// the index, so it reads as missing rather than empty.
+static void append_tick_runs(TickSymbol *sym) {
+  while (sym->next_append < sym->num_tasks && sym->tasks[sym->next_append].done) {
+    TickTask *task = &sym->tasks[sym->next_append++];
+    if (task->failed) {
+      char date[16];
+      format_date(task->day_start + exchange_utc_offset(task->day_start), date, sizeof(date));
+      fprintf(stderr, "Error: %s %s for %s are missing from %s/%s.%s\n", sym->symbol, tick_kind_name(sym->kind), date,
+        sym->outdir, sym->symbol, tick_kind_name(sym->kind));
+    } else if (!sym->failed) {
+      if (!sym->open) {
+        sym->open = tick_file_create(&sym->writer, sym->outdir, sym->symbol, sym->kind) == 0;
+        sym->failed = !sym->open;
+      }
+      if (sym->open && (fflush(task->run) != 0 || tick_file_append_run(&sym->writer, task->day_start, task->run, &task->encoder) != 0)) {
+        sym->failed = true;
+      }
+    }
+    if (task->run) {
+      fclose(task->run);
+      task->run = NULL;
+    }
+    tick_encoder_free(&task->encoder);
+  }
 
-  curl_global_init(CURL_GLOBAL_ALL);
+  if (sym->next_append == sym->num_tasks && sym->open) {
+    if (sym->failed) {
+      tick_file_abort(&sym->writer);
+    } else if (tick_file_commit(&sym->writer) != 0) {
+      sym->failed = true;
+    }
+    sym->open = false;
+  }
+}
 
-  curl = curl_easy_init();
-  if(curl) {
-    // Convert symbol to uppercase
-    int len = strlen(symbol);
-    for (int i = 0; i < len; i++) {
-      symbol[i] = toupper(symbol[i]);
+// Start the next pending day on client. Days that cannot even start are finished
+// on the spot.
+static void start_next_tick_task(FetcherContext *ctx, RestMulti *multi, RestClient *client,
+                                 TickTask *tasks, size_t num_tasks, size_t *next_task, int *failures) {
+  while (*next_task < num_tasks) {
+    TickTask *task = &tasks[(*next_task)++];
+    start_tick_task(ctx, multi, client, task);
+    if (!task->failed) {
+      return;
     }
+    task->done = true;
+    (*failures)++;
+    append_tick_runs(task->owner);
+  }
+}
+
+// Function to download trades or quotes for every symbol and every weekday from
+// start_date to end_date (New York dates) into outdir/SYMBOL.trades|quotes and its
+// .idx index. Days are the unit of work: up to ctx->concurrency of them are in
+// flight at once, each following its own next_page_token chain and encoding its
+// records into a scratch file as they stream in.
+int download_ticks(FetcherContext *ctx, char **symbols, size_t num_symbols, TickKind kind, const char *outdir) {
+  int64_t t0 = parse_rfc3339(ctx->start_date);
+  int64_t t1 = parse_rfc3339(ctx->end_date);
+  if (t0 < 0 || t1 < t0) {
+    fprintf(stderr, "Error: -ticks needs a valid -start and -end date.\n");
+    return -1;
+  }
+  if (mkdir(outdir, 0755) != 0 && errno != EEXIST) {
+    perror("Error creating output directory");
+    return -1;
+  }
 
-    char url[256];
-    snprintf(url, 256, "%s/stocks/%s/trades/latest?feed=%s", ALPACA_ENDPOINT, symbol, sip);
+  // Weekend days never have data and are not requested
+  int64_t first_day = t0 / SECONDS_PER_DAY;
+  int64_t last_day = t1 / SECONDS_PER_DAY;
+  size_t days_per_symbol = 0;
+  for (int64_t d = first_day; d <= last_day; d++) {
+    int weekday = (int)((d + 4) % 7);
+    days_per_symbol += weekday != 0 && weekday != 6;
+  }
 
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    char auth_header[1024];
-    snprintf(auth_header, 1024, "APCA-API-KEY-ID: %s", ALPACA_API_KEY);
-    headers = curl_slist_append(headers, auth_header);
-    char auth_secret_header[1024];
-    snprintf(auth_secret_header, 1024, "APCA-API-SECRET-KEY: %s", ALPACA_SECRET_KEY);
-    headers = curl_slist_append(headers, auth_secret_header);
+  size_t num_tasks = num_symbols * days_per_symbol;
+  TickSymbol *syms = (TickSymbol *)calloc(num_symbols ? num_symbols : 1, sizeof(TickSymbol));
+  TickTask *tasks = (TickTask *)calloc(num_tasks ? num_tasks : 1, sizeof(TickTask));
+  if (!syms || !tasks) {
+    free(syms);
+    free(tasks);
+    return -1;
+  }
 
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+  // Tasks are ordered by symbol, then day, so the days in flight together usually
+  // belong to the same symbol and its file can be completed early
+  size_t n = 0;
+  for (size_t s = 0; s < num_symbols; s++) {
+    TickSymbol *sym = &syms[s];
+    sym->symbol = symbols[s];
+    sym->kind = kind;
+    sym->outdir = outdir;
+    sym->tasks = &tasks[n];
+    sym->num_tasks = days_per_symbol;
+    for (int64_t d = first_day; d <= last_day; d++) {
+      int weekday = (int)((d + 4) % 7);
+      if (weekday == 0 || weekday == 6) {
+        continue;
+      }
+      TickTask *task = &tasks[n++];
+      int64_t next_day = exchange_local_to_utc((d + 1) * SECONDS_PER_DAY);
+      task->ctx = ctx;
+      task->owner = sym;
+      task->day_start = exchange_local_to_utc(d * SECONDS_PER_DAY);
+      format_rfc3339(task->day_start, task->start, sizeof(task->start));
+      // The end is inclusive, so stop at the last nanosecond before the next midnight
+      format_rfc3339(next_day - 1, task->end, sizeof(task->end));
+      snprintf(task->end + strlen(task->end) - 1, sizeof(task->end) - strlen(task->end) + 1, ".999999999Z");
+      tick_stream_init(&task->parser, kind, tick_task_on_tick, task);
+      task->sink.begin = tick_task_sink_begin;
+      task->sink.write = tick_task_sink_write;
+      task->sink.user = task;
+    }
+  }
 
-    res = curl_easy_perform(curl);
+  int concurrency = ctx->concurrency < 1 ? 1 : ctx->concurrency;
+  if ((size_t)concurrency > num_tasks) {
+    concurrency = (int)num_tasks;
+  }
+  RestMulti *multi = rest_multi_create(concurrency);
+  RestClient **clients = (RestClient **)calloc(concurrency ? concurrency : 1, sizeof(RestClient *));
+  int failures = 0;
+  size_t next_task = 0;
 
-    if(res != CURLE_OK) {
-      fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-      curl_easy_cleanup(curl);
-      curl_global_cleanup();
-      free(chunk.data);
-      return -1.0;
+  if (multi && clients) {
+    for (int i = 0; i < concurrency; i++) {
+      clients[i] = rest_client_create();
+      if (!clients[i]) {
+        break;
+      }
+      rest_client_set_fresh_connections(clients[i], ctx->client->fresh_connections);
+      rest_client_set_priority(clients[i], REST_PRIORITY_BULK);
+      start_next_tick_task(ctx, multi, clients[i], tasks, num_tasks, &next_task, &failures);
     }
 
-    double price = -1.0;
+    RestClient *client;
+    while ((client = rest_multi_next(multi)) != NULL) {
+      TickTask *task = (TickTask *)client->user;
+
+      free(task->next_page_token);
+      task->next_page_token = NULL;
+      if (!rest_client_ok(client)) {
+        fprintf(stderr, "Error fetching %s for %s from %s: %s\n", tick_kind_name(kind), task->owner->symbol, task->start, rest_client_error(client));
+        task->failed = true;
+      } else {
+        report_page_latency(ctx, client);
+        if (tick_stream_finish(&task->parser, &task->next_page_token) != 0) {
+          task->failed = true;
+        }
+      }
 
-    json_error_t error;
-    json_t *root = json_loads(chunk.data, 0, &error);
-    if (root != NULL) {
-      json_t *trade = json_object_get(root, "trade");
-      if (json_is_object(trade)) {
-        json_t *price_item = json_object_get(trade, "p");
-        if (json_is_number(price_item)) {
-          price = json_number_value(price_item);
+      if (!task->failed && task->next_page_token != NULL) {
+        // Keep paging this day on the same client
+        start_tick_task(ctx, multi, client, task);
+        if (!task->failed) {
+          continue;
         }
       }
-      json_decref(root);
+      free(task->next_page_token);
+      task->next_page_token = NULL;
+      if (!task->failed && tick_encoder_flush(&task->encoder) != 0) {
+        perror("Error writing tick data");
+        task->failed = true;
+      }
+      task->done = true;
+      failures += task->failed;
+      ctx->total_bars_count += task->encoder.count;
+      append_tick_runs(task->owner);
+      start_next_tick_task(ctx, multi, client, tasks, num_tasks, &next_task, &failures);
     }
 
-    json_decref(root);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    free(chunk.data);
+    for (int i = 0; i < concurrency; i++) {
+      rest_client_destroy(clients[i]);
+    }
+  } else {
+    failures++;
+  }
+  free(clients);
+  rest_multi_destroy(multi);
+
+  uint64_t json_bytes = 0;
+  uint64_t encoded_bytes = 0;
+  for (size_t i = 0; i < num_tasks; i++) {
+    encoded_bytes += tasks[i].encoder.bytes;
+    if (tasks[i].run) {
+      fclose(tasks[i].run);
+    }
+    tick_encoder_free(&tasks[i].encoder);
+    free(tasks[i].next_page_token);
+  }
+  for (size_t s = 0; s < num_symbols; s++) {
+    json_bytes += syms[s].json_bytes;
+    failures += syms[s].failed;
+    if (syms[s].open) {
+      tick_file_abort(&syms[s].writer);
+    }
+  }
+  free(tasks);
+  free(syms);
+
+  fprintf(stderr, "Wrote %zu %s for %zu symbols in %zu requests: %.1f MB encoded from %.1f MB of JSON.\n",
+    ctx->total_bars_count, tick_kind_name(kind), num_symbols, ctx->pages, encoded_bytes / 1e6, json_bytes / 1e6);
+  return failures ? -1 : 0;
+}
+
+static volatile sig_atomic_t follow_stop = 0;
+
+static void follow_signal_handler(int signum) {
+  follow_stop = 1;
+}
+
+// Sleep until the given wall-clock time, waking early if interrupted
+static void follow_sleep_until(double wake_at) {
+  while (!follow_stop) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double remaining = wake_at - (now.tv_sec + now.tv_nsec / 1e9);
+    if (remaining <= 0) {
+      return;
+    }
+    struct timespec delay = { (time_t)remaining, (long)((remaining - (time_t)remaining) * 1e9) };
+    nanosleep(&delay, NULL);
+  }
+}
+
+// Fetch the bars that started after since, up to now, following next_page_token
+static int fetch_bars_since(FetcherContext *ctx, int64_t since, BarArray *out) {
+  char url[URL_SIZE];
+  char start[32];
+  char *page_token = NULL;
+  format_rfc3339(since, start, sizeof(start));
+
+  do {
+    int n = snprintf(url, sizeof(url), "%s/v2/stocks/%s/bars?timeframe=%s&start=%s&limit=%d&feed=%s",
+      rest_data_url(), ctx->symbol, ctx->timeframe, start, ctx->limit, ctx->sip);
+    if (page_token != NULL && n > 0 && (size_t)n < sizeof(url)) {
+      snprintf(url + n, sizeof(url) - n, "&page_token=%s", page_token);
+    }
+    free(page_token);
+    page_token = NULL;
 
-    return price;
+    size_t len = 0;
+    const char *body = rest_client_get(ctx->client, url, &len);
+    if (body == NULL || !rest_client_ok(ctx->client)) {
+      fprintf(stderr, "Error polling bars for %s: %s\n", ctx->symbol, rest_client_error(ctx->client));
+      return -1;
+    }
+    report_page_latency(ctx, ctx->client);
+    if (parse_bars_page(body, len, out, &page_token) != 0) {
+      return -1;
+    }
+  } while (page_token != NULL);
+  return 0;
+}
+
+// Function to keep printing new bars after the initial download. It sleeps until
+// the next bar on the grid of the newest bar seen has closed, plus settle seconds,
+// then asks only for bars after that newest one, so each poll costs one request
+// however long the session has been running. Runs until SIGINT or SIGTERM.
+int follow_bars(FetcherContext *ctx, double settle) {
+  int64_t tf = timeframe_seconds(ctx->timeframe);
+  if (tf <= 0 || tf > SECONDS_PER_DAY) {
+    fprintf(stderr, "Error: -follow needs a timeframe between 1Min and 1Day, not '%s'.\n", ctx->timeframe);
+    return -1;
+  }
+
+  signal(SIGINT, follow_signal_handler);
+  signal(SIGTERM, follow_signal_handler);
+
+  // Without any bar yet, poll on a grid aligned to the epoch from the start of the range
+  int64_t anchor = ctx->last_bar_t;
+  if (anchor <= 0) {
+    int64_t start = parse_rfc3339(ctx->start_date);
+    int64_t now = (int64_t)time(NULL);
+    anchor = (start > 0 && start < now ? start : now);
+    anchor -= anchor % tf + tf;
   }
 
-  curl_global_cleanup();
-  free(chunk.data);
+  BarArray polled = { NULL, 0, 0 };
+  while (!follow_stop) {
+    fflush(stdout);
+
+    // The earliest boundary at which a bar after the anchor is complete and settled
+    int64_t now = (int64_t)time(NULL);
+    int64_t periods = (int64_t)((now - settle - anchor) / tf) + 1;
+    if (periods < 2) {
+      periods = 2;
+    }
+    follow_sleep_until((double)(anchor + periods * tf) + settle);
+    if (follow_stop) {
+      break;
+    }
+
+    polled.count = 0;
+    // After a failure the next period asks again from the same anchor
+    if (fetch_bars_since(ctx, anchor + 1, &polled) != 0) {
+      continue;
+    }
+
+    // Print only bars that are new and whose period has ended
+    now = (int64_t)time(NULL);
+    size_t count = 0;
+    for (size_t i = 0; i < polled.count; i++) {
+      const AlpacaBar *bar = &polled.bars[i];
+      if (bar->t > ctx->last_bar_t && bar->t + tf <= now) {
+        polled.bars[count++] = *bar;
+      }
+    }
+    polled.count = count;
+    print_bars(ctx, &polled);
+    flush_resampled(ctx, now);
+
+    // Outside trading hours nothing arrives and the anchor stays put; the request
+    // still returns only bars after it
+    if (count > 0) {
+      anchor = ctx->last_bar_t;
+    }
+  }
 
-  return -1.0;
+  bar_array_free(&polled);
+  fflush(stdout);
+  return 0;
+}
+
+// Fetch the latest trade price over the same connection used for the bar pages
+double get_latest_trade(FetcherContext *ctx, char* symbol, const char* sip) {
+  // Convert symbol to uppercase
+  int len = strlen(symbol);
+  for (int i = 0; i < len; i++) {
+    symbol[i] = toupper(symbol[i]);
+  }
+
+  char url[URL_SIZE];
+  snprintf(url, URL_SIZE, "%s/v2/stocks/%s/trades/latest?feed=%s", rest_data_url(), symbol, sip);
+
+  const char *data = rest_client_get(ctx->client, url, NULL);
+  if (data == NULL || !rest_client_ok(ctx->client)) {
+    return -1.0;
+  }
+
+  double price = -1.0;
+
+  json_error_t error;
+  json_t *root = json_loads(data, 0, &error);
+  if (root != NULL) {
+    json_t *trade = json_object_get(root, "trade");
+    if (json_is_object(trade)) {
+      json_t *price_item = json_object_get(trade, "p");
+      if (json_is_number(price_item)) {
+        price = json_number_value(price_item);
+      }
+    }
+    json_decref(root);
+  }
+
+  return price;
 }
 
 // Main C program that fetches JSON data from Alpaca API based on user input
@@ -288,9 +1181,25 @@ int main(int argc, char *argv[]) {
     time_t t = time(NULL);
     struct tm tm = *localtime(&t);
     char default_end_date[11];
-    char* next_page_token = NULL;
-    char* json_data = NULL; // to store the received JSON data
-    bool first_fetch = true; // to check if this is the first fetch
+    bool report_latency = false;
+    bool fresh_connections = false;
+    int shard_days = -1;  // sized to the timeframe unless -shard is given
+    int concurrency = 8;
+    double rate_limit = 0;
+    const char *cache_dir = bar_cache_default_dir();
+    OutputFormat format = OUTPUT_TEXT;
+    const char *symbols_file = NULL;
+    bool follow = false;
+    double settle = FOLLOW_DEFAULT_SETTLE;
+    const char *outdir = ".";
+    int batch_size = 100;
+    bool resample = false;
+    bool ticks = false;
+    TickKind tick_kind = TICK_TRADES;
+    BarSession session = SESSION_ALL;
+    BarResampler resampler;
+    char resample_start[32];
+    char resample_end[32];
 
     // Pre-load timezone database into memory
     tzset();
@@ -323,6 +1232,117 @@ int main(int argc, char *argv[]) {
 	else if (strcmp(argv[i], "-sip") == 0 && i < argc - 1) {
 	    sip = argv[i+1];
 	}
+	// If the argument is "-latency", report per-page request timing on stderr
+	else if (strcmp(argv[i], "-latency") == 0) {
+	    report_latency = true;
+	}
+	// If the argument is "-fresh-connections", open a new connection per page (for comparison)
+	else if (strcmp(argv[i], "-fresh-connections") == 0) {
+	    fresh_connections = true;
+	}
+	// If the argument is "-shard", split the range into day or week shards, "none" or "auto"
+	else if (strcmp(argv[i], "-shard") == 0 && i < argc - 1) {
+	    const char *shard = argv[i+1];
+	    if (strcmp(shard, "auto") == 0) {
+		shard_days = -1;
+	    } else if (strcmp(shard, "day") == 0) {
+		shard_days = 1;
+	    } else if (strcmp(shard, "week") == 0) {
+		shard_days = 7;
+	    } else if (strcmp(shard, "none") == 0) {
+		shard_days = 0;
+	    } else {
+		fprintf(stderr, "Error: -shard must be 'auto', 'day', 'week' or 'none'.\n");
+		return 1;
+	    }
+	}
+	// If the argument is "-concurrency", set how many shards are downloaded at once
+	else if (strcmp(argv[i], "-concurrency") == 0 && i < argc - 1) {
+	    concurrency = atoi(argv[i+1]);
+	}
+	// If the argument is "-rate", cap requests per minute (default: the account's limit)
+	else if (strcmp(argv[i], "-rate") == 0 && i < argc - 1) {
+	    rate_limit = atof(argv[i+1]);
+	}
+	// If the argument is "-format", choose text, csv, ndjson or binary output
+	else if (strcmp(argv[i], "-format") == 0 && i < argc - 1) {
+	    const char *name = argv[i+1];
+	    if (strcmp(name, "text") == 0) {
+		format = OUTPUT_TEXT;
+	    } else if (strcmp(name, "csv") == 0) {
+		format = OUTPUT_CSV;
+	    } else if (strcmp(name, "ndjson") == 0) {
+		format = OUTPUT_NDJSON;
+	    } else if (strcmp(name, "binary") == 0) {
+		format = OUTPUT_BINARY;
+	    } else {
+		fprintf(stderr, "Error: -format must be 'text', 'csv', 'ndjson' or 'binary'.\n");
+		return 1;
+	    }
+	}
+	// If the argument is "-symbols", fetch every symbol listed in the file ("-" for stdin)
+	else if (strcmp(argv[i], "-symbols") == 0 && i < argc - 1) {
+	    symbols_file = argv[i+1];
+	}
+	// If the argument is "-batch", set how many symbols share one request in -symbols mode
+	else if (strcmp(argv[i], "-batch") == 0 && i < argc - 1) {
+	    batch_size = atoi(argv[i+1]);
+	}
+	// If the argument is "-outdir", set where the per-symbol files of -symbols mode go
+	else if (strcmp(argv[i], "-outdir") == 0 && i < argc - 1) {
+	    outdir = argv[i+1];
+	}
+	// If the argument is "-follow", keep running and print new bars as they close
+	else if (strcmp(argv[i], "-follow") == 0) {
+	    follow = true;
+	}
+	// If the argument is "-settle", wait this many seconds after a bar closes before polling
+	else if (strcmp(argv[i], "-settle") == 0 && i < argc - 1) {
+	    settle = atof(argv[i+1]);
+	}
+	// If the argument is "-ticks", download trades or quotes into binary files instead of bars
+	else if (strcmp(argv[i], "-ticks") == 0 && i < argc - 1) {
+	    const char *name = argv[i+1];
+	    ticks = true;
+	    if (strcmp(name, "trades") == 0) {
+		tick_kind = TICK_TRADES;
+	    } else if (strcmp(name, "quotes") == 0) {
+		tick_kind = TICK_QUOTES;
+	    } else {
+		fprintf(stderr, "Error: -ticks must be 'trades' or 'quotes'.\n");
+		return 1;
+	    }
+	}
+	// If the argument is "-resample", build the timeframe locally from 1Min bars
+	else if (strcmp(argv[i], "-resample") == 0) {
+	    resample = true;
+	}
+	// If the argument is "-session", choose which minutes go into resampled bars
+	else if (strcmp(argv[i], "-session") == 0 && i < argc - 1) {
+	    const char *name = argv[i+1];
+	    if (strcmp(name, "all") == 0) {
+		session = SESSION_ALL;
+	    } else if (strcmp(name, "regular") == 0) {
+		session = SESSION_REGULAR;
+	    } else {
+		fprintf(stderr, "Error: -session must be 'all' or 'regular'.\n");
+		return 1;
+	    }
+	}
+	// If the argument is "-cache", keep downloaded days under this directory ("none" disables it)
+	else if (strcmp(argv[i], "-cache") == 0 && i < argc - 1) {
+	    cache_dir = strcmp(argv[i+1], "none") == 0 ? NULL : argv[i+1];
+	}
+    }
+
+    // The symbol, feed and timeframe name directories of the bar cache
+    if (symbol && !symbol_is_valid(symbol)) {
+	fprintf(stderr, "Error: symbol '%s' may only contain letters, digits and '.'.\n", symbol);
+	return 1;
+    }
+    if (strchr(timeframe, '/') || strchr(sip, '/') || strstr(timeframe, "..") || strstr(sip, "..")) {
+	fprintf(stderr, "Error: -timeframe and -sip cannot contain '/' or '..'.\n");
+	return 1;
     }
 
     // If no end date is provided, set the default end date
@@ -336,38 +1356,155 @@ int main(int argc, char *argv[]) {
     }
 
     // If any required command line arguments are missing, print an error message and return
-    if (!symbol) {
-	fprintf(stderr, "Missing command-line arguments.\nUsage: %s -symbol <symbol> -start <start_date> -end <end_date>\n", argv[0]);
+    if (!symbol && !symbols_file) {
+	fprintf(stderr, "Missing command-line arguments.\nUsage: %s -symbol <symbol> | -symbols <file> [-batch N] [-outdir <dir>] -start <start_date> -end <end_date> [-timeframe <tf>] [-sip <feed>] [-shard auto|day|week|none] [-concurrency N] [-rate N] [-cache <dir>|none] [-format text|csv|ndjson|binary] [-follow [-settle S]] [-resample [-session all|regular]] [-ticks trades|quotes] [-latency] [-fresh-connections]\n", argv[0]);
 	return 1;
     }
 
-    while (true) {
-       // Fetch JSON data from Alpaca API
-       json_data = fetch_json_data(symbol, timeframe, start_date, end_date, limit, sip, next_page_token);
+    if (follow && symbols_file) {
+	fprintf(stderr, "Error: -follow works with a single -symbol.\n");
+	return 1;
+    }
 
-       // Parse the JSON data and store the result
-       next_page_token = parse_json_data(json_data);
-       if (next_page_token != NULL) {
-         if (first_fetch) {
-           // printf("%s\n", next_page_token);
-           first_fetch = false;
-         }
-       } else {
-         // If there is no next page token, break out of the loop
-         break;
-       }
+    if (ticks && (follow || resample)) {
+	fprintf(stderr, "Error: -ticks cannot be combined with -follow or -resample.\n");
+	return 1;
     }
 
-    double price = get_latest_trade(symbol,sip);
-    if (price >= 0) {
-      printf("Latest trade price for %s: %.3f\n", symbol, price);
-    } else {
-      printf("Failed to retrieve latest trade price for %s.\n", symbol);
+    if (resample && symbols_file) {
+	fprintf(stderr, "Error: -resample works with a single -symbol.\n");
+	return 1;
+    }
+
+    // Resampling downloads (or reads from the cache) 1Min bars and aggregates them,
+    // so every coarser timeframe is served from the same files
+    if (resample) {
+	if (bar_resampler_init(&resampler, timeframe_seconds(timeframe), session) != 0) {
+	    return 1;
+	}
+
+	// Date-only bounds are New York trading dates here, so -start 2024-03-08
+	// begins with that day's bar
+	int64_t t0 = parse_rfc3339(start_date);
+	int64_t t1 = parse_rfc3339(end_date);
+	if (t0 >= 0 && strlen(start_date) == 10) {
+	    t0 = exchange_local_to_utc(t0);
+	}
+	if (t1 >= 0 && strlen(end_date) == 10) {
+	    t1 = exchange_local_to_utc(t1 + SECONDS_PER_DAY) - 1;
+	}
+
+	// Widen the range to whole buckets so the first and last bars are not partial
+	// (a bound outside the session, such as midnight, falls in an all-hours bucket)
+	if (t0 >= 0 && t1 >= t0) {
+	    int64_t bucket_end;
+	    resampler.from = bar_bucket_start(t0, resampler.seconds, session, &bucket_end);
+	    if (resampler.from < 0) {
+		resampler.from = bar_bucket_start(t0, resampler.seconds, SESSION_ALL, &bucket_end);
+	    }
+	    if (bar_bucket_start(t1, resampler.seconds, session, &bucket_end) < 0) {
+		bar_bucket_start(t1, resampler.seconds, SESSION_ALL, &bucket_end);
+	    }
+	    resampler.to = bucket_end - 1;
+
+	    // With a cache, ask for whole UTC days so every day fetched can be stored
+	    int64_t from = resampler.from;
+	    int64_t to = resampler.to;
+	    if (cache_dir) {
+		from -= from % SECONDS_PER_DAY;
+		to += SECONDS_PER_DAY - 1 - to % SECONDS_PER_DAY;
+	    }
+	    format_rfc3339(from, resample_start, sizeof(resample_start));
+	    format_rfc3339(to, resample_end, sizeof(resample_end));
+	    start_date = resample_start;
+	    end_date = resample_end;
+	}
+	timeframe = "1Min";
+    }
+    if (shard_days < 0) {
+	shard_days = shard_days_for_timeframe(timeframe, limit);
+    }
+
+    // One client, and therefore one keep-alive connection, serves every request below
+    RestClient *client = rest_client_create();
+    if (!client) {
+	return 1;
+    }
+    rest_client_set_fresh_connections(client, fresh_connections);
+    if (rate_limit > 0) {
+	rest_scheduler_set_rate(rest_scheduler_default(), rate_limit);
     }
 
-    // Clean up the curl global environment
+    FetcherContext ctx = { symbol, timeframe, start_date, end_date, limit, sip, 0, client, report_latency, 0, 0.0, shard_days, concurrency, cache_dir, 0, format };
+    ctx.resampler = resample ? &resampler : NULL;
+
+    // Write bars in large blocks rather than line by line
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    // Tick mode: every trade or quote of each symbol, one binary file per symbol
+    if (ticks) {
+      SymbolList symbols = { NULL, 0, 0 };
+      int loaded = symbols_file ? symbol_list_read_file(&symbols, symbols_file) : symbol_list_add(&symbols, symbol);
+      int status = loaded == 0 && download_ticks(&ctx, symbols.symbols, symbols.count, tick_kind, outdir) == 0 ? 0 : 1;
+      if (report_latency && ctx.pages > 0) {
+        fprintf(stderr, "Fetched %zu pages, mean latency %.1f ms per page.\n", ctx.pages, ctx.total_latency_ms / ctx.pages);
+      }
+      symbol_list_free(&symbols);
+      rest_client_destroy(client);
+      curl_global_cleanup();
+      return status;
+    }
+
+    // Universe mode: many symbols per request, one output file per symbol
+    if (symbols_file) {
+      SymbolList symbols = { NULL, 0, 0 };
+      int status = symbol_list_read_file(&symbols, symbols_file) == 0 &&
+        download_universe(&ctx, symbols.symbols, symbols.count, batch_size, outdir) == 0 ? 0 : 1;
+      if (report_latency && ctx.pages > 0) {
+        fprintf(stderr, "Fetched %zu pages, mean latency %.1f ms per page.\n", ctx.pages, ctx.total_latency_ms / ctx.pages);
+      }
+      symbol_list_free(&symbols);
+      rest_client_destroy(client);
+      curl_global_cleanup();
+      return status;
+    }
+
+    // Fetch every shard of the range and print the bars in timestamp order
+    int status = download_bars(&ctx) == 0 ? 0 : 1;
+
+    // The last resampled bucket is printed even if it is still in progress, as the
+    // API does, except when following: then it waits until the bucket has closed
+    flush_resampled(&ctx, follow ? (int64_t)time(NULL) : INT64_MAX);
+
+    // Then keep polling for the bars that close after it
+    if (follow) {
+      status = follow_bars(&ctx, settle) == 0 ? status : 1;
+    }
+
+    if (report_latency && cache_dir) {
+      fprintf(stderr, "Served %zu days from the bar cache.\n", ctx.cached_days);
+    }
+    if (report_latency && ctx.pages > 0) {
+      fprintf(stderr, "Fetched %zu pages, mean latency %.1f ms per page.\n", ctx.pages, ctx.total_latency_ms / ctx.pages);
+    }
+
+    // Only the text format is followed by the latest trade price; the other formats
+    // contain nothing but bars so they can be fed straight to other tools
+    if (format == OUTPUT_TEXT && !follow) {
+      double price = get_latest_trade(&ctx, symbol, sip);
+      if (price >= 0) {
+        printf("Latest trade price for %s: %.3f\n", symbol, price);
+      } else {
+        printf("Failed to retrieve latest trade price for %s.\n", symbol);
+      }
+    }
+    fflush(stdout);
+
+    // Clean up the connection and the curl global environment
+    bar_array_free(&ctx.resampled);
+    rest_client_destroy(client);
     curl_global_cleanup();
 
     // Return 0 to indicate success
-    return 0;
+    return status;
 }
@@ -0,0 +1,173 @@
+#include "alpaca_page_scanner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void page_scanner_init(PageScanner *scanner, const char *records_key, const PageRecordHandler *handler) {
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->records_key = records_key;
+    scanner->handler = *handler;
+}
+
+// Forget any partial document, e.g. before a retried request starts over
+void page_scanner_reset(PageScanner *scanner) {
+    PageRecordHandler handler = scanner->handler;
+    page_scanner_init(scanner, scanner->records_key, &handler);
+}
+
+static void page_scanner_append(PageScanner *scanner, char c) {
+    // Values we do not use may be longer than the buffer; keeping a prefix is enough
+    if (scanner->token_len < sizeof(scanner->token) - 1) {
+        scanner->token[scanner->token_len++] = c;
+    }
+}
+
+// True when the object just opened at the current depth is one record
+static int page_scanner_at_record(const PageScanner *scanner) {
+    if (strcmp(scanner->keys[0], scanner->records_key) != 0) {
+        return 0;
+    }
+    if (scanner->depth == 3) {
+        return scanner->container[1] == '[';
+    }
+    return scanner->depth == 4 && scanner->container[1] == '{' && scanner->container[2] == '[';
+}
+
+// Handle a complete string or scalar value
+static void page_scanner_value(PageScanner *scanner, int is_string) {
+    scanner->token[scanner->token_len] = 0;
+
+    if (scanner->record_depth && scanner->depth == scanner->record_depth) {
+        scanner->handler.value(scanner->handler.user, scanner->keys[scanner->depth - 1], scanner->token, is_string, 0);
+    } else if (scanner->record_depth && scanner->depth == scanner->record_depth + 1 &&
+               scanner->container[scanner->depth - 1] == '[') {
+        // One entry of a list field of the record
+        scanner->handler.value(scanner->handler.user, scanner->keys[scanner->record_depth - 1], scanner->token, is_string, 1);
+    } else if (scanner->depth == 1 && strcmp(scanner->keys[0], "next_page_token") == 0) {
+        // null (a scalar) marks the last page
+        if (is_string) {
+            memcpy(scanner->next_page_token, scanner->token, scanner->token_len + 1);
+        } else {
+            scanner->next_page_token[0] = 0;
+        }
+    }
+}
+
+static void page_scanner_string_done(PageScanner *scanner) {
+    scanner->token[scanner->token_len] = 0;
+    if (scanner->expect_key && scanner->depth > 0 && scanner->container[scanner->depth - 1] == '{') {
+        snprintf(scanner->keys[scanner->depth - 1], PAGE_SCANNER_KEY_SIZE, "%s", scanner->token);
+        scanner->expect_key = 0;
+        return;
+    }
+    page_scanner_value(scanner, 1);
+}
+
+static int page_scanner_structural(PageScanner *scanner, char c) {
+    switch (c) {
+    case ' ': case '\t': case '\r': case '\n':
+        return 0;
+    case '"':
+        scanner->in_string = 1;
+        scanner->token_len = 0;
+        return 0;
+    case '{':
+    case '[':
+        if (scanner->depth == PAGE_SCANNER_MAX_DEPTH) {
+            return -1;
+        }
+        scanner->started = 1;
+        scanner->container[scanner->depth] = c;
+        scanner->keys[scanner->depth][0] = 0;
+        scanner->depth++;
+        scanner->expect_key = (c == '{');
+        if (c == '{' && page_scanner_at_record(scanner)) {
+            scanner->record_depth = scanner->depth;
+            scanner->handler.begin(scanner->handler.user);
+        }
+        return 0;
+    case '}':
+    case ']':
+        if (scanner->depth == 0 || scanner->container[scanner->depth - 1] != (c == '}' ? '{' : '[')) {
+            return -1;
+        }
+        if (scanner->record_depth == scanner->depth) {
+            const char *symbol = scanner->container[1] == '{' ? scanner->keys[1] : NULL;
+            scanner->handler.end(scanner->handler.user, symbol);
+            scanner->record_depth = 0;
+        }
+        scanner->depth--;
+        scanner->expect_key = 0;
+        return 0;
+    case ':':
+        scanner->expect_key = 0;
+        return 0;
+    case ',':
+        scanner->expect_key = scanner->depth > 0 && scanner->container[scanner->depth - 1] == '{';
+        return 0;
+    default:
+        if ((c >= '0' && c <= '9') || c == '-' || c == 't' || c == 'f' || c == 'n') {
+            scanner->in_scalar = 1;
+            scanner->token_len = 0;
+            page_scanner_append(scanner, c);
+            return 0;
+        }
+        return -1;
+    }
+}
+
+// Function to feed the next chunk of the response body. Returns -1 on malformed input.
+int page_scanner_feed(PageScanner *scanner, const char *data, size_t len) {
+    if (scanner->failed) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+
+        if (scanner->in_string) {
+            if (scanner->in_escape) {
+                scanner->in_escape = 0;
+                page_scanner_append(scanner, c);
+            } else if (c == '\\') {
+                scanner->in_escape = 1;
+            } else if (c == '"') {
+                scanner->in_string = 0;
+                page_scanner_string_done(scanner);
+            } else {
+                page_scanner_append(scanner, c);
+            }
+            continue;
+        }
+
+        if (scanner->in_scalar) {
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '.' || c == '+' || c == '-') {
+                page_scanner_append(scanner, c);
+                continue;
+            }
+            scanner->in_scalar = 0;
+            page_scanner_value(scanner, 0);
+        }
+
+        if (page_scanner_structural(scanner, c) != 0) {
+            fprintf(stderr, "error: unexpected '%c' in %s response\n", c, scanner->records_key);
+            scanner->failed = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to check that a whole document was parsed. Returns 0 and sets
+// *next_page_token (caller frees) or NULL on the last page.
+int page_scanner_finish(PageScanner *scanner, char **next_page_token) {
+    *next_page_token = NULL;
+    if (scanner->failed || !scanner->started || scanner->depth != 0 || scanner->in_string) {
+        fprintf(stderr, "error: incomplete %s response\n", scanner->records_key);
+        return -1;
+    }
+    if (scanner->next_page_token[0]) {
+        *next_page_token = strdup(scanner->next_page_token);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef ALPACA_PAGE_SCANNER_H
+#define ALPACA_PAGE_SCANNER_H
+
+#include <stddef.h>
+
+#define PAGE_SCANNER_MAX_DEPTH 8
+#define PAGE_SCANNER_KEY_SIZE 32
+#define PAGE_SCANNER_TOKEN_SIZE 1024
+
+// What a scanner does with the records of a page. begin is called when a record's
+// object opens, value for each of its fields, and end when it closes. A value in a
+// list inside the record ("c": ["@", "I"]) is passed with in_list set and the key
+// of the list. symbol is NULL for single-symbol responses.
+typedef struct {
+    void (*begin)(void *user);
+    void (*value)(void *user, const char *key, const char *token, int is_string, int in_list);
+    void (*end)(void *user, const char *symbol);
+    void *user;
+} PageRecordHandler;
+
+// Incremental scanner for one page of a market data response: {"<records_key>":
+// [...] or {"SYM": [...]}, "next_page_token": ...}. The body can be fed in chunks of
+// any size and each record is handed over as soon as its closing brace arrives, so
+// memory use does not depend on the page size.
+typedef struct {
+    const char *records_key;    // "bars", "trades" or "quotes"
+    PageRecordHandler handler;
+    int depth;
+    char container[PAGE_SCANNER_MAX_DEPTH];                     // '{' or '[' per open level
+    char keys[PAGE_SCANNER_MAX_DEPTH][PAGE_SCANNER_KEY_SIZE];   // current key per object level
+    char token[PAGE_SCANNER_TOKEN_SIZE];                        // string or scalar in progress
+    size_t token_len;
+    int in_string;
+    int in_escape;
+    int in_scalar;
+    int expect_key;
+    int record_depth;   // depth of the record object being filled, 0 if none
+    int started;
+    int failed;
+    char next_page_token[PAGE_SCANNER_TOKEN_SIZE];
+} PageScanner;
+
+void page_scanner_init(PageScanner *scanner, const char *records_key, const PageRecordHandler *handler);
+void page_scanner_reset(PageScanner *scanner);
+int page_scanner_feed(PageScanner *scanner, const char *data, size_t len);
+int page_scanner_finish(PageScanner *scanner, char **next_page_token);
+
+#endif // ALPACA_PAGE_SCANNER_H
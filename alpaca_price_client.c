@@ -0,0 +1,160 @@
+#include "alpaca_price_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+const char *price_kind_name(LatestKind kind) {
+    switch (kind) {
+    case LATEST_QUOTE: return "quote";
+    case LATEST_SNAPSHOT: return "snapshot";
+    default: return "trade";
+    }
+}
+
+// Function to format one response line; returns its length
+int price_format_line(char *buf, size_t size, const LatestPrice *price) {
+    return snprintf(buf, size, PRICE_LINE_FORMAT, price->symbol, price->has_trade, price->has_quote, price->has_prev_close,
+                    price->price, price->size, (long long)price->trade_time, price->bid, price->ask,
+                    price->bid_size, price->ask_size, (long long)price->quote_time, price->prev_close);
+}
+
+// Function to decode one response line. Returns 0 on success.
+int price_parse_line(const char *line, LatestPrice *price) {
+    long long trade_time = 0, quote_time = 0;
+    memset(price, 0, sizeof(*price));
+    int n = sscanf(line, "%15s %d %d %d %lf %lf %lld %lf %lf %lf %lf %lld %lf", price->symbol,
+                   &price->has_trade, &price->has_quote, &price->has_prev_close, &price->price, &price->size,
+                   &trade_time, &price->bid, &price->ask, &price->bid_size, &price->ask_size, &quote_time,
+                   &price->prev_close);
+    price->trade_time = trade_time;
+    price->quote_time = quote_time;
+    return n == 13 ? 0 : -1;
+}
+
+// Function to connect to a running price daemon. Returns NULL if it is not listening.
+PriceClient *price_client_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return NULL;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Error connecting to price daemon");
+        close(fd);
+        return NULL;
+    }
+
+    PriceClient *client = (PriceClient *)calloc(1, sizeof(PriceClient));
+    if (!client) {
+        close(fd);
+        return NULL;
+    }
+    client->fd = fd;
+    return client;
+}
+
+void price_client_close(PriceClient *client) {
+    if (client) {
+        close(client->fd);
+        free(client);
+    }
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Read one '\n'-terminated line into line (without the newline)
+static int read_line(PriceClient *client, char *line, size_t size) {
+    for (;;) {
+        char *newline = memchr(client->buffer, '\n', client->length);
+        if (newline) {
+            size_t len = (size_t)(newline - client->buffer);
+            if (len >= size) {
+                return -1;
+            }
+            memcpy(line, client->buffer, len);
+            line[len] = 0;
+            client->length -= len + 1;
+            memmove(client->buffer, newline + 1, client->length);
+            return 0;
+        }
+        if (client->length == sizeof(client->buffer)) {
+            return -1;
+        }
+        ssize_t n = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        client->length += (size_t)n;
+    }
+}
+
+// Function to ask the daemon for the latest prices of count symbols. prices[i]
+// receives symbols[i]. Returns 0 on success, -1 if the connection failed or the
+// daemon serves another kind of price.
+int price_client_get(PriceClient *client, LatestKind kind, const char *const *symbols, size_t count, LatestPrice *prices) {
+    char request[PRICE_REQUEST_MAX];
+    size_t len = (size_t)snprintf(request, sizeof(request), "@%s", price_kind_name(kind));
+    for (size_t i = 0; i < count; i++) {
+        size_t symbol_len = strlen(symbols[i]);
+        if (len + symbol_len + 2 > sizeof(request)) {
+            fprintf(stderr, "Error: too many symbols for one request.\n");
+            return -1;
+        }
+        request[len++] = ' ';
+        memcpy(request + len, symbols[i], symbol_len);
+        len += symbol_len;
+    }
+    request[len++] = '\n';
+    if (write_all(client->fd, request, len) != 0) {
+        return -1;
+    }
+
+    char line[512];
+    for (size_t i = 0; i < count; i++) {
+        if (read_line(client, line, sizeof(line)) != 0) {
+            return -1;
+        }
+        if (i == 0 && line[0] == '!') {
+            fprintf(stderr, "Error: the daemon serves %s prices, not %s prices.\n", line + 1, price_kind_name(kind));
+            read_line(client, line, sizeof(line));
+            return -1;
+        }
+        if (price_parse_line(line, &prices[i]) != 0) {
+            return -1;
+        }
+    }
+    // Each response ends with an empty line
+    if (read_line(client, line, sizeof(line)) != 0 || line[0] != 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef ALPACA_PRICE_CLIENT_H
+#define ALPACA_PRICE_CLIENT_H
+
+#include <stddef.h>
+#include "alpaca_latest.h"
+
+// Line protocol spoken over the price daemon's Unix domain socket.
+// Request:  an optional @trade, @quote or @snapshot, then symbols separated by
+//           spaces or commas, ending in '\n'.
+// Response: one PRICE_LINE_FORMAT line per requested symbol, in request order,
+//           followed by an empty line. has_* flags of 0 mean no data. A request
+//           for another kind than the daemon serves gets "!KIND" and an empty line.
+#define PRICE_REQUEST_MAX 4096
+#define PRICE_LINE_FORMAT "%s %d %d %d %.17g %.17g %lld %.17g %.17g %.17g %.17g %lld %.17g\n"
+
+typedef struct {
+    int fd;
+    char buffer[PRICE_REQUEST_MAX];
+    size_t length;
+} PriceClient;
+
+PriceClient *price_client_connect(const char *socket_path);
+int price_client_get(PriceClient *client, LatestKind kind, const char *const *symbols, size_t count, LatestPrice *prices);
+void price_client_close(PriceClient *client);
+
+const char *price_kind_name(LatestKind kind);
+int price_format_line(char *buf, size_t size, const LatestPrice *price);
+int price_parse_line(const char *line, LatestPrice *price);
+
+#endif // ALPACA_PRICE_CLIENT_H
@@ -0,0 +1,461 @@
+#define _GNU_SOURCE
+#include "alpaca_price_daemon.h"
+#include "alpaca_price_client.h"
+#include "alpaca_rest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Cached price of one symbol
+typedef struct {
+    LatestPrice price;
+    double fetched_at;      // monotonic seconds of the last fetch, -HUGE_VAL before the first
+    int in_flight;          // queued for or being fetched by the worker
+} CacheEntry;
+
+// One connected client and the request it is waiting on
+typedef struct {
+    int fd;
+    char in[PRICE_REQUEST_MAX];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+    int *request;           // cache entries of the request being served, -1 for invalid symbols
+    size_t request_count;
+    size_t request_capacity;
+    int active;
+    double issued_at;
+} DaemonClient;
+
+typedef struct {
+    PriceDaemonOptions options;
+    pthread_mutex_t lock;   // guards everything below except clients
+    pthread_cond_t cond;
+    SymbolTable table;
+    CacheEntry *entries;    // indexed like table
+    size_t num_entries;
+    size_t entries_capacity;
+    int *queue;             // entries waiting for the worker
+    size_t queue_len;
+    size_t queue_capacity;
+    int last_symbol;        // most recently requested entry, refreshed to keep the connection warm
+    int stopping;
+    int wake_pipe[2];       // the worker writes a byte after every fetch
+    RestClient *rest;
+    DaemonClient clients[DAEMON_MAX_CLIENTS];
+    size_t num_clients;
+} PriceDaemon;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal_handler(int signum) {
+    daemon_stop = 1;
+}
+
+static int grow_array(void **array, size_t *capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void *ptr = realloc(*array, new_capacity * item_size);
+    if (!ptr) {
+        fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+        return -1;
+    }
+    *array = ptr;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Queue an entry for the worker unless it is already on its way. Called with the lock held.
+static void daemon_enqueue(PriceDaemon *daemon, int index) {
+    CacheEntry *entry = &daemon->entries[index];
+    if (entry->in_flight) {
+        return;
+    }
+    if (grow_array((void **)&daemon->queue, &daemon->queue_capacity, daemon->queue_len + 1, sizeof(int)) != 0) {
+        return;
+    }
+    entry->in_flight = 1;
+    daemon->queue[daemon->queue_len++] = index;
+    pthread_cond_signal(&daemon->cond);
+}
+
+// The worker owns the REST connection. It takes everything queued at once, so
+// requests for the same symbol from many clients become one lookup, and symbols
+// asked for at about the same time share a batched request.
+static void *daemon_worker(void *arg) {
+    PriceDaemon *daemon = (PriceDaemon *)arg;
+    int *taken = NULL;
+    size_t taken_capacity = 0;
+    LatestPrice *batch = NULL;
+    size_t batch_capacity = 0;
+
+    pthread_mutex_lock(&daemon->lock);
+    while (!daemon->stopping) {
+        if (daemon->queue_len == 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += (time_t)DAEMON_WARM_INTERVAL;
+            int rc = pthread_cond_timedwait(&daemon->cond, &daemon->lock, &deadline);
+            // After a quiet spell, refresh the last symbol asked for so the next
+            // lookup does not pay for a new connection
+            if (rc == ETIMEDOUT && daemon->queue_len == 0 && daemon->last_symbol >= 0) {
+                daemon_enqueue(daemon, daemon->last_symbol);
+            }
+            continue;
+        }
+
+        // Swap the queue out so new requests can be queued while this batch runs
+        int *queue = daemon->queue;
+        size_t queue_capacity = daemon->queue_capacity;
+        size_t count = daemon->queue_len;
+        daemon->queue = taken;
+        daemon->queue_capacity = taken_capacity;
+        daemon->queue_len = 0;
+        taken = queue;
+        taken_capacity = queue_capacity;
+
+        if (grow_array((void **)&batch, &batch_capacity, count, sizeof(LatestPrice)) != 0) {
+            break;
+        }
+        memset(batch, 0, count * sizeof(LatestPrice));
+        for (size_t i = 0; i < count; i++) {
+            snprintf(batch[i].symbol, sizeof(batch[i].symbol), "%s", symbol_table_name(&daemon->table, taken[i]));
+        }
+        pthread_mutex_unlock(&daemon->lock);
+
+        fetch_latest_prices(daemon->rest, daemon->options.feed, daemon->options.kind, batch, count, daemon->options.batch_size);
+        double now = rest_monotonic_seconds();
+
+        pthread_mutex_lock(&daemon->lock);
+        for (size_t i = 0; i < count; i++) {
+            CacheEntry *entry = &daemon->entries[taken[i]];
+            entry->price = batch[i];
+            entry->fetched_at = now;
+            entry->in_flight = 0;
+        }
+        if (write(daemon->wake_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+            perror("Error waking price daemon");
+        }
+    }
+    pthread_mutex_unlock(&daemon->lock);
+
+    free(taken);
+    free(batch);
+    return NULL;
+}
+
+static int client_append(DaemonClient *client, const char *data, size_t len) {
+    if (grow_array((void **)&client->out, &client->out_capacity, client->out_len + len, 1) != 0) {
+        return -1;
+    }
+    memcpy(client->out + client->out_len, data, len);
+    client->out_len += len;
+    return 0;
+}
+
+// Write as much pending output as the socket takes. Returns -1 if the client is gone.
+static int client_flush(DaemonClient *client) {
+    while (client->out_sent < client->out_len) {
+        ssize_t n = write(client->fd, client->out + client->out_sent, client->out_len - client->out_sent);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        client->out_sent += (size_t)n;
+    }
+    client->out_len = 0;
+    client->out_sent = 0;
+    return 0;
+}
+
+// Answer the client's request if every symbol in it is fresh enough
+static void daemon_try_complete(PriceDaemon *daemon, DaemonClient *client) {
+    double ttl = daemon->options.ttl;
+
+    pthread_mutex_lock(&daemon->lock);
+    for (size_t i = 0; i < client->request_count; i++) {
+        int index = client->request[i];
+        if (index >= 0 && daemon->entries[index].fetched_at < client->issued_at - ttl) {
+            pthread_mutex_unlock(&daemon->lock);
+            return;
+        }
+    }
+
+    char line[512];
+    for (size_t i = 0; i < client->request_count; i++) {
+        int index = client->request[i];
+        LatestPrice unknown;
+        const LatestPrice *price = &unknown;
+        if (index >= 0) {
+            price = &daemon->entries[index].price;
+        } else {
+            memset(&unknown, 0, sizeof(unknown));
+            strcpy(unknown.symbol, "?");
+        }
+        int len = price_format_line(line, sizeof(line), price);
+        client_append(client, line, (size_t)len);
+    }
+    pthread_mutex_unlock(&daemon->lock);
+
+    client_append(client, "\n", 1);
+    client->active = 0;
+}
+
+// Start serving one request line: look every symbol up and queue the stale ones
+static void daemon_start_request(PriceDaemon *daemon, DaemonClient *client, char *line) {
+    double now = rest_monotonic_seconds();
+    client->request_count = 0;
+
+    char *saveptr;
+    char *token = strtok_r(line, ", \t\r", &saveptr);
+    if (token && token[0] == '@') {
+        // The client says which kind of price it will read the answer as
+        const char *served = price_kind_name(daemon->options.kind);
+        if (strcmp(token + 1, served) != 0) {
+            client_append(client, "!", 1);
+            client_append(client, served, strlen(served));
+            client_append(client, "\n\n", 2);
+            return;
+        }
+        token = strtok_r(NULL, ", \t\r", &saveptr);
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    for (; token; token = strtok_r(NULL, ", \t\r", &saveptr)) {
+        for (char *c = token; *c; c++) {
+            *c = toupper((unsigned char)*c);
+        }
+        // A bad token would corrupt the batched symbols= query shared with other clients
+        int index = symbol_is_valid(token) && strlen(token) < SYMBOL_SIZE ? symbol_table_add(&daemon->table, token) : -1;
+        if (index >= 0 && (size_t)index == daemon->num_entries) {
+            // A symbol seen for the first time
+            if (grow_array((void **)&daemon->entries, &daemon->entries_capacity, daemon->num_entries + 1, sizeof(CacheEntry)) == 0) {
+                CacheEntry *entry = &daemon->entries[daemon->num_entries++];
+                memset(entry, 0, sizeof(*entry));
+                entry->fetched_at = -HUGE_VAL;
+                snprintf(entry->price.symbol, sizeof(entry->price.symbol), "%s", token);
+            } else {
+                index = -1;
+            }
+        }
+        if (index >= 0 && (size_t)index < daemon->num_entries) {
+            CacheEntry *entry = &daemon->entries[index];
+            if (entry->fetched_at < now - daemon->options.ttl) {
+                daemon_enqueue(daemon, index);
+            }
+            daemon->last_symbol = index;
+        } else {
+            index = -1;
+        }
+        if (grow_array((void **)&client->request, &client->request_capacity, client->request_count + 1, sizeof(int)) == 0) {
+            client->request[client->request_count++] = index;
+        }
+    }
+    pthread_mutex_unlock(&daemon->lock);
+
+    client->issued_at = now;
+    client->active = 1;
+    daemon_try_complete(daemon, client);
+}
+
+// Start the next complete request line in the client's input, if it is idle
+static void daemon_process_input(PriceDaemon *daemon, DaemonClient *client) {
+    while (!client->active) {
+        char *newline = memchr(client->in, '\n', client->in_len);
+        if (!newline) {
+            return;
+        }
+        *newline = 0;
+        size_t consumed = (size_t)(newline - client->in) + 1;
+        char line[PRICE_REQUEST_MAX];
+        memcpy(line, client->in, consumed);
+        client->in_len -= consumed;
+        memmove(client->in, client->in + consumed, client->in_len);
+        daemon_start_request(daemon, client, line);
+    }
+}
+
+static void daemon_close_client(PriceDaemon *daemon, size_t i) {
+    DaemonClient *client = &daemon->clients[i];
+    close(client->fd);
+    free(client->out);
+    free(client->request);
+    daemon->clients[i] = daemon->clients[--daemon->num_clients];
+}
+
+static int daemon_listen(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        perror("Error listening on price daemon socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to serve latest prices on a Unix domain socket until SIGINT or SIGTERM.
+// Prices are cached per symbol for options->ttl seconds; stale and unknown symbols
+// are fetched by a worker thread over one warm connection.
+int price_daemon_run(const PriceDaemonOptions *options) {
+    PriceDaemon *daemon = (PriceDaemon *)calloc(1, sizeof(PriceDaemon));
+    if (!daemon) {
+        return -1;
+    }
+    daemon->options = *options;
+    daemon->last_symbol = -1;
+    symbol_table_init(&daemon->table);
+    pthread_mutex_init(&daemon->lock, NULL);
+    pthread_cond_init(&daemon->cond, NULL);
+
+    daemon->rest = rest_client_create();
+    int listen_fd = daemon->rest ? daemon_listen(options->socket_path) : -1;
+    if (listen_fd < 0 || pipe(daemon->wake_pipe) != 0) {
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        rest_client_destroy(daemon->rest);
+        free(daemon);
+        return -1;
+    }
+    fcntl(daemon->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(daemon->wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    signal(SIGINT, daemon_signal_handler);
+    signal(SIGTERM, daemon_signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t worker;
+    pthread_create(&worker, NULL, daemon_worker, daemon);
+    fprintf(stderr, "Price daemon listening on %s (ttl %.3f s)\n", options->socket_path, options->ttl);
+
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 2];
+    while (!daemon_stop) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = daemon->wake_pipe[0];
+        fds[1].events = POLLIN;
+        size_t num_clients = daemon->num_clients;
+        for (size_t i = 0; i < num_clients; i++) {
+            fds[i + 2].fd = daemon->clients[i].fd;
+            fds[i + 2].events = POLLIN | (daemon->clients[i].out_len > 0 ? POLLOUT : 0);
+        }
+
+        if (poll(fds, num_clients + 2, 1000) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        // Fetches finished: answer every request that is now complete
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(daemon->wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+            for (size_t i = 0; i < daemon->num_clients; i++) {
+                if (daemon->clients[i].active) {
+                    daemon_try_complete(daemon, &daemon->clients[i]);
+                    daemon_process_input(daemon, &daemon->clients[i]);
+                }
+            }
+        }
+
+        // Walk backwards so closing a client (which moves the last one into its
+        // place) does not skip anyone
+        for (size_t i = num_clients; i-- > 0; ) {
+            DaemonClient *client = &daemon->clients[i];
+            short revents = fds[i + 2].revents;
+            int closed = 0;
+
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = read(client->fd, client->in + client->in_len, sizeof(client->in) - client->in_len);
+                if (n <= 0 && !(n < 0 && (errno == EAGAIN || errno == EINTR))) {
+                    closed = 1;
+                } else if (n > 0) {
+                    client->in_len += (size_t)n;
+                    daemon_process_input(daemon, client);
+                    // A line longer than the buffer can never complete
+                    if (client->in_len == sizeof(client->in) && !client->active) {
+                        closed = 1;
+                    }
+                }
+            }
+            if (!closed && client->out_len > 0 && client_flush(client) != 0) {
+                closed = 1;
+            }
+            if (closed) {
+                daemon_close_client(daemon, i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                if (daemon->num_clients == DAEMON_MAX_CLIENTS) {
+                    close(fd);
+                    continue;
+                }
+                DaemonClient *client = &daemon->clients[daemon->num_clients++];
+                memset(client, 0, sizeof(*client));
+                client->fd = fd;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&daemon->lock);
+    daemon->stopping = 1;
+    pthread_cond_broadcast(&daemon->cond);
+    pthread_mutex_unlock(&daemon->lock);
+    pthread_join(worker, NULL);
+
+    while (daemon->num_clients > 0) {
+        daemon_close_client(daemon, daemon->num_clients - 1);
+    }
+    close(listen_fd);
+    unlink(options->socket_path);
+    close(daemon->wake_pipe[0]);
+    close(daemon->wake_pipe[1]);
+    rest_client_destroy(daemon->rest);
+    symbol_table_free(&daemon->table);
+    free(daemon->entries);
+    free(daemon->queue);
+    pthread_mutex_destroy(&daemon->lock);
+    pthread_cond_destroy(&daemon->cond);
+    free(daemon);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef ALPACA_PRICE_DAEMON_H
+#define ALPACA_PRICE_DAEMON_H
+
+#include <stddef.h>
+#include "alpaca_latest.h"
+
+#define DAEMON_DEFAULT_TTL 1.0       // seconds a cached price is served without refetching
+#define DAEMON_MAX_CLIENTS 256
+#define DAEMON_WARM_INTERVAL 20.0    // idle seconds before the connection is refreshed
+
+typedef struct {
+    const char *socket_path;
+    const char *feed;
+    LatestKind kind;
+    double ttl;
+    size_t batch_size;
+} PriceDaemonOptions;
+
+int price_daemon_run(const PriceDaemonOptions *options);
+
+#endif // ALPACA_PRICE_DAEMON_H
@@ -0,0 +1,326 @@
+#include "alpaca_rankings.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MIN_RANKINGS_CAPACITY 1024
+
+static const char *ranking_titles[RANK_COUNT] = { "Top gainers", "Top losers", "Volume leaders", "Widest spreads" };
+
+void rankings_init(MarketRankings *rankings) {
+    memset(rankings, 0, sizeof(*rankings));
+    symbol_table_init(&rankings->symbols);
+}
+
+void rankings_free(MarketRankings *rankings) {
+    for (int k = 0; k < RANK_COUNT; k++) {
+        free(rankings->heaps[k].heap);
+        free(rankings->heaps[k].pos);
+        free(rankings->heaps[k].key);
+    }
+    free(rankings->aggregates);
+    symbol_table_free(&rankings->symbols);
+    memset(rankings, 0, sizeof(*rankings));
+}
+
+static void heap_swap(IndexedHeap *h, size_t a, size_t b) {
+    int32_t sa = h->heap[a];
+    int32_t sb = h->heap[b];
+    h->heap[a] = sb;
+    h->heap[b] = sa;
+    h->pos[sb] = (int32_t)a;
+    h->pos[sa] = (int32_t)b;
+}
+
+static void heap_up(IndexedHeap *h, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (h->key[h->heap[parent]] >= h->key[h->heap[i]]) {
+            break;
+        }
+        heap_swap(h, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(IndexedHeap *h, size_t i) {
+    for (;;) {
+        size_t largest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < h->count && h->key[h->heap[left]] > h->key[h->heap[largest]]) {
+            largest = left;
+        }
+        if (right < h->count && h->key[h->heap[right]] > h->key[h->heap[largest]]) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+        heap_swap(h, i, largest);
+        i = largest;
+    }
+}
+
+// Function to insert a symbol or move it to match its new key
+static void heap_set(IndexedHeap *h, int32_t symbol, double key) {
+    int32_t pos = h->pos[symbol];
+    if (pos < 0) {
+        h->key[symbol] = key;
+        h->heap[h->count] = symbol;
+        h->pos[symbol] = (int32_t)h->count;
+        heap_up(h, h->count++);
+        return;
+    }
+    double old = h->key[symbol];
+    h->key[symbol] = key;
+    if (key > old) {
+        heap_up(h, (size_t)pos);
+    } else if (key < old) {
+        heap_down(h, (size_t)pos);
+    }
+}
+
+static void heap_remove(IndexedHeap *h, int32_t symbol) {
+    int32_t pos = h->pos[symbol];
+    if (pos < 0) {
+        return;
+    }
+    size_t last = --h->count;
+    if ((size_t)pos != last) {
+        heap_swap(h, (size_t)pos, last);
+        heap_down(h, (size_t)pos);
+        heap_up(h, (size_t)pos);
+    }
+    h->pos[symbol] = -1;
+}
+
+// Function to grow the per-symbol arrays to hold every symbol in the table
+static int ensure_capacity(MarketRankings *rankings) {
+    size_t needed = rankings->symbols.count;
+    if (needed <= rankings->capacity) {
+        return 0;
+    }
+    size_t capacity = rankings->capacity ? rankings->capacity * 2 : MIN_RANKINGS_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    SymbolAggregate *aggregates = (SymbolAggregate *)realloc(rankings->aggregates, capacity * sizeof(SymbolAggregate));
+    if (!aggregates) {
+        return -1;
+    }
+    memset(aggregates + rankings->capacity, 0, (capacity - rankings->capacity) * sizeof(SymbolAggregate));
+    rankings->aggregates = aggregates;
+    for (int k = 0; k < RANK_COUNT; k++) {
+        IndexedHeap *h = &rankings->heaps[k];
+        int32_t *heap = (int32_t *)realloc(h->heap, capacity * sizeof(int32_t));
+        if (heap) {
+            h->heap = heap;
+        }
+        int32_t *pos = heap ? (int32_t *)realloc(h->pos, capacity * sizeof(int32_t)) : NULL;
+        if (pos) {
+            h->pos = pos;
+        }
+        double *key = pos ? (double *)realloc(h->key, capacity * sizeof(double)) : NULL;
+        if (!key) {
+            return -1;
+        }
+        h->key = key;
+        memset(h->pos + rankings->capacity, 0xff, (capacity - rankings->capacity) * sizeof(int32_t));
+    }
+    rankings->capacity = capacity;
+    return 0;
+}
+
+static int symbol_index(MarketRankings *rankings, const char *symbol) {
+    int index = symbol ? symbol_table_add(&rankings->symbols, symbol) : -1;
+    if (index < 0 || ensure_capacity(rankings) != 0) {
+        return -1;
+    }
+    return index;
+}
+
+static void update_change(MarketRankings *rankings, int index) {
+    SymbolAggregate *a = &rankings->aggregates[index];
+    if (a->prior_close <= 0 || a->last <= 0) {
+        return;
+    }
+    a->change = (a->last / a->prior_close - 1.0) * 100.0;
+    heap_set(&rankings->heaps[RANK_GAINERS], index, a->change);
+    heap_set(&rankings->heaps[RANK_LOSERS], index, -a->change);
+}
+
+int rankings_set_prior_close(MarketRankings *rankings, const char *symbol, double close) {
+    int index = symbol_index(rankings, symbol);
+    if (index < 0 || close <= 0) {
+        return -1;
+    }
+    rankings->aggregates[index].prior_close = close;
+    update_change(rankings, index);
+    return 0;
+}
+
+// Function to read prior closes, one "SYMBOL PRICE" pair per line (spaces, tabs or a
+// comma between them; '#' starts a comment). Returns the number of closes read, or
+// -1 if the file cannot be opened.
+int rankings_load_prior_closes(MarketRankings *rankings, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    int line_number = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_number++;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        char *saveptr = NULL;
+        char *symbol = strtok_r(line, " \t,\r\n", &saveptr);
+        char *price = symbol ? strtok_r(NULL, " \t,\r\n", &saveptr) : NULL;
+        if (!symbol) {
+            continue;
+        }
+        for (char *c = symbol; *c; c++) {
+            *c = (char)toupper((unsigned char)*c);
+        }
+        if (!price || rankings_set_prior_close(rankings, symbol, atof(price)) != 0) {
+            fprintf(stderr, "%s:%d: expected SYMBOL PRICE\n", path, line_number);
+            continue;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+// Function to add a trade to its symbol's totals. A symbol without a loaded prior
+// close is measured from its first trade.
+void rankings_trade(MarketRankings *rankings, const char *symbol, double price, double size) {
+    int index = symbol_index(rankings, symbol);
+    if (index < 0 || price <= 0) {
+        return;
+    }
+    SymbolAggregate *a = &rankings->aggregates[index];
+    if (a->prior_close <= 0) {
+        a->prior_close = price;
+    }
+    a->last = price;
+    a->trades++;
+    if (size > 0) {
+        a->volume += size;
+        a->notional += size * price;
+        heap_set(&rankings->heaps[RANK_VOLUME], index, a->volume);
+    }
+    update_change(rankings, index);
+}
+
+// Function to record a symbol's quote. Crossed or one-sided quotes take the symbol
+// out of the spread ranking until a usable quote arrives.
+void rankings_quote(MarketRankings *rankings, const char *symbol, double bid, double ask) {
+    int index = symbol_index(rankings, symbol);
+    if (index < 0) {
+        return;
+    }
+    SymbolAggregate *a = &rankings->aggregates[index];
+    a->bid = bid;
+    a->ask = ask;
+    a->has_spread = bid > 0 && ask >= bid;
+    if (a->has_spread) {
+        a->spread_bps = (ask - bid) / ((ask + bid) / 2) * 1e4;
+        heap_set(&rankings->heaps[RANK_SPREAD], index, a->spread_bps);
+    } else {
+        heap_remove(&rankings->heaps[RANK_SPREAD], index);
+    }
+}
+
+// Function to copy the first n entries of a ranking into out, best first. Only the
+// top of the heap is visited: the next best entry is always a child of one already
+// taken, so a small heap of those children is enough (O(n log n) whatever the size
+// of the universe). Returns the number of entries.
+size_t rankings_top(const MarketRankings *rankings, RankingKind kind, size_t n, RankEntry *out) {
+    const IndexedHeap *h = &rankings->heaps[kind];
+    if (n > h->count) {
+        n = h->count;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    size_t *frontier = (size_t *)malloc((2 * n + 1) * sizeof(size_t));
+    if (!frontier) {
+        return 0;
+    }
+    size_t size = 0;
+    frontier[size++] = 0;
+
+    size_t taken = 0;
+    while (taken < n && size > 0) {
+        // The frontier is a max-heap of positions in h, ordered by their keys
+        size_t best = frontier[0];
+        frontier[0] = frontier[--size];
+        for (size_t i = 0;;) {
+            size_t largest = i;
+            size_t left = 2 * i + 1;
+            size_t right = left + 1;
+            if (left < size && h->key[h->heap[frontier[left]]] > h->key[h->heap[frontier[largest]]]) {
+                largest = left;
+            }
+            if (right < size && h->key[h->heap[frontier[right]]] > h->key[h->heap[frontier[largest]]]) {
+                largest = right;
+            }
+            if (largest == i) {
+                break;
+            }
+            size_t tmp = frontier[i];
+            frontier[i] = frontier[largest];
+            frontier[largest] = tmp;
+            i = largest;
+        }
+
+        int32_t symbol = h->heap[best];
+        out[taken].symbol = symbol_table_name(&rankings->symbols, symbol);
+        out[taken].value = kind == RANK_LOSERS ? -h->key[symbol] : h->key[symbol];
+        out[taken].aggregate = &rankings->aggregates[symbol];
+        taken++;
+
+        for (size_t child = 2 * best + 1; child <= 2 * best + 2 && child < h->count; child++) {
+            size_t i = size++;
+            frontier[i] = child;
+            while (i > 0 && h->key[h->heap[frontier[(i - 1) / 2]]] < h->key[h->heap[frontier[i]]]) {
+                size_t tmp = frontier[i];
+                frontier[i] = frontier[(i - 1) / 2];
+                frontier[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+    free(frontier);
+    return taken;
+}
+
+// Function to print the top n of every ranking
+void rankings_print(const MarketRankings *rankings, FILE *fp, size_t n) {
+    RankEntry *entries = (RankEntry *)malloc((n ? n : 1) * sizeof(RankEntry));
+    if (!entries) {
+        return;
+    }
+    for (int k = 0; k < RANK_COUNT; k++) {
+        size_t count = rankings_top(rankings, (RankingKind)k, n, entries);
+        fprintf(fp, "%s:\n", ranking_titles[k]);
+        for (size_t i = 0; i < count; i++) {
+            const SymbolAggregate *a = entries[i].aggregate;
+            if (k == RANK_SPREAD) {
+                fprintf(fp, "  %2zu. %-8s %8.1f bps  bid %.4f ask %.4f\n", i + 1, entries[i].symbol, entries[i].value, a->bid, a->ask);
+            } else if (k == RANK_VOLUME) {
+                fprintf(fp, "  %2zu. %-8s %12.0f shares  $%.0f  last %.4f\n", i + 1, entries[i].symbol, entries[i].value, a->notional, a->last);
+            } else {
+                fprintf(fp, "  %2zu. %-8s %+8.2f%%  last %.4f prior close %.4f\n", i + 1, entries[i].symbol, entries[i].value, a->last, a->prior_close);
+            }
+        }
+    }
+    fprintf(fp, "\n");
+    free(entries);
+}
@@ -0,0 +1,64 @@
+#ifndef ALPACA_RANKINGS_H
+#define ALPACA_RANKINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "alpaca_symbol_table.h"
+
+#define RANKINGS_DEFAULT_TOP 10
+
+typedef enum {
+    RANK_GAINERS,       // largest percent change from the prior close
+    RANK_LOSERS,        // smallest percent change
+    RANK_VOLUME,        // most shares traded
+    RANK_SPREAD,        // widest quoted spread, in basis points of the midpoint
+    RANK_COUNT
+} RankingKind;
+
+// Running totals for one symbol, updated in O(1) per trade or quote
+typedef struct {
+    double last;
+    double prior_close;     // 0 until loaded or set from the first trade
+    double change;          // percent from prior_close to last
+    double volume;
+    double notional;
+    int64_t trades;
+    double bid;
+    double ask;
+    double spread_bps;
+    int has_spread;
+} SymbolAggregate;
+
+// Max-heap of symbol indices with each symbol's heap position, so a symbol whose key
+// changes is moved up or down in O(log n) instead of re-sorting the universe
+typedef struct {
+    int32_t *heap;
+    int32_t *pos;           // indexed by symbol, -1 when not in the heap
+    double *key;            // indexed by symbol
+    size_t count;
+} IndexedHeap;
+
+typedef struct {
+    SymbolTable symbols;
+    SymbolAggregate *aggregates;    // indexed like symbols
+    size_t capacity;
+    IndexedHeap heaps[RANK_COUNT];
+} MarketRankings;
+
+typedef struct {
+    const char *symbol;
+    double value;           // the ranked quantity: percent, shares or basis points
+    const SymbolAggregate *aggregate;
+} RankEntry;
+
+void rankings_init(MarketRankings *rankings);
+void rankings_free(MarketRankings *rankings);
+int rankings_set_prior_close(MarketRankings *rankings, const char *symbol, double close);
+int rankings_load_prior_closes(MarketRankings *rankings, const char *path);
+void rankings_trade(MarketRankings *rankings, const char *symbol, double price, double size);
+void rankings_quote(MarketRankings *rankings, const char *symbol, double bid, double ask);
+size_t rankings_top(const MarketRankings *rankings, RankingKind kind, size_t n, RankEntry *out);
+void rankings_print(const MarketRankings *rankings, FILE *fp, size_t n);
+
+#endif // ALPACA_RANKINGS_H
@@ -0,0 +1,720 @@
+#include "alpaca_relay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <libwebsockets.h>
+
+#define RELAY_MAX_MESSAGE (1 << 26)     // largest frame accepted from either side
+#define RELAY_MAX_CLIENT_MESSAGE 65536
+#define RELAY_ALL_CLIENTS -2            // kind of a message every client gets
+
+static const char *kind_names[RELAY_KINDS] = { "trades", "quotes", "bars" };
+
+// Function to map a message type to the subscription that receives it: corrections
+// and cancel errors go to trade subscribers. Returns -1 for control messages.
+static int kind_of_type(const char *type) {
+    if (!type) {
+        return -1;
+    }
+    if (strcmp(type, "t") == 0 || strcmp(type, "c") == 0 || strcmp(type, "x") == 0) {
+        return 0;
+    }
+    if (strcmp(type, "q") == 0) {
+        return 1;
+    }
+    if (strcmp(type, "b") == 0) {
+        return 2;
+    }
+    if (strcmp(type, "error") == 0) {
+        return RELAY_ALL_CLIENTS;
+    }
+    return -1;
+}
+
+void relay_hub_init(RelayHub *hub, size_t headroom, size_t max_queued) {
+    memset(hub, 0, sizeof(*hub));
+    hub->headroom = headroom;
+    hub->max_queued = max_queued ? max_queued : RELAY_DEFAULT_MAX_QUEUED;
+    symbol_table_init(&hub->symbols);
+}
+
+void relay_frame_release(RelayFrame *frame) {
+    if (frame && --frame->refs <= 0) {
+        free(frame);
+    }
+}
+
+static void free_client(RelayClient *client) {
+    while (client->count > 0) {
+        relay_client_pop(client);
+    }
+    free(client->queue);
+    free(client->wants);
+    free(client->rx);
+    free(client);
+}
+
+void relay_hub_free(RelayHub *hub) {
+    for (size_t i = 0; i < hub->num_clients; i++) {
+        free_client(hub->clients[i]);
+    }
+    free(hub->clients);
+    free(hub->symbol_state);
+    symbol_table_free(&hub->symbols);
+    memset(hub, 0, sizeof(*hub));
+}
+
+// Allocate a frame of len bytes after the headroom, held once by the caller
+static RelayFrame *frame_alloc(const RelayHub *hub, size_t len) {
+    RelayFrame *frame = (RelayFrame *)malloc(sizeof(RelayFrame) + hub->headroom + len + 1);
+    if (!frame) {
+        fprintf(stderr, "Error: not enough memory for a relay frame.\n");
+        return NULL;
+    }
+    frame->refs = 1;
+    frame->len = len;
+    frame->data[hub->headroom + len] = 0;
+    return frame;
+}
+
+static RelayFrame *frame_from_text(const RelayHub *hub, const char *text, size_t len) {
+    RelayFrame *frame = frame_alloc(hub, len);
+    if (frame) {
+        memcpy(frame->data + hub->headroom, text, len);
+    }
+    return frame;
+}
+
+// Function to wrap one message of an upstream frame in a frame of its own
+static RelayFrame *frame_from_message(const RelayHub *hub, json_t *message) {
+    char *text = json_dumps(message, JSON_COMPACT);
+    if (!text) {
+        return NULL;
+    }
+    size_t len = strlen(text);
+    RelayFrame *frame = frame_alloc(hub, len + 2);
+    if (frame) {
+        unsigned char *out = frame->data + hub->headroom;
+        out[0] = '[';
+        memcpy(out + 1, text, len);
+        out[len + 1] = ']';
+    }
+    free(text);
+    return frame;
+}
+
+// Function to queue a frame for a client, dropping its oldest frame if the queue is full
+static void enqueue(RelayHub *hub, RelayClient *client, RelayFrame *frame) {
+    if (client->count == client->capacity) {
+        relay_frame_release(client->queue[client->head]);
+        client->head = (client->head + 1) % client->capacity;
+        client->count--;
+        client->dropped++;
+    }
+    frame->refs++;
+    client->queue[(client->head + client->count) % client->capacity] = frame;
+    client->count++;
+    if (client->count == 1 && hub->wake) {
+        hub->wake(client->transport);
+    }
+}
+
+static void send_text(RelayHub *hub, RelayClient *client, const char *text) {
+    RelayFrame *frame = frame_from_text(hub, text, strlen(text));
+    if (frame) {
+        enqueue(hub, client, frame);
+        relay_frame_release(frame);
+    }
+}
+
+RelayFrame *relay_client_front(const RelayClient *client) {
+    return client->count > 0 ? client->queue[client->head] : NULL;
+}
+
+// Function to drop the frame at the front of a client's queue once it has been sent
+void relay_client_pop(RelayClient *client) {
+    if (client->count == 0) {
+        return;
+    }
+    relay_frame_release(client->queue[client->head]);
+    client->head = (client->head + 1) % client->capacity;
+    client->count--;
+    client->sent++;
+}
+
+RelayClient *relay_hub_add_client(RelayHub *hub, void *transport) {
+    if (hub->num_clients == hub->clients_capacity) {
+        size_t capacity = hub->clients_capacity ? hub->clients_capacity * 2 : 16;
+        RelayClient **clients = (RelayClient **)realloc(hub->clients, capacity * sizeof(RelayClient *));
+        if (!clients) {
+            return NULL;
+        }
+        hub->clients = clients;
+        hub->clients_capacity = capacity;
+    }
+    RelayClient *client = (RelayClient *)calloc(1, sizeof(RelayClient));
+    if (!client || !(client->queue = (RelayFrame **)malloc(hub->max_queued * sizeof(RelayFrame *)))) {
+        free(client);
+        return NULL;
+    }
+    client->capacity = hub->max_queued;
+    client->transport = transport;
+    hub->clients[hub->num_clients++] = client;
+
+    // Greet the client the way Alpaca does, so existing stream code works unchanged
+    send_text(hub, client, "[{\"T\":\"success\",\"msg\":\"connected\"}]");
+    return client;
+}
+
+void relay_hub_remove_client(RelayHub *hub, RelayClient *client) {
+    int changed = 0;
+    for (size_t i = 0; i < client->wants_capacity; i++) {
+        for (int k = 0; k < RELAY_KINDS; k++) {
+            if (client->wants[i] & (1u << k)) {
+                changed |= --hub->symbol_state[i].wanted[k] == 0;
+            }
+        }
+    }
+    for (int k = 0; k < RELAY_KINDS; k++) {
+        if (client->all & (1u << k)) {
+            changed |= --hub->all_wanted[k] == 0;
+        }
+    }
+    for (size_t i = 0; i < hub->num_clients; i++) {
+        if (hub->clients[i] == client) {
+            hub->clients[i] = hub->clients[--hub->num_clients];
+            break;
+        }
+    }
+    free_client(client);
+    if (changed && hub->upstream_changed) {
+        hub->upstream_changed(hub->user);
+    }
+}
+
+// Function to find, or with add set add, a symbol, upper-cased. Returns -1 for a
+// symbol that is unknown, empty, too long or cannot be stored.
+static int hub_symbol(RelayHub *hub, const char *symbol, int add) {
+    char name[SYMBOL_SIZE];
+    size_t len = strlen(symbol);
+    if (len == 0 || len >= sizeof(name)) {
+        return -1;
+    }
+    for (size_t i = 0; i <= len; i++) {
+        name[i] = (char)toupper((unsigned char)symbol[i]);
+    }
+    int index = add ? symbol_table_add(&hub->symbols, name) : symbol_table_find(&hub->symbols, name);
+    if (index < 0) {
+        return -1;
+    }
+    if ((size_t)index >= hub->symbol_capacity) {
+        size_t capacity = hub->symbol_capacity ? hub->symbol_capacity * 2 : 64;
+        RelaySymbol *state = (RelaySymbol *)realloc(hub->symbol_state, capacity * sizeof(RelaySymbol));
+        if (!state) {
+            return -1;
+        }
+        memset(state + hub->symbol_capacity, 0, (capacity - hub->symbol_capacity) * sizeof(RelaySymbol));
+        hub->symbol_state = state;
+        hub->symbol_capacity = capacity;
+    }
+    return index;
+}
+
+static int client_grow_wants(RelayClient *client, size_t count) {
+    if (count <= client->wants_capacity) {
+        return 0;
+    }
+    uint8_t *wants = (uint8_t *)realloc(client->wants, count);
+    if (!wants) {
+        return -1;
+    }
+    memset(wants + client->wants_capacity, 0, count - client->wants_capacity);
+    client->wants = wants;
+    client->wants_capacity = count;
+    return 0;
+}
+
+// Function to add (on set) or remove the symbols listed in a subscribe message for a
+// client, or for the base subscription when client is NULL. Returns 1 if the union
+// of all subscriptions changed.
+static int apply_subscription(RelayHub *hub, RelayClient *client, json_t *message, int on) {
+    int changed = 0;
+    for (int k = 0; k < RELAY_KINDS; k++) {
+        unsigned bit = 1u << k;
+        size_t i;
+        json_t *value;
+        json_array_foreach(json_object_get(message, kind_names[k]), i, value) {
+            const char *symbol = json_string_value(value);
+            if (!symbol) {
+                continue;
+            }
+            if (strcmp(symbol, "*") == 0) {
+                if (!client || ((client->all & bit) != 0) != on) {
+                    changed |= on ? hub->all_wanted[k]++ == 0 : --hub->all_wanted[k] == 0;
+                    if (client) {
+                        client->all ^= bit;
+                    }
+                }
+                continue;
+            }
+            int index = hub_symbol(hub, symbol, on);
+            if (index < 0 || (client && client_grow_wants(client, hub->symbols.count) != 0)) {
+                continue;
+            }
+            RelaySymbol *state = &hub->symbol_state[index];
+            if (!client || ((client->wants[index] & bit) != 0) != on) {
+                changed |= on ? state->wanted[k]++ == 0 : --state->wanted[k] == 0;
+                if (client) {
+                    client->wants[index] ^= bit;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+// Function to subscribe upstream to params ({"trades": [...], "quotes": [...],
+// "bars": [...]}) whatever the clients want
+int relay_hub_subscribe_base(RelayHub *hub, json_t *params) {
+    if (params && apply_subscription(hub, NULL, params, 1) && hub->upstream_changed) {
+        hub->upstream_changed(hub->user);
+    }
+    return 0;
+}
+
+// Function to reply with a client's whole subscription, as Alpaca does
+static void send_subscription(RelayHub *hub, RelayClient *client) {
+    json_t *reply = json_object();
+    json_object_set_new(reply, "T", json_string("subscription"));
+    for (int k = 0; k < RELAY_KINDS; k++) {
+        json_t *symbols = json_array();
+        if (client->all & (1u << k)) {
+            json_array_append_new(symbols, json_string("*"));
+        }
+        for (size_t i = 0; i < client->wants_capacity; i++) {
+            if (client->wants[i] & (1u << k)) {
+                json_array_append_new(symbols, json_string(symbol_table_name(&hub->symbols, (int)i)));
+            }
+        }
+        json_object_set_new(reply, kind_names[k], symbols);
+    }
+    json_t *frame = json_array();
+    json_array_append_new(frame, reply);
+    char *text = json_dumps(frame, JSON_COMPACT);
+    if (text) {
+        send_text(hub, client, text);
+        free(text);
+    }
+    json_decref(frame);
+}
+
+// Function to handle a message from a client: auth is accepted as is, subscribe and
+// unsubscribe change the client's filter. Returns -1 for a message that is not
+// understood, after telling the client.
+int relay_hub_client_message(RelayHub *hub, RelayClient *client, const char *data, size_t len) {
+    json_t *root = json_loadb(data, len, 0, NULL);
+    const char *action = json_string_value(json_object_get(root, "action"));
+    int result = 0;
+
+    if (action && strcmp(action, "auth") == 0) {
+        send_text(hub, client, "[{\"T\":\"success\",\"msg\":\"authenticated\"}]");
+    } else if (action && (strcmp(action, "subscribe") == 0 || strcmp(action, "unsubscribe") == 0)) {
+        if (apply_subscription(hub, client, root, action[0] == 's') && hub->upstream_changed) {
+            hub->upstream_changed(hub->user);
+        }
+        send_subscription(hub, client);
+    } else {
+        send_text(hub, client, "[{\"T\":\"error\",\"code\":400,\"msg\":\"invalid syntax\"}]");
+        result = -1;
+    }
+    json_decref(root);
+    return result;
+}
+
+static int client_matches(const RelayClient *client, int kind, int symbol) {
+    if (kind == RELAY_ALL_CLIENTS) {
+        return 1;
+    }
+    if (kind < 0) {
+        return 0;
+    }
+    if (client->all & (1u << kind)) {
+        return 1;
+    }
+    return symbol >= 0 && (size_t)symbol < client->wants_capacity && (client->wants[symbol] & (1u << kind));
+}
+
+// Function to fan an upstream frame out to the clients. A client that wants every
+// message in the frame gets the frame as received; one that wants only some gets
+// them one per frame. Either way each frame is built once and shared.
+int relay_hub_publish(RelayHub *hub, const char *data, size_t len) {
+    json_error_t error;
+    json_t *root = json_loadb(data, len, 0, &error);
+    if (!root) {
+        fprintf(stderr, "Error parsing upstream frame: %s\n", error.text);
+        return -1;
+    }
+    size_t n = json_is_array(root) ? json_array_size(root) : 1;
+    int *kinds = (int *)malloc(2 * n * sizeof(int) + 1);
+    RelayFrame **frames = (RelayFrame **)calloc(n + 1, sizeof(RelayFrame *));
+    if (!kinds || !frames) {
+        free(kinds);
+        free(frames);
+        json_decref(root);
+        return -1;
+    }
+    int *symbols = kinds + n;
+
+    for (size_t c = 0; c < hub->num_clients; c++) {
+        hub->clients[c]->matched = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        json_t *message = json_is_array(root) ? json_array_get(root, i) : root;
+        const char *type = json_string_value(json_object_get(message, "T"));
+        const char *symbol = json_string_value(json_object_get(message, "S"));
+        kinds[i] = kind_of_type(type);
+        symbols[i] = symbol ? symbol_table_find(&hub->symbols, symbol) : -1;
+        if (type && strcmp(type, "subscription") == 0) {
+            char *text = json_dumps(message, JSON_COMPACT);
+            printf("Upstream subscription: %s\n", text ? text : "");
+            free(text);
+        } else if (type && (strcmp(type, "success") == 0 || strcmp(type, "error") == 0)) {
+            const char *msg = json_string_value(json_object_get(message, "msg"));
+            fprintf(type[0] == 'e' ? stderr : stdout, "Upstream %s: %s\n", type, msg ? msg : "");
+        }
+        for (size_t c = 0; c < hub->num_clients; c++) {
+            hub->clients[c]->matched += client_matches(hub->clients[c], kinds[i], symbols[i]);
+        }
+    }
+
+    RelayFrame *whole = NULL;
+    for (size_t c = 0; c < hub->num_clients; c++) {
+        RelayClient *client = hub->clients[c];
+        if (client->matched == 0) {
+            continue;
+        }
+        if (client->matched == n) {
+            if (!whole && !(whole = frame_from_text(hub, data, len))) {
+                continue;
+            }
+            enqueue(hub, client, whole);
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!client_matches(client, kinds[i], symbols[i])) {
+                continue;
+            }
+            if (!frames[i] && !(frames[i] = frame_from_message(hub, json_is_array(root) ? json_array_get(root, i) : root))) {
+                continue;
+            }
+            enqueue(hub, client, frames[i]);
+        }
+    }
+
+    relay_frame_release(whole);
+    for (size_t i = 0; i < n; i++) {
+        relay_frame_release(frames[i]);
+    }
+    hub->frames_published++;
+    free(frames);
+    free(kinds);
+    json_decref(root);
+    return 0;
+}
+
+// Function to build the next message that brings the upstream subscription in line
+// with what is wanted: a subscribe for what is missing, then an unsubscribe for what
+// nobody wants any more. The subscription is marked as sent. Returns NULL when
+// upstream is up to date; the caller frees the message.
+char *relay_hub_next_upstream(RelayHub *hub) {
+    for (int on = 1; on >= 0; on--) {
+        json_t *message = json_object();
+        int any = 0;
+        json_object_set_new(message, "action", json_string(on ? "subscribe" : "unsubscribe"));
+        for (int k = 0; k < RELAY_KINDS; k++) {
+            unsigned bit = 1u << k;
+            json_t *symbols = json_array();
+            if ((hub->all_wanted[k] > 0) == on && ((hub->all_subscribed & bit) != 0) != on) {
+                json_array_append_new(symbols, json_string("*"));
+                hub->all_subscribed ^= bit;
+            }
+            for (size_t i = 0; i < hub->symbols.count; i++) {
+                RelaySymbol *state = &hub->symbol_state[i];
+                if ((state->wanted[k] > 0) == on && ((state->subscribed & bit) != 0) != on) {
+                    json_array_append_new(symbols, json_string(symbol_table_name(&hub->symbols, (int)i)));
+                    state->subscribed ^= bit;
+                }
+            }
+            if (json_array_size(symbols) > 0) {
+                json_object_set_new(message, kind_names[k], symbols);
+                any = 1;
+            } else {
+                json_decref(symbols);
+            }
+        }
+        char *text = any ? json_dumps(message, JSON_COMPACT) : NULL;
+        json_decref(message);
+        if (text) {
+            return text;
+        }
+    }
+    return NULL;
+}
+
+// Function to forget what upstream is subscribed to, after a new connection
+void relay_hub_upstream_reset(RelayHub *hub) {
+    hub->all_subscribed = 0;
+    for (size_t i = 0; i < hub->symbols.count; i++) {
+        hub->symbol_state[i].subscribed = 0;
+    }
+}
+
+// The relay as served by libwebsockets: one client connection upstream and a
+// WebSocket listener on a local port, a Unix socket or both
+typedef struct {
+    RelayHub hub;
+    AlpacaContext *feed;
+    struct lws *upstream;
+    char *rx;
+    size_t rx_len;
+    size_t rx_capacity;
+} Relay;
+
+// Function to collect the fragments of a message. Returns -1 if it grows past limit.
+static int append_fragment(char **buf, size_t *len, size_t *capacity, const void *in, size_t n, size_t limit) {
+    if (*len + n > limit) {
+        return -1;
+    }
+    if (*len + n > *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 4096;
+        while (new_capacity < *len + n) {
+            new_capacity *= 2;
+        }
+        char *ptr = (char *)realloc(*buf, new_capacity);
+        if (!ptr) {
+            return -1;
+        }
+        *buf = ptr;
+        *capacity = new_capacity;
+    }
+    memcpy(*buf + *len, in, n);
+    *len += n;
+    return 0;
+}
+
+static void relay_wake(void *transport) {
+    lws_callback_on_writable((struct lws *)transport);
+}
+
+static void relay_upstream_changed(void *user) {
+    Relay *relay = (Relay *)user;
+    if (relay->upstream) {
+        lws_callback_on_writable(relay->upstream);
+    }
+}
+
+static int relay_callback_upstream(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+    Relay *relay = (Relay *)lws_context_user(lws_get_context(wsi));
+
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            puts("Connected to Alpaca WebSocket server.");
+            relay->upstream = wsi;
+            send_auth_message(relay->feed, wsi);
+            relay_hub_upstream_reset(&relay->hub);
+            lws_callback_on_writable(wsi);
+            break;
+        case LWS_CALLBACK_CLIENT_WRITEABLE: {
+            // One subscription change per write; ask again for the next one
+            char *message = relay_hub_next_upstream(&relay->hub);
+            if (message) {
+                size_t n = strlen(message);
+                unsigned char *buf = (unsigned char *)malloc(LWS_PRE + n);
+                if (buf) {
+                    printf("Sending subscription message: %s\n", message);
+                    memcpy(buf + LWS_PRE, message, n);
+                    lws_write(wsi, buf + LWS_PRE, n, LWS_WRITE_TEXT);
+                    free(buf);
+                }
+                free(message);
+                lws_callback_on_writable(wsi);
+            }
+            break;
+        }
+        case LWS_CALLBACK_CLIENT_RECEIVE:
+            if (append_fragment(&relay->rx, &relay->rx_len, &relay->rx_capacity, in, len, RELAY_MAX_MESSAGE) != 0) {
+                fprintf(stderr, "Error: upstream message too large, dropped.\n");
+                relay->rx_len = 0;
+                break;
+            }
+            if (lws_is_final_fragment(wsi)) {
+                relay_hub_publish(&relay->hub, relay->rx, relay->rx_len);
+                relay->rx_len = 0;
+            }
+            break;
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            fprintf(stderr, "Error connecting to Alpaca WebSocket server: %s\n", in ? (const char *)in : "unknown error");
+            relay->upstream = NULL;
+            alpaca_context_interrupt(relay->feed);
+            break;
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            puts("Connection closed.");
+            relay->upstream = NULL;
+            alpaca_context_interrupt(relay->feed);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+// The per-session data of a local connection is a pointer to its RelayClient
+static int relay_callback_local(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len) {
+    Relay *relay = (Relay *)lws_context_user(lws_get_context(wsi));
+    RelayClient **slot = (RelayClient **)user;
+
+    switch (reason) {
+        case LWS_CALLBACK_ESTABLISHED:
+            *slot = relay_hub_add_client(&relay->hub, wsi);
+            if (!*slot) {
+                return -1;
+            }
+            break;
+        case LWS_CALLBACK_RECEIVE: {
+            RelayClient *client = *slot;
+            if (!client || append_fragment(&client->rx, &client->rx_len, &client->rx_capacity, in, len, RELAY_MAX_CLIENT_MESSAGE) != 0) {
+                return -1;
+            }
+            if (lws_is_final_fragment(wsi)) {
+                relay_hub_client_message(&relay->hub, client, client->rx, client->rx_len);
+                client->rx_len = 0;
+            }
+            break;
+        }
+        case LWS_CALLBACK_SERVER_WRITEABLE: {
+            RelayClient *client = *slot;
+            RelayFrame *frame = client ? relay_client_front(client) : NULL;
+            if (!frame) {
+                break;
+            }
+            if (lws_write(wsi, frame->data + relay->hub.headroom, frame->len, LWS_WRITE_TEXT) < (int)frame->len) {
+                return -1;
+            }
+            relay_client_pop(client);
+            if (relay_client_front(client)) {
+                lws_callback_on_writable(wsi);
+            }
+            break;
+        }
+        case LWS_CALLBACK_CLOSED:
+            if (*slot) {
+                fprintf(stderr, "Relay client left after %zu frames (%zu dropped).\n", (*slot)->sent, (*slot)->dropped);
+                relay_hub_remove_client(&relay->hub, *slot);
+                *slot = NULL;
+            }
+            break;
+        default:
+            return lws_callback_http_dummy(wsi, reason, user, in, len);
+    }
+    return 0;
+}
+
+static const struct lws_protocols upstream_protocols[] = {
+    {"alpaca", relay_callback_upstream, 0, 0},
+    {NULL, NULL, 0, 0}};
+
+static const struct lws_protocols local_protocols[] = {
+    {"alpaca-relay", relay_callback_local, sizeof(RelayClient *), 0},
+    {NULL, NULL, 0, 0}};
+
+// Function to run the relay until interrupted: one upstream connection subscribed to
+// the feed's parameters and to whatever the local clients ask for, re-served over
+// WebSocket on 127.0.0.1:port and/or a Unix socket
+int relay_run(AlpacaContext *feed, const RelayOptions *options) {
+    Relay *relay = (Relay *)calloc(1, sizeof(Relay));
+    if (!relay) {
+        return -1;
+    }
+    relay->feed = feed;
+    relay_hub_init(&relay->hub, LWS_PRE, options->max_queued);
+    relay->hub.wake = relay_wake;
+    relay->hub.upstream_changed = relay_upstream_changed;
+    relay->hub.user = relay;
+    relay_hub_subscribe_base(&relay->hub, alpaca_context_params(feed));
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+    info.port = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = upstream_protocols;
+    info.user = relay;
+
+    struct lws_context *context = lws_create_context(&info);
+    if (!context) {
+        fprintf(stderr, "Error creating WebSocket context.\n");
+        relay_hub_free(&relay->hub);
+        free(relay);
+        return -1;
+    }
+
+    int ok = 1;
+    struct lws_context_creation_info vinfo;
+    if (options->port > 0) {
+        memset(&vinfo, 0, sizeof(vinfo));
+        vinfo.port = options->port;
+        vinfo.iface = "127.0.0.1";
+        vinfo.protocols = local_protocols;
+        vinfo.vhost_name = "relay";
+        ok = lws_create_vhost(context, &vinfo) != NULL;
+        if (ok) {
+            printf("Relay listening on ws://127.0.0.1:%d\n", options->port);
+        }
+    }
+    if (ok && options->unix_path) {
+        memset(&vinfo, 0, sizeof(vinfo));
+        vinfo.options = LWS_SERVER_OPTION_UNIX_SOCK;
+        vinfo.iface = options->unix_path;
+        vinfo.protocols = local_protocols;
+        vinfo.vhost_name = "relay-unix";
+        unlink(options->unix_path);
+        ok = lws_create_vhost(context, &vinfo) != NULL;
+        if (ok) {
+            printf("Relay listening on Unix socket %s\n", options->unix_path);
+        }
+    }
+
+    struct lws_client_connect_info ccinfo;
+    memset(&ccinfo, 0, sizeof(ccinfo));
+    ccinfo.context = context;
+    ccinfo.address = "stream.data.alpaca.markets";
+    ccinfo.port = 443;
+    ccinfo.path = options->path;
+    ccinfo.host = ccinfo.address;
+    ccinfo.origin = ccinfo.address;
+    ccinfo.protocol = "alpaca";
+    ccinfo.ssl_connection = LCCSCF_USE_SSL;
+
+    if (!ok) {
+        fprintf(stderr, "Error opening the relay listeners.\n");
+    } else if (!lws_client_connect_via_info(&ccinfo)) {
+        fprintf(stderr, "Error connecting to WebSocket server.\n");
+        ok = 0;
+    }
+
+    while (ok && !alpaca_context_interrupted(feed)) {
+        lws_service(context, 50);
+    }
+
+    // Destroying the context closes every client, which removes it from the hub
+    lws_context_destroy(context);
+    if (options->unix_path) {
+        unlink(options->unix_path);
+    }
+    fprintf(stderr, "Relayed %zu upstream frames.\n", relay->hub.frames_published);
+    relay_hub_free(&relay->hub);
+    free(relay->rx);
+    free(relay);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+#ifndef ALPACA_RELAY_H
+#define ALPACA_RELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <jansson.h>
+#include "alpaca_lib_jansson.h"
+#include "alpaca_symbol_table.h"
+
+#define RELAY_DEFAULT_MAX_QUEUED 1024   // frames held per client before the oldest is dropped
+#define RELAY_KINDS 3                   // trades, quotes, bars
+
+// One message for the clients, shared by every client it is queued for. The hub
+// drops its reference once the frame is queued; the last client to send or drop
+// it frees it.
+typedef struct {
+    int refs;
+    size_t len;
+    unsigned char data[];   // hub->headroom bytes, then len bytes of JSON
+} RelayFrame;
+
+// A local client. Frames wait in a ring of hub->max_queued entries; when it is
+// full the oldest is dropped so a slow client only ever loses its own backlog.
+typedef struct {
+    void *transport;        // handed back to the hub's wake callback
+    RelayFrame **queue;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    uint8_t *wants;         // RELAY_KINDS bits per hub symbol
+    size_t wants_capacity;
+    unsigned all;           // kinds subscribed with "*"
+    size_t sent;
+    size_t dropped;
+    size_t matched;         // scratch for relay_hub_publish
+    char *rx;               // message being received, for fragmented frames
+    size_t rx_len;
+    size_t rx_capacity;
+} RelayClient;
+
+// Per symbol: how many clients (and the base subscription) want each kind, and
+// which kinds the upstream connection is subscribed to
+typedef struct {
+    uint32_t wanted[RELAY_KINDS];
+    unsigned subscribed;
+} RelaySymbol;
+
+// Fans the messages of one upstream feed out to any number of local clients, each
+// with its own subscription. The upstream subscription is kept at the union of the
+// clients' subscriptions and the base one.
+typedef struct {
+    size_t headroom;        // bytes reserved in front of every frame, LWS_PRE for libwebsockets
+    size_t max_queued;
+    void (*wake)(void *transport);      // a client's queue is no longer empty
+    void (*upstream_changed)(void *user); // relay_hub_next_upstream has something to send
+    void *user;
+    SymbolTable symbols;
+    RelaySymbol *symbol_state;          // indexed like symbols
+    size_t symbol_capacity;
+    uint32_t all_wanted[RELAY_KINDS];
+    unsigned all_subscribed;
+    RelayClient **clients;
+    size_t num_clients;
+    size_t clients_capacity;
+    size_t frames_published;
+} RelayHub;
+
+void relay_hub_init(RelayHub *hub, size_t headroom, size_t max_queued);
+void relay_hub_free(RelayHub *hub);
+RelayClient *relay_hub_add_client(RelayHub *hub, void *transport);
+void relay_hub_remove_client(RelayHub *hub, RelayClient *client);
+int relay_hub_subscribe_base(RelayHub *hub, json_t *params);
+int relay_hub_client_message(RelayHub *hub, RelayClient *client, const char *data, size_t len);
+int relay_hub_publish(RelayHub *hub, const char *data, size_t len);
+char *relay_hub_next_upstream(RelayHub *hub);
+void relay_hub_upstream_reset(RelayHub *hub);
+
+RelayFrame *relay_client_front(const RelayClient *client);
+void relay_client_pop(RelayClient *client);
+void relay_frame_release(RelayFrame *frame);
+
+typedef struct {
+    const char *path;       // upstream path, /v2/sip or /v2/iex
+    int port;               // local WebSocket port on 127.0.0.1, 0 for none
+    const char *unix_path;  // local WebSocket Unix socket, NULL for none
+    size_t max_queued;
+} RelayOptions;
+
+int relay_run(AlpacaContext *feed, const RelayOptions *options);
+
+#endif // ALPACA_RELAY_H
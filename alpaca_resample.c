@@ -0,0 +1,148 @@
+#include "alpaca_resample.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SECONDS_PER_DAY 86400
+#define SECONDS_PER_WEEK (7 * SECONDS_PER_DAY)
+
+// First Sunday on or after a day number (days since 1970-01-01, a Thursday)
+static int64_t sunday_on_or_after(int64_t day) {
+    return day + (7 - (day + 4) % 7) % 7;
+}
+
+// Function to return the New York offset from UTC in seconds at time t: -4 h while
+// daylight saving time is in effect (second Sunday of March 02:00 EST to first
+// Sunday of November 02:00 EDT), -5 h otherwise
+int64_t exchange_utc_offset(int64_t t) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    int year = tm.tm_year + 1900;
+
+    int64_t dst_start = (sunday_on_or_after(days_from_civil(year, 3, 1)) + 7) * SECONDS_PER_DAY + 7 * 3600;
+    int64_t dst_end = sunday_on_or_after(days_from_civil(year, 11, 1)) * SECONDS_PER_DAY + 6 * 3600;
+    return (t >= dst_start && t < dst_end) ? -4 * 3600 : -5 * 3600;
+}
+
+// Function to convert a New York wall-clock time, expressed as seconds since 1970, to UTC
+int64_t exchange_local_to_utc(int64_t local) {
+    return local - exchange_utc_offset(local + 5 * 3600);
+}
+
+// Function to find the bucket a bar starting at t belongs to. Returns the bucket
+// start in UTC and stores the first second after it in *bucket_end, or returns -1
+// if the bar lies outside the session.
+int64_t bar_bucket_start(int64_t t, int64_t seconds, BarSession session, int64_t *bucket_end) {
+    int64_t local = t + exchange_utc_offset(t);
+    int64_t day = local - local % SECONDS_PER_DAY;
+    int64_t since_midnight = local - day;
+    int64_t start, end;
+
+    if (session == SESSION_REGULAR &&
+        (since_midnight < EXCHANGE_OPEN_SECONDS || since_midnight >= EXCHANGE_CLOSE_SECONDS)) {
+        return -1;
+    }
+
+    if (seconds >= SECONDS_PER_WEEK) {
+        // Weeks start on Monday
+        start = day - ((day / SECONDS_PER_DAY + 3) % 7) * SECONDS_PER_DAY;
+        end = start + SECONDS_PER_WEEK;
+    } else if (seconds >= SECONDS_PER_DAY) {
+        start = day;
+        end = day + (session == SESSION_REGULAR ? EXCHANGE_CLOSE_SECONDS : SECONDS_PER_DAY);
+    } else if (session == SESSION_REGULAR) {
+        // Count buckets from the open, and cut the last one short at the close
+        start = day + EXCHANGE_OPEN_SECONDS + (since_midnight - EXCHANGE_OPEN_SECONDS) / seconds * seconds;
+        end = start + seconds;
+        if (end > day + EXCHANGE_CLOSE_SECONDS) {
+            end = day + EXCHANGE_CLOSE_SECONDS;
+        }
+    } else {
+        start = day + since_midnight / seconds * seconds;
+        end = start + seconds;
+        if (end > day + SECONDS_PER_DAY) {
+            end = day + SECONDS_PER_DAY;
+        }
+    }
+
+    *bucket_end = exchange_local_to_utc(end);
+    return exchange_local_to_utc(start);
+}
+
+// Function to set up a resampler for a target timeframe in seconds. Intraday
+// timeframes, 1Day and 1Week are supported.
+int bar_resampler_init(BarResampler *resampler, int64_t seconds, BarSession session) {
+    memset(resampler, 0, sizeof(*resampler));
+    if (seconds < 60 || (seconds > SECONDS_PER_DAY && seconds != SECONDS_PER_WEEK)) {
+        fprintf(stderr, "Error: cannot resample to a timeframe of %lld seconds; use minutes, hours, 1Day or 1Week.\n", (long long)seconds);
+        return -1;
+    }
+    resampler->seconds = seconds;
+    resampler->session = session;
+    resampler->from = INT64_MIN;
+    resampler->to = INT64_MAX;
+    return 0;
+}
+
+// Close the bucket in progress and append it to out
+static int bar_resampler_emit(BarResampler *resampler, BarArray *out) {
+    if (resampler->bar.volume > 0) {
+        resampler->bar.vw = resampler->vw_volume / (double)resampler->bar.volume;
+    }
+    resampler->has_bar = 0;
+    return bar_array_push(out, &resampler->bar);
+}
+
+// Function to add one source bar. Bars must arrive in time order; a bucket is
+// appended to out as soon as a bar from a later bucket shows up.
+int bar_resampler_push(BarResampler *resampler, const AlpacaBar *bar, BarArray *out) {
+    if (bar->t < resampler->from || bar->t > resampler->to) {
+        return 0;
+    }
+
+    int64_t end;
+    int64_t start = bar_bucket_start(bar->t, resampler->seconds, resampler->session, &end);
+    if (start < 0) {
+        return 0;
+    }
+
+    if (resampler->has_bar && start != resampler->bar.t) {
+        if (bar_resampler_emit(resampler, out) != 0) {
+            return -1;
+        }
+    }
+
+    AlpacaBar *agg = &resampler->bar;
+    if (!resampler->has_bar) {
+        *agg = *bar;
+        agg->t = start;
+        resampler->bucket_end = end;
+        resampler->vw_volume = bar->vw * (double)bar->volume;
+        resampler->has_bar = 1;
+        return 0;
+    }
+
+    if (bar->high > agg->high) {
+        agg->high = bar->high;
+    }
+    if (bar->low < agg->low) {
+        agg->low = bar->low;
+    }
+    agg->close = bar->close;
+    agg->volume += bar->volume;
+    agg->trades += bar->trades;
+    resampler->vw_volume += bar->vw * (double)bar->volume;
+    // Without any volume the bucket keeps the latest vw
+    agg->vw = bar->vw;
+    return 0;
+}
+
+// Function to append the bucket in progress to out if it has ended by now.
+// Pass INT64_MAX at the end of the data to emit a partial last bucket too.
+int bar_resampler_flush(BarResampler *resampler, int64_t now, BarArray *out) {
+    if (resampler->has_bar && resampler->bucket_end <= now) {
+        return bar_resampler_emit(resampler, out);
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ALPACA_RESAMPLE_H
+#define ALPACA_RESAMPLE_H
+
+#include <stdint.h>
+#include "alpaca_bars.h"
+
+#define EXCHANGE_OPEN_SECONDS (9 * 3600 + 30 * 60)   // 09:30 New York time
+#define EXCHANGE_CLOSE_SECONDS (16 * 3600)           // 16:00 New York time
+
+// Which source bars go into a resampled bar
+typedef enum {
+    SESSION_ALL,        // every bar the feed returns, pre- and after-market included
+    SESSION_REGULAR     // only 09:30-16:00 New York time, with intraday buckets counted from the open
+} BarSession;
+
+// Aggregates time-ordered bars (normally 1Min) into bars of a coarser timeframe.
+// Buckets are aligned to New York time like the API's own bars: intraday buckets
+// from local midnight (or from the open with SESSION_REGULAR), days at local
+// midnight and weeks on Monday. Only bars with from <= t <= to are used.
+typedef struct {
+    int64_t seconds;    // target timeframe
+    BarSession session;
+    int64_t from;
+    int64_t to;
+    int has_bar;        // a bucket is in progress
+    int64_t bucket_end; // first second after the bucket in progress
+    AlpacaBar bar;
+    double vw_volume;   // sum of vw * volume over the bucket
+} BarResampler;
+
+int64_t exchange_utc_offset(int64_t t);
+int64_t exchange_local_to_utc(int64_t local);
+int64_t bar_bucket_start(int64_t t, int64_t seconds, BarSession session, int64_t *bucket_end);
+int bar_resampler_init(BarResampler *resampler, int64_t seconds, BarSession session);
+int bar_resampler_push(BarResampler *resampler, const AlpacaBar *bar, BarArray *out);
+int bar_resampler_flush(BarResampler *resampler, int64_t now, BarArray *out);
+
+#endif // ALPACA_RESAMPLE_H
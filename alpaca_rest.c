@@ -0,0 +1,625 @@
+#include "alpaca_rest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <math.h>
+
+#define REST_INITIAL_CAPACITY (64 * 1024)
+#define REST_BACKOFF_BASE 0.5      // seconds before the first retry
+#define REST_BACKOFF_CAP 30.0      // longest single backoff, in seconds
+#define REST_BULK_RESERVE 0.1      // fraction of the burst that bulk requests leave for interactive ones
+
+static pthread_once_t rest_init_once = PTHREAD_ONCE_INIT;
+static CURLcode rest_init_result = CURLE_OK;
+
+static void rest_global_init_once(void) {
+    rest_init_result = curl_global_init(CURL_GLOBAL_ALL);
+}
+
+// Function to initialize libcurl exactly once per process, whichever thread gets there first
+int rest_global_init(void) {
+    pthread_once(&rest_init_once, rest_global_init_once);
+    return rest_init_result == CURLE_OK ? 0 : -1;
+}
+
+// Function to return the market data base URL, overridable with APCA_API_DATA_URL
+const char *rest_data_url(void) {
+    const char *url = getenv("APCA_API_DATA_URL");
+    return (url && *url) ? url : ALPACA_DATA_URL;
+}
+
+double rest_monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void rest_sleep(double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+static RestScheduler default_scheduler;
+static pthread_once_t default_scheduler_once = PTHREAD_ONCE_INIT;
+
+static void rest_scheduler_init_default(void) {
+    pthread_mutex_init(&default_scheduler.lock, NULL);
+    pthread_cond_init(&default_scheduler.cond, NULL);
+    default_scheduler.last_refill = rest_monotonic_seconds();
+
+    // APCA_RATE_LIMIT pins the limit; otherwise the server's X-RateLimit-Limit is adopted
+    const char *env = getenv("APCA_RATE_LIMIT");
+    double rate = env ? atof(env) : 0;
+    rest_scheduler_set_rate(&default_scheduler, rate > 0 ? rate : REST_DEFAULT_RATE_LIMIT);
+    default_scheduler.rate_explicit = rate > 0;
+    default_scheduler.tokens = default_scheduler.burst;
+}
+
+// Function to return the process-wide scheduler that every client uses by default
+RestScheduler *rest_scheduler_default(void) {
+    pthread_once(&default_scheduler_once, rest_scheduler_init_default);
+    return &default_scheduler;
+}
+
+static void rest_scheduler_set_rate_locked(RestScheduler *scheduler, double requests_per_minute) {
+    scheduler->rate_per_minute = requests_per_minute;
+    // A small burst, with the refill reduced by the same amount, keeps any
+    // 60-second window at or below the limit
+    scheduler->burst = requests_per_minute / 10 > 1 ? requests_per_minute / 10 : 1;
+    scheduler->refill_per_sec = (requests_per_minute - scheduler->burst) / 60.0;
+    if (scheduler->refill_per_sec < requests_per_minute / 120.0) {
+        scheduler->refill_per_sec = requests_per_minute / 120.0;
+    }
+    if (scheduler->tokens > scheduler->burst) {
+        scheduler->tokens = scheduler->burst;
+    }
+}
+
+void rest_scheduler_set_rate(RestScheduler *scheduler, double requests_per_minute) {
+    pthread_mutex_lock(&scheduler->lock);
+    rest_scheduler_set_rate_locked(scheduler, requests_per_minute);
+    scheduler->rate_explicit = 1;
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Take a token if one is available to this priority. Returns 0 on success,
+// otherwise the number of seconds to wait before asking again.
+static double rest_scheduler_take_locked(RestScheduler *scheduler, RestPriority priority) {
+    double now = rest_monotonic_seconds();
+    scheduler->tokens += (now - scheduler->last_refill) * scheduler->refill_per_sec;
+    if (scheduler->tokens > scheduler->burst) {
+        scheduler->tokens = scheduler->burst;
+    }
+    scheduler->last_refill = now;
+
+    if (now < scheduler->blocked_until) {
+        return scheduler->blocked_until - now;
+    }
+
+    double needed = 1.0;
+    if (priority == REST_PRIORITY_BULK) {
+        // Bulk work yields to waiting interactive requests and never drains the reserve
+        if (scheduler->interactive_waiting > 0) {
+            return 1.0 / scheduler->refill_per_sec;
+        }
+        needed += scheduler->burst * REST_BULK_RESERVE;
+    }
+
+    if (scheduler->tokens >= needed) {
+        scheduler->tokens -= 1.0;
+        return 0;
+    }
+    return (needed - scheduler->tokens) / scheduler->refill_per_sec;
+}
+
+double rest_scheduler_try_acquire(RestScheduler *scheduler, RestPriority priority) {
+    pthread_mutex_lock(&scheduler->lock);
+    double wait = rest_scheduler_take_locked(scheduler, priority);
+    pthread_mutex_unlock(&scheduler->lock);
+    return wait;
+}
+
+// Function to block until a request of the given priority may be sent
+void rest_scheduler_acquire(RestScheduler *scheduler, RestPriority priority) {
+    pthread_mutex_lock(&scheduler->lock);
+    if (priority == REST_PRIORITY_INTERACTIVE) {
+        scheduler->interactive_waiting++;
+    }
+
+    double wait;
+    while ((wait = rest_scheduler_take_locked(scheduler, priority)) > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        double end = deadline.tv_sec + deadline.tv_nsec / 1e9 + wait;
+        deadline.tv_sec = (time_t)end;
+        deadline.tv_nsec = (long)((end - deadline.tv_sec) * 1e9);
+        scheduler->throttled++;
+        pthread_cond_timedwait(&scheduler->cond, &scheduler->lock, &deadline);
+    }
+
+    if (priority == REST_PRIORITY_INTERACTIVE) {
+        scheduler->interactive_waiting--;
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Function to fold a response's rate-limit headers into the bucket. The server
+// counts every request made with the account's keys, including other processes.
+void rest_scheduler_update(RestScheduler *scheduler, const RestClient *client) {
+    pthread_mutex_lock(&scheduler->lock);
+    double now = rest_monotonic_seconds();
+
+    if (client->ratelimit_limit > 0 && !scheduler->rate_explicit &&
+        client->ratelimit_limit != (long)scheduler->rate_per_minute) {
+        rest_scheduler_set_rate_locked(scheduler, (double)client->ratelimit_limit);
+    }
+    if (client->ratelimit_remaining >= 0 && client->ratelimit_remaining < scheduler->tokens) {
+        scheduler->tokens = (double)client->ratelimit_remaining;
+    }
+
+    // Stop everyone until the window resets when the server says we are out
+    double until = 0;
+    if (client->ratelimit_remaining == 0 && client->ratelimit_reset > 0) {
+        until = now + (double)(client->ratelimit_reset - time(NULL));
+    }
+    if (client->http_status == 429) {
+        double retry = client->retry_after >= 0 ? (double)client->retry_after : 1.0;
+        if (now + retry > until) {
+            until = now + retry;
+        }
+    }
+    if (until > scheduler->blocked_until) {
+        scheduler->blocked_until = until;
+    }
+
+    pthread_cond_broadcast(&scheduler->cond);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void rest_buffer_reset(RestBuffer *buffer) {
+    buffer->size = 0;
+    if (buffer->data) {
+        buffer->data[0] = 0;
+    }
+}
+
+// Append bytes, doubling the capacity when full so a page costs O(log n) reallocations
+int rest_buffer_append(RestBuffer *buffer, const void *data, size_t len) {
+    if (buffer->size + len + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : REST_INITIAL_CAPACITY;
+        while (buffer->size + len + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *ptr = realloc(buffer->data, capacity);
+        if (ptr == NULL) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        buffer->data = ptr;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, len);
+    buffer->size += len;
+    buffer->data[buffer->size] = 0;
+    return 0;
+}
+
+void rest_buffer_free(RestBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+// This function is called by libcurl when it receives data.
+static size_t rest_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    RestClient *client = (RestClient *)userp;
+
+    if (client->sink) {
+        // The status line has been read by the time the body arrives
+        if (client->sink_state == REST_SINK_UNDECIDED) {
+            long status = 0;
+            curl_easy_getinfo(client->curl, CURLINFO_RESPONSE_CODE, &status);
+            client->sink_state = (status >= 200 && status < 300) ? REST_SINK_STREAMING : REST_SINK_BUFFERING;
+            if (client->sink_state == REST_SINK_STREAMING && client->sink->begin && client->sink->begin(client->sink->user) != 0) {
+                client->sink_state = REST_SINK_FAILED;
+                return 0;
+            }
+        }
+        if (client->sink_state == REST_SINK_STREAMING) {
+            if (client->sink->write(client->sink->user, (const char *)contents, realsize) != 0) {
+                client->sink_state = REST_SINK_FAILED;
+                return 0;
+            }
+            return realsize;
+        }
+    }
+    return rest_buffer_append(&client->response, contents, realsize) == 0 ? realsize : 0;
+}
+
+// Pick up Retry-After and the X-RateLimit-* headers as they arrive
+static size_t rest_header_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    RestClient *client = (RestClient *)userp;
+
+    char line[256];
+    size_t n = len < sizeof(line) - 1 ? len : sizeof(line) - 1;
+    memcpy(line, buffer, n);
+    line[n] = 0;
+
+    char *colon = strchr(line, ':');
+    if (!colon) {
+        return len;
+    }
+    *colon = 0;
+    long value = strtol(colon + 1, NULL, 10);
+
+    if (strcasecmp(line, "Retry-After") == 0) {
+        client->retry_after = value;
+    } else if (strcasecmp(line, "X-RateLimit-Limit") == 0) {
+        client->ratelimit_limit = value;
+    } else if (strcasecmp(line, "X-RateLimit-Remaining") == 0) {
+        client->ratelimit_remaining = value;
+    } else if (strcasecmp(line, "X-RateLimit-Reset") == 0) {
+        client->ratelimit_reset = value;
+    }
+    return len;
+}
+
+// Function to create a client with the account's credentials and a persistent connection
+RestClient *rest_client_create(void) {
+    const char *api_key_id = getenv("APCA_API_KEY_ID");
+    const char *api_secret_key = getenv("APCA_API_SECRET_KEY");
+    if (!api_key_id || !api_secret_key) {
+        fprintf(stderr, "Error: APCA_API_KEY_ID and APCA_API_SECRET_KEY environment variables must be set.\n");
+        return NULL;
+    }
+
+    if (rest_global_init() != 0) {
+        fprintf(stderr, "Error: curl_global_init() failed.\n");
+        return NULL;
+    }
+
+    RestClient *client = (RestClient *)calloc(1, sizeof(RestClient));
+    if (!client) {
+        return NULL;
+    }
+
+    client->curl = curl_easy_init();
+    if (!client->curl) {
+        free(client);
+        return NULL;
+    }
+
+    char header[1024];
+    client->headers = curl_slist_append(client->headers, "Content-Type: application/json");
+    snprintf(header, sizeof(header), "APCA-API-KEY-ID: %s", api_key_id);
+    client->headers = curl_slist_append(client->headers, header);
+    snprintf(header, sizeof(header), "APCA-API-SECRET-KEY: %s", api_secret_key);
+    client->headers = curl_slist_append(client->headers, header);
+
+    // Options that stay fixed for the lifetime of the handle
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, rest_write_callback);
+    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, (void *)client);
+    curl_easy_setopt(client->curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(client->curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+    curl_easy_setopt(client->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_HEADERFUNCTION, rest_header_callback);
+    curl_easy_setopt(client->curl, CURLOPT_HEADERDATA, (void *)client);
+    curl_easy_setopt(client->curl, CURLOPT_PRIVATE, (void *)client);
+
+    client->scheduler = rest_scheduler_default();
+    client->priority = REST_PRIORITY_INTERACTIVE;
+    client->seed = (unsigned int)time(NULL) ^ (unsigned int)(size_t)client;
+
+    return client;
+}
+
+void rest_client_destroy(RestClient *client) {
+    if (!client) {
+        return;
+    }
+    curl_easy_cleanup(client->curl);
+    curl_slist_free_all(client->headers);
+    rest_buffer_free(&client->response);
+    free(client);
+}
+
+// Force a new connection for every request; only useful to measure what reuse saves
+void rest_client_set_fresh_connections(RestClient *client, int enabled) {
+    client->fresh_connections = enabled;
+    curl_easy_setopt(client->curl, CURLOPT_FRESH_CONNECT, (long)enabled);
+    curl_easy_setopt(client->curl, CURLOPT_FORBID_REUSE, (long)enabled);
+}
+
+void rest_client_set_priority(RestClient *client, RestPriority priority) {
+    client->priority = priority;
+}
+
+// Stream successful response bodies into sink (NULL restores buffering)
+void rest_client_set_sink(RestClient *client, RestSink *sink) {
+    client->sink = sink;
+}
+
+// Reset per-attempt state; the URL set on the handle is kept for retries
+static void rest_client_begin(RestClient *client) {
+    rest_buffer_reset(&client->response);
+    client->http_status = 0;
+    client->result = CURLE_OK;
+    client->retry_after = -1;
+    client->ratelimit_limit = -1;
+    client->ratelimit_remaining = -1;
+    client->ratelimit_reset = -1;
+    client->sink_state = REST_SINK_UNDECIDED;
+    memset(&client->timing, 0, sizeof(client->timing));
+}
+
+// Throttling, server errors and transport failures are worth another try
+static int rest_client_retryable(const RestClient *client) {
+    // A body the sink could not use will not get better on a second try
+    if (client->sink_state == REST_SINK_FAILED) {
+        return 0;
+    }
+    if (client->result != CURLE_OK) {
+        return 1;
+    }
+    return client->http_status == 429 || client->http_status >= 500;
+}
+
+// Full-jitter exponential backoff, but never sooner than the server asked for
+static double rest_client_backoff(RestClient *client) {
+    double ceiling = REST_BACKOFF_BASE * pow(2.0, client->attempts - 1);
+    if (ceiling > REST_BACKOFF_CAP) {
+        ceiling = REST_BACKOFF_CAP;
+    }
+    double delay = ceiling * rand_r(&client->seed) / (double)RAND_MAX;
+    if (client->retry_after >= 0 && delay < client->retry_after) {
+        delay = (double)client->retry_after;
+    }
+    return delay;
+}
+
+int rest_client_ok(const RestClient *client) {
+    return client->result == CURLE_OK && client->http_status >= 200 && client->http_status < 300;
+}
+
+// Describe why the last request failed, for error messages
+const char *rest_client_error(const RestClient *client) {
+    if (client->sink_state == REST_SINK_FAILED) {
+        return "response body could not be processed";
+    }
+    if (client->result != CURLE_OK) {
+        return curl_easy_strerror(client->result);
+    }
+    if (client->http_status == 429) {
+        return "rate limit exceeded (HTTP 429)";
+    }
+    if (client->response.data && client->response.size > 0) {
+        return client->response.data;
+    }
+    return "unexpected HTTP status";
+}
+
+// Collect status and timing once a transfer has finished, however it was driven
+static void rest_client_finish(RestClient *client, CURLcode res) {
+    double connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+    curl_easy_getinfo(client->curl, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(client->curl, CURLINFO_APPCONNECT_TIME, &appconnect);
+    curl_easy_getinfo(client->curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    curl_easy_getinfo(client->curl, CURLINFO_TOTAL_TIME, &total);
+    curl_easy_getinfo(client->curl, CURLINFO_NUM_CONNECTS, &client->timing.new_connections);
+    client->timing.connect_ms = connect * 1e3;
+    client->timing.tls_ms = appconnect > connect ? (appconnect - connect) * 1e3 : 0;
+    client->timing.first_byte_ms = starttransfer * 1e3;
+    client->timing.total_ms = total * 1e3;
+
+    client->result = res;
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(client->curl, CURLINFO_RESPONSE_CODE, &client->http_status);
+    }
+    rest_scheduler_update(client->scheduler, client);
+
+    // Make sure callers always get a terminated string, even for an empty body
+    if (!client->response.data) {
+        rest_buffer_append(&client->response, "", 0);
+    }
+}
+
+// Function to perform a GET request through the scheduler, retrying throttled and
+// failed attempts with backoff. The returned body is owned by the client and stays
+// valid until the next request; NULL is returned if no attempt succeeded. Callers
+// still check client->http_status (or rest_client_ok) for non-retryable errors.
+const char *rest_client_get(RestClient *client, const char *url, size_t *len) {
+    curl_easy_setopt(client->curl, CURLOPT_URL, url);
+
+    for (client->attempts = 1; ; client->attempts++) {
+        rest_scheduler_acquire(client->scheduler, client->priority);
+        rest_client_begin(client);
+        rest_client_finish(client, curl_easy_perform(client->curl));
+
+        if (!rest_client_retryable(client) || client->attempts > REST_MAX_RETRIES) {
+            break;
+        }
+        double delay = rest_client_backoff(client);
+        fprintf(stderr, "Request failed (%s), retry %d in %.1f s\n", rest_client_error(client), client->attempts, delay);
+        rest_sleep(delay);
+    }
+
+    if (client->result != CURLE_OK) {
+        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(client->result));
+        return NULL;
+    }
+    if (!client->response.data) {
+        return NULL;
+    }
+    if (len) {
+        *len = client->response.size;
+    }
+    return client->response.data;
+}
+
+// Function to create a multi handle. Transfers share its connection cache and are
+// multiplexed over one HTTP/2 connection when the server supports it.
+RestMulti *rest_multi_create(int max_connections) {
+    if (rest_global_init() != 0) {
+        return NULL;
+    }
+
+    RestMulti *multi = (RestMulti *)calloc(1, sizeof(RestMulti));
+    if (!multi) {
+        return NULL;
+    }
+    multi->multi = curl_multi_init();
+    if (!multi->multi) {
+        free(multi);
+        return NULL;
+    }
+    curl_multi_setopt(multi->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    if (max_connections > 0) {
+        curl_multi_setopt(multi->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_connections);
+    }
+    return multi;
+}
+
+void rest_multi_destroy(RestMulti *multi) {
+    if (!multi) {
+        return;
+    }
+    curl_multi_cleanup(multi->multi);
+    free(multi->pending);
+    free(multi);
+}
+
+static int rest_multi_defer(RestMulti *multi, RestClient *client, double ready_at) {
+    if (multi->num_pending == multi->pending_capacity) {
+        size_t capacity = multi->pending_capacity ? multi->pending_capacity * 2 : 16;
+        RestPending *ptr = realloc(multi->pending, capacity * sizeof(RestPending));
+        if (!ptr) {
+            return -1;
+        }
+        multi->pending = ptr;
+        multi->pending_capacity = capacity;
+    }
+    multi->pending[multi->num_pending].client = client;
+    multi->pending[multi->num_pending].ready_at = ready_at;
+    multi->num_pending++;
+    return 0;
+}
+
+// Start every pending request whose delay has passed and that the scheduler admits,
+// interactive ones first. Returns the seconds until the next one could start.
+static double rest_multi_start_pending(RestMulti *multi) {
+    double next_wait = 1.0;
+    double now = rest_monotonic_seconds();
+
+    for (int pass = REST_PRIORITY_INTERACTIVE; pass <= REST_PRIORITY_BULK; pass++) {
+        size_t i = 0;
+        while (i < multi->num_pending) {
+            RestPending *pending = &multi->pending[i];
+            RestClient *client = pending->client;
+            if ((int)client->priority != pass) {
+                i++;
+                continue;
+            }
+            if (pending->ready_at > now) {
+                if (pending->ready_at - now < next_wait) {
+                    next_wait = pending->ready_at - now;
+                }
+                i++;
+                continue;
+            }
+
+            double wait = rest_scheduler_try_acquire(client->scheduler, client->priority);
+            if (wait > 0) {
+                if (wait < next_wait) {
+                    next_wait = wait;
+                }
+                i++;
+                continue;
+            }
+
+            rest_client_begin(client);
+            // Wait for an existing HTTP/2 connection rather than opening one per transfer
+            curl_easy_setopt(client->curl, CURLOPT_PIPEWAIT, 1L);
+            if (curl_multi_add_handle(multi->multi, client->curl) == CURLM_OK) {
+                multi->active++;
+            } else {
+                client->result = CURLE_FAILED_INIT;
+                client->next_failed = multi->failed;
+                multi->failed = client;
+            }
+            multi->pending[i] = multi->pending[--multi->num_pending];
+        }
+    }
+    return next_wait;
+}
+
+// Queue a request on a client; it starts once the scheduler admits it and its
+// result is picked up later with rest_multi_next()
+int rest_multi_add(RestMulti *multi, RestClient *client, const char *url) {
+    curl_easy_setopt(client->curl, CURLOPT_URL, url);
+    client->attempts = 1;
+    return rest_multi_defer(multi, client, 0);
+}
+
+// Function to block until one of the requests completes and return its client
+// (check rest_client_ok). Throttled and failed attempts are retried internally
+// with backoff. Returns NULL when nothing is queued or in flight.
+RestClient *rest_multi_next(RestMulti *multi) {
+    while (multi->active > 0 || multi->num_pending > 0 || multi->failed) {
+        double wait = rest_multi_start_pending(multi);
+        if (multi->failed) {
+            RestClient *client = multi->failed;
+            multi->failed = client->next_failed;
+            client->next_failed = NULL;
+            return client;
+        }
+
+        int running = 0;
+        curl_multi_perform(multi->multi, &running);
+
+        int queued;
+        CURLMsg *msg;
+        while ((msg = curl_multi_info_read(multi->multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            RestClient *client = NULL;
+            CURL *easy = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&client);
+            curl_multi_remove_handle(multi->multi, easy);
+            multi->active--;
+            rest_client_finish(client, res);
+
+            if (rest_client_retryable(client) && client->attempts <= REST_MAX_RETRIES) {
+                double delay = rest_client_backoff(client);
+                fprintf(stderr, "Request failed (%s), retry %d in %.1f s\n", rest_client_error(client), client->attempts, delay);
+                client->attempts++;
+                if (rest_multi_defer(multi, client, rest_monotonic_seconds() + delay) != 0) {
+                    return client;
+                }
+                continue;
+            }
+            return client;
+        }
+
+        int timeout_ms = multi->num_pending > 0 ? (int)(wait * 1000) + 1 : 1000;
+        if (multi->active > 0) {
+            curl_multi_poll(multi->multi, NULL, 0, timeout_ms, NULL);
+        } else {
+            rest_sleep(timeout_ms / 1000.0);
+        }
+    }
+    return NULL;
+}
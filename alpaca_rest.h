@@ -0,0 +1,135 @@
+#ifndef ALPACA_REST_H
+#define ALPACA_REST_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#define ALPACA_DATA_URL "https://data.alpaca.markets"
+#define REST_DEFAULT_RATE_LIMIT 200   // requests per minute on the basic data plan
+#define REST_MAX_RETRIES 5
+
+// Response body buffer that is reused across requests and grows geometrically
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} RestBuffer;
+
+// Timing of the most recent request, in milliseconds
+typedef struct {
+    double connect_ms;
+    double tls_ms;
+    double first_byte_ms;
+    double total_ms;
+    long new_connections;
+} RestTiming;
+
+// Interactive requests (latest prices) are served before bulk ones (backfills)
+typedef enum {
+    REST_PRIORITY_INTERACTIVE = 0,
+    REST_PRIORITY_BULK = 1
+} RestPriority;
+
+// Token bucket shared by every client in the process. It is sized to the
+// account's per-minute limit and corrected by the server's rate-limit headers.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    double rate_per_minute;
+    double burst;
+    double tokens;
+    double refill_per_sec;
+    double last_refill;
+    double blocked_until;
+    int interactive_waiting;
+    int rate_explicit;
+    unsigned long throttled;
+} RestScheduler;
+
+// Receives the body of successful (2xx) responses as it arrives, instead of the
+// response buffer. begin is called before the first byte of every attempt, so a
+// retried request starts again from a clean state. A non-zero return aborts the
+// transfer without retrying it.
+typedef struct {
+    int (*begin)(void *user);
+    int (*write)(void *user, const char *data, size_t len);
+    void *user;
+} RestSink;
+
+typedef enum {
+    REST_SINK_UNDECIDED = 0,  // no body bytes yet in this attempt
+    REST_SINK_STREAMING,      // 2xx body going to the sink
+    REST_SINK_BUFFERING,      // error body kept in the response buffer
+    REST_SINK_FAILED          // the sink rejected the body
+} RestSinkState;
+
+// One long-lived curl handle: the connection, TLS session and buffers survive
+// between requests so pagination reuses the same keep-alive connection.
+typedef struct RestClient {
+    CURL *curl;
+    struct curl_slist *headers;
+    RestBuffer response;
+    long http_status;
+    RestTiming timing;
+    int fresh_connections;
+    CURLcode result;    // transport result of the last request
+    void *user;         // caller data, e.g. the work item a multi transfer belongs to
+    RestScheduler *scheduler;
+    RestPriority priority;
+    int attempts;       // tries used by the current request
+    long retry_after;   // seconds, from Retry-After; -1 if absent
+    long ratelimit_limit;
+    long ratelimit_remaining;
+    long ratelimit_reset;
+    unsigned int seed;
+    RestSink *sink;     // stream bodies here instead of buffering them; NULL to buffer
+    RestSinkState sink_state;
+    struct RestClient *next_failed;  // RestMulti's list of requests that could not start
+} RestClient;
+
+// A request waiting for its retry delay or for a token before it is started
+typedef struct {
+    RestClient *client;
+    double ready_at;
+} RestPending;
+
+// Runs many RestClient requests concurrently over a shared connection pool
+typedef struct {
+    CURLM *multi;
+    int active;
+    RestPending *pending;
+    size_t num_pending;
+    size_t pending_capacity;
+    RestClient *failed;     // could not be started; handed back by rest_multi_next
+} RestMulti;
+
+int rest_global_init(void);
+const char *rest_data_url(void);
+double rest_monotonic_seconds(void);
+
+RestScheduler *rest_scheduler_default(void);
+void rest_scheduler_set_rate(RestScheduler *scheduler, double requests_per_minute);
+double rest_scheduler_try_acquire(RestScheduler *scheduler, RestPriority priority);
+void rest_scheduler_acquire(RestScheduler *scheduler, RestPriority priority);
+void rest_scheduler_update(RestScheduler *scheduler, const RestClient *client);
+
+RestClient *rest_client_create(void);
+void rest_client_destroy(RestClient *client);
+void rest_client_set_fresh_connections(RestClient *client, int enabled);
+void rest_client_set_priority(RestClient *client, RestPriority priority);
+void rest_client_set_sink(RestClient *client, RestSink *sink);
+const char *rest_client_get(RestClient *client, const char *url, size_t *len);
+int rest_client_ok(const RestClient *client);
+const char *rest_client_error(const RestClient *client);
+
+RestMulti *rest_multi_create(int max_connections);
+void rest_multi_destroy(RestMulti *multi);
+int rest_multi_add(RestMulti *multi, RestClient *client, const char *url);
+RestClient *rest_multi_next(RestMulti *multi);
+
+void rest_buffer_reset(RestBuffer *buffer);
+int rest_buffer_append(RestBuffer *buffer, const void *data, size_t len);
+void rest_buffer_free(RestBuffer *buffer);
+
+#endif // ALPACA_REST_H
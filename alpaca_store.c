@@ -0,0 +1,250 @@
+#include "alpaca_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_SERIES_CAPACITY 16
+#define MIN_ORDER_CAPACITY 64
+
+void record_store_init(RecordStore *store, size_t record_size, void (*free_record)(void *record), size_t max_records) {
+    memset(store, 0, sizeof(*store));
+    store->record_size = record_size;
+    store->free_record = free_record;
+    store->max_records = max_records;
+    symbol_table_init(&store->symbols);
+}
+
+static void *series_item(const RecordStore *store, const StoreSeries *series, size_t i) {
+    return series->items + (series->start + i) * store->record_size;
+}
+
+// Function to release every record but keep the symbols and the memory for reuse
+void record_store_clear(RecordStore *store) {
+    for (size_t s = 0; s < store->symbols.count; s++) {
+        StoreSeries *series = &store->series[s];
+        if (store->free_record) {
+            for (size_t i = 0; i < series->count; i++) {
+                store->free_record(series_item(store, series, i));
+            }
+        }
+        series->start = 0;
+        series->count = 0;
+    }
+    store->order_head = 0;
+    store->order_count = 0;
+}
+
+void record_store_free(RecordStore *store) {
+    record_store_clear(store);
+    for (size_t s = 0; s < store->series_capacity; s++) {
+        free(store->series[s].t);
+        free(store->series[s].items);
+    }
+    free(store->series);
+    free(store->order);
+    symbol_table_free(&store->symbols);
+    store->series = NULL;
+    store->series_capacity = 0;
+    store->order = NULL;
+    store->order_capacity = 0;
+}
+
+// Function to drop the earliest record of the symbol that received the oldest one
+static void evict_oldest(RecordStore *store) {
+    int32_t symbol = store->order[store->order_head];
+    store->order_head = (store->order_head + 1) % store->order_capacity;
+    store->order_count--;
+
+    StoreSeries *series = &store->series[symbol];
+    if (store->free_record) {
+        store->free_record(series_item(store, series, 0));
+    }
+    series->start++;
+    series->count--;
+    if (series->count == 0) {
+        series->start = 0;
+    }
+}
+
+void record_store_set_limit(RecordStore *store, size_t max_records) {
+    store->max_records = max_records;
+    while (store->order_count > store->max_records) {
+        evict_oldest(store);
+    }
+}
+
+size_t record_store_count(const RecordStore *store) {
+    return store->order_count;
+}
+
+static int ensure_series(RecordStore *store, size_t count) {
+    if (count <= store->series_capacity) {
+        return 0;
+    }
+    size_t capacity = store->series_capacity ? store->series_capacity * 2 : MIN_SERIES_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    StoreSeries *series = (StoreSeries *)realloc(store->series, capacity * sizeof(StoreSeries));
+    if (!series) {
+        return -1;
+    }
+    memset(series + store->series_capacity, 0, (capacity - store->series_capacity) * sizeof(StoreSeries));
+    store->series = series;
+    store->series_capacity = capacity;
+    return 0;
+}
+
+// Function to make room for one more record at the end of a series. Records dropped
+// from the front leave a gap that is reclaimed once it is as large as the live part.
+static int reserve_one(const RecordStore *store, StoreSeries *series) {
+    if (series->start + series->count < series->capacity) {
+        return 0;
+    }
+    if (series->start > 0 && series->start >= series->count) {
+        memmove(series->t, series->t + series->start, series->count * sizeof(int64_t));
+        memmove(series->items, series_item(store, series, 0), series->count * store->record_size);
+        series->start = 0;
+        return 0;
+    }
+    size_t capacity = series->capacity ? series->capacity * 2 : MIN_SERIES_CAPACITY;
+    int64_t *t = (int64_t *)realloc(series->t, capacity * sizeof(int64_t));
+    if (!t) {
+        return -1;
+    }
+    series->t = t;
+    char *items = (char *)realloc(series->items, capacity * store->record_size);
+    if (!items) {
+        return -1;
+    }
+    series->items = items;
+    series->capacity = capacity;
+    return 0;
+}
+
+static int push_order(RecordStore *store, int32_t symbol) {
+    if (store->order_count == store->order_capacity) {
+        size_t capacity = store->order_capacity ? store->order_capacity * 2 : MIN_ORDER_CAPACITY;
+        int32_t *order = (int32_t *)malloc(capacity * sizeof(int32_t));
+        if (!order) {
+            return -1;
+        }
+        for (size_t i = 0; i < store->order_count; i++) {
+            order[i] = store->order[(store->order_head + i) % store->order_capacity];
+        }
+        free(store->order);
+        store->order = order;
+        store->order_head = 0;
+        store->order_capacity = capacity;
+    }
+    store->order[(store->order_head + store->order_count) % store->order_capacity] = symbol;
+    store->order_count++;
+    return 0;
+}
+
+// First index in t[0..n-1] whose time is at least (or, with after set, greater than) key
+static size_t search_time(const int64_t *t, size_t n, int64_t key, int after) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t[mid] < key || (after && t[mid] == key)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Function to copy a record into the store, keeping the symbol's records in time
+// order. Records normally arrive in order and are appended; a late one is moved
+// into place after any others with the same time. On success the store owns the
+// record's strings; on failure -1 is returned and they are still the caller's.
+int record_store_add(RecordStore *store, const char *symbol, int64_t t, const void *record) {
+    int index = symbol_table_add(&store->symbols, symbol);
+    if (index < 0 || ensure_series(store, store->symbols.count) != 0) {
+        fprintf(stderr, "Error: cannot store a record for symbol %s.\n", symbol);
+        return -1;
+    }
+    StoreSeries *series = &store->series[index];
+    if (reserve_one(store, series) != 0 || push_order(store, index) != 0) {
+        fprintf(stderr, "Error: not enough memory to store a record for %s.\n", symbol);
+        return -1;
+    }
+
+    int64_t *times = series->t + series->start;
+    size_t pos = series->count;
+    if (pos > 0 && times[pos - 1] > t) {
+        pos = search_time(times, series->count, t, 1);
+        memmove(times + pos + 1, times + pos, (series->count - pos) * sizeof(int64_t));
+        memmove(series_item(store, series, pos + 1), series_item(store, series, pos), (series->count - pos) * store->record_size);
+    }
+    times[pos] = t;
+    memcpy(series_item(store, series, pos), record, store->record_size);
+    series->count++;
+
+    while (store->order_count > store->max_records) {
+        evict_oldest(store);
+    }
+    return 0;
+}
+
+RecordView record_store_symbol(const RecordStore *store, int symbol) {
+    RecordView view = { NULL, NULL, 0 };
+    if (symbol < 0 || (size_t)symbol >= store->symbols.count) {
+        return view;
+    }
+    const StoreSeries *series = &store->series[symbol];
+    if (series->count > 0) {
+        view.items = series_item(store, series, 0);
+        view.t = series->t + series->start;
+        view.count = series->count;
+    }
+    return view;
+}
+
+static RecordView sub_view(const RecordStore *store, RecordView view, size_t begin, size_t end) {
+    RecordView result = { NULL, NULL, 0 };
+    if (begin < end) {
+        result.items = (const char *)view.items + begin * store->record_size;
+        result.t = view.t + begin;
+        result.count = end - begin;
+    }
+    return result;
+}
+
+// Function to find the records of a symbol with from <= t <= to
+RecordView record_store_between(const RecordStore *store, const char *symbol, int64_t from, int64_t to) {
+    RecordView view = record_store_symbol(store, symbol_table_find(&store->symbols, symbol));
+    size_t begin = search_time(view.t, view.count, from, 0);
+    size_t end = search_time(view.t, view.count, to, 1);
+    return sub_view(store, view, begin, end);
+}
+
+// Function to find the last n records of a symbol with t <= as_of, oldest first
+RecordView record_store_last(const RecordStore *store, const char *symbol, size_t n, int64_t as_of) {
+    RecordView view = record_store_symbol(store, symbol_table_find(&store->symbols, symbol));
+    size_t end = search_time(view.t, view.count, as_of, 1);
+    return sub_view(store, view, end > n ? end - n : 0, end);
+}
+
+// Function to call visit on every record from the newest received to the oldest.
+// Stops at the first non-zero return of visit and returns it; -1 if out of memory.
+int record_store_newest_first(const RecordStore *store, int (*visit)(void *user, const void *record), void *user) {
+    size_t *cursor = (size_t *)malloc((store->symbols.count + 1) * sizeof(size_t));
+    if (!cursor) {
+        return -1;
+    }
+    for (size_t s = 0; s < store->symbols.count; s++) {
+        cursor[s] = store->series[s].count;
+    }
+    int result = 0;
+    for (size_t i = store->order_count; result == 0 && i-- > 0;) {
+        int32_t symbol = store->order[(store->order_head + i) % store->order_capacity];
+        const StoreSeries *series = &store->series[symbol];
+        result = visit(user, series_item(store, series, --cursor[symbol]));
+    }
+    free(cursor);
+    return result;
+}
@@ -0,0 +1,116 @@
+#ifndef ALPACA_STORE_H
+#define ALPACA_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_symbol_table.h"
+
+// Records received from the WebSocket feed. The strings are owned by the store
+// once a record has been added.
+typedef struct {
+    char *symbol;
+    double open;
+    double high;
+    double low;
+    double close;
+    double vw;
+    int64_t volume;
+    int64_t trades;
+    char *timestamp_str;
+    char *local_time_str;
+    double digital_seconds;
+} Bar;
+
+typedef struct {
+    char *symbol;
+    long long trade_id;
+    char *exchange;
+    double price;
+    int size;
+    char **trade_conditions;
+    size_t num_conditions;
+    char *tape;
+    char *timestamp_str;
+    char *local_time_str;
+    double digital_seconds;
+    int side;               // TRADE_BUY, TRADE_SELL or TRADE_UNKNOWN, see alpaca_flow.h
+} Trade;
+
+typedef struct {
+    char *symbol;
+    char *bid_exchange;
+    double bid_price;
+    int bid_size;
+    char *ask_exchange;
+    double ask_price;
+    int ask_size;
+    char *timestamp_str;
+    char *local_time_str;
+    double digital_seconds;
+} Quote;
+
+// Consecutive records of one symbol, oldest first, and their times in nanoseconds
+// since 1970 UTC. Views point into the store and stay valid until the next record
+// is added or dropped.
+typedef struct {
+    const void *items;
+    const int64_t *t;
+    size_t count;
+} RecordView;
+
+typedef struct {
+    const Bar *items;
+    const int64_t *t;
+    size_t count;
+} BarView;
+
+typedef struct {
+    const Trade *items;
+    const int64_t *t;
+    size_t count;
+} TradeView;
+
+typedef struct {
+    const Quote *items;
+    const int64_t *t;
+    size_t count;
+} QuoteView;
+
+// One symbol's records sorted by time; the live ones are at start..start+count-1
+typedef struct {
+    int64_t *t;
+    char *items;
+    size_t start;
+    size_t count;
+    size_t capacity;
+} StoreSeries;
+
+// Stored records of one kind. Each symbol has its own array in time order, so a
+// time range or the last N records as of a time is a binary search and comes back
+// as a view into the array. Once max_records are stored, every new record pushes
+// out the oldest one received, whatever its symbol.
+typedef struct {
+    size_t record_size;
+    void (*free_record)(void *record);
+    size_t max_records;
+    SymbolTable symbols;
+    StoreSeries *series;    // indexed like symbols
+    size_t series_capacity;
+    int32_t *order;         // symbol of every stored record in arrival order, as a ring
+    size_t order_head;
+    size_t order_count;
+    size_t order_capacity;
+} RecordStore;
+
+void record_store_init(RecordStore *store, size_t record_size, void (*free_record)(void *record), size_t max_records);
+void record_store_free(RecordStore *store);
+void record_store_clear(RecordStore *store);
+void record_store_set_limit(RecordStore *store, size_t max_records);
+int record_store_add(RecordStore *store, const char *symbol, int64_t t, const void *record);
+size_t record_store_count(const RecordStore *store);
+RecordView record_store_symbol(const RecordStore *store, int symbol);
+RecordView record_store_between(const RecordStore *store, const char *symbol, int64_t from, int64_t to);
+RecordView record_store_last(const RecordStore *store, const char *symbol, size_t n, int64_t as_of);
+int record_store_newest_first(const RecordStore *store, int (*visit)(void *user, const void *record), void *user);
+
+#endif // ALPACA_STORE_H
@@ -0,0 +1,109 @@
+#include "alpaca_symbol_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_TABLE_INITIAL_SLOTS 64
+
+// FNV-1a over the symbol's characters
+static uint32_t symbol_hash(const char *symbol) {
+    uint32_t hash = 2166136261u;
+    for (; *symbol; symbol++) {
+        hash ^= (unsigned char)*symbol;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void symbol_table_init(SymbolTable *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+void symbol_table_free(SymbolTable *table) {
+    free(table->names);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Function to return the index of symbol, or -1 if it has not been added
+int symbol_table_find(const SymbolTable *table, const char *symbol) {
+    if (table->num_slots == 0) {
+        return -1;
+    }
+    size_t mask = table->num_slots - 1;
+    for (size_t slot = symbol_hash(symbol) & mask; ; slot = (slot + 1) & mask) {
+        int32_t index = table->slots[slot];
+        if (index < 0) {
+            return -1;
+        }
+        if (strcmp(table->names[index], symbol) == 0) {
+            return index;
+        }
+    }
+}
+
+static int symbol_table_rehash(SymbolTable *table, size_t num_slots) {
+    int32_t *slots = (int32_t *)malloc(num_slots * sizeof(int32_t));
+    if (!slots) {
+        fprintf(stderr, "not enough memory (malloc returned NULL)\n");
+        return -1;
+    }
+    memset(slots, 0xff, num_slots * sizeof(int32_t));
+
+    size_t mask = num_slots - 1;
+    for (size_t i = 0; i < table->count; i++) {
+        size_t slot = symbol_hash(table->names[i]) & mask;
+        while (slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = (int32_t)i;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+    return 0;
+}
+
+// Function to return the index of symbol, adding it first if it is new.
+// Returns -1 if the symbol is too long or memory runs out.
+int symbol_table_add(SymbolTable *table, const char *symbol) {
+    int index = symbol_table_find(table, symbol);
+    if (index >= 0) {
+        return index;
+    }
+    if (strlen(symbol) >= SYMBOL_SIZE) {
+        return -1;
+    }
+
+    if ((table->count + 1) * 2 > table->num_slots) {
+        size_t num_slots = table->num_slots ? table->num_slots * 2 : SYMBOL_TABLE_INITIAL_SLOTS;
+        if (symbol_table_rehash(table, num_slots) != 0) {
+            return -1;
+        }
+    }
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : SYMBOL_TABLE_INITIAL_SLOTS / 2;
+        char (*names)[SYMBOL_SIZE] = realloc(table->names, capacity * SYMBOL_SIZE);
+        if (!names) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        table->names = names;
+        table->capacity = capacity;
+    }
+
+    index = (int)table->count++;
+    snprintf(table->names[index], SYMBOL_SIZE, "%s", symbol);
+
+    size_t mask = table->num_slots - 1;
+    size_t slot = symbol_hash(symbol) & mask;
+    while (table->slots[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    table->slots[slot] = index;
+    return index;
+}
+
+const char *symbol_table_name(const SymbolTable *table, int index) {
+    return (index >= 0 && (size_t)index < table->count) ? table->names[index] : NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef ALPACA_SYMBOL_TABLE_H
+#define ALPACA_SYMBOL_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYMBOL_SIZE 16
+
+// Maps ticker symbols to dense indices 0..count-1 in insertion order, so per-symbol
+// state can live in plain arrays indexed by symbol. Open addressing, linear probing.
+typedef struct {
+    char (*names)[SYMBOL_SIZE];
+    size_t count;
+    size_t capacity;
+    int32_t *slots;     // index into names, or -1 for an empty slot
+    size_t num_slots;   // power of two, kept at most half full
+} SymbolTable;
+
+void symbol_table_init(SymbolTable *table);
+void symbol_table_free(SymbolTable *table);
+int symbol_table_find(const SymbolTable *table, const char *symbol);
+int symbol_table_add(SymbolTable *table, const char *symbol);
+const char *symbol_table_name(const SymbolTable *table, int index);
+
+#endif // ALPACA_SYMBOL_TABLE_H
@@ -0,0 +1,367 @@
+#include "alpaca_tick_codec.h"
+#include <string.h>
+#include <math.h>
+
+// Layout of one block: varint record count, one byte column count, then per column
+// a type byte, a parameter byte (decimal places), a 4-byte little-endian length and
+// the column's varints. Values are delta or xor coded from the start of the block,
+// so every block decodes on its own and a reader can start at any of them.
+
+#define TICK_COLUMN_HEADER_SIZE 6
+#define TICK_MAX_COLUMNS 8
+
+static const double decimal_scale[] = { 1.0, 100.0, 10000.0, 1000000.0, 100000000.0 };
+static const int decimal_places[] = { 0, 2, 4, 6, 8 };
+
+static int tick_num_columns(TickKind kind) {
+    switch (kind) {
+    case TICK_QUOTES: return 6;
+    case TICK_BARS: return 8;
+    default: return 5;
+    }
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Function to return the most bytes tick_block_encode can write for count records
+size_t tick_block_bound(TickKind kind, size_t count) {
+    return 16 + (size_t)tick_num_columns(kind) * (TICK_COLUMN_HEADER_SIZE + 10 * count);
+}
+
+// Write one column of integers; returns the bytes written
+static size_t encode_column(uint8_t *out, TickColumnType type, int places, const int64_t *values, size_t count) {
+    uint8_t *p = out + TICK_COLUMN_HEADER_SIZE;
+    int64_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        switch (type) {
+        case TICK_COLUMN_DELTA:
+        case TICK_COLUMN_DECIMAL:
+            p += put_varint(p, zigzag(values[i] - prev));
+            break;
+        case TICK_COLUMN_XOR:
+            p += put_varint(p, (uint64_t)(values[i] ^ prev));
+            break;
+        default:
+            p += put_varint(p, (uint64_t)values[i]);
+            break;
+        }
+        prev = values[i];
+    }
+
+    uint32_t length = (uint32_t)(p - out - TICK_COLUMN_HEADER_SIZE);
+    out[0] = (uint8_t)type;
+    out[1] = (uint8_t)places;
+    for (int i = 0; i < 4; i++) {
+        out[2 + i] = (uint8_t)(length >> (8 * i));
+    }
+    return (size_t)(p - out);
+}
+
+// Write a column of doubles: as decimal fixed point with the fewest places that
+// reproduce every value exactly (cents for most prices), or as xor-coded bits if
+// no scale up to 10^8 does
+static size_t encode_double_column(uint8_t *out, const double *values, size_t count, int64_t *scratch) {
+    for (size_t s = 0; s < sizeof(decimal_places) / sizeof(decimal_places[0]); s++) {
+        size_t i;
+        for (i = 0; i < count; i++) {
+            double scaled = values[i] * decimal_scale[s];
+            if (!(fabs(scaled) < 9007199254740992.0)) {
+                break;
+            }
+            scratch[i] = llround(scaled);
+            if ((double)scratch[i] / decimal_scale[s] != values[i]) {
+                break;
+            }
+        }
+        if (i == count) {
+            return encode_column(out, TICK_COLUMN_DECIMAL, decimal_places[s], scratch, count);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&scratch[i], &values[i], sizeof(double));
+    }
+    return encode_column(out, TICK_COLUMN_XOR, 0, scratch, count);
+}
+
+// Function to encode up to TICK_BLOCK_RECORDS records (AlpacaTrade, AlpacaQuote or
+// AlpacaBar according to kind) into out, which must hold tick_block_bound bytes.
+// Returns the block size in bytes, or 0 if count is out of range.
+size_t tick_block_encode(TickKind kind, const void *records, size_t count, uint8_t *out) {
+    int64_t ints[TICK_BLOCK_RECORDS];
+    int64_t scratch[TICK_BLOCK_RECORDS];
+    double doubles[TICK_BLOCK_RECORDS];
+    if (count == 0 || count > TICK_BLOCK_RECORDS) {
+        return 0;
+    }
+
+    uint8_t *p = out + put_varint(out, count);
+    *p++ = (uint8_t)tick_num_columns(kind);
+
+// Gather one field of every record into ints or doubles
+#define GATHER(array, type, expr) for (size_t i = 0; i < count; i++) { const type *r = (const type *)records + i; array[i] = (expr); }
+
+    if (kind == TICK_QUOTES) {
+        GATHER(ints, AlpacaQuote, r->t);
+        p += encode_column(p, TICK_COLUMN_DELTA, 0, ints, count);
+        GATHER(doubles, AlpacaQuote, r->bid);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(doubles, AlpacaQuote, r->ask);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(ints, AlpacaQuote, r->bid_size);
+        p += encode_column(p, TICK_COLUMN_RAW, 0, ints, count);
+        GATHER(ints, AlpacaQuote, r->ask_size);
+        p += encode_column(p, TICK_COLUMN_RAW, 0, ints, count);
+        for (size_t i = 0; i < count; i++) {
+            const AlpacaQuote *r = (const AlpacaQuote *)records + i;
+            uint32_t conditions;
+            memcpy(&conditions, r->conditions, sizeof(conditions));
+            ints[i] = (int64_t)((uint8_t)r->bid_exchange | (uint64_t)(uint8_t)r->ask_exchange << 8 |
+                                (uint64_t)(uint8_t)r->tape << 16 | (uint64_t)conditions << 24);
+        }
+        p += encode_column(p, TICK_COLUMN_XOR, 0, ints, count);
+    } else if (kind == TICK_BARS) {
+        GATHER(ints, AlpacaBar, r->t);
+        p += encode_column(p, TICK_COLUMN_DELTA, 0, ints, count);
+        GATHER(doubles, AlpacaBar, r->open);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(doubles, AlpacaBar, r->high);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(doubles, AlpacaBar, r->low);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(doubles, AlpacaBar, r->close);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(doubles, AlpacaBar, r->vw);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(ints, AlpacaBar, r->volume);
+        p += encode_column(p, TICK_COLUMN_RAW, 0, ints, count);
+        GATHER(ints, AlpacaBar, r->trades);
+        p += encode_column(p, TICK_COLUMN_RAW, 0, ints, count);
+    } else {
+        GATHER(ints, AlpacaTrade, r->t);
+        p += encode_column(p, TICK_COLUMN_DELTA, 0, ints, count);
+        GATHER(doubles, AlpacaTrade, r->price);
+        p += encode_double_column(p, doubles, count, scratch);
+        GATHER(ints, AlpacaTrade, r->size);
+        p += encode_column(p, TICK_COLUMN_RAW, 0, ints, count);
+        for (size_t i = 0; i < count; i++) {
+            const AlpacaTrade *r = (const AlpacaTrade *)records + i;
+            uint32_t conditions;
+            memcpy(&conditions, r->conditions, sizeof(conditions));
+            ints[i] = (int64_t)((uint8_t)r->exchange | (uint64_t)(uint8_t)r->tape << 8 | (uint64_t)conditions << 16);
+        }
+        p += encode_column(p, TICK_COLUMN_XOR, 0, ints, count);
+        GATHER(ints, AlpacaTrade, (int64_t)r->id);
+        p += encode_column(p, TICK_COLUMN_DELTA, 0, ints, count);
+    }
+#undef GATHER
+    return (size_t)(p - out);
+}
+
+// Read one varint; returns 0 if it runs past the end
+static size_t get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (size_t n = 0; n < 10 && p + n < end; n++) {
+        result |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+        if (!(p[n] & 0x80)) {
+            *v = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Function to return the number of records in a block, or 0 if it is malformed
+size_t tick_block_count(const uint8_t *data, size_t len) {
+    uint64_t count = 0;
+    if (get_varint(data, data + len, &count) == 0 || count > TICK_BLOCK_RECORDS) {
+        return 0;
+    }
+    return (size_t)count;
+}
+
+// Decode exactly count varints filling len bytes. Most deltas fit in one byte, so
+// eight bytes at a time are checked for continuation bits with one mask and copied
+// straight through.
+static int decode_varints(const uint8_t *p, size_t len, uint64_t *out, size_t count) {
+    const uint8_t *end = p + len;
+    size_t i = 0;
+    while (i < count) {
+        if (i + 8 <= count && end - p >= 8) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0) {
+                for (int k = 0; k < 8; k++) {
+                    out[i + k] = p[k];
+                }
+                i += 8;
+                p += 8;
+                continue;
+            }
+        }
+        size_t n = get_varint(p, end, &out[i]);
+        if (n == 0) {
+            return -1;
+        }
+        p += n;
+        i++;
+    }
+    return p == end ? 0 : -1;
+}
+
+// Decode one column into values. The zigzag step is a flat loop the compiler can
+// vectorize; the running sum or xor that follows is a single dependent pass.
+static int decode_column(const uint8_t **cursor, const uint8_t *end, size_t count, int64_t *values, int *type, int *places) {
+    const uint8_t *p = *cursor;
+    if (end - p < TICK_COLUMN_HEADER_SIZE) {
+        return -1;
+    }
+    *type = p[0];
+    *places = p[1];
+    uint32_t length = (uint32_t)p[2] | (uint32_t)p[3] << 8 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 24;
+    p += TICK_COLUMN_HEADER_SIZE;
+    if ((size_t)(end - p) < length) {
+        return -1;
+    }
+
+    uint64_t *raw = (uint64_t *)values;
+    if (decode_varints(p, length, raw, count) != 0) {
+        return -1;
+    }
+    *cursor = p + length;
+
+    switch (*type) {
+    case TICK_COLUMN_DELTA:
+    case TICK_COLUMN_DECIMAL: {
+        for (size_t i = 0; i < count; i++) {
+            values[i] = (int64_t)(raw[i] >> 1) ^ -(int64_t)(raw[i] & 1);
+        }
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += values[i];
+            values[i] = sum;
+        }
+        break;
+    }
+    case TICK_COLUMN_XOR: {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < count; i++) {
+            acc ^= raw[i];
+            raw[i] = acc;
+        }
+        break;
+    }
+    case TICK_COLUMN_RAW:
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+// Turn a decoded DECIMAL or XOR column back into doubles
+static int column_to_doubles(const int64_t *values, size_t count, int type, int places, double *out) {
+    if (type == TICK_COLUMN_DECIMAL) {
+        size_t s;
+        for (s = 0; s < sizeof(decimal_places) / sizeof(decimal_places[0]) && decimal_places[s] != places; s++) {
+        }
+        if (s == sizeof(decimal_places) / sizeof(decimal_places[0])) {
+            return -1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[i] = (double)values[i] / decimal_scale[s];
+        }
+        return 0;
+    }
+    if (type == TICK_COLUMN_XOR) {
+        memcpy(out, values, count * sizeof(double));
+        return 0;
+    }
+    return -1;
+}
+
+// Function to decode a block into records (AlpacaTrade, AlpacaQuote or AlpacaBar).
+// Returns the number of records, or 0 if the block is malformed or has more than
+// max_records.
+size_t tick_block_decode(TickKind kind, const uint8_t *data, size_t len, void *records, size_t max_records) {
+    int64_t values[TICK_MAX_COLUMNS][TICK_BLOCK_RECORDS];
+    double doubles[TICK_BLOCK_RECORDS];
+    int types[TICK_MAX_COLUMNS];
+    int places[TICK_MAX_COLUMNS];
+    const uint8_t *end = data + len;
+    uint64_t count;
+
+    size_t n = get_varint(data, end, &count);
+    int num_columns = tick_num_columns(kind);
+    if (n == 0 || count == 0 || count > TICK_BLOCK_RECORDS || count > max_records ||
+        data + n >= end || data[n] != num_columns) {
+        return 0;
+    }
+    const uint8_t *p = data + n + 1;
+    for (int c = 0; c < num_columns; c++) {
+        if (decode_column(&p, end, count, values[c], &types[c], &places[c]) != 0) {
+            return 0;
+        }
+    }
+
+// Scatter a decoded integer column, or a double column through doubles[], into the records
+#define SCATTER_INT(type, field, c) for (size_t i = 0; i < count; i++) { ((type *)records)[i].field = values[c][i]; }
+#define SCATTER_DOUBLE(type, field, c) \
+    if (column_to_doubles(values[c], count, types[c], places[c], doubles) != 0) return 0; \
+    for (size_t i = 0; i < count; i++) { ((type *)records)[i].field = doubles[i]; }
+
+    if (kind == TICK_QUOTES) {
+        memset(records, 0, count * sizeof(AlpacaQuote));
+        SCATTER_INT(AlpacaQuote, t, 0);
+        SCATTER_DOUBLE(AlpacaQuote, bid, 1);
+        SCATTER_DOUBLE(AlpacaQuote, ask, 2);
+        SCATTER_INT(AlpacaQuote, bid_size, 3);
+        SCATTER_INT(AlpacaQuote, ask_size, 4);
+        for (size_t i = 0; i < count; i++) {
+            AlpacaQuote *r = (AlpacaQuote *)records + i;
+            uint64_t attrs = (uint64_t)values[5][i];
+            uint32_t conditions = (uint32_t)(attrs >> 24);
+            r->bid_exchange = (char)(attrs & 0xff);
+            r->ask_exchange = (char)((attrs >> 8) & 0xff);
+            r->tape = (char)((attrs >> 16) & 0xff);
+            memcpy(r->conditions, &conditions, sizeof(conditions));
+        }
+    } else if (kind == TICK_BARS) {
+        SCATTER_INT(AlpacaBar, t, 0);
+        SCATTER_DOUBLE(AlpacaBar, open, 1);
+        SCATTER_DOUBLE(AlpacaBar, high, 2);
+        SCATTER_DOUBLE(AlpacaBar, low, 3);
+        SCATTER_DOUBLE(AlpacaBar, close, 4);
+        SCATTER_DOUBLE(AlpacaBar, vw, 5);
+        SCATTER_INT(AlpacaBar, volume, 6);
+        SCATTER_INT(AlpacaBar, trades, 7);
+    } else {
+        memset(records, 0, count * sizeof(AlpacaTrade));
+        SCATTER_INT(AlpacaTrade, t, 0);
+        SCATTER_DOUBLE(AlpacaTrade, price, 1);
+        SCATTER_INT(AlpacaTrade, size, 2);
+        for (size_t i = 0; i < count; i++) {
+            AlpacaTrade *r = (AlpacaTrade *)records + i;
+            uint64_t attrs = (uint64_t)values[3][i];
+            uint32_t conditions = (uint32_t)(attrs >> 16);
+            r->exchange = (char)(attrs & 0xff);
+            r->tape = (char)((attrs >> 8) & 0xff);
+            memcpy(r->conditions, &conditions, sizeof(conditions));
+        }
+        SCATTER_INT(AlpacaTrade, id, 4);
+    }
+#undef SCATTER_INT
+#undef SCATTER_DOUBLE
+    return (size_t)count;
+}
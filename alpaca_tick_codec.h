@@ -0,0 +1,25 @@
+#ifndef ALPACA_TICK_CODEC_H
+#define ALPACA_TICK_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alpaca_bars.h"
+#include "alpaca_ticks.h"
+
+#define TICK_BLOCK_RECORDS 1024     // records per full block
+
+// How one column of a block is stored. Every column is a run of LEB128 varints;
+// the type says what the varints hold.
+typedef enum {
+    TICK_COLUMN_RAW = 1,        // the value itself (sizes, counts)
+    TICK_COLUMN_DELTA = 2,      // zigzag difference from the previous value (times, ids)
+    TICK_COLUMN_XOR = 3,        // bitwise xor with the previous value (codes, float bits)
+    TICK_COLUMN_DECIMAL = 4     // a double times 10^places, delta coded; places is stored
+} TickColumnType;
+
+size_t tick_block_bound(TickKind kind, size_t count);
+size_t tick_block_encode(TickKind kind, const void *records, size_t count, uint8_t *out);
+size_t tick_block_count(const uint8_t *data, size_t len);
+size_t tick_block_decode(TickKind kind, const uint8_t *data, size_t len, void *records, size_t max_records);
+
+#endif // ALPACA_TICK_CODEC_H
@@ -0,0 +1,481 @@
+#include "alpaca_ticks.h"
+#include "alpaca_bars.h"
+#include "alpaca_tick_codec.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TICK_COPY_BUFFER_SIZE (1 << 16)
+
+const char *tick_kind_name(TickKind kind) {
+    switch (kind) {
+    case TICK_QUOTES: return "quotes";
+    case TICK_BARS: return "bars";
+    default: return "trades";
+    }
+}
+
+size_t tick_record_size(TickKind kind) {
+    switch (kind) {
+    case TICK_QUOTES: return sizeof(AlpacaQuote);
+    case TICK_BARS: return sizeof(AlpacaBar);
+    default: return sizeof(AlpacaTrade);
+    }
+}
+
+static void tick_trade_field(AlpacaTrade *trade, const char *key, const char *token, int is_string) {
+    if (key[1] != 0) {
+        return;
+    }
+    switch (key[0]) {
+    case 't': trade->t = is_string ? parse_rfc3339_ns(token) : -1; break;
+    case 'p': trade->price = strtod(token, NULL); break;
+    case 's': trade->size = (uint32_t)strtod(token, NULL); break;
+    case 'x': trade->exchange = token[0]; break;
+    case 'z': trade->tape = token[0]; break;
+    case 'i': trade->id = strtoull(token, NULL, 10); break;
+    }
+}
+
+static void tick_quote_field(AlpacaQuote *quote, const char *key, const char *token, int is_string) {
+    if (key[1] == 0) {
+        if (key[0] == 't') {
+            quote->t = is_string ? parse_rfc3339_ns(token) : -1;
+        } else if (key[0] == 'z') {
+            quote->tape = token[0];
+        }
+        return;
+    }
+    if (key[2] != 0) {
+        return;
+    }
+    if (key[0] == 'b') {
+        switch (key[1]) {
+        case 'p': quote->bid = strtod(token, NULL); break;
+        case 's': quote->bid_size = (uint32_t)strtod(token, NULL); break;
+        case 'x': quote->bid_exchange = token[0]; break;
+        }
+    } else if (key[0] == 'a') {
+        switch (key[1]) {
+        case 'p': quote->ask = strtod(token, NULL); break;
+        case 's': quote->ask_size = (uint32_t)strtod(token, NULL); break;
+        case 'x': quote->ask_exchange = token[0]; break;
+        }
+    }
+}
+
+static void tick_stream_begin(void *user) {
+    TickStreamParser *parser = (TickStreamParser *)user;
+    memset(&parser->tick, 0, sizeof(parser->tick));
+    parser->tick.trade.t = -1;
+    parser->num_conditions = 0;
+}
+
+// Map one field of a trade or quote object onto the record being filled
+static void tick_stream_value(void *user, const char *key, const char *token, int is_string, int in_list) {
+    TickStreamParser *parser = (TickStreamParser *)user;
+    if (!in_list) {
+        if (parser->kind == TICK_QUOTES) {
+            tick_quote_field(&parser->tick.quote, key, token, is_string);
+        } else {
+            tick_trade_field(&parser->tick.trade, key, token, is_string);
+        }
+    } else if (is_string && strcmp(key, "c") == 0) {
+        // One entry of the record's condition list
+        char *conditions = parser->kind == TICK_QUOTES ? parser->tick.quote.conditions : parser->tick.trade.conditions;
+        if (parser->num_conditions < TICK_MAX_CONDITIONS && token[0]) {
+            conditions[parser->num_conditions++] = token[0];
+        }
+    }
+}
+
+static void tick_stream_end(void *user, const char *symbol) {
+    TickStreamParser *parser = (TickStreamParser *)user;
+    parser->on_tick(parser->user, symbol, &parser->tick);
+}
+
+void tick_stream_init(TickStreamParser *parser, TickKind kind, TickCallback on_tick, void *user) {
+    PageRecordHandler handler = { tick_stream_begin, tick_stream_value, tick_stream_end, parser };
+    memset(parser, 0, sizeof(*parser));
+    parser->kind = kind;
+    parser->on_tick = on_tick;
+    parser->user = user;
+    page_scanner_init(&parser->scanner, tick_kind_name(kind), &handler);
+}
+
+// Forget any partial document, e.g. before a retried request starts over
+void tick_stream_reset(TickStreamParser *parser) {
+    page_scanner_reset(&parser->scanner);
+}
+
+// Function to feed the next chunk of the response body. Returns -1 on malformed input.
+int tick_stream_feed(TickStreamParser *parser, const char *data, size_t len) {
+    return page_scanner_feed(&parser->scanner, data, len);
+}
+
+// Function to check that a whole document was parsed. Returns 0 and sets
+// *next_page_token (caller frees) or NULL on the last page.
+int tick_stream_finish(TickStreamParser *parser, char **next_page_token) {
+    return page_scanner_finish(&parser->scanner, next_page_token);
+}
+
+// Grow an array of block entries to hold at least one more
+static int reserve_blocks(TickBlockEntry **blocks, size_t count, size_t *capacity) {
+    if (count < *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    TickBlockEntry *ptr = realloc(*blocks, new_capacity * sizeof(TickBlockEntry));
+    if (!ptr) {
+        fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+        return -1;
+    }
+    *blocks = ptr;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Function to set up an encoder writing to fp. Returns -1 if out of memory.
+int tick_encoder_init(TickEncoder *encoder, TickKind kind, FILE *fp) {
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->kind = kind;
+    encoder->fp = fp;
+    encoder->pending = malloc(TICK_BLOCK_RECORDS * tick_record_size(kind));
+    encoder->block = malloc(tick_block_bound(kind, TICK_BLOCK_RECORDS));
+    if (!encoder->pending || !encoder->block) {
+        tick_encoder_free(encoder);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to encode and write the records collected so far as one block
+int tick_encoder_flush(TickEncoder *encoder) {
+    if (encoder->num_pending == 0 || encoder->failed) {
+        return encoder->failed ? -1 : 0;
+    }
+    size_t length = tick_block_encode(encoder->kind, encoder->pending, encoder->num_pending, encoder->block);
+    if (length == 0 || reserve_blocks(&encoder->blocks, encoder->num_blocks, &encoder->blocks_capacity) != 0 ||
+        fwrite(encoder->block, 1, length, encoder->fp) != length) {
+        encoder->failed = 1;
+        return -1;
+    }
+
+    TickBlockEntry *entry = &encoder->blocks[encoder->num_blocks++];
+    entry->first_t = *(const int64_t *)encoder->pending;
+    entry->offset = encoder->bytes;
+    entry->count = (uint32_t)encoder->num_pending;
+    entry->length = (uint32_t)length;
+    encoder->bytes += length;
+    encoder->num_pending = 0;
+    return 0;
+}
+
+// Function to append one record (AlpacaTrade, AlpacaQuote or AlpacaBar). Every
+// record type starts with its int64_t time.
+int tick_encoder_put(TickEncoder *encoder, const void *record) {
+    size_t size = tick_record_size(encoder->kind);
+    memcpy((char *)encoder->pending + encoder->num_pending * size, record, size);
+    encoder->num_pending++;
+
+    int64_t t = *(const int64_t *)record;
+    if (encoder->count == 0) {
+        encoder->first_t = t;
+    }
+    encoder->last_t = t;
+    encoder->count++;
+
+    if (encoder->num_pending == TICK_BLOCK_RECORDS) {
+        return tick_encoder_flush(encoder);
+    }
+    return encoder->failed ? -1 : 0;
+}
+
+// Function to remember the encoder's position. Call it between blocks, after
+// tick_encoder_flush.
+void tick_encoder_mark(const TickEncoder *encoder, TickEncoderMark *mark) {
+    mark->count = encoder->count;
+    mark->bytes = encoder->bytes;
+    mark->num_blocks = encoder->num_blocks;
+    mark->first_t = encoder->first_t;
+    mark->last_t = encoder->last_t;
+}
+
+// Function to drop everything written after mark, truncating the file to match
+int tick_encoder_rewind(TickEncoder *encoder, const TickEncoderMark *mark) {
+    encoder->count = mark->count;
+    encoder->bytes = mark->bytes;
+    encoder->num_blocks = mark->num_blocks;
+    encoder->first_t = mark->first_t;
+    encoder->last_t = mark->last_t;
+    encoder->num_pending = 0;
+    encoder->failed = 0;
+    if (fflush(encoder->fp) != 0 || ftruncate(fileno(encoder->fp), (off_t)encoder->bytes) != 0 ||
+        fseeko(encoder->fp, (off_t)encoder->bytes, SEEK_SET) != 0) {
+        encoder->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+void tick_encoder_free(TickEncoder *encoder) {
+    free(encoder->pending);
+    free(encoder->block);
+    free(encoder->blocks);
+    encoder->pending = NULL;
+    encoder->block = NULL;
+    encoder->blocks = NULL;
+    encoder->num_pending = 0;
+    encoder->num_blocks = 0;
+    encoder->blocks_capacity = 0;
+}
+
+static void tick_file_paths(char *path, size_t size, const char *dir, const char *symbol, TickKind kind, const char *suffix) {
+    snprintf(path, size, "%s/%s.%s%s", dir, symbol, tick_kind_name(kind), suffix);
+}
+
+static void tick_file_header(TickFileHeader *header, const char *magic, TickKind kind, uint64_t count, uint64_t num_blocks) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, magic, 8);
+    header->version = TICK_FILE_VERSION;
+    header->kind = (uint32_t)kind;
+    header->count = count;
+    header->num_blocks = num_blocks;
+}
+
+// Function to start DIR/SYMBOL.<kind>, written under a temporary name until commit
+int tick_file_create(TickFileWriter *writer, const char *dir, const char *symbol, TickKind kind) {
+    memset(writer, 0, sizeof(*writer));
+    writer->kind = kind;
+    tick_file_paths(writer->path, sizeof(writer->path), dir, symbol, kind, "");
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.%d.tmp", writer->path, (int)getpid());
+
+    writer->fp = fopen(writer->tmp_path, "wb");
+    if (!writer->fp) {
+        perror("Error opening tick file");
+        return -1;
+    }
+    setvbuf(writer->fp, NULL, _IOFBF, TICK_COPY_BUFFER_SIZE);
+
+    TickFileHeader header;
+    tick_file_header(&header, TICK_FILE_MAGIC, kind, 0, 0);
+    if (fwrite(&header, sizeof(header), 1, writer->fp) != 1) {
+        perror("Error writing tick file");
+        tick_file_abort(writer);
+        return -1;
+    }
+    writer->offset = sizeof(header);
+    return 0;
+}
+
+// Function to copy one flushed run from its scratch file to the end of the data
+// file and add it, and its blocks, to the index
+int tick_file_append_run(TickFileWriter *writer, int64_t day_start, FILE *run, const TickEncoder *encoder) {
+    if (writer->count == writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 64;
+        TickIndexEntry *entries = realloc(writer->entries, capacity * sizeof(TickIndexEntry));
+        if (!entries) {
+            fprintf(stderr, "not enough memory (realloc returned NULL)\n");
+            return -1;
+        }
+        writer->entries = entries;
+        writer->capacity = capacity;
+    }
+    for (size_t i = 0; i < encoder->num_blocks; i++) {
+        if (reserve_blocks(&writer->blocks, writer->num_blocks + i, &writer->blocks_capacity) != 0) {
+            return -1;
+        }
+    }
+
+    char buffer[TICK_COPY_BUFFER_SIZE];
+    uint64_t copied = 0;
+    rewind(run);
+    while (copied < encoder->bytes) {
+        size_t want = encoder->bytes - copied < sizeof(buffer) ? (size_t)(encoder->bytes - copied) : sizeof(buffer);
+        size_t got = fread(buffer, 1, want, run);
+        if (got == 0 || fwrite(buffer, 1, got, writer->fp) != got) {
+            perror("Error copying tick data");
+            return -1;
+        }
+        copied += got;
+    }
+
+    TickIndexEntry *entry = &writer->entries[writer->count++];
+    entry->day_start = day_start;
+    entry->offset = writer->offset;
+    entry->length = encoder->bytes;
+    entry->count = encoder->count;
+    entry->first_t = encoder->first_t;
+    entry->last_t = encoder->last_t;
+    entry->first_block = writer->num_blocks;
+    entry->num_blocks = encoder->num_blocks;
+    for (size_t i = 0; i < encoder->num_blocks; i++) {
+        TickBlockEntry *block = &writer->blocks[writer->num_blocks++];
+        *block = encoder->blocks[i];
+        block->offset += writer->offset;
+    }
+    writer->offset += encoder->bytes;
+    return 0;
+}
+
+// Function to write the index and move both files into place
+int tick_file_commit(TickFileWriter *writer) {
+    char index_path[TICK_PATH_SIZE + 8];
+    char index_tmp[TICK_PATH_SIZE + 48];
+    snprintf(index_path, sizeof(index_path), "%s.idx", writer->path);
+    snprintf(index_tmp, sizeof(index_tmp), "%s.%d.tmp", index_path, (int)getpid());
+
+    int ok = fclose(writer->fp) == 0;
+    writer->fp = NULL;
+
+    FILE *fp = ok ? fopen(index_tmp, "wb") : NULL;
+    if (fp) {
+        TickFileHeader header;
+        tick_file_header(&header, TICK_INDEX_MAGIC, writer->kind, writer->count, writer->num_blocks);
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        ok = ok && (writer->count == 0 || fwrite(writer->entries, sizeof(TickIndexEntry), writer->count, fp) == writer->count);
+        ok = ok && (writer->num_blocks == 0 || fwrite(writer->blocks, sizeof(TickBlockEntry), writer->num_blocks, fp) == writer->num_blocks);
+        ok = (fclose(fp) == 0) && ok;
+    } else {
+        ok = 0;
+    }
+
+    // The data file goes first so a reader never finds an index without its data
+    if (!ok || rename(writer->tmp_path, writer->path) != 0 || rename(index_tmp, index_path) != 0) {
+        perror("Error writing tick file");
+        unlink(index_tmp);
+        tick_file_abort(writer);
+        return -1;
+    }
+    free(writer->entries);
+    free(writer->blocks);
+    writer->entries = NULL;
+    writer->blocks = NULL;
+    return 0;
+}
+
+void tick_file_abort(TickFileWriter *writer) {
+    if (writer->fp) {
+        fclose(writer->fp);
+        writer->fp = NULL;
+    }
+    unlink(writer->tmp_path);
+    free(writer->entries);
+    free(writer->blocks);
+    writer->entries = NULL;
+    writer->blocks = NULL;
+    writer->count = 0;
+    writer->num_blocks = 0;
+}
+
+static void *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *base = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(TickFileHeader)) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        *size = (size_t)st.st_size;
+    }
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+// Function to map DIR/SYMBOL.<kind> and its index. Returns 0 if both are valid.
+int tick_file_open(TickFile *file, const char *dir, const char *symbol, TickKind kind) {
+    char path[TICK_PATH_SIZE];
+    char index_path[TICK_PATH_SIZE];
+    memset(file, 0, sizeof(*file));
+    file->kind = kind;
+    tick_file_paths(path, sizeof(path), dir, symbol, kind, "");
+    tick_file_paths(index_path, sizeof(index_path), dir, symbol, kind, ".idx");
+
+    file->data = (const uint8_t *)map_file(path, &file->data_size);
+    file->index_base = map_file(index_path, &file->index_size);
+    if (!file->data || !file->index_base) {
+        tick_file_close(file);
+        return -1;
+    }
+
+    const TickFileHeader *header = (const TickFileHeader *)file->data;
+    const TickFileHeader *index = (const TickFileHeader *)file->index_base;
+    if (memcmp(header->magic, TICK_FILE_MAGIC, 8) != 0 || memcmp(index->magic, TICK_INDEX_MAGIC, 8) != 0 ||
+        header->version != TICK_FILE_VERSION || index->version != TICK_FILE_VERSION ||
+        header->kind != (uint32_t)kind || index->kind != (uint32_t)kind ||
+        file->index_size != sizeof(TickFileHeader) + index->count * sizeof(TickIndexEntry) + index->num_blocks * sizeof(TickBlockEntry)) {
+        tick_file_close(file);
+        return -1;
+    }
+
+    file->entries = (const TickIndexEntry *)((const char *)file->index_base + sizeof(TickFileHeader));
+    file->count = index->count;
+    file->blocks = (const TickBlockEntry *)(file->entries + file->count);
+    file->num_blocks = index->num_blocks;
+    for (size_t i = 0; i < file->num_blocks; i++) {
+        if (file->blocks[i].offset + file->blocks[i].length > file->data_size) {
+            tick_file_close(file);
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < file->count; i++) {
+        if (file->entries[i].first_block + file->entries[i].num_blocks > file->num_blocks) {
+            tick_file_close(file);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void tick_file_close(TickFile *file) {
+    if (file->data) {
+        munmap((void *)file->data, file->data_size);
+    }
+    if (file->index_base) {
+        munmap(file->index_base, file->index_size);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+// Function to find where to start reading for records at or after t: the last
+// block that starts at or before t, or 0. Earlier records of that block still
+// have to be skipped by the caller.
+size_t tick_file_find_block(const TickFile *file, int64_t t) {
+    size_t lo = 0;
+    size_t hi = file->num_blocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (file->blocks[mid].first_t <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+// Function to decode one block; records must have room for blocks[block].count records
+size_t tick_file_decode_block(const TickFile *file, size_t block, void *records) {
+    const TickBlockEntry *b = &file->blocks[block];
+    return tick_block_decode(file->kind, file->data + b->offset, b->length, records, b->count);
+}
+
+// Function to decode one indexed day; records must have room for entries[entry].count records
+size_t tick_file_decode_entry(const TickFile *file, size_t entry, void *records) {
+    const TickIndexEntry *e = &file->entries[entry];
+    size_t size = tick_record_size(file->kind);
+    size_t count = 0;
+    for (uint64_t b = e->first_block; b < e->first_block + e->num_blocks; b++) {
+        size_t n = tick_file_decode_block(file, (size_t)b, (char *)records + count * size);
+        if (n != file->blocks[b].count) {
+            break;
+        }
+        count += n;
+    }
+    return count;
+}
@@ -0,0 +1,176 @@
+#ifndef ALPACA_TICKS_H
+#define ALPACA_TICKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "alpaca_page_scanner.h"
+
+#define TICK_FILE_MAGIC "ALPTICK"
+#define TICK_INDEX_MAGIC "ALPTIDX"
+#define TICK_FILE_VERSION 2
+#define TICK_MAX_CONDITIONS 4
+#define TICK_PATH_SIZE 1024
+
+typedef enum {
+    TICK_TRADES = 1,    // /v2/stocks/{symbol}/trades
+    TICK_QUOTES = 2,    // /v2/stocks/{symbol}/quotes
+    TICK_BARS = 3       // AlpacaBar records, for the block codec
+} TickKind;
+
+// One trade as returned by /v2/stocks/{symbol}/trades
+typedef struct {
+    int64_t t;          // nanoseconds since 1970 UTC
+    double price;
+    uint32_t size;
+    char exchange;
+    char tape;
+    char conditions[TICK_MAX_CONDITIONS];   // one-character codes, NUL-padded
+    uint64_t id;
+} AlpacaTrade;
+
+// One quote as returned by /v2/stocks/{symbol}/quotes
+typedef struct {
+    int64_t t;          // nanoseconds since 1970 UTC
+    double bid;
+    double ask;
+    uint32_t bid_size;
+    uint32_t ask_size;
+    char bid_exchange;
+    char ask_exchange;
+    char tape;
+    char conditions[TICK_MAX_CONDITIONS];
+} AlpacaQuote;
+
+const char *tick_kind_name(TickKind kind);
+size_t tick_record_size(TickKind kind);
+
+// Called for every complete record, an AlpacaTrade or AlpacaQuote according to the
+// parser's kind; symbol is NULL for single-symbol responses
+typedef void (*TickCallback)(void *user, const char *symbol, const void *tick);
+
+// Incremental parser for /trades and /quotes responses, fed in chunks of any size
+// like BarStreamParser. Each record is handed to on_tick when its closing brace arrives.
+typedef struct {
+    TickKind kind;
+    TickCallback on_tick;
+    void *user;
+    PageScanner scanner;
+    int num_conditions;
+    union {
+        AlpacaTrade trade;
+        AlpacaQuote quote;
+    } tick;
+} TickStreamParser;
+
+void tick_stream_init(TickStreamParser *parser, TickKind kind, TickCallback on_tick, void *user);
+void tick_stream_reset(TickStreamParser *parser);
+int tick_stream_feed(TickStreamParser *parser, const char *data, size_t len);
+int tick_stream_finish(TickStreamParser *parser, char **next_page_token);
+
+// Where one block of records lives; the sparse block index has one entry per block
+typedef struct {
+    int64_t first_t;    // time of the block's first record
+    uint64_t offset;    // byte offset of the block (from the start of the run while encoding)
+    uint32_t count;
+    uint32_t length;
+} TickBlockEntry;
+
+// Writes a run of records (normally one day of one symbol) to a file as blocks of up
+// to TICK_BLOCK_RECORDS records, each encoded by tick_block_encode in
+// alpaca_tick_codec.c, and keeps the index entry of every block written.
+typedef struct {
+    TickKind kind;
+    FILE *fp;
+    void *pending;          // records of the block being filled
+    size_t num_pending;
+    uint8_t *block;         // encoding buffer
+    TickBlockEntry *blocks;
+    size_t num_blocks;
+    size_t blocks_capacity;
+    uint64_t count;
+    uint64_t bytes;
+    int64_t first_t;
+    int64_t last_t;
+    int failed;
+} TickEncoder;
+
+// Position of an encoder between blocks, to go back to when a page is retried
+typedef struct {
+    uint64_t count;
+    uint64_t bytes;
+    size_t num_blocks;
+    int64_t first_t;
+    int64_t last_t;
+} TickEncoderMark;
+
+int tick_encoder_init(TickEncoder *encoder, TickKind kind, FILE *fp);
+int tick_encoder_put(TickEncoder *encoder, const void *record);
+int tick_encoder_flush(TickEncoder *encoder);
+void tick_encoder_mark(const TickEncoder *encoder, TickEncoderMark *mark);
+int tick_encoder_rewind(TickEncoder *encoder, const TickEncoderMark *mark);
+void tick_encoder_free(TickEncoder *encoder);
+
+// Header shared by the data file (TICK_FILE_MAGIC) and its index (TICK_INDEX_MAGIC).
+// In the index, count day entries are followed by num_blocks block entries.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t count;
+    uint64_t num_blocks;
+} TickFileHeader;
+
+// Where one run of a symbol's data file lives, as stored in DIR/SYMBOL.<kind>.idx
+typedef struct {
+    int64_t day_start;  // the run's trading day, as the UTC time of New York midnight
+    uint64_t offset;    // byte offset of the run in the data file
+    uint64_t length;
+    uint64_t count;
+    int64_t first_t;    // nanoseconds, 0 if the run is empty
+    int64_t last_t;
+    uint64_t first_block;
+    uint64_t num_blocks;
+} TickIndexEntry;
+
+// Builds DIR/SYMBOL.<kind> and its index from runs appended in time order. Both
+// files are written under temporary names and renamed into place on commit.
+typedef struct {
+    TickKind kind;
+    char path[TICK_PATH_SIZE];
+    char tmp_path[TICK_PATH_SIZE + 32];
+    FILE *fp;
+    uint64_t offset;
+    TickIndexEntry *entries;
+    size_t count;
+    size_t capacity;
+    TickBlockEntry *blocks;
+    size_t num_blocks;
+    size_t blocks_capacity;
+} TickFileWriter;
+
+int tick_file_create(TickFileWriter *writer, const char *dir, const char *symbol, TickKind kind);
+int tick_file_append_run(TickFileWriter *writer, int64_t day_start, FILE *run, const TickEncoder *encoder);
+int tick_file_commit(TickFileWriter *writer);
+void tick_file_abort(TickFileWriter *writer);
+
+// Read-only view of a symbol's data file and index, both mapped
+typedef struct {
+    TickKind kind;
+    const uint8_t *data;
+    size_t data_size;
+    const TickIndexEntry *entries;
+    size_t count;
+    const TickBlockEntry *blocks;
+    size_t num_blocks;
+    void *index_base;
+    size_t index_size;
+} TickFile;
+
+int tick_file_open(TickFile *file, const char *dir, const char *symbol, TickKind kind);
+void tick_file_close(TickFile *file);
+size_t tick_file_find_block(const TickFile *file, int64_t t);
+size_t tick_file_decode_block(const TickFile *file, size_t block, void *records);
+size_t tick_file_decode_entry(const TickFile *file, size_t entry, void *records);
+
+#endif // ALPACA_TICKS_H
@@ -5,12 +5,29 @@ prints the received data to the console. The program allows the user to choose
 between SIP or IEX data source.
 The program requires the APCA_API_KEY_ID and APCA_API_SECRET_KEY environment
 variables to be set, which are used for authentication.
-Usage: alpaca_websocket_jansson [-t trades] [-q quotes] [-b bars] [-s sip]
+Usage: alpaca_websocket_jansson [-t trades] [-q quotes] [-b bars] [-s sip] [-c file] [-i secs] [-r port] [-u path] [-n frames] [-m secs] [-P file] [-N count] [-A file] [-O path] [-B spec] [-X codes] [-R window] [-W file]
 Options:
 -t trades : Comma-separated list of trade symbols, or "*" for all trades (with quotes).
 -q quotes : Comma-separated list of quote symbols, or "*" for all quotes (with quotes).
 -b bars : Comma-separated list of bar symbols, or "*" for all bars (with quotes).
 -s sip : Choose the data source. Allowed values are 'sip' (default) or 'iex'.
+-c file : Checkpoint file. Restored on startup and written on shutdown and periodically.
+-i secs : Seconds between periodic checkpoints (default 60, 0 disables).
+-r port : Relay mode: re-serve the feed to local WebSocket clients on 127.0.0.1:port.
+-u path : Relay mode: re-serve the feed to local WebSocket clients on a Unix socket.
+-n frames : Frames queued per relay client before the oldest are dropped (default 1024).
+-m secs : Print the top movers, volume leaders and widest spreads every secs seconds
+          (0 prints only on SIGUSR1 and at exit).
+-P file : Prior closes for the rankings, one "SYMBOL PRICE" per line. Enables the rankings.
+-N count : Entries per ranking (default 10).
+-A file : Price alert rules, one "SYMBOL above|below LEVEL [NAME]" per line.
+-O path : Write triggered alerts to a file, FIFO or Unix socket instead of stdout.
+-B spec : Build bars from trades: time:SECONDS, volume:SHARES or dollar:DOLLARS.
+-X codes : Comma-separated trade conditions left out of built bars.
+-R window : Keep correlations of bar returns over the last window periods; window:max_symbols
+            raises the default limit of 512 symbols. With -B time:SECONDS the built
+            bars are used instead of bar messages.
+-W file : Rewrite the correlation matrix as CSV in file after each period.
 
 To exit the program, press Ctrl+C.
 */
@@ -23,9 +40,17 @@ To exit the program, press Ctrl+C.
 #include <unistd.h>
 #include <jansson.h>
 #include <getopt.h>
+#include <time.h>
 #include "alpaca_lib_jansson.h"  // Include the header file for the library
+#include "alpaca_relay.h"
 
-extern int interrupted;
+// Set by SIGUSR1 to print the rankings on demand
+static volatile sig_atomic_t rankings_requested = 0;
+
+static void sigusr1_handler(int sig) {
+    (void)sig;
+    rankings_requested = 1;
+}
 
 // WebSocket protocols
 static struct lws_protocols protocols[] = {
@@ -45,8 +70,36 @@ int main(int argc, char *argv[]) {
     // Default WebSocket path for SIP data source
     char *path = "/v2/sip";
 
+    // Checkpoint settings
+    const char *checkpoint_path = NULL;
+    int checkpoint_interval = 60;
+
+    // Relay settings
+    RelayOptions relay_options;
+    memset(&relay_options, 0, sizeof(relay_options));
+
+    // Ranking settings
+    const char *prior_close_path = NULL;
+    int rankings_interval = -1;
+    size_t rankings_count = RANKINGS_DEFAULT_TOP;
+
+    // Alert settings
+    const char *alert_rules_path = NULL;
+    const char *alert_output_path = NULL;
+
+    // Bar builder settings
+    const char *bar_spec = NULL;
+    const char *excluded_conditions = NULL;
+
+    // Correlation settings
+    const char *correlation_spec = NULL;
+    const char *correlation_path = NULL;
+
+    // First option given that only applies when messages are handled here, not relayed
+    int local_option = 0;
+
     // Parse the command-line options
-    while ((opt = getopt(argc, argv, "t:q:b:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "t:q:b:s:c:i:r:u:n:m:P:N:A:O:B:X:R:W:")) != -1) {
         switch (opt) {
             case 't':
                 json_object_set_new(params, "trades", parse_symbols(optarg));
@@ -67,12 +120,169 @@ int main(int argc, char *argv[]) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'c':
+                checkpoint_path = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'i':
+                checkpoint_interval = atoi(optarg);
+                break;
+            case 'r':
+                relay_options.port = atoi(optarg);
+                break;
+            case 'u':
+                relay_options.unix_path = optarg;
+                break;
+            case 'n':
+                relay_options.max_queued = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                rankings_interval = atoi(optarg);
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'P':
+                prior_close_path = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'N':
+                rankings_count = strtoul(optarg, NULL, 10);
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'A':
+                alert_rules_path = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'O':
+                alert_output_path = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'B':
+                bar_spec = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'X':
+                excluded_conditions = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'R':
+                correlation_spec = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
+            case 'W':
+                correlation_path = optarg;
+                local_option = local_option ? local_option : opt;
+                break;
             default:
                 print_help(argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
 
+    // The context owns the stores for this feed and is handed to the connection as its user data
+    AlpacaContext *feed = alpaca_context_create(params);
+    if (!feed) {
+        fprintf(stderr, "Error creating feed context.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Relay mode: one upstream connection shared by every local client. Messages are
+    // passed on rather than printed or stored.
+    if (relay_options.port > 0 || relay_options.unix_path) {
+        if (local_option) {
+            fprintf(stderr, "Error: -%c cannot be used with -r or -u; the relay passes messages on without storing or analysing them.\n", local_option);
+            exit(EXIT_FAILURE);
+        }
+        relay_options.path = path;
+        signal(SIGINT, sigint_handler);
+        int status = relay_run(feed, &relay_options);
+        alpaca_context_destroy(feed);
+        json_decref(params);
+        return status == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    // Live rankings over every trade and quote received, kept incrementally so a
+    // snapshot never has to walk the whole universe
+    MarketRankings rankings;
+    int rankings_enabled = rankings_interval >= 0 || prior_close_path;
+    if (rankings_enabled) {
+        rankings_init(&rankings);
+        if (prior_close_path) {
+            int loaded = rankings_load_prior_closes(&rankings, prior_close_path);
+            if (loaded < 0) {
+                rankings_free(&rankings);
+                alpaca_context_destroy(feed);
+                exit(EXIT_FAILURE);
+            }
+            printf("Loaded %d prior closes from %s.\n", loaded, prior_close_path);
+        }
+        alpaca_context_set_rankings(feed, &rankings);
+        signal(SIGUSR1, sigusr1_handler);
+    }
+
+    // Restore the previous session's state before any new data arrives. The rankings are
+    // set up first so that they are rebuilt from the restored trades and quotes.
+    if (checkpoint_path) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int status = load_checkpoint(feed, checkpoint_path);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (status == 0) {
+            printf("Restored checkpoint %s in %.3f ms.\n", checkpoint_path,
+                   (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+        } else if (status < 0) {
+            fprintf(stderr, "Ignoring unusable checkpoint %s.\n", checkpoint_path);
+        }
+    }
+
+    // Price alerts, checked as each message arrives and before it is printed or stored
+    AlertEngine alerts;
+    int alerts_enabled = alert_rules_path != NULL;
+    if (alerts_enabled) {
+        alert_engine_init(&alerts);
+        int loaded = alert_engine_load(&alerts, alert_rules_path);
+        if (loaded < 0 || (alert_output_path && alert_engine_open_output(&alerts, alert_output_path) != 0)) {
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "Loaded %d alerts for %zu symbols from %s.\n", loaded, alerts.symbols.count, alert_rules_path);
+        alpaca_context_set_alerts(feed, &alerts);
+        // A reader of the FIFO or socket going away must not end the program
+        signal(SIGPIPE, SIG_IGN);
+    } else if (alert_output_path) {
+        fprintf(stderr, "Error: -O needs alert rules from -A.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Bars built from the trade stream, stored and printed like the feed's own bars
+    BarBuilder builder;
+    int builder_enabled = bar_spec != NULL;
+    if (builder_enabled) {
+        if (bar_builder_init(&builder, bar_spec, NULL, NULL) != 0 ||
+            (excluded_conditions && bar_builder_exclude(&builder, excluded_conditions) != 0)) {
+            exit(EXIT_FAILURE);
+        }
+        alpaca_context_set_bar_builder(feed, &builder);
+    } else if (excluded_conditions) {
+        fprintf(stderr, "Error: -X needs a bar spec from -B.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Rolling correlations of the returns of every symbol's bars
+    CorrelationEngine correlation;
+    int correlation_enabled = correlation_spec != NULL;
+    if (correlation_enabled) {
+        char *end = NULL;
+        size_t window = strtoul(correlation_spec, &end, 10);
+        size_t max_symbols = *end == ':' ? strtoul(end + 1, &end, 10) : CORRELATION_DEFAULT_MAX_SYMBOLS;
+        if (*end || correlation_init(&correlation, max_symbols, window, 0) != 0) {
+            fprintf(stderr, "Error: -R expects window or window:max_symbols, got %s.\n", correlation_spec);
+            exit(EXIT_FAILURE);
+        }
+        alpaca_context_set_correlation(feed, &correlation);
+    } else if (correlation_path) {
+        fprintf(stderr, "Error: -W needs a window from -R.\n");
+        exit(EXIT_FAILURE);
+    }
+
     // Set the SIGINT signal handler
     signal(SIGINT, sigint_handler);
 
@@ -87,6 +297,19 @@ int main(int argc, char *argv[]) {
     struct lws_context *context = lws_create_context(&info);
     if (!context) {
         fprintf(stderr, "Error creating WebSocket context.\n");
+        if (rankings_enabled) {
+            rankings_free(&rankings);
+        }
+        if (alerts_enabled) {
+            alert_engine_free(&alerts);
+        }
+        if (builder_enabled) {
+            bar_builder_free(&builder);
+        }
+        if (correlation_enabled) {
+            correlation_free(&correlation);
+        }
+        alpaca_context_destroy(feed);
         return -1;
     }
 
@@ -101,23 +324,91 @@ int main(int argc, char *argv[]) {
     ccinfo.origin = ccinfo.address;
     ccinfo.protocol = "alpaca";
     ccinfo.ssl_connection = LCCSCF_USE_SSL;
-    ccinfo.userdata = params;
+    ccinfo.userdata = feed;
 
     // Connect to the WebSocket server
     struct lws *wsi = lws_client_connect_via_info(&ccinfo);
     if (!wsi) {
         fprintf(stderr, "Error connecting to WebSocket server.\n");
         lws_context_destroy(context);
+        if (rankings_enabled) {
+            rankings_free(&rankings);
+        }
+        if (alerts_enabled) {
+            alert_engine_free(&alerts);
+        }
+        if (builder_enabled) {
+            bar_builder_free(&builder);
+        }
+        if (correlation_enabled) {
+            correlation_free(&correlation);
+        }
+        alpaca_context_destroy(feed);
         return -1;
     }
 
     // Main event loop: process WebSocket events until interrupted
-    while (!interrupted) {
+    time_t last_checkpoint = time(NULL);
+    time_t last_rankings = time(NULL);
+    size_t correlation_rows = 0;
+    while (!alpaca_context_interrupted(feed)) {
         lws_service(context, 50);
+
+        // Periodically snapshot the stored data so a crash loses at most one interval
+        if (checkpoint_path && checkpoint_interval > 0 && time(NULL) - last_checkpoint >= checkpoint_interval) {
+            save_checkpoint(feed, checkpoint_path);
+            last_checkpoint = time(NULL);
+        }
+
+        if (rankings_enabled && (rankings_requested || (rankings_interval > 0 && time(NULL) - last_rankings >= rankings_interval))) {
+            rankings_requested = 0;
+            rankings_print(&rankings, stdout, rankings_count);
+            last_rankings = time(NULL);
+        }
+
+        // Close the time bars of symbols that have stopped trading
+        if (builder_enabled) {
+            bar_builder_flush(&builder, bar_builder_clock_ns());
+        }
+
+        // Complete a period whose last bars are overdue, and publish the matrix once per period
+        if (correlation_enabled) {
+            correlation_flush(&correlation, (int64_t)time(NULL) * 1000000000);
+            if (correlation_path && correlation.rows != correlation_rows) {
+                correlation_write_csv(&correlation, correlation_path);
+                correlation_rows = correlation.rows;
+            }
+        }
+    }
+
+    // Keep the time bars that have ended, then write the final snapshot before the
+    // stored data is released
+    if (builder_enabled) {
+        bar_builder_flush(&builder, bar_builder_clock_ns());
+    }
+    if (checkpoint_path) {
+        save_checkpoint(feed, checkpoint_path);
     }
 
     // Clean up: destroy the WebSocket context and delete the JSON object
     lws_context_destroy(context);
+    if (rankings_enabled) {
+        rankings_print(&rankings, stdout, rankings_count);
+        rankings_free(&rankings);
+    }
+    if (alerts_enabled) {
+        fprintf(stderr, "Alerts: %zu of %zu fired, %zu could not be written.\n", alerts.fired, alerts.rules, alerts.write_failures);
+        alert_engine_free(&alerts);
+    }
+    if (builder_enabled) {
+        fprintf(stderr, "Bars built: %zu (%zu trades filtered by condition, %zu late).\n", builder.built, builder.filtered, builder.late);
+        bar_builder_free(&builder);
+    }
+    if (correlation_enabled) {
+        fprintf(stderr, "Correlations: %zu periods of %zu symbols.\n", correlation.rows, correlation.symbols.count);
+        correlation_free(&correlation);
+    }
+    alpaca_context_destroy(feed);
     json_decref(params);
 
     // Exit the program
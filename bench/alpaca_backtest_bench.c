@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alpaca_backtest.h"
+#include "alpaca_indicators.h"
+
+// Times backtest_run on a synthetic universe of regular-session minute bars, a year
+// of them per symbol by default, with an EMA crossover strategy. A few random walks
+// are made up front; the loader copies one of them column by column into the
+// worker's series, as backtest_load_cache copies mapped cache files, so memory
+// stays at one series per thread however many symbols there are.
+//
+//   alpaca_backtest_bench [-symbols N] [-days N] [-threads N[,N...]]
+
+#define DEFAULT_SYMBOLS 3000
+#define DEFAULT_DAYS 252
+#define BARS_PER_DAY 390
+#define MAX_THREAD_COUNTS 16
+#define SECONDS_PER_DAY 86400
+#define FIRST_DAY 1704205800        // 2024-01-02 14:30 UTC, the open
+#define NUM_WALKS 16
+
+typedef struct {
+    size_t days;
+    BarSeries walks[NUM_WALKS];
+} SyntheticSource;
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Function to make up a cent-priced random walk
+static int make_walk(BarSeries *series, size_t n, uint64_t state) {
+    if (bar_series_reserve(series, n) != 0) {
+        return -1;
+    }
+    double price = 20.0 + (double)(next_random(&state) % 40000) / 100.0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = next_random(&state);
+        double open = price;
+        price += ((double)(r % 21) - 10.0) / 100.0;
+        if (price < 1.0) {
+            price = 1.0;
+        }
+        series->t[i] = FIRST_DAY + (int64_t)(i / BARS_PER_DAY) * SECONDS_PER_DAY + (int64_t)(i % BARS_PER_DAY) * 60;
+        series->open[i] = open;
+        series->high[i] = (open > price ? open : price) + (double)((r >> 8) % 5) / 100.0;
+        series->low[i] = (open < price ? open : price) - (double)((r >> 16) % 5) / 100.0;
+        series->close[i] = price;
+        series->vw[i] = (open + price) / 2;
+        series->volume[i] = (double)(100 + (r >> 24) % 20000);
+    }
+    series->count = n;
+    return 0;
+}
+
+// Function to copy the walk picked by the symbol's name
+static int load_synthetic(void *user, const char *symbol, BarSeries *series) {
+    const SyntheticSource *source = (const SyntheticSource *)user;
+    uint32_t hash = 2166136261u;
+    for (const char *c = symbol; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    const BarSeries *walk = &source->walks[hash % NUM_WALKS];
+    size_t n = walk->count;
+    if (bar_series_reserve(series, n) != 0) {
+        return -1;
+    }
+    memcpy(series->t, walk->t, n * sizeof(int64_t));
+    memcpy(series->open, walk->open, n * sizeof(double));
+    memcpy(series->high, walk->high, n * sizeof(double));
+    memcpy(series->low, walk->low, n * sizeof(double));
+    memcpy(series->close, walk->close, n * sizeof(double));
+    memcpy(series->vw, walk->vw, n * sizeof(double));
+    memcpy(series->volume, walk->volume, n * sizeof(double));
+    series->count = n;
+    return 0;
+}
+
+typedef struct {
+    EmaStream fast;
+    EmaStream slow;
+    int started;
+} CrossState;
+
+static double cross_on_bar(void *state, const BarSeries *bars, size_t i, double position, void *user) {
+    CrossState *s = (CrossState *)state;
+    if (!s->started) {
+        ema_stream_init(&s->fast, 12);
+        ema_stream_init(&s->slow, 26);
+        s->started = 1;
+    }
+    double fast = ema_stream_update(&s->fast, bars->close[i]);
+    double slow = ema_stream_update(&s->slow, bars->close[i]);
+    return fast > slow ? 100 : 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t num_symbols = DEFAULT_SYMBOLS;
+    static SyntheticSource source;
+    source.days = DEFAULT_DAYS;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int num_counts = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-symbols") == 0 && i + 1 < argc) {
+            num_symbols = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-days") == 0 && i + 1 < argc) {
+            source.days = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            char *p = argv[++i];
+            while (*p && num_counts < MAX_THREAD_COUNTS) {
+                thread_counts[num_counts++] = (int)strtol(p, &p, 10);
+                p += *p == ',';
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-symbols N] [-days N] [-threads N[,N...]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_counts == 0) {
+        thread_counts[num_counts++] = 1;
+        if (backtest_default_threads() > 1) {
+            thread_counts[num_counts++] = backtest_default_threads();
+        }
+    }
+
+    char (*names)[16] = calloc(num_symbols, sizeof(*names));
+    const char **symbols = calloc(num_symbols, sizeof(char *));
+    BacktestResult *results = calloc(num_symbols, sizeof(BacktestResult));
+    if (!names || !symbols || !results) {
+        fprintf(stderr, "not enough memory\n");
+        return 1;
+    }
+    for (size_t s = 0; s < num_symbols; s++) {
+        snprintf(names[s], sizeof(names[s]), "S%05u", (unsigned)s);
+        symbols[s] = names[s];
+    }
+    for (int w = 0; w < NUM_WALKS; w++) {
+        if (make_walk(&source.walks[w], source.days * BARS_PER_DAY, 0x2545F4914F6CDD1DULL * (w + 1)) != 0) {
+            return 1;
+        }
+    }
+
+    BacktestOptions options;
+    memset(&options, 0, sizeof(options));
+    options.load = load_synthetic;
+    options.load_user = &source;
+    options.strategy.on_bar = cross_on_bar;
+    options.strategy.state_size = sizeof(CrossState);
+
+    size_t bars = num_symbols * source.days * BARS_PER_DAY;
+    printf("%zu symbols x %zu days x %d minute bars = %zu bars\n", num_symbols, source.days, BARS_PER_DAY, bars);
+    printf("%8s %10s %14s %12s %14s\n", "threads", "seconds", "Mbars/s", "fills", "total pnl");
+
+    int failed = 0;
+    double checksum = NAN;
+    for (int c = 0; c < num_counts; c++) {
+        memset(results, 0, num_symbols * sizeof(BacktestResult));
+        options.threads = thread_counts[c];
+        double start = now_seconds();
+        if (backtest_run(&options, symbols, num_symbols, results) != 0) {
+            return 1;
+        }
+        double elapsed = now_seconds() - start;
+
+        size_t fills = 0;
+        double pnl = 0;
+        for (size_t s = 0; s < num_symbols; s++) {
+            failed |= results[s].failed;
+            fills += results[s].num_fills;
+            pnl += results[s].pnl;
+        }
+        // Every thread count has to give the same answer
+        if (!isnan(checksum) && fabs(pnl - checksum) > 1e-6 * (fabs(checksum) + 1)) {
+            fprintf(stderr, "Error: %d threads gave a total pnl of %.2f, expected %.2f\n", thread_counts[c], pnl, checksum);
+            failed = 1;
+        }
+        checksum = pnl;
+        printf("%8d %10.3f %14.1f %12zu %14.2f\n", thread_counts[c], elapsed, bars / elapsed / 1e6, fills, pnl);
+    }
+
+    for (int w = 0; w < NUM_WALKS; w++) {
+        bar_series_free(&source.walks[w]);
+    }
+    free(names);
+    free(symbols);
+    free(results);
+    return failed ? 1 : 0;
+}
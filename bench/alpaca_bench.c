@@ -0,0 +1,503 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <jansson.h>
+#include "alpaca_lib_jansson.h"
+#include "alpaca_bars.h"
+#include "alpaca_ticks.h"
+
+// Benchmarks the websocket message handlers and the REST page parsers on the
+// recorded frames in bench/fixtures. Each benchmark runs for at least -seconds and
+// reports ns/message, heap allocations/message and throughput. Results go to stdout
+// as JSON; with -baseline FILE they are compared against an earlier run and the exit
+// status is 2 if anything got slower by more than -threshold percent.
+//
+//   alpaca_bench [-fixtures DIR] [-seconds S] [-filter TEXT] [-baseline FILE] [-threshold PCT]
+//
+// The handlers print every message they parse, so stdout is sent to /dev/null while
+// they run; formatting costs are measured, terminal speed is not.
+
+#define DEFAULT_FIXTURES "bench/fixtures"
+#define DEFAULT_SECONDS 0.5
+#define DEFAULT_THRESHOLD 10.0
+#define STREAM_CHUNK_SIZE 16384
+
+// Allocation counting. glibc lets a program replace malloc and friends, and its own
+// internals (strdup, stdio, jansson, libcurl) then call the replacements too, so
+// every heap allocation in the process is counted.
+static size_t alloc_count = 0;
+
+#ifdef __GLIBC__
+#define HAVE_ALLOC_COUNT 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    alloc_count++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#else
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t messages;    // messages per call: array elements, bars or trades
+} Fixture;
+
+typedef struct Bench Bench;
+
+// Runs the benchmarked code once and returns the number of messages handled
+typedef size_t (*BenchFunc)(Bench *bench);
+
+struct Bench {
+    const char *name;
+    BenchFunc run;
+    Fixture *fixture;
+    const char *text;           // single message or timestamp, for the per-message benchmarks
+    AlpacaContext *ctx;
+    BarArray bars;
+    size_t sink;                // keeps results alive so the loops are not optimized out
+};
+
+typedef struct {
+    const char *name;
+    size_t calls;
+    size_t messages;
+    double seconds;
+    size_t allocations;
+    size_t bytes;
+} BenchResult;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to read a whole fixture file. Returns -1 if it cannot be read.
+static int load_fixture(const char *dir, const char *name, Fixture *fixture) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    memset(fixture, 0, sizeof(*fixture));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    fixture->data = (char *)malloc((size_t)size + 1);
+    if (!fixture->data || fread(fixture->data, 1, (size_t)size, fp) != (size_t)size) {
+        fprintf(stderr, "Error reading %s\n", path);
+        fclose(fp);
+        free(fixture->data);
+        fixture->data = NULL;
+        return -1;
+    }
+    fclose(fp);
+    fixture->data[size] = '\0';
+    fixture->len = (size_t)size;
+
+    // Count the messages once, outside the timed loop
+    json_t *root = json_loadb(fixture->data, fixture->len, 0, NULL);
+    if (json_is_array(root)) {
+        fixture->messages = json_array_size(root);
+    } else if (json_is_object(root)) {
+        json_t *list = json_object_get(root, "bars");
+        if (!list) {
+            list = json_object_get(root, "trades");
+        }
+        fixture->messages = json_array_size(list);
+    }
+    json_decref(root);
+    if (fixture->messages == 0) {
+        fprintf(stderr, "Error: %s has no messages\n", path);
+        free(fixture->data);
+        fixture->data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Function to return the first message of a websocket fixture as a JSON object string
+static char *first_message(const Fixture *fixture) {
+    json_t *root = json_loadb(fixture->data, fixture->len, 0, NULL);
+    char *text = json_dumps(json_array_get(root, 0), JSON_COMPACT);
+    json_decref(root);
+    return text;
+}
+
+static size_t run_process_received_data(Bench *bench) {
+    process_received_data(bench->ctx, bench->fixture->data);
+    return bench->fixture->messages;
+}
+
+static size_t run_parse_trade_data(Bench *bench) {
+    parse_trade_data(bench->ctx, bench->text);
+    return 1;
+}
+
+static size_t run_parse_quote_data(Bench *bench) {
+    parse_quote_data(bench->ctx, bench->text);
+    return 1;
+}
+
+static size_t run_parse_bar_data(Bench *bench) {
+    parse_bar_data(bench->ctx, bench->text);
+    return 1;
+}
+
+static size_t run_print_local_time(Bench *bench) {
+    char *local = print_local_time(bench->text);
+    bench->sink += (size_t)local[0];
+    free(local);
+    return 1;
+}
+
+static size_t run_format_local_time(Bench *bench) {
+    char buf[64];
+    format_local_time(parse_rfc3339(bench->text), buf, sizeof(buf));
+    bench->sink += (size_t)buf[0];
+    return 1;
+}
+
+static size_t run_parse_rfc3339_ns(Bench *bench) {
+    bench->sink += (size_t)parse_rfc3339_ns(bench->text);
+    return 1;
+}
+
+static size_t run_parse_bars_page(Bench *bench) {
+    char *next_page_token = NULL;
+    bench->bars.count = 0;
+    if (parse_bars_page(bench->fixture->data, bench->fixture->len, &bench->bars, &next_page_token) != 0) {
+        return 0;
+    }
+    free(next_page_token);
+    return bench->bars.count;
+}
+
+static void count_bar(void *user, const char *symbol, const AlpacaBar *bar) {
+    (*(size_t *)user)++;
+}
+
+static void count_tick(void *user, const char *symbol, const void *tick) {
+    (*(size_t *)user)++;
+}
+
+// Feed the page in network-sized chunks, as the REST client does
+static size_t run_bar_stream(Bench *bench) {
+    BarStreamParser parser;
+    size_t count = 0;
+    char *next_page_token = NULL;
+    bar_stream_init(&parser, count_bar, &count);
+    for (size_t off = 0; off < bench->fixture->len; off += STREAM_CHUNK_SIZE) {
+        size_t n = bench->fixture->len - off < STREAM_CHUNK_SIZE ? bench->fixture->len - off : STREAM_CHUNK_SIZE;
+        if (bar_stream_feed(&parser, bench->fixture->data + off, n) != 0) {
+            return 0;
+        }
+    }
+    if (bar_stream_finish(&parser, &next_page_token) != 0) {
+        return 0;
+    }
+    free(next_page_token);
+    return count;
+}
+
+static size_t run_tick_stream(Bench *bench) {
+    TickStreamParser parser;
+    size_t count = 0;
+    char *next_page_token = NULL;
+    tick_stream_init(&parser, TICK_TRADES, count_tick, &count);
+    for (size_t off = 0; off < bench->fixture->len; off += STREAM_CHUNK_SIZE) {
+        size_t n = bench->fixture->len - off < STREAM_CHUNK_SIZE ? bench->fixture->len - off : STREAM_CHUNK_SIZE;
+        if (tick_stream_feed(&parser, bench->fixture->data + off, n) != 0) {
+            return 0;
+        }
+    }
+    if (tick_stream_finish(&parser, &next_page_token) != 0) {
+        return 0;
+    }
+    free(next_page_token);
+    return count;
+}
+
+// Fill the trade store from the batch fixture once, then time the queries against it
+static int64_t query_from_ns;
+static int64_t query_to_ns;
+static const Fixture *query_fixture;
+
+static void fill_trades(Bench *bench) {
+    size_t bars, trades, quotes;
+    alpaca_context_get_counts(bench->ctx, &bars, &trades, &quotes);
+    while (trades < 1000) {
+        process_received_data(bench->ctx, query_fixture->data);
+        trades += query_fixture->messages;
+    }
+}
+
+static size_t run_trades_between(Bench *bench) {
+    fill_trades(bench);
+    TradeView view = alpaca_trades_between(bench->ctx, bench->text, query_from_ns, query_to_ns);
+    bench->sink += view.count;
+    return 1;
+}
+
+static size_t run_trades_last(Bench *bench) {
+    fill_trades(bench);
+    TradeView view = alpaca_trades_last(bench->ctx, bench->text, 20, query_to_ns);
+    bench->sink += view.count;
+    return 1;
+}
+
+// Function to run one benchmark for at least min_seconds. The handlers keep up to
+// 1000 records per type in their context, so the context is filled first and the
+// numbers are for a store in steady state.
+static int run_bench(Bench *bench, double min_seconds, BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->name = bench->name;
+
+    json_t *params = json_object();
+    bench->ctx = alpaca_context_create(params);
+    json_decref(params);
+    if (!bench->ctx) {
+        return -1;
+    }
+
+    size_t warmup = 0;
+    double start = now_seconds();
+    while (warmup < 2000 && now_seconds() - start < min_seconds) {
+        size_t n = bench->run(bench);
+        if (n == 0) {
+            fprintf(stderr, "Error: %s failed\n", bench->name);
+            alpaca_context_destroy(bench->ctx);
+            return -1;
+        }
+        warmup += n;
+    }
+    fflush(stdout);
+
+    size_t allocations = alloc_count;
+    start = now_seconds();
+    double elapsed = 0;
+    do {
+        // Check the clock every few calls so cheap benchmarks are not dominated by it
+        for (int i = 0; i < 16; i++) {
+            result->messages += bench->run(bench);
+            result->calls++;
+        }
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+    fflush(stdout);
+    result->seconds = elapsed;
+    result->allocations = alloc_count - allocations;
+    result->bytes = result->calls * (bench->fixture ? bench->fixture->len : strlen(bench->text));
+
+    alpaca_context_destroy(bench->ctx);
+    bench->ctx = NULL;
+    return 0;
+}
+
+static json_t *result_to_json(const BenchResult *r) {
+    json_t *obj = json_object();
+    json_object_set_new(obj, "name", json_string(r->name));
+    json_object_set_new(obj, "messages", json_integer((json_int_t)r->messages));
+    json_object_set_new(obj, "ns_per_message", json_real(r->seconds * 1e9 / r->messages));
+    if (HAVE_ALLOC_COUNT) {
+        json_object_set_new(obj, "allocations_per_message", json_real((double)r->allocations / r->messages));
+    } else {
+        json_object_set_new(obj, "allocations_per_message", json_null());
+    }
+    json_object_set_new(obj, "messages_per_second", json_real(r->messages / r->seconds));
+    json_object_set_new(obj, "mb_per_second", json_real(r->bytes / r->seconds / 1e6));
+    return obj;
+}
+
+// Function to compare results against a previous run's JSON. Returns the number of
+// benchmarks more than threshold percent slower per message.
+static int compare_baseline(const char *path, const BenchResult *results, size_t count, double threshold) {
+    json_error_t error;
+    json_t *baseline = json_load_file(path, 0, &error);
+    if (!baseline) {
+        fprintf(stderr, "Error reading baseline %s: %s\n", path, error.text);
+        return -1;
+    }
+
+    int regressions = 0;
+    json_t *list = json_object_get(baseline, "results");
+    fprintf(stderr, "\n%-44s %12s %12s %8s\n", "compared with baseline", "before ns", "now ns", "change");
+    for (size_t i = 0; i < count; i++) {
+        size_t index;
+        json_t *entry;
+        json_array_foreach(list, index, entry) {
+            const char *name = json_string_value(json_object_get(entry, "name"));
+            if (!name || strcmp(name, results[i].name) != 0) {
+                continue;
+            }
+            double before = json_number_value(json_object_get(entry, "ns_per_message"));
+            double now = results[i].seconds * 1e9 / results[i].messages;
+            double change = before > 0 ? (now - before) * 100.0 / before : 0.0;
+            int slower = change > threshold;
+            regressions += slower;
+            fprintf(stderr, "%-44s %12.1f %12.1f %+7.1f%%%s\n", results[i].name, before, now, change, slower ? "  REGRESSION" : "");
+        }
+    }
+    json_decref(baseline);
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    const char *fixtures_dir = DEFAULT_FIXTURES;
+    const char *filter = NULL;
+    const char *baseline = NULL;
+    double min_seconds = DEFAULT_SECONDS;
+    double threshold = DEFAULT_THRESHOLD;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-fixtures") == 0 && i + 1 < argc) {
+            fixtures_dir = argv[++i];
+        } else if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+            min_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-fixtures DIR] [-seconds S] [-filter TEXT] [-baseline FILE] [-threshold PCT]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static const char *fixture_names[] = {
+        "ws_trade_single.json", "ws_trade_batch.json", "ws_quote_single.json", "ws_quote_batch.json",
+        "ws_bar_single.json", "ws_bar_batch.json", "ws_mixed_batch.json", "rest_bars_10000.json", "rest_trades_1000.json"
+    };
+    enum { TRADE_SINGLE, TRADE_BATCH, QUOTE_SINGLE, QUOTE_BATCH, BAR_SINGLE, BAR_BATCH, MIXED_BATCH, REST_BARS, REST_TRADES, NUM_FIXTURES };
+    Fixture fixtures[NUM_FIXTURES];
+    for (int i = 0; i < NUM_FIXTURES; i++) {
+        if (load_fixture(fixtures_dir, fixture_names[i], &fixtures[i]) != 0) {
+            return 1;
+        }
+    }
+
+    char *trade = first_message(&fixtures[TRADE_SINGLE]);
+    char *quote = first_message(&fixtures[QUOTE_SINGLE]);
+    char *bar = first_message(&fixtures[BAR_SINGLE]);
+    const char *timestamp = "2024-03-08T14:30:00.123456789Z";
+    query_from_ns = parse_rfc3339_ns("2024-03-08T14:30:01Z");
+    query_to_ns = parse_rfc3339_ns("2024-03-08T14:30:03Z");
+    query_fixture = &fixtures[TRADE_BATCH];
+
+    Bench benches[] = {
+        { "process_received_data/trade_single", run_process_received_data, &fixtures[TRADE_SINGLE] },
+        { "process_received_data/trade_batch", run_process_received_data, &fixtures[TRADE_BATCH] },
+        { "process_received_data/quote_single", run_process_received_data, &fixtures[QUOTE_SINGLE] },
+        { "process_received_data/quote_batch", run_process_received_data, &fixtures[QUOTE_BATCH] },
+        { "process_received_data/bar_single", run_process_received_data, &fixtures[BAR_SINGLE] },
+        { "process_received_data/bar_batch", run_process_received_data, &fixtures[BAR_BATCH] },
+        { "process_received_data/mixed_batch", run_process_received_data, &fixtures[MIXED_BATCH] },
+        { "parse_trade_data", run_parse_trade_data, NULL, trade },
+        { "parse_quote_data", run_parse_quote_data, NULL, quote },
+        { "parse_bar_data", run_parse_bar_data, NULL, bar },
+        { "parse_bars_page/rest_bars_10000", run_parse_bars_page, &fixtures[REST_BARS] },
+        { "bar_stream_feed/rest_bars_10000", run_bar_stream, &fixtures[REST_BARS] },
+        { "tick_stream_feed/rest_trades_1000", run_tick_stream, &fixtures[REST_TRADES] },
+        { "print_local_time", run_print_local_time, NULL, timestamp },
+        { "format_local_time", run_format_local_time, NULL, timestamp },
+        { "parse_rfc3339_ns", run_parse_rfc3339_ns, NULL, timestamp },
+        { "alpaca_trades_between", run_trades_between, NULL, "AAPL" },
+        { "alpaca_trades_last", run_trades_last, NULL, "AAPL" },
+    };
+    size_t num_benches = sizeof(benches) / sizeof(benches[0]);
+
+    // JSON goes to the real stdout; the handlers' output goes to /dev/null
+    int json_fd = dup(STDOUT_FILENO);
+    if (json_fd < 0 || !freopen("/dev/null", "w", stdout)) {
+        perror("Error redirecting stdout");
+        return 1;
+    }
+
+    BenchResult *results = (BenchResult *)calloc(num_benches, sizeof(BenchResult));
+    size_t num_results = 0;
+    int failures = 0;
+    fprintf(stderr, "%-44s %12s %12s %12s %10s\n", "benchmark", "ns/message", "allocs/msg", "messages/s", "MB/s");
+    for (size_t i = 0; i < num_benches; i++) {
+        if (filter && !strstr(benches[i].name, filter)) {
+            continue;
+        }
+        BenchResult *r = &results[num_results];
+        if (run_bench(&benches[i], min_seconds, r) != 0) {
+            failures++;
+            continue;
+        }
+        num_results++;
+        fprintf(stderr, "%-44s %12.1f %12.2f %12.0f %10.1f\n", r->name, r->seconds * 1e9 / r->messages,
+            HAVE_ALLOC_COUNT ? (double)r->allocations / r->messages : -1.0, r->messages / r->seconds, r->bytes / r->seconds / 1e6);
+    }
+
+    json_t *report = json_object();
+    json_t *list = json_array();
+    char when[32];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    json_object_set_new(report, "time", json_string(when));
+    json_object_set_new(report, "seconds_per_benchmark", json_real(min_seconds));
+    for (size_t i = 0; i < num_results; i++) {
+        json_array_append_new(list, result_to_json(&results[i]));
+    }
+    json_object_set_new(report, "results", list);
+    if (json_dumpfd(report, json_fd, JSON_INDENT(2)) != 0 || write(json_fd, "\n", 1) != 1) {
+        perror("Error writing results");
+        failures++;
+    }
+    json_decref(report);
+    close(json_fd);
+
+    int regressions = 0;
+    if (baseline) {
+        regressions = compare_baseline(baseline, results, num_results, threshold);
+        if (regressions < 0) {
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < num_benches; i++) {
+        bar_array_free(&benches[i].bars);
+    }
+    for (int i = 0; i < NUM_FIXTURES; i++) {
+        free(fixtures[i].data);
+    }
+    free(trade);
+    free(quote);
+    free(bar);
+    free(results);
+
+    if (failures) {
+        return 1;
+    }
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alpaca_correlation.h"
+
+// Times the rolling correlation engine on synthetic minute bars: the incremental
+// update made as each period closes, and the full recompute at several thread
+// counts. Every symbol follows a common market walk plus its own noise, and about
+// one bar in ten is missing, as with thinly traded symbols.
+//
+//   alpaca_correlation_bench [-symbols N] [-window N] [-periods N] [-threads N[,N...]]
+//
+// A thread count of 0 means one thread per CPU.
+
+#define DEFAULT_SYMBOLS 500
+#define DEFAULT_WINDOW 390
+#define DEFAULT_PERIODS 2000
+#define MAX_THREAD_COUNTS 16
+#define RECOMPUTE_REPEATS 5
+#define FIRST_MINUTE 1704205800LL   // 2024-01-02 14:30 UTC, the open
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Uniform in [-1, 1)
+static double uniform(uint64_t *state) {
+    return (double)(next_random(state) >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t num_symbols = DEFAULT_SYMBOLS;
+    size_t window = DEFAULT_WINDOW;
+    size_t periods = DEFAULT_PERIODS;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int num_counts = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-symbols") == 0 && i + 1 < argc) {
+            num_symbols = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            window = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-periods") == 0 && i + 1 < argc) {
+            periods = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            char *p = argv[++i];
+            while (*p && num_counts < MAX_THREAD_COUNTS) {
+                thread_counts[num_counts++] = (int)strtol(p, &p, 10);
+                p += *p == ',';
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-symbols N] [-window N] [-periods N] [-threads N[,N...]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_counts == 0) {
+        thread_counts[num_counts++] = 1;
+        thread_counts[num_counts++] = 0;
+    }
+
+    CorrelationEngine engine;
+    if (correlation_init(&engine, num_symbols, window, 1) != 0) {
+        return 1;
+    }
+    char (*names)[16] = calloc(num_symbols, sizeof(*names));
+    double *prices = calloc(num_symbols, sizeof(double));
+    if (!names || !prices) {
+        fprintf(stderr, "not enough memory\n");
+        return 1;
+    }
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t s = 0; s < num_symbols; s++) {
+        snprintf(names[s], sizeof(names[s]), "S%05u", (unsigned)s);
+        prices[s] = 20.0 + 400.0 * (uniform(&state) + 1.0) / 2.0;
+    }
+
+    // One bar per symbol and period; a period is completed by the first bar of the
+    // next. Periods that also ran the periodic recompute are left out of the timing.
+    double update_seconds = 0;
+    size_t updates = 0;
+    for (size_t p = 0; p < periods; p++) {
+        double market = 0.001 * uniform(&state);
+        size_t rows = engine.rows;
+        double start = now_seconds();
+        for (size_t s = 0; s < num_symbols; s++) {
+            prices[s] *= exp(market * (0.5 + (double)(s % 5) / 4.0) + 0.002 * uniform(&state));
+            if (next_random(&state) % 10 != 0 || s == num_symbols - 1) {
+                correlation_add_bar(&engine, names[s], (FIRST_MINUTE + (int64_t)p * 60) * 1000000000LL, prices[s]);
+            }
+        }
+        if (engine.rows > rows && engine.since_recompute != 0) {
+            update_seconds += now_seconds() - start;
+            updates += engine.rows - rows;
+        }
+    }
+    if (updates == 0) {
+        fprintf(stderr, "Error: no periods were completed\n");
+        return 1;
+    }
+    printf("%zu symbols, window of %zu periods, %zu periods\n", num_symbols, window, periods);
+    printf("incremental update: %.1f us per period (bars included)\n", update_seconds / updates * 1e6);
+
+    // The sums kept up incrementally have to match a recompute from the window
+    double *incremental = malloc(num_symbols * sizeof(double));
+    if (!incremental) {
+        return 1;
+    }
+    for (size_t s = 0; s < num_symbols; s++) {
+        incremental[s] = correlation_get(&engine, (int)s, (int)((s * 7 + 3) % num_symbols));
+    }
+
+    printf("%8s %14s %14s\n", "threads", "recompute ms", "Gflop/s");
+    int failed = 0;
+    for (int c = 0; c < num_counts; c++) {
+        engine.threads = thread_counts[c];
+        double start = now_seconds();
+        for (int r = 0; r < RECOMPUTE_REPEATS; r++) {
+            correlation_recompute(&engine);
+        }
+        double elapsed = (now_seconds() - start) / RECOMPUTE_REPEATS;
+        double flops = (double)num_symbols * (num_symbols + 1) / 2 * engine.count * 2;
+        printf("%8d %14.2f %14.2f\n", thread_counts[c], elapsed * 1e3, flops / elapsed / 1e9);
+
+        double worst = 0;
+        for (size_t s = 0; s < num_symbols; s++) {
+            double r = correlation_get(&engine, (int)s, (int)((s * 7 + 3) % num_symbols));
+            if (isnan(r) && isnan(incremental[s])) {
+                continue;
+            }
+            double diff = fabs(r - incremental[s]);
+            if (diff > worst || isnan(diff)) {
+                worst = isnan(diff) ? INFINITY : diff;
+            }
+        }
+        if (worst > 1e-9) {
+            fprintf(stderr, "Error: %d threads differ from the incremental correlations by %.3e\n", thread_counts[c], worst);
+            failed = 1;
+        }
+    }
+
+    correlation_free(&engine);
+    free(incremental);
+    free(names);
+    free(prices);
+    return failed;
+}
@@ -0,0 +1,259 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alpaca_indicators.h"
+
+// Times every indicator on a universe of full-day 1-minute series, with the AVX2
+// kernels and with the scalar code, and checks both (and the streaming forms)
+// against the scalar results.
+//
+//   alpaca_indicator_bench [-symbols N] [-bars N] [-period N] [-rounds N]
+
+#define DEFAULT_SYMBOLS 3000
+#define DEFAULT_BARS 390            // 9:30 to 16:00
+#define DEFAULT_PERIOD 20
+#define DEFAULT_ROUNDS 5
+#define TOLERANCE 1e-9              // relative
+
+typedef enum {
+    IND_SMA, IND_EMA, IND_STD, IND_BOLLINGER, IND_RSI, IND_VWAP, IND_ATR, IND_MIN_MAX, NUM_INDICATORS
+} Indicator;
+
+static const char *indicator_names[] = { "sma", "ema", "rolling_std", "bollinger", "rsi", "vwap", "atr", "rolling_min_max" };
+
+// One column per field, symbol after symbol, as a backtest would hold them
+typedef struct {
+    size_t symbols;
+    size_t bars;
+    double *high;
+    double *low;
+    double *close;
+    double *volume;
+} Universe;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Function to fill the universe with cent-priced random walks
+static void make_universe(Universe *u) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t s = 0; s < u->symbols; s++) {
+        double price = 20.0 + (double)(next_random(&state) % 40000) / 100.0;
+        for (size_t i = 0; i < u->bars; i++) {
+            size_t k = s * u->bars + i;
+            uint64_t r = next_random(&state);
+            price += ((double)(r % 21) - 10.0) / 100.0;
+            if (price < 1.0) {
+                price = 1.0;
+            }
+            u->close[k] = price;
+            u->high[k] = price + (double)((r >> 8) % 15) / 100.0;
+            u->low[k] = price - (double)((r >> 16) % 15) / 100.0;
+            u->volume[k] = (double)(100 + (r >> 24) % 20000);
+        }
+    }
+}
+
+// Function to run one indicator over every symbol; out and out2/out3 are as large
+// as the universe
+static void run_indicator(Indicator ind, const Universe *u, size_t period, double *out, double *out2, double *out3) {
+    for (size_t s = 0; s < u->symbols; s++) {
+        size_t k = s * u->bars;
+        switch (ind) {
+        case IND_SMA: indicator_sma(u->close + k, u->bars, period, out + k); break;
+        case IND_EMA: indicator_ema(u->close + k, u->bars, period, out + k); break;
+        case IND_STD: indicator_rolling_std(u->close + k, u->bars, period, NULL, out + k); break;
+        case IND_BOLLINGER: indicator_bollinger(u->close + k, u->bars, period, 2.0, out + k, out2 + k, out3 + k); break;
+        case IND_RSI: indicator_rsi(u->close + k, u->bars, period, out + k); break;
+        case IND_VWAP: indicator_vwap(u->close + k, u->volume + k, u->bars, out + k); break;
+        case IND_ATR: indicator_atr(u->high + k, u->low + k, u->close + k, u->bars, period, out + k); break;
+        default: indicator_rolling_min_max(u->close + k, u->bars, period, out + k, out2 + k); break;
+        }
+    }
+}
+
+// Function to run the streaming form over every symbol into the same layout
+static int run_stream(Indicator ind, const Universe *u, size_t period, double *out, double *out2, double *out3) {
+    for (size_t s = 0; s < u->symbols; s++) {
+        size_t k = s * u->bars;
+        RollingStream rolling;
+        MinMaxStream min_max;
+        EmaStream ema;
+        RsiStream rsi;
+        VwapStream vwap;
+        AtrStream atr;
+        if ((ind == IND_SMA || ind == IND_STD || ind == IND_BOLLINGER) && rolling_stream_init(&rolling, period) != 0) {
+            return -1;
+        }
+        if (ind == IND_MIN_MAX && min_max_stream_init(&min_max, period) != 0) {
+            return -1;
+        }
+        ema_stream_init(&ema, period);
+        rsi_stream_init(&rsi, period);
+        vwap_stream_init(&vwap);
+        atr_stream_init(&atr, period);
+
+        for (size_t i = 0; i < u->bars; i++) {
+            double x = u->close[k + i];
+            double sd;
+            switch (ind) {
+            case IND_SMA: rolling_stream_update(&rolling, x, &out[k + i], NULL); break;
+            case IND_EMA: out[k + i] = ema_stream_update(&ema, x); break;
+            case IND_STD: rolling_stream_update(&rolling, x, NULL, &out[k + i]); break;
+            case IND_BOLLINGER:
+                rolling_stream_update(&rolling, x, &out[k + i], &sd);
+                out2[k + i] = out[k + i] + 2.0 * sd;
+                out3[k + i] = out[k + i] - 2.0 * sd;
+                break;
+            case IND_RSI: out[k + i] = rsi_stream_update(&rsi, x); break;
+            case IND_VWAP: out[k + i] = vwap_stream_update(&vwap, x, u->volume[k + i]); break;
+            case IND_ATR: out[k + i] = atr_stream_update(&atr, u->high[k + i], u->low[k + i], x); break;
+            default: min_max_stream_update(&min_max, x, &out[k + i], &out2[k + i]); break;
+            }
+        }
+        if (ind == IND_SMA || ind == IND_STD || ind == IND_BOLLINGER) {
+            rolling_stream_free(&rolling);
+        }
+        if (ind == IND_MIN_MAX) {
+            min_max_stream_free(&min_max);
+        }
+    }
+    return 0;
+}
+
+// Largest difference relative to the reference value (at least 1), or to the price
+// where one is given, since a standard deviation carries the rounding of sums of
+// prices. NAN in one array and not the other counts as infinite.
+static double max_difference(const double *a, const double *ref, const double *price, size_t n) {
+    double worst = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isnan(a[i]) || isnan(ref[i])) {
+            if (isnan(a[i]) != isnan(ref[i])) {
+                return INFINITY;
+            }
+            continue;
+        }
+        double scale = price ? fabs(price[i]) : fabs(ref[i]);
+        if (scale < 1.0) {
+            scale = 1.0;
+        }
+        double d = fabs(a[i] - ref[i]) / scale;
+        if (d > worst) {
+            worst = d;
+        }
+    }
+    return worst;
+}
+
+static double time_indicator(Indicator ind, const Universe *u, size_t period, int rounds, double *out, double *out2, double *out3) {
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        double start = now_seconds();
+        run_indicator(ind, u, period, out, out2, out3);
+        double elapsed = now_seconds() - start;
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    Universe u = { DEFAULT_SYMBOLS, DEFAULT_BARS, NULL, NULL, NULL, NULL };
+    size_t period = DEFAULT_PERIOD;
+    int rounds = DEFAULT_ROUNDS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-symbols") == 0 && i + 1 < argc) {
+            u.symbols = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-bars") == 0 && i + 1 < argc) {
+            u.bars = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-period") == 0 && i + 1 < argc) {
+            period = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-symbols N] [-bars N] [-period N] [-rounds N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (u.symbols == 0 || u.bars == 0 || period == 0) {
+        fprintf(stderr, "Error: -symbols, -bars and -period must be positive\n");
+        return 1;
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    size_t total = u.symbols * u.bars;
+    double *buffers[10];
+    for (int b = 0; b < 10; b++) {
+        buffers[b] = (double *)malloc(total * sizeof(double));
+        if (!buffers[b]) {
+            fprintf(stderr, "not enough memory\n");
+            return 1;
+        }
+    }
+    u.high = buffers[0];
+    u.low = buffers[1];
+    u.close = buffers[2];
+    u.volume = buffers[3];
+    double *ref[3] = { buffers[4], buffers[5], buffers[6] };
+    double *out[3] = { buffers[7], buffers[8], buffers[9] };
+    make_universe(&u);
+
+    indicator_set_simd(1);
+    const char *simd = indicator_simd_name();
+    printf("%zu symbols x %zu bars, period %zu, kernels: %s\n", u.symbols, u.bars, period, simd);
+    printf("%-16s %12s %12s %8s %14s %14s\n", "indicator", "scalar ns/bar", "simd ns/bar", "speedup", "simd diff", "stream diff");
+
+    int failures = 0;
+    for (int ind = 0; ind < NUM_INDICATORS; ind++) {
+        int outputs = ind == IND_BOLLINGER ? 3 : ind == IND_MIN_MAX ? 2 : 1;
+        const double *price = ind == IND_STD ? u.close : NULL;
+
+        indicator_set_simd(0);
+        double scalar = time_indicator((Indicator)ind, &u, period, rounds, ref[0], ref[1], ref[2]);
+        indicator_set_simd(1);
+        double vector = time_indicator((Indicator)ind, &u, period, rounds, out[0], out[1], out[2]);
+        double simd_diff = 0;
+        for (int o = 0; o < outputs; o++) {
+            double d = max_difference(out[o], ref[o], price, total);
+            simd_diff = d > simd_diff ? d : simd_diff;
+        }
+
+        double stream_diff = INFINITY;
+        if (run_stream((Indicator)ind, &u, period, out[0], out[1], out[2]) == 0) {
+            stream_diff = 0;
+            for (int o = 0; o < outputs; o++) {
+                double d = max_difference(out[o], ref[o], price, total);
+                stream_diff = d > stream_diff ? d : stream_diff;
+            }
+        }
+
+        int ok = simd_diff <= TOLERANCE && stream_diff <= TOLERANCE;
+        failures += !ok;
+        printf("%-16s %12.2f %12.2f %7.1fx %14.3g %14.3g%s\n", indicator_names[ind], scalar * 1e9 / total, vector * 1e9 / total,
+            vector > 0 ? scalar / vector : 0.0, simd_diff, stream_diff, ok ? "" : "  MISMATCH");
+    }
+
+    for (int b = 0; b < 10; b++) {
+        free(buffers[b]);
+    }
+    return failures ? 1 : 0;
+}
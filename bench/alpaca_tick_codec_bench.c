@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alpaca_tick_codec.h"
+
+// Measures the tick codec: bytes per record against the in-memory structs, and
+// encode and decode throughput over whole blocks. Runs on synthetic trades, quotes
+// and bars, or on the records of an existing tick file.
+//
+//   alpaca_tick_codec_bench [-records N] [-rounds N] [-dir DIR -symbol SYM -kind trades|quotes]
+
+#define DEFAULT_RECORDS 1000000
+#define DEFAULT_ROUNDS 5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Small xorshift generator so runs are repeatable
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Function to fill records with a random walk in cents starting at 9:30 New York time
+static void make_records(TickKind kind, void *records, size_t count) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int64_t t = 1677681000LL * 1000000000LL;
+    int64_t cents = 15000;
+    static const char exchanges[] = "VQNPKZ";
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t r = next_random(&state);
+        t += (int64_t)(r % 5000000);                  // up to 5 ms apart
+        cents += (int64_t)((r >> 24) % 5) - 2;
+        if (cents < 100) {
+            cents = 100;
+        }
+        double price = cents / 100.0;
+
+        if (kind == TICK_TRADES) {
+            AlpacaTrade *trade = &((AlpacaTrade *)records)[i];
+            memset(trade, 0, sizeof(*trade));
+            trade->t = t;
+            trade->price = price;
+            trade->size = (uint32_t)(1 + (r >> 32) % 4 * 100);
+            trade->exchange = exchanges[(r >> 40) % 6];
+            trade->tape = 'C';
+            trade->conditions[0] = '@';
+            if ((r >> 48) % 3 == 0) {
+                trade->conditions[1] = 'I';
+            }
+            trade->id = 52983525029461ULL + i;
+        } else if (kind == TICK_QUOTES) {
+            AlpacaQuote *quote = &((AlpacaQuote *)records)[i];
+            memset(quote, 0, sizeof(*quote));
+            quote->t = t;
+            quote->bid = price;
+            quote->ask = (cents + 1 + (int64_t)((r >> 32) % 3)) / 100.0;
+            quote->bid_size = (uint32_t)(1 + (r >> 36) % 8);
+            quote->ask_size = (uint32_t)(1 + (r >> 40) % 8);
+            quote->bid_exchange = exchanges[(r >> 44) % 6];
+            quote->ask_exchange = exchanges[(r >> 48) % 6];
+            quote->tape = 'C';
+            quote->conditions[0] = 'R';
+        } else {
+            AlpacaBar *bar = &((AlpacaBar *)records)[i];
+            memset(bar, 0, sizeof(*bar));
+            bar->t = 1677681000LL + (int64_t)i * 60;
+            bar->open = price;
+            bar->high = price + ((r >> 32) % 20) / 100.0;
+            bar->low = price - ((r >> 40) % 20) / 100.0;
+            bar->close = (cents + (int64_t)((r >> 48) % 11) - 5) / 100.0;
+            bar->vw = (cents * 100 + (int64_t)((r >> 52) % 100)) / 10000.0;
+            bar->volume = 1000 + (r >> 20) % 50000;
+            bar->trades = 10 + (r >> 12) % 500;
+        }
+    }
+}
+
+// Function to load every record of DIR/SYMBOL.<kind>. Returns NULL if the file
+// cannot be read.
+static void *load_records(const char *dir, const char *symbol, TickKind kind, size_t *count) {
+    TickFile file;
+    if (tick_file_open(&file, dir, symbol, kind) != 0) {
+        fprintf(stderr, "Error: cannot open %s/%s.%s\n", dir, symbol, tick_kind_name(kind));
+        return NULL;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < file.count; i++) {
+        total += file.entries[i].count;
+    }
+    void *records = malloc((total ? total : 1) * tick_record_size(kind));
+    size_t n = 0;
+    for (size_t i = 0; records && i < file.count; i++) {
+        n += tick_file_decode_entry(&file, i, (char *)records + n * tick_record_size(kind));
+    }
+    tick_file_close(&file);
+    *count = n;
+    return records;
+}
+
+static int run_bench(TickKind kind, const void *records, size_t count, int rounds) {
+    size_t size = tick_record_size(kind);
+    size_t num_blocks = (count + TICK_BLOCK_RECORDS - 1) / TICK_BLOCK_RECORDS;
+    uint8_t *encoded = malloc(num_blocks * tick_block_bound(kind, TICK_BLOCK_RECORDS));
+    size_t *offsets = malloc((num_blocks + 1) * sizeof(size_t));
+    void *decoded = malloc(count * size);
+    if (!encoded || !offsets || !decoded) {
+        fprintf(stderr, "not enough memory\n");
+        free(encoded);
+        free(offsets);
+        free(decoded);
+        return -1;
+    }
+
+    double encode_best = 0;
+    for (int round = 0; round < rounds; round++) {
+        double start = now_seconds();
+        offsets[0] = 0;
+        for (size_t b = 0; b < num_blocks; b++) {
+            size_t n = count - b * TICK_BLOCK_RECORDS < TICK_BLOCK_RECORDS ? count - b * TICK_BLOCK_RECORDS : TICK_BLOCK_RECORDS;
+            offsets[b + 1] = offsets[b] + tick_block_encode(kind, (const char *)records + b * TICK_BLOCK_RECORDS * size, n, encoded + offsets[b]);
+        }
+        double elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < encode_best) {
+            encode_best = elapsed;
+        }
+    }
+
+    double decode_best = 0;
+    size_t decoded_count = 0;
+    for (int round = 0; round < rounds; round++) {
+        double start = now_seconds();
+        decoded_count = 0;
+        for (size_t b = 0; b < num_blocks; b++) {
+            decoded_count += tick_block_decode(kind, encoded + offsets[b], offsets[b + 1] - offsets[b],
+                (char *)decoded + decoded_count * size, TICK_BLOCK_RECORDS);
+        }
+        double elapsed = now_seconds() - start;
+        if (round == 0 || elapsed < decode_best) {
+            decode_best = elapsed;
+        }
+    }
+
+    int ok = decoded_count == count && memcmp(records, decoded, count * size) == 0;
+    size_t bytes = offsets[num_blocks];
+    printf("%-7s %9zu records  %6.2f bytes/record  %5.1fx smaller than structs  "
+           "encode %7.1f M/s  decode %7.1f M/s (%6.0f MB/s out)  %s\n",
+        tick_kind_name(kind), count, count ? (double)bytes / count : 0.0, bytes ? (double)count * size / bytes : 0.0,
+        encode_best > 0 ? count / encode_best / 1e6 : 0.0, decode_best > 0 ? count / decode_best / 1e6 : 0.0,
+        decode_best > 0 ? count * size / decode_best / 1e6 : 0.0, ok ? "round trip ok" : "ROUND TRIP MISMATCH");
+
+    free(encoded);
+    free(offsets);
+    free(decoded);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    size_t records = DEFAULT_RECORDS;
+    int rounds = DEFAULT_ROUNDS;
+    const char *dir = NULL;
+    const char *symbol = NULL;
+    TickKind file_kind = TICK_TRADES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-records") == 0 && i + 1 < argc) {
+            records = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-symbol") == 0 && i + 1 < argc) {
+            symbol = argv[++i];
+        } else if (strcmp(argv[i], "-kind") == 0 && i + 1 < argc) {
+            file_kind = strcmp(argv[++i], "quotes") == 0 ? TICK_QUOTES : TICK_TRADES;
+        } else {
+            fprintf(stderr, "Usage: %s [-records N] [-rounds N] [-dir DIR -symbol SYMBOL -kind trades|quotes]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    int failures = 0;
+    if (dir && symbol) {
+        size_t count = 0;
+        void *data = load_records(dir, symbol, file_kind, &count);
+        if (!data) {
+            return 1;
+        }
+        failures += run_bench(file_kind, data, count, rounds) != 0;
+        free(data);
+        return failures ? 1 : 0;
+    }
+
+    static const TickKind kinds[] = { TICK_TRADES, TICK_QUOTES, TICK_BARS };
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        void *data = malloc((records ? records : 1) * tick_record_size(kinds[k]));
+        if (!data) {
+            fprintf(stderr, "not enough memory\n");
+            return 1;
+        }
+        make_records(kinds[k], data, records);
+        failures += run_bench(kinds[k], data, records, rounds) != 0;
+        free(data);
+    }
+    return failures ? 1 : 0;
+}
@@ -45,12 +45,12 @@ if [ -z "${start_date}" ] ; then
    # echo $start_date  # Output e.g. '2023-03-01' if today is a weekday, or '2023-02-28' if today is Sunday
 fi
 
-./alpaca_memory_price_fetcher -symbol "${symbol}" -start "${start_date}" | \
-awk -F"," '{if(NF==8){print $5}}' | sed 's/Close=//g' | awk '{print NR, $1}' > stuff.bin 
+./alpaca_memory_price_fetcher -symbol "${symbol}" -start "${start_date}" -format csv > stuff.csv
 
-last_y_value=$(tail -1 stuff.bin | awk '{print $2}') 
-gnuplot -e "set datafile separator ' '; set grid xtics ytics linetype 1 dashtype 2; 
+# CSV columns: time,open,high,low,close,volume,trade_count,vwap
+last_y_value=$(tail -1 stuff.csv | cut -d, -f5)
+gnuplot -e "set datafile separator ','; set grid xtics ytics linetype 1 dashtype 2; 
 set xlabel 'Trading Minutes'; set ylabel 'Price ($)'; 
-set title sprintf('"${symbol}" Closing Prices (Current Price = $%.3f)', $last_y_value); plot 'stuff.bin' using 1:2 with lines linecolor rgb 'black' title 'Data Plot'; pause -1"
+set title sprintf('"${symbol}" Closing Prices (Current Price = $%.3f)', $last_y_value); plot 'stuff.csv' using (\$0+1):5 with lines linecolor rgb 'black' title 'Data Plot'; pause -1"
 
-rm -f stuff.bin
+rm -f stuff.csv